@@ -31,6 +31,7 @@
 #include <stdint.h>
 
 struct msgb;
+struct gsmtap_inst;
 
 
 struct msgb *gmr1_gsmtap_makemsg(
@@ -38,6 +39,41 @@ struct msgb *gmr1_gsmtap_makemsg(
 	const uint8_t *l2, int len);
 
 
+#define GMR1_GSMTAP_MAX_L2	64	/*!< \brief Largest pooled L2 payload */
+
+/*! \brief Counters of a batched GSMtap sender */
+struct gmr1_gsmtap_stats
+{
+	unsigned long sent;		/*!< \brief Messages sent */
+	unsigned long flushes;		/*!< \brief sendmmsg calls */
+	unsigned long drop_pool;	/*!< \brief Dropped, pool exhausted */
+	unsigned long drop_send;	/*!< \brief Dropped, refused by socket */
+};
+
+struct gmr1_gsmtap_batch;
+
+struct gmr1_gsmtap_batch *gmr1_gsmtap_batch_alloc(
+	struct gsmtap_inst *gti, int size, int max_delay_ms);
+void gmr1_gsmtap_batch_release(struct gmr1_gsmtap_batch *b);
+
+int gmr1_gsmtap_batch_send(struct gmr1_gsmtap_batch *b,
+	uint8_t chan_type, uint32_t fn, uint8_t tn,
+	const uint8_t *l2, int len);
+int gmr1_gsmtap_batch_flush(struct gmr1_gsmtap_batch *b);
+int gmr1_gsmtap_batch_poll(struct gmr1_gsmtap_batch *b);
+void gmr1_gsmtap_batch_stats(struct gmr1_gsmtap_batch *b,
+	struct gmr1_gsmtap_stats *stats);
+
+
+struct gmr1_gsmtap_pcap;
+
+struct gmr1_gsmtap_pcap *gmr1_gsmtap_pcap_open(const char *filename);
+int gmr1_gsmtap_pcap_close(struct gmr1_gsmtap_pcap *p);
+int gmr1_gsmtap_pcap_write(struct gmr1_gsmtap_pcap *p, uint64_t ts_ns,
+	uint8_t chan_type, uint32_t fn, uint8_t tn,
+	const uint8_t *l2, int len);
+
+
 /*! @} */
 
 #endif /* __OSMO_GMR1_GSMTAP_H__ */
@@ -0,0 +1,71 @@
+/* GMR-1 convolutional code matrices */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OSMO_GMR1_L1_CODEMAT_H__
+#define __OSMO_GMR1_L1_CODEMAT_H__
+
+/*! \defgroup codemat Code matrices
+ *  \ingroup l1_prim
+ *  @{
+ */
+
+/*! \file l1/codemat.h
+ *  \brief Osmocom GMR-1 convolutional code matrices header
+ */
+
+#include <stdint.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+
+
+/*! \brief Soft bit magnitude threshold of the decoders hard decision path */
+#define GMR1_CODEMAT_THR	1
+
+/*! \brief Generator / parity check matrices of a (punctured) conv. code
+ *
+ *  All matrices are stored as packed rows of 64 bits words (LSB first).
+ */
+struct gmr1_codemat {
+	int k;		/*!< \brief Number of input bits */
+	int n;		/*!< \brief Number of coded bits */
+	int kw;		/*!< \brief Words per row of k bits */
+	int nw;		/*!< \brief Words per row of n bits */
+	int sw;		/*!< \brief Words per row of n-k bits */
+	uint64_t *G;	/*!< \brief Generator, n rows of k bits  (c = G.u) */
+	uint64_t *H;	/*!< \brief Parity check, n-k rows of n bits (H.c = 0) */
+	uint64_t *R;	/*!< \brief Recovery, k rows of n bits (u = R.c) */
+	uint64_t *D;	/*!< \brief [R | H] columns by nibbles [n/4][16][kw+sw] */
+};
+
+int  gmr1_codemat_build(struct gmr1_codemat *cm,
+                        const struct osmo_conv_code *code);
+void gmr1_codemat_free(struct gmr1_codemat *cm);
+
+int  gmr1_codemat_hard_decode(const struct gmr1_codemat *cm,
+                              ubit_t *output, const sbit_t *input, int thr);
+
+int  gmr1_codemat_try_decode(struct gmr1_codemat *cm,
+                             const struct osmo_conv_code *code,
+                             ubit_t *output, const sbit_t *input);
+
+
+/*! @} */
+
+#endif /* __OSMO_GMR1_L1_CODEMAT_H__ */
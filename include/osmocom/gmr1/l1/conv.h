@@ -30,6 +30,7 @@
  *  \brief Osmocom GMR-1 convolutional coding header
  */
 
+#include <osmocom/core/bits.h>
 #include <osmocom/core/conv.h>
 
 
@@ -39,6 +40,12 @@ extern const struct osmo_conv_code gmr1_conv_14;
 extern const struct osmo_conv_code gmr1_conv_15;
 extern const struct osmo_conv_code gmr1_conv_tch3;
 
+int gmr1_conv_decode(const struct osmo_conv_code *code,
+                     const sbit_t *input, ubit_t *output);
+int gmr1_conv_decode_batch(const struct osmo_conv_code *code,
+                           const sbit_t * const *input, ubit_t * const *output,
+                           int *rv, int n);
+
 
 /*! @} */
 
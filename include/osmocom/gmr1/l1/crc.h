@@ -30,6 +30,9 @@
  *  \brief Osmocom GMR-1 CRC header
  */
 
+#include <stdint.h>
+
+#include <osmocom/core/bits.h>
 #include <osmocom/core/crcgen.h>
 
 
@@ -38,6 +41,28 @@ extern const struct osmo_crc16gen_code gmr1_crc12;
 extern const struct osmo_crc16gen_code gmr1_crc16;
 
 
+/*! \brief Table driven CRC context (LSB first packed data) */
+struct gmr1_crc_tab {
+	int bits;		/*!< \brief Number of CRC bits (<= 16) */
+	uint16_t poly;		/*!< \brief Polynom (without the leading 1) */
+	uint16_t rpoly;		/*!< \brief Bit reversed polynom */
+	uint16_t t[4][256];	/*!< \brief Slice-by-4 tables (reflected) */
+};
+
+extern const struct gmr1_crc_tab gmr1_crc8_tab;
+extern const struct gmr1_crc_tab gmr1_crc12_tab;
+extern const struct gmr1_crc_tab gmr1_crc16_tab;
+
+uint16_t gmr1_crc_compute_pbit(const struct gmr1_crc_tab *ct,
+                               const uint8_t *in, int len);
+uint16_t gmr1_crc_pack_ubit(const struct gmr1_crc_tab *ct,
+                            uint8_t *out, const ubit_t *in, int len);
+int  gmr1_crc_check_pack_ubit(const struct gmr1_crc_tab *ct,
+                              uint8_t *out, const ubit_t *in, int len);
+void gmr1_crc_unpack_set_ubit(const struct gmr1_crc_tab *ct,
+                              ubit_t *out, const uint8_t *in, int len);
+
+
 /*! @} */
 
 #endif /* __OSMO_GMR1_L1_CRC_H__ */
@@ -0,0 +1,66 @@
+/* GMR-1 packed encoder maps */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OSMO_GMR1_L1_ENCMAP_H__
+#define __OSMO_GMR1_L1_ENCMAP_H__
+
+/*! \defgroup encmap Packed encoder maps
+ *  \ingroup l1_prim
+ *  @{
+ */
+
+/*! \file l1/encmap.h
+ *  \brief Osmocom GMR-1 packed encoder maps header
+ */
+
+#include <stdint.h>
+
+#include <osmocom/core/bits.h>
+
+
+/*! \brief Number of 64 bits words needed to hold n packed bits */
+#define GMR1_P64_WORDS(n)	(((n) + 63) >> 6)
+
+void gmr1_p64_xor_bits(uint64_t *out, int out_ofs,
+                       const uint64_t *in, int in_ofs, int len);
+void gmr1_p64_xor_ubit(uint64_t *out, int out_ofs, const ubit_t *in, int len);
+void gmr1_p64_to_ubit(ubit_t *out, const uint64_t *in, int len);
+
+
+/*! \brief Reference encoder (any affine function of the input bits) */
+typedef void (*gmr1_encmap_ref_t)(ubit_t *out, const uint8_t *in);
+
+/*! \brief Table driven packed encoder map */
+struct gmr1_encmap {
+	int in_len;		/*!< \brief Input length (bytes) */
+	int out_len;		/*!< \brief Output length (bits) */
+	int words;		/*!< \brief Output length (64 bits words) */
+	uint64_t *base;		/*!< \brief Output for an all zero input */
+	uint64_t *tab;		/*!< \brief Nibble tables [2*in_len][16][words] */
+};
+
+int  gmr1_encmap_build(struct gmr1_encmap *em, int in_len, int out_len,
+                       gmr1_encmap_ref_t ref);
+void gmr1_encmap_run(const struct gmr1_encmap *em,
+                     uint64_t *out, const uint8_t *in);
+
+
+/*! @} */
+
+#endif /* __OSMO_GMR1_L1_ENCMAP_H__ */
@@ -36,6 +36,8 @@
 
 void gmr1_facch3_encode(ubit_t *bits_e, const uint8_t *l2,
                         const ubit_t *bits_s, const ubit_t *ciph);
+int  gmr1_facch3_encode_p64(uint64_t *bits_e, const uint8_t *l2,
+                            const ubit_t *bits_s, const ubit_t *ciph);
 int  gmr1_facch3_decode(uint8_t *l2, ubit_t *bits_s,
                         const sbit_t *bits_e, const ubit_t *ciph, int *conv_rv);
 
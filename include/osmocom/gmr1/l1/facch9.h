@@ -37,6 +37,9 @@
 void gmr1_facch9_encode(ubit_t *bits_e, const uint8_t *l2,
                         const ubit_t *bits_sacch, const ubit_t *bits_status,
                         const ubit_t *ciph);
+int  gmr1_facch9_encode_p64(uint64_t *bits_e, const uint8_t *l2,
+                            const ubit_t *bits_sacch, const ubit_t *bits_status,
+                            const ubit_t *ciph);
 int gmr1_facch9_decode(uint8_t *l2, sbit_t *bits_sacch, sbit_t *bits_status,
                        const sbit_t *bits_e, const ubit_t *ciph, int *conv_rv);
 
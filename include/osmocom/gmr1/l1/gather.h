@@ -0,0 +1,74 @@
+/* GMR-1 soft bits gather tables */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OSMO_GMR1_L1_GATHER_H__
+#define __OSMO_GMR1_L1_GATHER_H__
+
+/*! \defgroup gather Soft bits gather tables
+ *  \ingroup l1_prim
+ *  @{
+ */
+
+/*! \file l1/gather.h
+ *  \brief Osmocom GMR-1 soft bits gather tables header
+ */
+
+#include <stdint.h>
+
+#include <osmocom/core/bits.h>
+
+
+#define GMR1_GATHER_NONE	0xffff	/*!< \brief No (second) source */
+
+/*! \brief One output soft bit of a gather table */
+struct gmr1_gather_ent
+{
+	uint16_t src;	/*!< \brief Index in the input bits */
+	uint16_t src2;	/*!< \brief Second index to average with (or NONE) */
+	uint16_t ciph;	/*!< \brief Index in the cipher stream (or NONE) */
+	sbit_t mask;	/*!< \brief Scrambling sign mask of src (0 / -1) */
+	sbit_t mask2;	/*!< \brief Scrambling sign mask of src2 (0 / -1) */
+};
+
+/*! \brief Soft bits gather table */
+struct gmr1_gather
+{
+	int len;			/*!< \brief Number of output bits */
+	const struct gmr1_gather_ent *ent;	/*!< \brief Output bits entries */
+};
+
+/*! \brief Reference (bit by bit) implementation of a gather
+ *  \param[out] out Output soft bits
+ *  \param[in] in Input soft bits
+ *  \param[in] ciph Cipher stream (can be NULL)
+ */
+typedef void (*gmr1_gather_ref_t)(sbit_t *out, const sbit_t *in,
+                                  const ubit_t *ciph);
+
+void gmr1_gather_build(struct gmr1_gather *g, struct gmr1_gather_ent *ent,
+                       int out_len, int in_len, int ciph_len,
+                       gmr1_gather_ref_t ref, gmr1_gather_ref_t ref2);
+
+void gmr1_gather_sbit(const struct gmr1_gather *g,
+                      sbit_t *out, const sbit_t *in, const ubit_t *ciph);
+
+
+/*! @} */
+
+#endif /* __OSMO_GMR1_L1_GATHER_H__ */
@@ -30,6 +30,8 @@
  *  \brief Osmocom GMR-1 interleaving header
  */
 
+#include <stdint.h>
+
 
 /* Intra burst interleaving */
 
@@ -44,7 +46,7 @@ struct gmr1_interleaver
 {
 	int N;			/*!< \brief Interleaver depth */
 	int K;			/*!< \brief Interleaver width */
-	int n;			/*!< \brief Current burst number */
+	int n;			/*!< \brief Current burst number (modulo N) */
 	uint8_t *bits_cpp;	/*!< \brief c'' bit state storage */
 };
 
@@ -55,6 +57,9 @@ void gmr1_interleave_inter(struct gmr1_interleaver *il,
 void gmr1_deinterleave_inter(struct gmr1_interleaver *il,
                              void *bits_ep, void *bits_epp);
 
+void gmr1_interleave_inter_p64(struct gmr1_interleaver *il,
+                               uint64_t *bits_epp, const uint64_t *bits_ep);
+
 
 /*! @} */
 
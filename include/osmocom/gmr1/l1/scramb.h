@@ -30,12 +30,22 @@
  *  \brief Osmocom GMR-1 scrambling header
  */
 
+#include <stdint.h>
+
 #include <osmocom/core/bits.h>
 
 
 void gmr1_scramble_sbit(sbit_t *out, const sbit_t *in, int len);
 void gmr1_scramble_ubit(ubit_t *out, const ubit_t *in, int len);
 
+void gmr1_scramble_sbit_ciph(sbit_t *out, const sbit_t *in, const ubit_t *ciph,
+                             int ofs, int len);
+void gmr1_scramble_ubit_ciph(ubit_t *out, const ubit_t *in, const ubit_t *ciph,
+                             int ofs, int len);
+
+void gmr1_scramble_pbit(uint8_t *out, const uint8_t *in, int len);
+void gmr1_scramble_p64(uint64_t *out, const uint64_t *in, int len);
+
 
 /*! @} */
 
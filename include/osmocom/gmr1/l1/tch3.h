@@ -37,6 +37,9 @@
 void gmr1_tch3_encode(ubit_t *bits_e,
                       const uint8_t *frame0, const uint8_t *frame1,
                       const ubit_t *bits_s, const ubit_t *ciph, int m);
+int  gmr1_tch3_encode_p64(uint64_t *bits_e,
+                          const uint8_t *frame0, const uint8_t *frame1,
+                          const ubit_t *bits_s, const ubit_t *ciph, int m);
 void gmr1_tch3_decode(uint8_t *frame0, uint8_t *frame1, ubit_t *bits_s,
                       const sbit_t *bits_e, const ubit_t *ciph, int m,
                       int *conv0_rv, int *conv1_rv);
@@ -47,10 +47,38 @@ enum gmr1_tch9_mode {
 void gmr1_tch9_encode(ubit_t *bits_e, const uint8_t *l2, enum gmr1_tch9_mode mode,
                       const ubit_t *bits_sacch, const ubit_t *bits_status,
                       const ubit_t *ciph, struct gmr1_interleaver *il);
+int  gmr1_tch9_encode_p64(uint64_t *bits_e, const uint8_t *l2,
+                          enum gmr1_tch9_mode mode,
+                          const ubit_t *bits_sacch, const ubit_t *bits_status,
+                          const ubit_t *ciph, struct gmr1_interleaver *il);
 void gmr1_tch9_decode(uint8_t *l2, sbit_t *bits_sacch, sbit_t *bits_status,
                       const sbit_t *bits_e, enum gmr1_tch9_mode mode,
                       const ubit_t *ciph, struct gmr1_interleaver *il,
                       int *conv_rv);
+int  gmr1_tch9_decode_batch(uint8_t * const *l2, sbit_t * const *bits_sacch,
+                            sbit_t * const *bits_status,
+                            const sbit_t * const *bits_e,
+                            enum gmr1_tch9_mode mode,
+                            const ubit_t * const *ciph,
+                            struct gmr1_interleaver * const *il,
+                            int *conv_rv, int n);
+
+/*! \brief TCH9 automatic rate selection state (one per call) */
+struct gmr1_tch9_rate {
+	enum gmr1_tch9_mode mode;	/*!< \brief Current rate */
+	int locked;			/*!< \brief Current rate is locked */
+	int wins;			/*!< \brief Wins in a row of current rate */
+	int frames;			/*!< \brief Frames since last full check */
+};
+
+void gmr1_tch9_rate_init(struct gmr1_tch9_rate *rs);
+enum gmr1_tch9_mode gmr1_tch9_decode_auto(uint8_t *l2, sbit_t *bits_sacch,
+                                          sbit_t *bits_status,
+                                          const sbit_t *bits_e,
+                                          const ubit_t *ciph,
+                                          struct gmr1_interleaver *il,
+                                          struct gmr1_tch9_rate *rs,
+                                          int *conv_rv);
 
 
 /*! @} */
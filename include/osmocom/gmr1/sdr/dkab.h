@@ -37,10 +37,27 @@
 
 #define GMR1_DKAB_SYMS (39*3)
 
+/*! \brief DKAB search request for \ref gmr1_dkab_demod_multi */
+struct gmr1_dkab_req {
+	/* Input */
+	int ofs;	/*!< \brief Search window offset in the signal */
+	int len;	/*!< \brief Search window length */
+	int p;		/*!< \brief DKAB position */
+
+	/* Output */
+	int rv;		/*!< \brief 0 if found, 1 if not, -errno for errors */
+	float toa;	/*!< \brief TOA relative to the search window */
+	sbit_t ebits[8];/*!< \brief Encoded soft bits */
+};
+
 int
 gmr1_dkab_demod(struct osmo_cxvec *burst_in, int sps, float freq_shift, int p,
                 sbit_t *ebits, float *toa_p);
 
+int
+gmr1_dkab_demod_multi(struct osmo_cxvec *sig, int sps, float freq_shift,
+                      struct gmr1_dkab_req *req, int n);
+
 
 /*! @} */
 
@@ -43,8 +43,12 @@ ambe_decode_init(struct ambe_decoder *dec)
 
 	ambe_synth_init(&dec->synth);
 
+#ifdef AMBE_FIXED
+	dec->sf_prev.w0 = 64104752;	/* 0.09378 rad */
+#else
 	dec->sf_prev.w0 = 0.09378;
 	dec->sf_prev.f0 = dec->sf_prev.w0 / (2 * M_PIf);
+#endif
 	dec->sf_prev.L  = 30;
 }
 
@@ -77,18 +81,53 @@ ambe_classify_frame(const uint8_t *frame)
 	};
 }
 
+/*! \brief Generates audio in place of a corrupt frame
+ *  \param[in] dec Decoder state structure
+ *  \param[out] audio Output audio buffer
+ *  \param[in] N number of audio samples to produce (152..168)
+ *  \returns 0 for success. Negative error code otherwise.
+ *
+ *  The last subframe is repeated, 6 dB lower for each subframe, for up
+ *  to AMBE_BAD_REPEAT frames. Longer bursts of bad frames are muted.
+ *  The corrupt frame isn't decoded at all, so the parameters prediction
+ *  state stays the one of the last good frame.
+ */
+static int
+ambe_decode_bad(struct ambe_decoder *dec,
+                int16_t *audio, int N)
+{
+	struct ambe_subframe sf;
+	int i, l;
+
+	if (++dec->bad_cnt > AMBE_BAD_REPEAT)
+		return ambe_decode_dtx(dec, audio, N);
+
+	for (i=0; i<2; i++)
+	{
+		memcpy(&sf, &dec->sf_prev, sizeof(struct ambe_subframe));
+
+		for (l=0; l<sf.L; l++)
+			sf.Ml[l] /= 2;
+
+		ambe_synth_audio(&dec->synth, audio + 80*i, &sf, &dec->sf_prev);
+
+		memcpy(&dec->sf_prev, &sf, sizeof(struct ambe_subframe));
+	}
+
+	return 0;
+}
+
 /*! \brief Decodes an AMBE speech frame to audio
  *  \param[in] dec Decoder state structure
  *  \param[out] audio Output audio buffer
  *  \param[in] N number of audio samples to produce (152..168)
  *  \param[in] frame Frame data (10 bytes = 80 bits)
- *  \param[in] bad Bad Frame Indicator. Set to 1 if frame is corrupt
  *  \returns 0 for success. Negative error code otherwise.
  */
 static int
 ambe_decode_speech(struct ambe_decoder *dec,
                    int16_t *audio, int N,
-                   const uint8_t *frame, int bad)
+                   const uint8_t *frame)
 {
 	struct ambe_raw_params rp;
 	struct ambe_subframe sf[2];
@@ -130,9 +169,15 @@ ambe_decode_frame(struct ambe_decoder *dec,
                   int16_t *audio, int N,
                   const uint8_t *frame, int bad)
 {
+	/* The type of a corrupt frame can't be trusted either */
+	if (bad)
+		return ambe_decode_bad(dec, audio, N);
+
+	dec->bad_cnt = 0;
+
 	switch(ambe_classify_frame(frame)) {
 		case AMBE_SPEECH:
-			return ambe_decode_speech(dec, audio, N, frame, bad);
+			return ambe_decode_speech(dec, audio, N, frame);
 
 		case AMBE_SILENCE:
 			/* FIXME: Comfort noise */
@@ -0,0 +1,133 @@
+/* GMR-1 AMBE vocoder - Decoder benchmark */
+
+/* (C) 2013 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup codec_private
+ *  @{
+ */
+
+/*! \file codec/codec_bench.c
+ *  \brief Osmocom GMR-1 AMBE vocoder decoder benchmark
+ *
+ * Built twice, as codec_bench_float and codec_bench_fixed, with the
+ * float and the fixed-point (AMBE_FIXED) speech decoder whatever
+ * --enable-codec-fixed says. Both decode the same speech frames, single
+ * threaded, and print the time per frame. Run both on the target
+ * machine to know if the fixed-point build is worth it there: with a
+ * fast FPU it is not.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <osmocom/gmr1/codec/codec.h>
+
+
+#define BENCH_FRAMES	1000	/* Distinct speech frames */
+#define BENCH_TIME	1.0	/* Seconds per measurement */
+#define BENCH_RUNS	5	/* Measurements, the best one is kept */
+
+#ifdef AMBE_FIXED
+#define BENCH_NAME	"fixed"
+#else
+#define BENCH_NAME	"float"
+#endif
+
+
+static uint8_t bench_frames[BENCH_FRAMES][10];
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*! \brief Fixed pseudo random speech frames (not libc rand, same everywhere) */
+static void
+bench_gen(void)
+{
+	uint32_t s = 1;
+	int i, j;
+
+	for (i=0; i<BENCH_FRAMES; i++) {
+		for (j=0; j<10; j++) {
+			s = s * 1103515245 + 12345;
+			bench_frames[i][j] = s >> 16;
+		}
+
+		/* Speech frames only, no tone / silence */
+		bench_frames[i][0] &= 0xf7;
+	}
+}
+
+/*! \brief Time per frame (s) of one decoder over the generated frames */
+static double
+bench_run(void)
+{
+	struct gmr1_codec *codec;
+	int16_t audio[160];
+	double t0, t;
+	long n = 0;
+	int i;
+
+	codec = gmr1_codec_alloc();
+	if (!codec)
+		return -1.0;
+
+	t0 = now();
+	do {
+		for (i=0; i<BENCH_FRAMES; i++)
+			gmr1_codec_decode_frame(codec, audio, 160, bench_frames[i], 0);
+		n += BENCH_FRAMES;
+		t = now() - t0;
+	} while (t < BENCH_TIME);
+
+	gmr1_codec_release(codec);
+
+	return t / n;
+}
+
+int main(int argc, char *argv[])
+{
+	double t, best = 0.0;
+	int i;
+
+	bench_gen();
+
+	for (i=0; i<BENCH_RUNS; i++) {
+		t = bench_run();
+		if (t < 0.0) {
+			fprintf(stderr, "[!] Failed to allocate the codec\n");
+			return 1;
+		}
+		if (!i || t < best)
+			best = t;
+	}
+
+	/* A frame is 20 ms of audio */
+	printf("%s decoder: %.2f us per frame, %.0fx real time\n",
+		BENCH_NAME, best * 1e6, 20e-3 / best);
+
+	return 0;
+}
+
+/*! @} */
@@ -78,6 +78,8 @@ ambe_frame_unpack_raw(struct ambe_raw_params *rp, const uint8_t *frame)
 	rp->sf0_perr_58    = _get_bits(p, 44, 2, 3) | _get_bits(p, 77, 3, 0);
 }
 
+#ifndef AMBE_FIXED
+
 /*! \brief Interpolates fundamental between subframes
  *  \param[in] f0log_prev log(fund(-1)) Previous subframe log freq
  *  \param[in] f0log_cur  log(fund(0))  Current  subframe log freq
@@ -356,20 +358,27 @@ ambe_frame_decode_params(struct ambe_subframe *sf,
 void
 ambe_subframe_expand(struct ambe_subframe *sf)
 {
-	float unvc;
+	float kv, ku;
 	int i;
 
 	sf->w0 = sf->f0 * (2.0f * M_PIf);
 
-	unvc = 0.2046f / sqrtf(sf->w0); /* ??? */
+	kv = 1.0f / 6.0f;
+	ku = kv * 0.2046f / sqrtf(sf->w0); /* ??? */
 
 	for (i=0; i<sf->L; i++) {
 		int j = (int)(i * 16.0f * sf->f0);
+		if (j > 7)	/* L is at least 9, even for high f0 */
+			j = 7;
 		sf->Vl[i] = sf->v_uv[j];
-		sf->Ml[i] = powf(2.0, sf->Mlog[i]) / 6.0f;
-		if (!sf->Vl[i])
-			sf->Ml[i] *= unvc;
 	}
+
+	ambe_exp2_v(sf->Ml, sf->Mlog, sf->L);
+
+	for (i=0; i<sf->L; i++)
+		sf->Ml[i] *= sf->Vl[i] ? kv : ku;
 }
 
+#endif /* AMBE_FIXED */
+
 /*! @} */
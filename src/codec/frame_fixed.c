@@ -0,0 +1,415 @@
+/* GMR-1 AMBE vocoder - Fixed-point speech parameters decode */
+
+/* (C) 2014 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup codec_private
+ *  @{
+ */
+
+/*! \file codec/frame_fixed.c
+ *  \brief Osmocom GMR-1 AMBE vocoder fixed-point speech parameters decode
+ *
+ *  Replaces the parameters decode of frame.c when built with AMBE_FIXED,
+ *  see synth_fixed.c. The log2 domain values are Q16 (gain, Mlog) or Q24
+ *  (f0log, the voiced harmonics phases drift with its error), the
+ *  quantizer tables come as Q16 copies from codec_tables.h, and the only
+ *  exponentials (w0 and Ml) go through a 2^x table.
+ */
+
+#ifdef AMBE_FIXED
+
+#include <stdint.h>
+#include <string.h>
+
+#include "private.h"
+#include "codec_tables.h"
+
+
+/*! \brief Q16 value of a constant (constant expressions only) */
+#define AMBE_Q16(x)	((int32_t)((x) * 65536.0 + ((x) < 0 ? -.5 : .5)))
+
+/*! \brief Q24 value of a constant (constant expressions only) */
+#define AMBE_Q24(x)	((int32_t)((x) * 16777216.0 + ((x) < 0 ? -.5 : .5)))
+
+
+/*! \brief 2^(x / 2^24), rounded, saturated to UINT32_MAX
+ *
+ *  Interpolation in \ref exp2_q30, with a second order correction so
+ *  there is no bias on w0 (it adds up in the voiced phases).
+ */
+static uint32_t
+_exp2_q24(int32_t x)
+{
+	int e = (x >> 24) - 30;
+	int i = (x >> 16) & 0xff;
+	uint32_t f = x & 0xffff;
+	uint32_t a = exp2_q30[i];
+	uint32_t m = a + (uint32_t)(((uint64_t)(exp2_q30[i+1] - a) * f
+	                             + (1 << 15)) >> 16);
+
+	/* The chord is always above the curve: take off
+	 * a.(ln(2)/256)^2/2.t.(1-t) (the constant is Q32) */
+	m -= (((uint64_t)a * ((f * (65536 - f)) >> 16) >> 16) * 15746) >> 32;
+
+	if (e > 1)
+		return UINT32_MAX;
+	else if (e >= 0)
+		return m << e;
+	else if (e < -31)
+		return 0;
+
+	return (m + (1U << (-e - 1))) >> -e;
+}
+
+/*! \brief Inverse DCT of Q16 values, \ref ambe_idct with the basis tables
+ *  \param[out] out iDCT result buffer (time domain, N elements)
+ *  \param[in] in iDCT input buffer (freq domain, M elements)
+ *  \param[in] N Number of points of the DCT (<= AMBE_DCT_MAX_N)
+ *  \param[in] M Limit to the number of frequency components (<= AMBE_DCT_MAX_M)
+ */
+static void
+ambe_idct_q(int32_t *out, const int32_t *in, int N, int M)
+{
+	const int16_t *b = &dct_tbl_q13[dct_ofs[N]];
+	const int Np = (N + 3) & ~3;
+	int i, j;
+
+	for (i=0; i<N; i++)
+	{
+		int64_t v = 0;
+
+		for (j=1; j<M; j++)
+			v += (int64_t)in[j] * b[(j-1) * Np + i];
+
+		out[i] = in[0] + (int32_t)((v + (1 << 12)) >> 13);
+	}
+}
+
+/*! \brief Interpolates fundamental between subframes (fixed-point)
+ *  \param[in] f0log_prev log(fund(-1)) Previous subframe log freq (Q24)
+ *  \param[in] f0log_cur  log(fund(0))  Current  subframe log freq (Q24)
+ *  \param[in] rule Which interpolation rule to apply
+ *  \returns The interpolated log(fund) frequency (Q24)
+ */
+static int32_t
+ambe_interpolate_f0log_q(int32_t f0log_prev, int32_t f0log_cur, int rule)
+{
+	if (f0log_cur != f0log_prev) {
+		switch (rule) {
+		case 0:
+			return f0log_cur;
+
+		case 1:
+			return ((int64_t)f0log_cur  * AMBE_Q24(0.65)
+			      + (int64_t)f0log_prev * AMBE_Q24(0.35)
+			      + (1 << 23)) >> 24;
+
+		case 2:
+			return (f0log_cur + f0log_prev) >> 1;
+
+		case 3:
+			return f0log_prev;
+		}
+	} else {
+		const int32_t step = AMBE_Q24(4.2672e-2);
+
+		switch (rule) {
+		case 0:
+		case 1:
+			return f0log_cur;
+
+		case 2:
+			return f0log_cur + step;
+
+		case 3:
+			return f0log_cur - step;
+		}
+	}
+
+	return 0;	/* Not reached */
+}
+
+/*! \brief Computes and fill-in L and Lb vaues for a given subframe (from w0)
+ *  \param[in] sf Subframe
+ */
+static void
+ambe_subframe_compute_L_Lb_q(struct ambe_subframe *sf)
+{
+	/* 0.4751 / f0, with w0 = f0 * 2^32 */
+	sf->L = sf->w0 ? 2040538962U / sf->w0 : 56;
+
+	if (sf->L < 9)
+		sf->L = 9;
+	else if (sf->L > 56)
+		sf->L = 56;
+
+	sf->Lb[0] = ambe_hpg_tbl[sf->L - 9][0];
+	sf->Lb[1] = ambe_hpg_tbl[sf->L - 9][1];
+	sf->Lb[2] = ambe_hpg_tbl[sf->L - 9][2];
+	sf->Lb[3] = ambe_hpg_tbl[sf->L - 9][3];
+}
+
+/*! \brief Resample and "ac-couple" (remove mean) a magnitude array to a new L
+ *  \param[in] mag_dst Destination magnitude array (L_dst elements, Q16)
+ *  \param[in] L_dst Target number of magnitudes
+ *  \param[in] mag_src Source magnitude array (L_src elements, Q16)
+ *  \param[in] L_src Source number of magnitudes
+ *
+ *  The position of the i-th output is (i+1) * L_src / L_dst, computed
+ *  exactly instead of accumulating the step.
+ */
+static void
+ambe_resample_mag_q(int32_t *mag_dst, int L_dst, const int32_t *mag_src, int L_src)
+{
+	int64_t sum;
+	int32_t avg;
+	int i;
+
+	sum = 0;
+
+	for (i=0; i<L_dst; i++)
+	{
+		int pos  = (i + 1) * L_src;
+		int posi = pos / L_dst;
+
+		if (posi == 0) {
+			mag_dst[i] = mag_src[0];
+		} else if (posi >= L_src) {
+			mag_dst[i] = mag_src[L_src-1];
+		} else {
+			int32_t alpha = ((pos - posi * L_dst) << 16) / L_dst;
+			mag_dst[i] = mag_src[posi-1] + (int32_t)(
+				((int64_t)(mag_src[posi] - mag_src[posi-1]) * alpha
+				 + (1 << 15)) >> 16);
+		}
+
+		sum += mag_dst[i];
+	}
+
+	avg = sum / L_dst;
+
+	for (i=0; i<L_dst; i++)
+		mag_dst[i] -= avg;
+}
+
+/*! \brief Compute the spectral magnitudes of subframe 1 from raw params
+ *  \param[inout] sf Current subframe1 data
+ *  \param[in] sf_prev Previous subframe1 data
+ *  \param[in] rp Encoded frame raw parameters
+ */
+static void
+ambe_subframe1_compute_mag_q(struct ambe_subframe *sf,
+                             struct ambe_subframe *sf_prev,
+                             struct ambe_raw_params *rp)
+{
+	int32_t prba[8], Ri[8];
+	int32_t ofs;
+	int64_t sum;
+	int i, j, k;
+
+	/* Prediction */
+	ambe_resample_mag_q(sf->Mlog, sf->L, sf_prev->Mlog, sf_prev->L);
+
+	for (i=0; i<sf->L; i++)
+		sf->Mlog[i] = ((int64_t)sf->Mlog[i] * AMBE_Q16(0.65) + (1 << 15)) >> 16;
+
+	/* PRBA */
+	prba[0] = 0;
+	prba[1] = prba12_tbl_q16[rp->sf1_prba12][0];
+	prba[2] = prba12_tbl_q16[rp->sf1_prba12][1];
+	prba[3] = prba34_tbl_q16[rp->sf1_prba34][0];
+	prba[4] = prba34_tbl_q16[rp->sf1_prba34][1];
+	prba[5] = prba57_tbl_q16[rp->sf1_prba57][0];
+	prba[6] = prba57_tbl_q16[rp->sf1_prba57][1];
+	prba[7] = prba57_tbl_q16[rp->sf1_prba57][2];
+
+	ambe_idct_q(Ri, prba, 8, 8);
+
+	/* Process each block */
+	sum = 0;
+	k = 0;
+
+	for (i=0; i<4; i++) {
+		const int32_t *hoc_tbl[] = {
+			hoc0_tbl_q16[rp->sf1_hoc[0]],
+			hoc1_tbl_q16[rp->sf1_hoc[1]],
+			hoc2_tbl_q16[rp->sf1_hoc[2]],
+			hoc3_tbl_q16[rp->sf1_hoc[3]],
+		};
+		int32_t C[6], c[17];
+
+		/* From PRBA through 2x2 xform, 1 / (2.sqrt(2)) for C[1] */
+		C[0] = (Ri[i<<1] + Ri[(i<<1)+1]) >> 1;
+		C[1] = ((int64_t)(Ri[i<<1] - Ri[(i<<1)+1]) * AMBE_Q16(0.35355339)
+		        + (1 << 15)) >> 16;
+
+		/* HOC */
+		C[2] = hoc_tbl[i][0];
+		C[3] = hoc_tbl[i][1];
+		C[4] = hoc_tbl[i][2];
+		C[5] = hoc_tbl[i][3];
+
+		/* De-DCT */
+		ambe_idct_q(c, C, sf->Lb[i], 6);
+
+		/* Set magnitudes */
+		for (j=0; j<sf->Lb[i]; j++)
+			sf->Mlog[k++] += c[j];
+
+		sum += (int64_t)C[0] * sf->Lb[i];
+	}
+
+	/* Adjust to final gain value */
+	ofs = sf->gain - (log2_q16[sf->L] >> 1) - (int32_t)(sum / sf->L);
+
+	for (i=0; i<sf->L; i++)
+		sf->Mlog[i] += ofs;
+}
+
+/*! \brief Compute the spectral magnitudes of subframe 0 from raw params & sf1
+ *  \param[inout] sf Current subframe0 data
+ *  \param[in] sf1_prev Previous subframe 1 data
+ *  \param[in] sf1_cur  Current subframe 1 data
+ *  \param[in] rp Encoded frame raw parameters
+ */
+static void
+ambe_subframe0_compute_mag_q(struct ambe_subframe *sf,
+                             struct ambe_subframe *sf1_prev,
+                             struct ambe_subframe *sf1_cur,
+                             struct ambe_raw_params *rp)
+{
+	int32_t mag_p[56], mag_c[56], alpha;
+	int32_t perr[9], corr[56];
+	int32_t gain;
+	int i;
+
+	/* Base for interpolation */
+	ambe_resample_mag_q(mag_p, sf->L, sf1_prev->Mlog, sf1_prev->L);
+	ambe_resample_mag_q(mag_c, sf->L, sf1_cur->Mlog,  sf1_cur->L );
+
+	/* Interpolate / Prediction coefficient */
+	alpha = sf0_interp_tbl_q16[rp->sf0_mag_interp];
+
+	/* Correction */
+	perr[0] = 0;
+	perr[1] = sf0_perr14_tbl_q16[rp->sf0_perr_14][0];
+	perr[2] = sf0_perr14_tbl_q16[rp->sf0_perr_14][1];
+	perr[3] = sf0_perr14_tbl_q16[rp->sf0_perr_14][2];
+	perr[4] = sf0_perr14_tbl_q16[rp->sf0_perr_14][3];
+	perr[5] = sf0_perr58_tbl_q16[rp->sf0_perr_58][0];
+	perr[6] = sf0_perr58_tbl_q16[rp->sf0_perr_58][1];
+	perr[7] = sf0_perr58_tbl_q16[rp->sf0_perr_58][2];
+	perr[8] = sf0_perr58_tbl_q16[rp->sf0_perr_58][3];
+
+	ambe_idct_q(corr, perr, sf->L, 9);
+
+	/* Target gain value */
+	gain = sf->gain - (log2_q16[sf->L] >> 1);
+
+	/* Build final value, alpha * mag_p + (1 - alpha) * mag_c */
+	for (i=0; i<sf->L; i++)
+		sf->Mlog[i] = gain + corr[i] + mag_c[i] + (int32_t)(
+			((int64_t)alpha * (mag_p[i] - mag_c[i]) + (1 << 15)) >> 16);
+}
+
+/*! \brief Decodes the speech parameters for both subframes from raw params
+ *  \param[out] sf Array of 2 subframes data to fill-in
+ *  \param[in] sf_prev Previous subframe 1 data
+ *  \param[in] rp Encoded frame raw parameters
+ */
+void
+ambe_frame_decode_params(struct ambe_subframe *sf,
+                         struct ambe_subframe *sf_prev,
+                         struct ambe_raw_params *rp)
+{
+	uint16_t v_uv;
+	int i;
+
+	/* Fundamental */
+	/* (step in Q32, its Q24 rounding would add up over the pitch range) */
+	sf[1].f0log = AMBE_Q24(-4.312) -
+		(((int64_t)AMBE_Q24(2.1336e-2 * 256.0) * rp->pitch + 128) >> 8);
+	sf[1].w0 = _exp2_q24(sf[1].f0log + (32 << 24));
+
+	sf[0].f0log = ambe_interpolate_f0log_q(sf_prev->f0log, sf[1].f0log,
+	                                       rp->pitch_interp);
+	sf[0].w0 = _exp2_q24(sf[0].f0log + (32 << 24));
+
+	/* Harmonics count (total and per-block) */
+	ambe_subframe_compute_L_Lb_q(&sf[0]);
+	ambe_subframe_compute_L_Lb_q(&sf[1]);
+
+	/* Voicing decision */
+	v_uv = ambe_v_uv_tbl[rp->v_uv];
+
+	for (i=0; i<8; i++) {
+		sf[0].v_uv[i] = (v_uv >> ( 7-i)) & 1;
+		sf[1].v_uv[i] = (v_uv >> (15-i)) & 1;
+	}
+
+	/* Gain */
+	sf[0].gain = (sf_prev->gain >> 1) + gain_tbl_q16[rp->gain][0];
+	sf[1].gain = (sf_prev->gain >> 1) + gain_tbl_q16[rp->gain][1];
+
+	if (sf[0].gain > AMBE_Q16(13.0))
+		sf[0].gain = AMBE_Q16(13.0);
+
+	if (sf[1].gain > AMBE_Q16(13.0))
+		sf[1].gain = AMBE_Q16(13.0);
+
+	/* Subframe 1 spectral magnitudes */
+	ambe_subframe1_compute_mag_q(&sf[1], sf_prev, rp);
+
+	/* Subframe 0 spectral magnitudes */
+	ambe_subframe0_compute_mag_q(&sf[0], sf_prev, &sf[1], rp);
+}
+
+/*! \brief Expands the decoded subframe params to prepare for synthesis
+ *  \param[in] sf The subframe to expand
+ *
+ *  The voiced and unvoiced scales, 1/6 and 0.2046 / (6.sqrt(w0)), are
+ *  added in the log2 domain, so each magnitude is a single 2^x.
+ */
+void
+ambe_subframe_expand(struct ambe_subframe *sf)
+{
+	int32_t kv, ku;
+	int i;
+
+	/* log2(1/6), then + log2(0.2046 / sqrt(2.pi)) - log2(f0) / 2 */
+	kv = AMBE_Q16(-2.5849625);
+	ku = kv + AMBE_Q16(-3.6148700) - (sf->f0log >> 9);
+
+	for (i=0; i<sf->L; i++) {
+		int j = ((uint64_t)i * 16 * sf->w0) >> 32;
+		if (j > 7)	/* L is at least 9, even for high f0 */
+			j = 7;
+		sf->Vl[i] = sf->v_uv[j];
+	}
+
+	for (i=0; i<sf->L; i++) {
+		int32_t x = sf->Mlog[i] + (sf->Vl[i] ? kv : ku);
+		uint32_t m = x < (15 << 16) ?
+			_exp2_q24((x + (14 << 16)) << 8) : AMBE_Q_ML_MAX;
+		sf->Ml[i] = m < AMBE_Q_ML_MAX ? m : AMBE_Q_ML_MAX;
+	}
+}
+
+#endif /* AMBE_FIXED */
+
+/*! @} */
@@ -0,0 +1,268 @@
+/* GMR-1 AMBE vocoder - Build time tables generator */
+
+/* (C) 2013 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup codec_private
+ *  @{
+ */
+
+/*! \file codec/gen_tables.c
+ *  \brief Osmocom GMR-1 AMBE vocoder build time tables generator
+ *
+ * Prints the const tables that used to be computed at load time, the
+ * DCT basis, the FFT tables and the tables of the fixed-point decoder,
+ * including integer copies of the tables.c quantizer tables. The output
+ * becomes codec_tables.h, included by the modules using them.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "private.h"
+
+
+/*! \brief Prints \ref cos_tbl (for \ref cosf_fast and \ref sinf_fast) */
+static void
+gen_cos_tbl(FILE *fh)
+{
+	int i;
+
+	fprintf(fh, "/*! \\brief Table for \\ref cosf_fast and \\ref sinf_fast */\n");
+	fprintf(fh, "static const float cos_tbl[1024] = {");
+	for (i=0; i<1024; i++)
+		fprintf(fh, "%s%.8ef,", (i & 3) ? " " : "\n\t",
+			cosf((M_PIf * i) / 512.0f));
+	fprintf(fh, "\n};\n\n");
+}
+
+/*! \brief Prints the DCT basis of every size up to AMBE_DCT_MAX_N
+ *
+ * Rows are zero padded to a multiple of 4 values, dct_ofs[N] is the
+ * start of the block of size N.
+ */
+static void
+gen_dct_tbl(FILE *fh)
+{
+	int ofs[AMBE_DCT_MAX_N+1];
+	int N, Np, i, j;
+
+	for (N=1, ofs[0]=ofs[1]=0; N<AMBE_DCT_MAX_N; N++)
+		ofs[N+1] = ofs[N] + (AMBE_DCT_MAX_M - 1) * ((N + 3) & ~3);
+
+	fprintf(fh, "/*! \\brief Start of each size in \\ref dct_tbl */\n");
+	fprintf(fh, "static const uint16_t dct_ofs[%d] = {", AMBE_DCT_MAX_N+1);
+	for (N=0; N<=AMBE_DCT_MAX_N; N++)
+		fprintf(fh, "%s%d,", (N & 7) ? " " : "\n\t", ofs[N]);
+	fprintf(fh, "\n};\n\n");
+
+	fprintf(fh, "/*! \\brief DCT basis for \\ref ambe_fdct and \\ref ambe_idct */\n");
+	fprintf(fh, "static const float dct_tbl[%d] = {",
+		ofs[AMBE_DCT_MAX_N] + (AMBE_DCT_MAX_M - 1) * AMBE_DCT_MAX_N);
+	for (N=1; N<=AMBE_DCT_MAX_N; N++) {
+		Np = (N + 3) & ~3;
+		fprintf(fh, "\n\t/* N = %d */", N);
+		for (j=1; j<AMBE_DCT_MAX_M; j++)
+			for (i=0; i<Np; i++)
+				fprintf(fh, "%s%.8ef,", (i & 3) ? " " : "\n\t",
+					(i < N) ? 2.0 * cos((M_PI / N) * j * (i + .5)) : 0.0);
+	}
+	fprintf(fh, "\n};\n\n");
+}
+
+/*! \brief Prints the twiddles and bit reversal table of the real FFT */
+static void
+gen_fft_tbl(FILE *fh)
+{
+	const int n = AMBE_FFT_N / 2;
+	int i, j, b;
+
+	fprintf(fh, "/*! \\brief FFT twiddles e^(-j.2.pi.k/N), real part */\n");
+	fprintf(fh, "static const float fft_tw_re[%d] = {", n);
+	for (i=0; i<n; i++)
+		fprintf(fh, "%s%.8ef,", (i & 3) ? " " : "\n\t",
+			cos((2.0 * M_PI * i) / AMBE_FFT_N));
+	fprintf(fh, "\n};\n\n");
+
+	fprintf(fh, "/*! \\brief FFT twiddles e^(-j.2.pi.k/N), imag part */\n");
+	fprintf(fh, "static const float fft_tw_im[%d] = {", n);
+	for (i=0; i<n; i++)
+		fprintf(fh, "%s%.8ef,", (i & 3) ? " " : "\n\t",
+			-sin((2.0 * M_PI * i) / AMBE_FFT_N));
+	fprintf(fh, "\n};\n\n");
+
+	fprintf(fh, "/*! \\brief Bit reversal permutation of the N/2 points FFT */\n");
+	fprintf(fh, "static const uint8_t fft_bitrev[%d] = {", n);
+	for (i=0; i<n; i++) {
+		for (b=1, j=0; b<n; b<<=1)
+			j = (j << 1) | ((i & b) ? 1 : 0);
+		fprintf(fh, "%s%d,", (i & 7) ? " " : "\n\t", j);
+	}
+	fprintf(fh, "\n};\n\n");
+}
+
+/*! \brief Prints the tables of the fixed-point synthesis (synth_fixed.c) */
+static void
+gen_fixed_tbl(FILE *fh)
+{
+	const int n = AMBE_FFT_N / 2;
+	int i;
+
+	fprintf(fh, "/*! \\brief Cosine over a full turn, Q14 (last entry wraps) */\n");
+	fprintf(fh, "static const int16_t cos_q14[1025] = {");
+	for (i=0; i<=1024; i++)
+		fprintf(fh, "%s%d,", (i & 7) ? " " : "\n\t",
+			(int)lrint(16384.0 * cos((M_PI * i) / 512.0)));
+	fprintf(fh, "\n};\n\n");
+
+	fprintf(fh, "/*! \\brief FFT twiddles e^(-j.2.pi.k/N), real part, Q15 */\n");
+	fprintf(fh, "static const int32_t fft_tw_re_q15[%d] = {", n);
+	for (i=0; i<n; i++)
+		fprintf(fh, "%s%d,", (i & 7) ? " " : "\n\t",
+			(int)lrint(32768.0 * cos((2.0 * M_PI * i) / AMBE_FFT_N)));
+	fprintf(fh, "\n};\n\n");
+
+	fprintf(fh, "/*! \\brief FFT twiddles e^(-j.2.pi.k/N), imag part, Q15 */\n");
+	fprintf(fh, "static const int32_t fft_tw_im_q15[%d] = {", n);
+	for (i=0; i<n; i++)
+		fprintf(fh, "%s%d,", (i & 7) ? " " : "\n\t",
+			(int)lrint(-32768.0 * sin((2.0 * M_PI * i) / AMBE_FFT_N)));
+	fprintf(fh, "\n};\n\n");
+
+	fprintf(fh, "/*! \\brief (1 + i/128)^(1/4), Q30 */\n");
+	fprintf(fh, "static const uint32_t root4_q30[129] = {");
+	for (i=0; i<=128; i++)
+		fprintf(fh, "%s%lu,", (i & 7) ? " " : "\n\t",
+			(unsigned long)lrint(1073741824.0 * pow(1.0 + i / 128.0, 0.25)));
+	fprintf(fh, "\n};\n\n");
+
+	fprintf(fh, "/*! \\brief 2^(i/4) for i in [-4, 1], Q30 */\n");
+	fprintf(fh, "static const uint32_t root4_exp_q30[6] = {");
+	for (i=-4; i<=1; i++)
+		fprintf(fh, " %lu,",
+			(unsigned long)lrint(1073741824.0 * pow(2.0, i / 4.0)));
+	fprintf(fh, "\n};\n\n");
+
+	/* Window values are k/40 with k = 60-i and i-20 in the overlap */
+	fprintf(fh, "/*! \\brief Overlap normalization 40 / (k1^2 + k2^2), Q20 */\n");
+	fprintf(fh, "static const uint16_t wola_q20[39] = {");
+	for (i=21; i<60; i++) {
+		int k1 = 60 - i, k2 = i - 20;
+		fprintf(fh, "%s%d,", ((i-21) & 7) ? " " : "\n\t",
+			(int)lrint(40.0 * 1048576.0 / (k1 * k1 + k2 * k2)));
+	}
+	fprintf(fh, "\n};\n\n");
+}
+
+/*! \brief Prints one of the tables.c tables as Q16 integers
+ *  \param[in] fh Output file
+ *  \param[in] name Table name, without the ambe_ prefix and _tbl suffix
+ *  \param[in] tbl Float table
+ *  \param[in] n Number of rows
+ *  \param[in] m Number of values per row (1 for a plain array)
+ */
+static void
+gen_q16_tbl(FILE *fh, const char *name, const float *tbl, int n, int m)
+{
+	int i, j;
+
+	fprintf(fh, "/*! \\brief \\ref ambe_%s_tbl, Q16 */\n", name);
+
+	if (m == 1) {
+		fprintf(fh, "static const int32_t %s_tbl_q16[%d] = {", name, n);
+		for (i=0; i<n; i++)
+			fprintf(fh, "%s%ld,", (i & 7) ? " " : "\n\t",
+				lrint(65536.0 * tbl[i]));
+		fprintf(fh, "\n};\n\n");
+		return;
+	}
+
+	fprintf(fh, "static const int32_t %s_tbl_q16[%d][%d] = {\n", name, n, m);
+	for (i=0; i<n; i++) {
+		fprintf(fh, "\t{");
+		for (j=0; j<m; j++)
+			fprintf(fh, "%s%7ld", j ? ", " : " ", lrint(65536.0 * tbl[i*m+j]));
+		fprintf(fh, " },\n");
+	}
+	fprintf(fh, "};\n\n");
+}
+
+/*! \brief Prints the tables of the fixed-point parameters decode (frame_fixed.c) */
+static void
+gen_fixed_params_tbl(FILE *fh)
+{
+	int N, Np, i, j;
+
+	fprintf(fh, "/*! \\brief 2^(i/256), Q30 */\n");
+	fprintf(fh, "static const uint32_t exp2_q30[257] = {");
+	for (i=0; i<=256; i++)
+		fprintf(fh, "%s%lu,", (i & 7) ? " " : "\n\t",
+			(unsigned long)lrint(1073741824.0 * pow(2.0, i / 256.0)));
+	fprintf(fh, "\n};\n\n");
+
+	fprintf(fh, "/*! \\brief log2(i), Q16 (first entry unused) */\n");
+	fprintf(fh, "static const int32_t log2_q16[%d] = {", AMBE_DCT_MAX_N+1);
+	for (i=0; i<=AMBE_DCT_MAX_N; i++)
+		fprintf(fh, "%s%ld,", (i & 7) ? " " : "\n\t",
+			i ? lrint(65536.0 * log2(i)) : 0L);
+	fprintf(fh, "\n};\n\n");
+
+	/* Same layout as dct_tbl, 2.cos() is within [-2, 2] */
+	fprintf(fh, "/*! \\brief \\ref dct_tbl in Q13 */\n");
+	fprintf(fh, "static const int16_t dct_tbl_q13[] = {");
+	for (N=1; N<=AMBE_DCT_MAX_N; N++) {
+		Np = (N + 3) & ~3;
+		fprintf(fh, "\n\t/* N = %d */", N);
+		for (j=1; j<AMBE_DCT_MAX_M; j++)
+			for (i=0; i<Np; i++)
+				fprintf(fh, "%s%ld,", (i & 7) ? " " : "\n\t",
+					(i < N) ? lrint(8192.0 * 2.0 * cos((M_PI / N) * j * (i + .5))) : 0L);
+	}
+	fprintf(fh, "\n};\n\n");
+
+	gen_q16_tbl(fh, "gain",       &ambe_gain_tbl[0][0],       256, 2);
+	gen_q16_tbl(fh, "prba12",     &ambe_prba12_tbl[0][0],     128, 2);
+	gen_q16_tbl(fh, "prba34",     &ambe_prba34_tbl[0][0],      64, 2);
+	gen_q16_tbl(fh, "prba57",     &ambe_prba57_tbl[0][0],     128, 3);
+	gen_q16_tbl(fh, "hoc0",       &ambe_hoc0_tbl[0][0],       128, 4);
+	gen_q16_tbl(fh, "hoc1",       &ambe_hoc1_tbl[0][0],        64, 4);
+	gen_q16_tbl(fh, "hoc2",       &ambe_hoc2_tbl[0][0],        64, 4);
+	gen_q16_tbl(fh, "hoc3",       &ambe_hoc3_tbl[0][0],        64, 4);
+	gen_q16_tbl(fh, "sf0_interp", &ambe_sf0_interp_tbl[0],      4, 1);
+	gen_q16_tbl(fh, "sf0_perr14", &ambe_sf0_perr14_tbl[0][0],  64, 4);
+	gen_q16_tbl(fh, "sf0_perr58", &ambe_sf0_perr58_tbl[0][0],  32, 4);
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *fh = stdout;
+
+	fprintf(fh, "/* Generated by gen_tables, do not edit */\n\n");
+
+	gen_cos_tbl(fh);
+	gen_dct_tbl(fh);
+	gen_fft_tbl(fh);
+	gen_fixed_tbl(fh);
+	gen_fixed_params_tbl(fh);
+
+	if (fflush(fh) || ferror(fh))
+		return 1;
+
+	return 0;
+}
+
+/*! @} */
@@ -26,22 +26,21 @@
  */
 
 #include <math.h>
+#include <string.h>
 
 #include "private.h"
 
 
-/*! \brief Table for \ref cosf_fast and \ref sinf_fast */
-static float cos_tbl[1024];
+/* cos_tbl[1024], the DCT basis and the FFT tables are generated at
+ * build time (see gen_tables.c) */
+#include "codec_tables.h"
 
-/*! \brief Initializes \ref cos_tbl for \ref cosf_fast */
-static void __attribute__ ((constructor))
-cos_tbl_init(void)
-{
-	int i;
-
-	for (i=0; i<1024; i++)
-		cos_tbl[i] = cosf((M_PIf * i) / 512.0f);
-}
+/*! \brief Use libm in \ref ambe_exp2_v and \ref ambe_sincos_v
+ *
+ *  Only meant as the accuracy reference of the polynomial versions,
+ *  see math_test.c
+ */
+int ambe_math_libm = 0;
 
 /*! \brief Fast Cosinus approximation using a simple table
  *  \param[in] angle The angle value
@@ -65,6 +64,177 @@ sinf_fast(float angle)
 	return cos_tbl[((int)(angle*f) + 768) & 1023];
 }
 
+/*! \brief Polynomial 2^x
+ *  \param[in] x The exponent (|x| < 126, no range check)
+ *  \returns 2^x with a relative error below 2e-7
+ *
+ *  x is split in round(x) + f with f in [-0.5, 0.5]. The integer part
+ *  goes directly in the exponent field and 2^f is a degree 6 polynomial
+ *  (cephes exp2f coefficients). No branch nor libm call, so a loop of
+ *  it can be vectorized.
+ */
+static inline float
+_exp2f_poly(float x)
+{
+	union { float f; int32_t i; } e;
+	float f, p;
+	int i;
+
+	i = (int)(x + 126.5f) - 126;
+	f = x - (float)i;
+
+	p = 1.535336188319500e-4f;
+	p = p * f + 1.339887440266574e-3f;
+	p = p * f + 9.618437357674640e-3f;
+	p = p * f + 5.550332471162809e-2f;
+	p = p * f + 2.402264791363012e-1f;
+	p = p * f + 6.931472028550421e-1f;
+	p = p * f + 1.0f;
+
+	e.i = (i + 127) << 23;
+
+	return p * e.f;
+}
+
+/*! \brief Polynomial sine and cosine
+ *  \param[in] x The angle (|x| < 2^16)
+ *  \param[out] s Sine of the angle
+ *  \param[out] c Cosine of the angle
+ *
+ *  x is reduced to [-pi/4, pi/4] around the nearest multiple of pi/2
+ *  (pi/2 split in 3 parts to keep the reduction exact), the sine and
+ *  cosine there are cephes sinf/cosf polynomials and the quadrant
+ *  swaps / negates them with bit masks rather than branches.
+ */
+static inline void
+_sincosf_poly(float x, float *s, float *c)
+{
+	const float dp1 = 1.5703125f;
+	const float dp2 = 4.837512969970703125e-4f;
+	const float dp3 = 7.54978995489188216e-8f;
+	union { float f; uint32_t u; } ps, pc, vs, vc;
+	uint32_t swap, sgn_s, sgn_c;
+	float r, r2;
+	int q;
+
+	q = (int)(x * (2.0f / M_PIf) + copysignf(0.5f, x));
+
+	r = ((x - (float)q * dp1) - (float)q * dp2) - (float)q * dp3;
+	r2 = r * r;
+
+	ps.f = -1.9515295891e-4f;
+	ps.f = ps.f * r2 + 8.3321608736e-3f;
+	ps.f = ps.f * r2 - 1.6666654611e-1f;
+	ps.f = ps.f * r2 * r + r;
+
+	pc.f = 2.443315711809948e-5f;
+	pc.f = pc.f * r2 - 1.388731625493765e-3f;
+	pc.f = pc.f * r2 + 4.166664568298827e-2f;
+	pc.f = pc.f * r2 * r2 - 0.5f * r2 + 1.0f;
+
+	/* Quadrant: sin = { s, c, -s, -c }, cos = { c, -s, -c, s } */
+	swap  = -(uint32_t)(q & 1);
+	sgn_s = (uint32_t)(q & 2) << 30;
+	sgn_c = (uint32_t)((q + 1) & 2) << 30;
+
+	vs.u = ((pc.u & swap) | (ps.u & ~swap)) ^ sgn_s;
+	vc.u = ((ps.u & swap) | (pc.u & ~swap)) ^ sgn_c;
+
+	*s = vs.f;
+	*c = vc.f;
+}
+
+/*! \brief Fast 2^x approximation over a vector
+ *  \param[out] out Result values (n elements)
+ *  \param[in] in Exponents (n elements, |x| < 126)
+ *  \param[in] n Number of values
+ *
+ *  Values are done 4 at a time through a local block so the compiler
+ *  can vectorize them, the remainder one by one.
+ */
+void
+ambe_exp2_v(float *out, const float *in, int n)
+{
+	int i, m;
+
+	if (ambe_math_libm) {
+		for (i=0; i<n; i++)
+			out[i] = exp2f(in[i]);
+		return;
+	}
+
+	for (i=0; i+4<=n; i+=4)
+	{
+		float x[4], y[4];
+
+		for (m=0; m<4; m++)
+			x[m] = in[i+m];
+
+		for (m=0; m<4; m++)
+			y[m] = _exp2f_poly(x[m]);
+
+		for (m=0; m<4; m++)
+			out[i+m] = y[m];
+	}
+
+	for (; i<n; i++)
+		out[i] = _exp2f_poly(in[i]);
+}
+
+/*! \brief Fast sine and cosine over a vector
+ *  \param[out] s Sine of each angle (n elements)
+ *  \param[out] c Cosine of each angle (n elements)
+ *  \param[in] x Angles (n elements, |x| < 2^16)
+ *  \param[in] n Number of values
+ *
+ *  Same 4 values blocks as \ref ambe_exp2_v
+ */
+void
+ambe_sincos_v(float *s, float *c, const float *x, int n)
+{
+	int i, m;
+
+	if (ambe_math_libm) {
+		for (i=0; i<n; i++) {
+			s[i] = sinf(x[i]);
+			c[i] = cosf(x[i]);
+		}
+		return;
+	}
+
+	for (i=0; i+4<=n; i+=4)
+	{
+		float a[4], vs[4], vc[4];
+
+		for (m=0; m<4; m++)
+			a[m] = x[i+m];
+
+		for (m=0; m<4; m++)
+			_sincosf_poly(a[m], &vs[m], &vc[m]);
+
+		for (m=0; m<4; m++) {
+			s[i+m] = vs[m];
+			c[i+m] = vc[m];
+		}
+	}
+
+	for (; i<n; i++)
+		_sincosf_poly(x[i], &s[i], &c[i]);
+}
+
+/*! \brief DCT basis of N points, as AMBE_DCT_MAX_M-1 rows
+ *  \param[in] N Number of points of the DCT (N <= AMBE_DCT_MAX_N)
+ *  \returns Pointer to the table block
+ *
+ *  Row j-1 holds 2 * cos((pi / N) * j * (i + .5)) for i in [0,N), zero
+ *  padded to a multiple of 4 values.
+ */
+static inline const float *
+ambe_dct_basis(int N)
+{
+	return &dct_tbl[dct_ofs[N]];
+}
+
 /*! \brief Forward Discrete Cosine Transform (fDCT)
  *  \param[out] out fDCT result buffer (freq domain, M elements)
  *  \param[in] in fDCT input buffer (time domain, N elements)
@@ -76,6 +246,29 @@ ambe_fdct(float *out, float *in, int N, int M)
 {
 	int i, j;
 
+	if (N <= AMBE_DCT_MAX_N && M <= AMBE_DCT_MAX_M)
+	{
+		const float *b = ambe_dct_basis(N);
+		float v = 0.0f;
+
+		for (j=0; j<N; j++)
+			v += in[j];
+
+		out[0] = v / (float)N;
+
+		for (i=1; i<M; i++, b+=(N+3)&~3)
+		{
+			v = 0.0f;
+
+			for (j=0; j<N; j++)
+				v += in[j] * b[j];
+
+			out[i] = v / (float)(2 * N);
+		}
+
+		return;
+	}
+
 	for (i=0; i<M; i++)
 	{
 		float v = 0.0f;
@@ -94,12 +287,42 @@ ambe_fdct(float *out, float *in, int N, int M)
  *  \param[in] in iDCT input buffer (freq domain, M elements)
  *  \param[in] N Number of points of the DCT
  *  \param[in] M Limit to the number of frequency components (M <= N)
+ *
+ *  Every size used by the AMBE decoder has its basis precomputed. The
+ *  inner loop runs along the output, 4 independent values at a time, so
+ *  the compiler can vectorize it.
  */
 void
 ambe_idct(float *out, float *in, int N, int M)
 {
 	int i, j;
 
+	if (N <= AMBE_DCT_MAX_N && M <= AMBE_DCT_MAX_M)
+	{
+		const float *b = ambe_dct_basis(N);
+		const int Np = (N + 3) & ~3;
+		float v[AMBE_DCT_MAX_N];
+
+		for (i=0; i<Np; i++)
+			v[i] = in[0];
+
+		for (j=1; j<M; j++, b+=Np)
+		{
+			const float c = in[j];
+
+			for (i=0; i<Np; i+=4) {
+				v[i+0] += c * b[i+0];
+				v[i+1] += c * b[i+1];
+				v[i+2] += c * b[i+2];
+				v[i+3] += c * b[i+3];
+			}
+		}
+
+		memcpy(out, v, sizeof(float) * N);
+
+		return;
+	}
+
 	for (i=0; i<N; i++)
 	{
 		float v = in[0];
@@ -113,65 +336,140 @@ ambe_idct(float *out, float *in, int N, int M)
 	}
 }
 
-/*! \brief Forward Discrete Fourrier Transform (float->complex)
+/*! \brief In-place complex FFT of AMBE_FFT_N/2 points
+ *  \param[inout] re Real components (AMBE_FFT_N/2 elements)
+ *  \param[inout] im Imag components (AMBE_FFT_N/2 elements)
+ *
+ *  Radix-2 decimation in time. The twiddles of the AMBE_FFT_N points
+ *  real transform are used with a stride of 2.
+ */
+static void
+ambe_fft_half(float *re, float *im)
+{
+	const int n = AMBE_FFT_N / 2;
+	int i, j, k, s;
+
+	/* Bit reversed order */
+	for (i=0; i<n; i++)
+	{
+		float t;
+
+		j = fft_bitrev[i];
+		if (j <= i)
+			continue;
+
+		t = re[i]; re[i] = re[j]; re[j] = t;
+		t = im[i]; im[i] = im[j]; im[j] = t;
+	}
+
+	/* Butterflies */
+	for (s=1; s<n; s<<=1)
+	{
+		int ts = AMBE_FFT_N / (2 * s);
+
+		for (i=0; i<n; i+=2*s)
+		{
+			for (k=0; k<s; k++)
+			{
+				float wr = fft_tw_re[k * ts];
+				float wi = fft_tw_im[k * ts];
+				int a = i + k, b = a + s;
+				float tr = re[b] * wr - im[b] * wi;
+				float ti = re[b] * wi + im[b] * wr;
+
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+/*! \brief Forward real FFT (float->complex) of AMBE_FFT_N points
  *  \param[out] out_i Real component result buffer (freq domain, N/2+1 elements)
  *  \param[out] out_q Imag component result buffer (freq domain, N/2+1 elements)
  *  \param[in] in Input buffer (time domain, M elements)
- *  \param[in] N Number of points of the DFT
  *  \param[in] M Limit to to the number of available time domain elements
  *
  *  Since the input is float, the result is symmetric and so only one side
- *  is computed. The output index 0 is DC.
+ *  is computed. The output index 0 is DC. Even and odd samples are
+ *  transformed together as one N/2 points complex FFT and then split.
  */
 void
-ambe_fdft_fc(float *out_i, float *out_q, float *in, int N, int M)
+ambe_fft_fc(float *out_i, float *out_q, const float *in, int M)
 {
-	int fb, ts;
+	const int n = AMBE_FFT_N / 2;
+	float re[AMBE_FFT_N / 2], im[AMBE_FFT_N / 2];
+	int k;
 
-	for (fb=0; fb<=(N/2); fb++)
-	{
-		float i=0.0f, q=0.0f;
+	for (k=0; k<n; k++) {
+		re[k] = ((2*k)   < M) ? in[2*k]   : 0.0f;
+		im[k] = ((2*k+1) < M) ? in[2*k+1] : 0.0f;
+	}
 
-		for (ts=0; ts<M; ts++)
-		{
-			float angle = (- 2.0f * M_PIf / N) * fb * ts;
-			i += in[ts] * cosf_fast(angle);
-			q += in[ts] * sinf_fast(angle);
-		}
+	ambe_fft_half(re, im);
+
+	out_i[0] = re[0] + im[0];
+	out_q[0] = 0.0f;
+	out_i[n] = re[0] - im[0];
+	out_q[n] = 0.0f;
 
-		out_i[fb] = i;
-		out_q[fb] = q;
+	for (k=1; k<n; k++)
+	{
+		/* Even / Odd samples spectrums */
+		float evr = 0.5f * (re[k] + re[n-k]);
+		float evi = 0.5f * (im[k] - im[n-k]);
+		float odr = 0.5f * (im[k] + im[n-k]);
+		float odi = 0.5f * (re[n-k] - re[k]);
+
+		out_i[k] = evr + odr * fft_tw_re[k] - odi * fft_tw_im[k];
+		out_q[k] = evi + odr * fft_tw_im[k] + odi * fft_tw_re[k];
 	}
 }
 
-/*! \brief Inverse Discret Fourrier Transform (complex->float)
- *  \param[out] out Result buffer (time domain, M
+/*! \brief Inverse real FFT (complex->float) of AMBE_FFT_N points
+ *  \param[out] out Result buffer (time domain, M elements)
  *  \param[in] in_i Real component input buffer (freq domain, N/2+1 elements)
  *  \param[in] in_q Imag component input buffer (freq domain, N/2+1 elements)
- *  \param[in] N Number of points of the DFT
  *  \param[in] M Limit to the number of time domain elements to generate
  *
  *  The input is assumed to be symmetric and so only N/2+1 inputs are
- *  needed. DC component must be input index 0.
+ *  needed. DC component must be input index 0. The DC and N/2 inputs
+ *  are taken as real.
  */
 void
-ambe_idft_cf(float *out, float *in_i, float *in_q, int N, int M)
+ambe_ifft_cf(float *out, const float *in_i, const float *in_q, int M)
 {
-	int fb, ts;
+	const int n = AMBE_FFT_N / 2;
+	const float scale = 1.0f / n;
+	float re[AMBE_FFT_N / 2], im[AMBE_FFT_N / 2];
+	int k;
 
-	for (ts=0; ts<M; ts++)
+	/* Merge back as the conjugate of the N/2 points complex spectrum */
+	re[0] = 0.5f * (in_i[0] + in_i[n]);
+	im[0] = -0.5f * (in_i[0] - in_i[n]);
+
+	for (k=1; k<n; k++)
 	{
-		float r=0.0f;
+		float evr = 0.5f * (in_i[k] + in_i[n-k]);
+		float evi = 0.5f * (in_q[k] - in_q[n-k]);
+		float dr = 0.5f * (in_i[k] - in_i[n-k]);
+		float di = 0.5f * (in_q[k] + in_q[n-k]);
 
-		for (fb=0; fb<=(N/2); fb++)
-		{
-			float angle = (- 2.0f * M_PIf / N) * fb * ts;
-			float m = (fb == 0 || fb == (N/2)) ? 1.0f : 2.0f;
-			r += m * (in_i[fb] * cosf_fast(angle) + in_q[fb] * sinf_fast(angle));
-		}
+		/* Odd = (X[k] - conj(X[N/2-k])) / 2 * e^(j.2.pi.k/N) */
+		float odr = dr * fft_tw_re[k] + di * fft_tw_im[k];
+		float odi = di * fft_tw_re[k] - dr * fft_tw_im[k];
 
-		out[ts] = r / N;
+		re[k] =   evr - odi;
+		im[k] = -(evi + odr);
 	}
+
+	/* Inverse through the forward transform */
+	ambe_fft_half(re, im);
+
+	for (k=0; k<M; k++)
+		out[k] = (k & 1) ? -im[k>>1] * scale : re[k>>1] * scale;
 }
 
 /*! @} */
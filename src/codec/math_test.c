@@ -0,0 +1,116 @@
+/* GMR-1 AMBE vocoder - Polynomial math accuracy test */
+
+/* (C) 2013 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup codec_private
+ *  @{
+ */
+
+/*! \file codec/math_test.c
+ *  \brief Osmocom GMR-1 AMBE vocoder polynomial math accuracy test
+ *
+ * Decodes a fixed set of speech frames twice, once with the polynomial
+ * \ref ambe_exp2_v and \ref ambe_sincos_v and once with their libm
+ * reference, and fails if the audio differs by more than
+ * TEST_MAX_LSB anywhere.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <osmocom/gmr1/codec/codec.h>
+
+#include "private.h"
+
+
+#define TEST_STREAMS	3	/* Independent decoders, different frames */
+#define TEST_FRAMES	2000	/* Frames per stream */
+#define TEST_MAX_LSB	2	/* Max audio deviation allowed */
+#define TEST_CLIP	30000	/* Larger samples wrap around in int16 */
+
+
+/*! \brief Fixed pseudo random frame bytes (not libc rand, same everywhere) */
+static uint8_t
+test_rand(uint32_t *s)
+{
+	*s = *s * 1103515245 + 12345;
+	return *s >> 16;
+}
+
+int main(int argc, char *argv[])
+{
+	struct gmr1_codec *c_ref = NULL, *c_tst = NULL;
+	int16_t a_ref[160], a_tst[160];
+	uint8_t frame[10];
+	uint32_t seed;
+	int s, f, i, d, rv;
+	int dev = 0, n = 0;
+
+	for (s=0; s<TEST_STREAMS; s++)
+	{
+		c_ref = gmr1_codec_alloc();
+		c_tst = gmr1_codec_alloc();
+		if (!c_ref || !c_tst) {
+			fprintf(stderr, "[!] Failed to allocate the codecs\n");
+			return 1;
+		}
+
+		seed = s + 1;
+
+		for (f=0; f<TEST_FRAMES; f++)
+		{
+			for (i=0; i<10; i++)
+				frame[i] = test_rand(&seed);
+
+			/* Speech frames only (tone / silence don't use it) */
+			frame[0] &= 0xf7;
+
+			ambe_math_libm = 1;
+			rv = gmr1_codec_decode_frame(c_ref, a_ref, 160, frame, 0);
+
+			ambe_math_libm = 0;
+			rv |= gmr1_codec_decode_frame(c_tst, a_tst, 160, frame, 0);
+
+			if (rv) {
+				fprintf(stderr, "[!] Decode failed (stream %d frame %d)\n", s, f);
+				return 1;
+			}
+
+			for (i=0; i<160; i++) {
+				if (abs(a_ref[i]) > TEST_CLIP || abs(a_tst[i]) > TEST_CLIP)
+					continue;
+
+				d = abs(a_ref[i] - a_tst[i]);
+				if (d > dev)
+					dev = d;
+				n++;
+			}
+		}
+
+		gmr1_codec_release(c_tst);
+		gmr1_codec_release(c_ref);
+	}
+
+	printf("%d samples, max deviation %d LSB (limit %d)\n",
+		n, dev, TEST_MAX_LSB);
+
+	return dev > TEST_MAX_LSB ? 1 : 0;
+}
+
+/*! @} */
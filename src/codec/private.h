@@ -33,6 +33,7 @@
 
 
 #define AMBE_RATE 8000		/*!< \brief AMBE sample rate (Hz) */
+#define AMBE_BAD_REPEAT 2	/*!< \brief Bad frames repeated before muting */
 
 
 /*! \brief AMBE possible frame types */
@@ -61,29 +62,56 @@ struct ambe_raw_params
 	uint8_t sf0_perr_58;	/*!< \brief sf0 mag prediction error VQ [5,8] */
 };
 
-/*! \brief AMBE subframe parameters */
+#ifdef AMBE_FIXED
+/*! \brief Largest spectral magnitude (Q14), way past int16 clipping already */
+#define AMBE_Q_ML_MAX	(32767 << 14)
+#endif
+
+/*! \brief AMBE subframe parameters
+ *
+ *  With AMBE_FIXED, log2 values are Q16 (Q24 for f0log), magnitudes Q14,
+ *  and frequencies are 32 bits phase increments (2^32 = 2.pi rad/samp).
+ */
 struct ambe_subframe
 {
+#ifdef AMBE_FIXED
+	int32_t f0log;		/*!< \brief log2(f0) (Q24) */
+	uint32_t w0;		/*!< \brief fundamental frequency (2^32 = 2.pi rad/samp) */
+#else
 	float f0;               /*!< \brief fundamental normalized frequency */
 	float f0log;		/*!< \brief log2(f0) */
 	float w0;		/*!< \brief fundamental frequency (rad/samp) */
+#endif
 	int L;                  /*!< \brief Number of harmonics */
 	int Lb[4];              /*!< \brief Harmonics per block */
 	int v_uv[8];            /*!< \brief Voicing state */
 	int Vl[56];		/*!< \brief Per-harmonic voicing state */
+#ifdef AMBE_FIXED
+	int32_t gain;		/*!< \brief Gain (Q16) */
+	int32_t Mlog[56];	/*!< \brief log spectral magnitudes (Q16) */
+	int32_t Ml[56];		/*!< \brief spectral magnitudes (Q14) */
+#else
 	float gain;		/*!< \brief Gain */
 	float Mlog[56];         /*!< \brief log spectral magnitudes */
 	float Ml[56];		/*!< \brief spectral magnitudes */
+#endif
 };
 
 /*! \brief AMBE synthesizer state */
 struct ambe_synth
 {
 	int16_t u_prev;		/*!< \brief Last 'u' of previous subframe */
+#ifdef AMBE_FIXED
+	int32_t uw_prev[121];	/*!< \brief Unvoiced data from previous subframe (Q4) */
+	uint32_t psi1;		/*!< \brief Current PSI angle for fundamental (2^32 = 2.pi) */
+	uint32_t phi[56];	/*!< \brief Current phase for each harmonic (2^32 = 2.pi) */
+	uint64_t SE;		/*!< \brief Current energy parameter */
+#else
 	float uw_prev[121];	/*!< \brief Unvoiced data from previous subframe */
 	float psi1;		/*!< \brief Current PSI angle for fundamental */
 	float phi[56];		/*!< \brief Current phase for each harmonic */
 	float SE;		/*!< \brief Current energy parameter */
+#endif
 };
 
 /*! \brief AMBE decoder state */
@@ -93,6 +121,7 @@ struct ambe_decoder
 	float tone_phase_f2;	/*!< \brief Phase frequency 2 for tone frames */
 
 	struct ambe_subframe sf_prev;	/*!< \brief Previous subframe */
+	int bad_cnt;			/*!< \brief Consecutive bad frames */
 
 	struct ambe_synth synth;	/*!< \brief Synthesizer state */
 };
@@ -109,6 +138,8 @@ int ambe_decode_dtx(struct ambe_decoder *dec,
 
 /* From frame.c */
 void ambe_frame_unpack_raw(struct ambe_raw_params *rp, const uint8_t *frame);
+
+/* From frame.c, or frame_fixed.c with AMBE_FIXED */
 void ambe_frame_decode_params(struct ambe_subframe *sf,
                               struct ambe_subframe *sf_prev,
                               struct ambe_raw_params *rp);
@@ -116,16 +147,33 @@ void ambe_subframe_expand(struct ambe_subframe *sf);
 
 /* From math.c */
 #define M_PIf (3.141592653589793f)	/*!< \brief Value of pi as a float */
+#define AMBE_FFT_N 128			/*!< \brief Points of the real FFT */
+#define AMBE_DCT_MAX_N 56		/*!< \brief Max DCT points with a table */
+#define AMBE_DCT_MAX_M 9		/*!< \brief Max DCT coefs with a table */
+
+extern int ambe_math_libm;
 
 float cosf_fast(float angle);
 float sinf_fast(float angle);
+void ambe_exp2_v(float *out, const float *in, int n);
+void ambe_sincos_v(float *s, float *c, const float *x, int n);
 void ambe_fdct(float *out, float *in, int N, int M);
 void ambe_idct(float *out, float *in, int N, int M);
-void ambe_fdft_fc(float *out_i, float *out_q, float *in, int N, int M);
-void ambe_idft_cf(float *out, float *in_i, float *in_q, int N, int M);
+void ambe_fft_fc(float *out_i, float *out_q, const float *in, int M);
+void ambe_ifft_cf(float *out, const float *in_i, const float *in_q, int M);
 
 /* From synth.c */
+void ambe_gen_random(uint16_t *u_seq, uint16_t u_prev, int n);
 void ambe_synth_init(struct ambe_synth *synth);
+
+/* From synth.c, or synth_fixed.c with AMBE_FIXED */
+#ifdef AMBE_FIXED
+void ambe_synth_phase(struct ambe_synth *synth, uint32_t *phi_prev,
+                      struct ambe_subframe *sf, struct ambe_subframe *sf_prev);
+#else
+void ambe_synth_phase(struct ambe_synth *synth, float *phi_prev,
+                      struct ambe_subframe *sf, struct ambe_subframe *sf_prev);
+#endif
 void ambe_synth_enhance(struct ambe_synth *synth, struct ambe_subframe *sf);
 void ambe_synth_audio(struct ambe_synth *synth, int16_t *audio,
                       struct ambe_subframe *sf,
@@ -32,6 +32,7 @@
 
 #include "private.h"
 
+#ifndef AMBE_FIXED
 /*! \brief Synthesis window (39 samples overlap) */
 static const float ws[] = {
 	0.000f, 0.025f, 0.050f, 0.075f, 0.100f, 0.125f, 0.150f, 0.175f,
@@ -52,6 +53,7 @@ static const float ws[] = {
 	0.375f, 0.350f, 0.325f, 0.300f, 0.275f, 0.250f, 0.225f, 0.200f,
 	0.175f, 0.150f, 0.125f, 0.100f, 0.075f, 0.050f, 0.025f, 0.000f,
 };
+#endif
 
 /*! \brief Pitch refinement window */
 static const float wr[] = {
@@ -80,6 +82,7 @@ static const float wr[] = {
 	0.042353f, 0.035694f, 0.029633f, 0.024182f, 0.019270f, 0.014873f,
 };
 
+#ifndef AMBE_FIXED
 /*! \brief Random phase increment (precomputed) */
 static const float rho[] = {
 	 3.002978f, -0.385743f, -1.804058f,  0.708389f,  3.080091f,  0.234237f,
@@ -93,6 +96,7 @@ static const float rho[] = {
 	 0.520336f,  2.339119f, -0.808328f,  1.332154f,  2.929768f, -0.338316f,
 	 0.022767f, -1.063795f,
 };
+#endif
 
 
 /*! \brief Generates random sequence of uint16_t according to spec
@@ -100,7 +104,7 @@ static const float rho[] = {
  *  \param[in] u_prev Last 'u' value of where to resume from
  *  \param[in] n Number of items to generate
  */
-static void
+void
 ambe_gen_random(uint16_t *u_seq, uint16_t u_prev, int n)
 {
 	uint32_t u = u_prev;
@@ -112,6 +116,41 @@ ambe_gen_random(uint16_t *u_seq, uint16_t u_prev, int n)
 	}
 }
 
+#ifndef AMBE_FIXED
+
+/*! \brief Advance the harmonics phases to a new subframe
+ *  \param[in] synth Synthesizer state structure
+ *  \param[out] phi_prev Phases at the previous subframe (56 values)
+ *  \param[in] sf Expanded subframe data for current subframe
+ *  \param[in] sf_prev Expanded subframe data for prevous subframe
+ *
+ *  synth->phi holds the phases at the current subframe on return.
+ */
+void
+ambe_synth_phase(struct ambe_synth *synth, float *phi_prev,
+                 struct ambe_subframe *sf, struct ambe_subframe *sf_prev)
+{
+	int l, L_uv;
+
+	/* psi update */
+	L_uv = 0;
+	for (l=0; l<sf->L; l++)
+		L_uv += sf->Vl[l] ? 0 : 1;
+
+	synth->psi1 = remainderf(synth->psi1 + (sf->w0 + sf_prev->w0) * 40.0f, 2 * M_PIf);
+
+	/* New phases */
+	memcpy(phi_prev, synth->phi, sizeof(float) * 56);
+
+	for (l=0; l<56; l++)
+	{
+		synth->phi[l] = synth->psi1 * (l+1);
+
+		if (l >= (sf->L / 4))
+			synth->phi[l] += ((float)L_uv / (float)sf->L) * rho[l];
+	}
+}
+
 /*! \brief Perform unvoiced synthesis
  *  \param[in] synth Synthesizer state structure
  *  \param[out] suv Result buffer (80 samples)
@@ -133,10 +172,13 @@ ambe_synth_unvoiced(struct ambe_synth *synth, float *suv, struct ambe_subframe *
 		uw[i] = (float)u[i] * ws[i];
 
 	/* Compute the DFT */
-	ambe_fdft_fc(Uwi, Uwq, uw, 128, 121);
+	ambe_fft_fc(Uwi, Uwq, uw, 121);
 
-	/* Apply the spectral magnitude */
+	/* Apply the spectral magnitude (band edges limited to the spectrum,
+	 * high w0 and L from corrupt frames can go past it) */
 	bl = ceilf(128.0f / (2 * M_PIf) * (.5f) * sf->w0);
+	if (bl > 65)
+		bl = 65;
 
 	for (i=0; i<bl; i++) {
 		Uwi[i] = 0.0f;
@@ -150,6 +192,8 @@ ambe_synth_unvoiced(struct ambe_synth *synth, float *suv, struct ambe_subframe *
 		/* Edges */
 		al = bl;
 		bl = ceilf(128.0f / (2 * M_PIf) * (l + 1.5f) * sf->w0);
+		if (bl > 65)
+			bl = 65;
 
 		/* Compute factor */
 		ampl = 0.0f;
@@ -178,7 +222,7 @@ ambe_synth_unvoiced(struct ambe_synth *synth, float *suv, struct ambe_subframe *
 	}
 
 	/* Get time-domain samples via iDFT */
-	ambe_idft_cf(uw, Uwi, Uwq, 128, 121);
+	ambe_ifft_cf(uw, Uwi, Uwq, 121);
 
 	/* Weighted Overlap And Add */
 	for (i=0; i<21; i++) {
@@ -197,6 +241,88 @@ ambe_synth_unvoiced(struct ambe_synth *synth, float *suv, struct ambe_subframe *
 	memcpy(synth->uw_prev, uw, sizeof(float) * 121);
 }
 
+/*! \brief Bank of constant amplitude oscillators */
+struct ambe_osc {
+	int n;			/*!< \brief Number of oscillators */
+	float ampl[56];		/*!< \brief Amplitude */
+	float phase[56];	/*!< \brief Phase of the first sample */
+	float w[56];		/*!< \brief Angular speed (rad/sample) */
+	float zr[56];		/*!< \brief Real part of ampl * e^(j*phase) */
+	float zi[56];		/*!< \brief Imag part of ampl * e^(j*phase) */
+	float rr[56];		/*!< \brief Real part of e^(j*w) */
+	float ri[56];		/*!< \brief Imag part of e^(j*w) */
+};
+
+/*! \brief Adds an oscillator to a bank
+ *  \param[inout] osc Oscillator bank
+ *  \param[in] ampl Amplitude
+ *  \param[in] phase Phase of the first sample
+ *  \param[in] w Angular speed (rad/sample)
+ */
+static void
+ambe_osc_add(struct ambe_osc *osc, float ampl, float phase, float w)
+{
+	int k = osc->n++;
+
+	osc->ampl[k]  = ampl;
+	osc->phase[k] = phase;
+	osc->w[k]     = w;
+}
+
+/*! \brief Runs a bank of oscillators and adds their windowed sum
+ *  \param[inout] osc Oscillator bank (state is advanced)
+ *  \param[inout] out Output buffer to add to (N samples)
+ *  \param[in] win Window to apply (N samples)
+ *  \param[in] N Number of samples to generate
+ *
+ *  Each oscillator is a complex rotator, so a sample costs one complex
+ *  multiply per harmonic and no trigonometric function. Harmonics are
+ *  processed 4 at a time with independent accumulators so the compiler
+ *  can vectorize across them.
+ */
+static void
+ambe_osc_run(struct ambe_osc *osc, float *out, const float *win, int N)
+{
+	int i, k, m;
+
+	/* Pad with silent oscillators */
+	while (osc->n & 3)
+		ambe_osc_add(osc, 0.0f, 0.0f, 0.0f);
+
+	if (!osc->n)
+		return;
+
+	/* Initial state of all rotators at once */
+	ambe_sincos_v(osc->zi, osc->zr, osc->phase, osc->n);
+	ambe_sincos_v(osc->ri, osc->rr, osc->w, osc->n);
+
+	for (k=0; k<osc->n; k++) {
+		osc->zr[k] *= osc->ampl[k];
+		osc->zi[k] *= osc->ampl[k];
+	}
+
+	for (i=0; i<N; i++)
+	{
+		float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+		for (k=0; k<osc->n; k+=4)
+		{
+			for (m=0; m<4; m++)
+			{
+				float zr = osc->zr[k+m], zi = osc->zi[k+m];
+				float rr = osc->rr[k+m], ri = osc->ri[k+m];
+
+				acc[m] += zr;
+
+				osc->zr[k+m] = zr * rr - zi * ri;
+				osc->zi[k+m] = zr * ri + zi * rr;
+			}
+		}
+
+		out[i] += win[i] * ((acc[0] + acc[1]) + (acc[2] + acc[3]));
+	}
+}
+
 /*! \brief Perform voiced synthesis
  *  \param[in] synth Synthesizer state structure
  *  \param[out] sv Result buffer (80 samples)
@@ -207,20 +333,21 @@ static void
 ambe_synth_voiced(struct ambe_synth *synth, float *sv,
                   struct ambe_subframe *sf, struct ambe_subframe *sf_prev)
 {
-	int i, l, L_max, L_uv;
+	struct ambe_osc osc_cur, osc_prev;
+	float phi[56];
+	int i, l, L_max;
 
 	/* Pre-clear */
 	memset(sv, 0x00, sizeof(float) * 80);
 
+	osc_cur.n  = 0;
+	osc_prev.n = 0;
+
 	/* How many subband to process */
 	L_max = sf_prev->L > sf->L ? sf_prev->L : sf->L;
 
-	/* psi update */
-	L_uv = 0;
-	for (l=0; l<L_max; l++)
-		L_uv += sf->Vl[l] ? 0 : 1;
-
-	synth->psi1 = remainderf(synth->psi1 + (sf->w0 + sf_prev->w0) * 40.0f, 2 * M_PIf);
+	/* Phases update */
+	ambe_synth_phase(synth, phi, sf, sf_prev);
 
 	/* Scan each band */
 	for (l=0; l<L_max; l++)
@@ -242,13 +369,8 @@ ambe_synth_voiced(struct ambe_synth *synth, float *sv,
 		w_cur   = (l+1) * sf->w0;
 		w_prev  = (l+1) * sf_prev->w0;
 
-		phi_prev = synth->phi[l];
-		phi_cur  = synth->psi1 * (l+1);
-
-		if (l >= (sf->L / 4))
-			phi_cur += ((float)L_uv / (float)sf->L) * rho[l];
-
-		synth->phi[l] = phi_cur;
+		phi_prev = phi[l];
+		phi_cur  = synth->phi[l];
 
 		/* Actual synthesis */
 			/* Can we do a fine transistion ? */
@@ -263,31 +385,45 @@ ambe_synth_voiced(struct ambe_synth *synth, float *sv,
 			float THa = w_prev + Dwl;
 			float THb = (w_cur - w_prev) / 160.0f;
 
-			for (i=0; i<80; i++)
-				sv[i] += (Ml_prev + i * Ml_step) * cosf_fast(
-					phi_prev + (THa + THb * i) * i
-				);
+			/* Phase is phi_prev + (THa + THb * i) * i, its increment
+			 * THa + THb * (2i + 1) is itself a rotation */
+			float a[3] = { phi_prev, THa + THb, 2.0f * THb };
+			float sa[3], ca[3];
+			float zr, zi, rr, ri, cr, ci, t;
+
+			ambe_sincos_v(sa, ca, a, 3);
+
+			zr = ca[0]; zi = sa[0];
+			rr = ca[1]; ri = sa[1];
+			cr = ca[2]; ci = sa[2];
+
+			for (i=0; i<80; i++) {
+				sv[i] += (Ml_prev + i * Ml_step) * zr;
+
+				t  = zr * rr - zi * ri;
+				zi = zr * ri + zi * rr;
+				zr = t;
+
+				t  = rr * cr - ri * ci;
+				ri = rr * ci + ri * cr;
+				rr = t;
+			}
 		}
 
 			/* Coarse transition: Current frame (if voiced) */
 		if (!fine && Vl_cur)
-		{
-			for (i=21; i<80; i++)
-				sv[i] += ws[i-20] * Ml_cur * cosf_fast(phi_cur + w_cur * (i - 80));
-		}
+			ambe_osc_add(&osc_cur, Ml_cur, phi_cur - w_cur * 59, w_cur);
 
 			/* Coarse transition: Previous frame (if voiced) */
 		if (!fine && Vl_prev)
-		{
-			for (i=0; i<60; i++)
-				sv[i] += ws[i+60] * Ml_prev * cosf_fast(phi_prev + w_prev * i);
-		}
+			ambe_osc_add(&osc_prev, Ml_prev, phi_prev, w_prev);
 	}
 
-	/* Still need to update phi for the rest of the bands */
-	for (l=L_max; l<56; l++)
-		synth->phi[l] = (synth->psi1 * (l+1)) + (((float)L_uv / (float)sf->L) * rho[l]);
+	/* Coarse transitions of all bands */
+	ambe_osc_run(&osc_cur,  &sv[21], &ws[1],  59);
+	ambe_osc_run(&osc_prev, &sv[0],  &ws[60], 60);
 }
+#endif /* AMBE_FIXED */
 
 
 /*! \brief Initialized Synthesizer state
@@ -300,6 +436,7 @@ ambe_synth_init(struct ambe_synth *synth)
 	synth->u_prev = 3147;
 }
 
+#ifndef AMBE_FIXED
 /*! \brief Apply the spectral magnitude enhancement on the subframe
  *  \param[in] synth Synthesizer state structure
  *  \param[in] sf Expanded subframe data for subframe to enhance
@@ -338,10 +475,10 @@ ambe_synth_enhance(struct ambe_synth *synth, struct ambe_subframe *sf)
 		if ( (l+1)*8 <= sf->L ) {
 			w = 1.0f;
 		} else {
-			w = sqrtf(sf->Ml[l]) * powf(
-				k1 * (k2 - k3 * cosf_fast(sf->w0 * (l+1))),
-				0.25f
-			);
+			/* sqrt(Ml) * x^(1/4) == sqrt(Ml * sqrt(x)) */
+			w = sqrtf(sf->Ml[l] * sqrtf(
+				k1 * (k2 - k3 * cosf_fast(sf->w0 * (l+1)))
+			));
 
 			if (w > 1.2f)
 				w = 1.2f;
@@ -387,5 +524,6 @@ ambe_synth_audio(struct ambe_synth *synth, int16_t *audio,
 	for (i=0; i<80; i++)
 		audio[i] = (int16_t)((suv[i] + 2.0f * sv[i]) * 4.0f);
 }
+#endif /* AMBE_FIXED */
 
 /*! @} */
@@ -0,0 +1,702 @@
+/* GMR-1 AMBE vocoder - Fixed-point speech synthesis */
+
+/* (C) 2014 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup codec_private
+ *  @{
+ */
+
+/*! \file codec/synth_fixed.c
+ *  \brief Osmocom GMR-1 AMBE vocoder fixed-point speech synthesis
+ *
+ *  Replaces the synthesis part of synth.c when built with AMBE_FIXED
+ *  (configure --enable-codec-fixed), for targets without a fast FPU.
+ *  Along with frame_fixed.c, speech frames are decoded without float
+ *  (tone frames still are):
+ *
+ *   - magnitudes in Q14, unvoiced spectrum in Q2, unvoiced signal in Q4,
+ *     voiced signal in Q6
+ *   - FFT twiddles in Q15, cosine table in Q14
+ *   - phases and frequencies as 32 bits values, 2^32 being a full turn
+ */
+
+#ifdef AMBE_FIXED
+
+#include <stdint.h>
+#include <string.h>
+
+#include "private.h"
+#include "codec_tables.h"
+
+
+/*! \brief Largest unvoiced band amplitude (Q2) not overflowing the iFFT */
+#define AMBE_Q_UV_MAX	(1 << 21)
+
+/*! \brief Bounds of the enhancement weight to the power of 4 (Q24) */
+#define AMBE_Q_W4_MIN	(1 << 20)	/* 0.5^4 */
+#define AMBE_Q_W4_MAX	34789235	/* 1.2^4 */
+
+
+/*! \brief Random phase increment (precomputed, 2^32 = 2.pi) */
+static const int32_t rho_q32[] = {
+	 2052731484,  -263680520, -1233191404,   484230122,  2105443253,   160116279,
+	-1778338813,  1753276575,    69083157,  -165128864, -1560699832,   314775657,
+	-1101411639,  1543722121, -1404909153,  1185249553,  1720695120, -1207320509,
+	  613179926, -1613896932,  -191969738, -1855547510,  1435549967,  1572422976,
+	 -792092884, -1397390619, -1824016695, -1762735068,   126484184,  1060502992,
+	 1863955363,  1815285516,  2082725645,   570331321,  -351075708,  1002131986,
+	  472426317,    87030847, -1391003385,  -731862580,   312107702, -1557627889,
+	  840116079, -1462552846,   -81856942,  -206118172,    20090667,    47012202,
+	  355683621,  1598940524,  -552544952,   910614216,  2002687670,  -231261070,
+	   15562731,  -727173322,
+};
+
+
+/*! \brief Synthesis window ws as k/40, returns k */
+static inline int
+_ws_k(int i)
+{
+	return i < 40 ? i : (i > 80 ? 120 - i : 40);
+}
+
+/*! \brief Integer square root */
+static uint32_t
+_isqrt64(uint64_t x)
+{
+	uint64_t r = 0, b = 1ULL << 62;
+
+	while (b > x)
+		b >>= 2;
+
+	while (b) {
+		if (x >= r + b) {
+			x -= r + b;
+			r = (r >> 1) + b;
+		} else {
+			r >>= 1;
+		}
+		b >>= 2;
+	}
+
+	return r;
+}
+
+/*! \brief Fourth root of a Q24 weight in [AMBE_Q_W4_MIN, AMBE_Q_W4_MAX],
+ *  Q24 result, interpolated in \ref root4_q30
+ */
+static uint32_t
+_root4_q24(uint32_t x)
+{
+	int e, s, i;
+	uint32_t f, a, r;
+
+	for (e=25; !(x >> e); e--);
+
+	s = e - 7;
+	i = (x >> s) - 128;
+	f = x & ((1 << s) - 1);
+	a = root4_q30[i];
+	r = a + (uint32_t)(((uint64_t)(root4_q30[i+1] - a) * f) >> s);
+
+	return ((uint64_t)r * root4_exp_q30[e - 20] + (1ULL << 35)) >> 36;
+}
+
+/*! \brief Last FFT bin + 1 of the unvoiced band l (-1 for the DC band)
+ *  \param[in] w0 Fundamental frequency (2^32 = 2.pi rad/samp)
+ *  \param[in] l Band index
+ */
+static inline int
+_band_edge(uint32_t w0, int l)
+{
+	/* ceil(128 / (2.pi) * (l + 1.5) * w0) */
+	return ((uint64_t)(2 * l + 3) * 64 * w0 + 0xffffffffULL) >> 32;
+}
+
+/*! \brief Cosine of a 32 bits phase, Q14, linear interpolation */
+static inline int32_t
+_cos_q14(uint32_t ph)
+{
+	int i = ph >> 22;
+	int32_t f = (ph >> 12) & 1023;
+	int32_t a = cos_q14[i];
+	int32_t b = cos_q14[i+1];
+
+	return a + (((b - a) * f) >> 10);
+}
+
+
+/* Fixed-point FFT ------------------------------------------------------- */
+
+/*! \brief In-place complex FFT of AMBE_FFT_N/2 points (integer) */
+static void
+ambe_fft_half_q(int32_t *re, int32_t *im)
+{
+	const int n = AMBE_FFT_N / 2;
+	int i, j, k, s;
+
+	/* Bit reversed order */
+	for (i=0; i<n; i++)
+	{
+		int32_t t;
+
+		j = fft_bitrev[i];
+		if (j <= i)
+			continue;
+
+		t = re[i]; re[i] = re[j]; re[j] = t;
+		t = im[i]; im[i] = im[j]; im[j] = t;
+	}
+
+	/* Butterflies */
+	for (s=1; s<n; s<<=1)
+	{
+		int ts = AMBE_FFT_N / (2 * s);
+
+		for (i=0; i<n; i+=2*s)
+		{
+			for (k=0; k<s; k++)
+			{
+				int64_t wr = fft_tw_re_q15[k * ts];
+				int64_t wi = fft_tw_im_q15[k * ts];
+				int a = i + k, b = a + s;
+				int32_t tr = (re[b] * wr - im[b] * wi + (1 << 14)) >> 15;
+				int32_t ti = (re[b] * wi + im[b] * wr + (1 << 14)) >> 15;
+
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+/*! \brief Forward real FFT of AMBE_FFT_N points (integer)
+ *  \param[out] out_i Real component result buffer (N/2+1 elements)
+ *  \param[out] out_q Imag component result buffer (N/2+1 elements)
+ *  \param[in] in Input buffer (time domain, M elements)
+ *  \param[in] M Limit to to the number of available time domain elements
+ *
+ *  Same as \ref ambe_fft_fc (no scaling).
+ */
+static void
+ambe_fft_fc_q(int32_t *out_i, int32_t *out_q, const int32_t *in, int M)
+{
+	const int n = AMBE_FFT_N / 2;
+	int32_t re[AMBE_FFT_N / 2], im[AMBE_FFT_N / 2];
+	int k;
+
+	for (k=0; k<n; k++) {
+		re[k] = ((2*k)   < M) ? in[2*k]   : 0;
+		im[k] = ((2*k+1) < M) ? in[2*k+1] : 0;
+	}
+
+	ambe_fft_half_q(re, im);
+
+	out_i[0] = re[0] + im[0];
+	out_q[0] = 0;
+	out_i[n] = re[0] - im[0];
+	out_q[n] = 0;
+
+	for (k=1; k<n; k++)
+	{
+		int64_t evr = (re[k] + re[n-k]) >> 1;
+		int64_t evi = (im[k] - im[n-k]) >> 1;
+		int64_t odr = (im[k] + im[n-k]) >> 1;
+		int64_t odi = (re[n-k] - re[k]) >> 1;
+
+		out_i[k] = evr + ((odr * fft_tw_re_q15[k] - odi * fft_tw_im_q15[k] + (1 << 14)) >> 15);
+		out_q[k] = evi + ((odr * fft_tw_im_q15[k] + odi * fft_tw_re_q15[k] + (1 << 14)) >> 15);
+	}
+}
+
+/*! \brief Inverse real FFT of AMBE_FFT_N points (integer)
+ *  \param[out] out Result buffer (time domain, M elements)
+ *  \param[in] in_i Real component input buffer (N/2+1 elements)
+ *  \param[in] in_q Imag component input buffer (N/2+1 elements)
+ *  \param[in] M Limit to the number of time domain elements to generate
+ *
+ *  Same as \ref ambe_ifft_cf, including the 1/(N/2) scaling, for a Q2
+ *  input and a Q4 output.
+ */
+static void
+ambe_ifft_cf_q(int32_t *out, const int32_t *in_i, const int32_t *in_q, int M)
+{
+	const int n = AMBE_FFT_N / 2;
+	int32_t re[AMBE_FFT_N / 2], im[AMBE_FFT_N / 2];
+	int k;
+
+	/* Merge back as the conjugate of the N/2 points complex spectrum */
+	re[0] =   (in_i[0] + in_i[n]) >> 1;
+	im[0] = -((in_i[0] - in_i[n]) >> 1);
+
+	for (k=1; k<n; k++)
+	{
+		int32_t evr = (in_i[k] + in_i[n-k]) >> 1;
+		int32_t evi = (in_q[k] - in_q[n-k]) >> 1;
+		int64_t dr  = (in_i[k] - in_i[n-k]) >> 1;
+		int64_t di  = (in_q[k] + in_q[n-k]) >> 1;
+
+		int32_t odr = (dr * fft_tw_re_q15[k] + di * fft_tw_im_q15[k] + (1 << 14)) >> 15;
+		int32_t odi = (di * fft_tw_re_q15[k] - dr * fft_tw_im_q15[k] + (1 << 14)) >> 15;
+
+		re[k] =   evr - odi;
+		im[k] = -(evi + odr);
+	}
+
+	/* Inverse through the forward transform */
+	ambe_fft_half_q(re, im);
+
+	for (k=0; k<M; k++)
+		out[k] = (((k & 1) ? -im[k>>1] : re[k>>1]) + 8) >> 4;
+}
+
+
+/* Synthesis ------------------------------------------------------------- */
+
+/*! \brief Advance the harmonics phases to a new subframe
+ *  \param[in] synth Synthesizer state structure
+ *  \param[out] phi_prev Phases at the previous subframe (56 values)
+ *  \param[in] sf Expanded subframe data for current subframe
+ *  \param[in] sf_prev Expanded subframe data for prevous subframe
+ *
+ *  synth->phi holds the phases at the current subframe on return. The
+ *  32 bits phases wrap by themselves, no remainder needed.
+ */
+void
+ambe_synth_phase(struct ambe_synth *synth, uint32_t *phi_prev,
+                 struct ambe_subframe *sf, struct ambe_subframe *sf_prev)
+{
+	int l, L_uv;
+
+	/* psi update */
+	L_uv = 0;
+	for (l=0; l<sf->L; l++)
+		L_uv += sf->Vl[l] ? 0 : 1;
+
+	synth->psi1 += (sf->w0 + sf_prev->w0) * 40;
+
+	/* New phases */
+	memcpy(phi_prev, synth->phi, sizeof(uint32_t) * 56);
+
+	for (l=0; l<56; l++)
+	{
+		synth->phi[l] = synth->psi1 * (l+1);
+
+		if (l >= (sf->L / 4))
+			synth->phi[l] += (int64_t)rho_q32[l] * L_uv / sf->L;
+	}
+}
+
+/*! \brief Perform unvoiced synthesis (fixed-point)
+ *  \param[in] synth Synthesizer state structure
+ *  \param[out] suv Result buffer (80 samples, Q4)
+ *  \param[in] sf Expanded subframe data
+ */
+static void
+ambe_synth_unvoiced_q(struct ambe_synth *synth, int32_t *suv,
+                      struct ambe_subframe *sf)
+{
+	uint16_t u[121];
+	int32_t uw[121];
+	int32_t Uwi[65], Uwq[65];
+	int i, al, bl, l;
+
+	/* Generate the white noise sequence and window it with ws. The
+	 * scale doesn't matter, each band is normalized to its energy. */
+	ambe_gen_random(u, synth->u_prev, 121);
+	synth->u_prev = u[79];
+
+	for (i=0; i<121; i++)
+		uw[i] = ((int32_t)u[i] * _ws_k(i)) >> 4;
+
+	/* Compute the DFT */
+	ambe_fft_fc_q(Uwi, Uwq, uw, 121);
+
+	/* Apply the spectral magnitude */
+	bl = _band_edge(sf->w0, -1);
+	if (bl > 65)
+		bl = 65;
+
+	for (i=0; i<bl; i++) {
+		Uwi[i] = 0;
+		Uwq[i] = 0;
+	}
+
+	for (l=0; l<sf->L; l++)
+	{
+		uint64_t e;
+		uint32_t rms;
+		int64_t a, g;
+
+		/* Edges */
+		al = bl;
+		bl = _band_edge(sf->w0, l);
+		if (bl > 65)
+			bl = 65;
+
+		if (bl <= al)
+			continue;
+
+		if (sf->Vl[l]) {
+			for (i=al; i<bl; i++) {
+				Uwi[i] = 0;
+				Uwq[i] = 0;
+			}
+			continue;
+		}
+
+		/* Gain 76.89 * Ml / rms, Q2 result as Q16 */
+		e = 0;
+		for (i=al; i<bl; i++)
+			e += (int64_t)Uwi[i] * Uwi[i] + (int64_t)Uwq[i] * Uwq[i];
+
+		rms = _isqrt64(e / (bl - al));
+
+		/* 76.89 * Ml, Q14 -> Q2 */
+		a = ((int64_t)sf->Ml[l] * 19684 + (1 << 19)) >> 20;
+		if (a > AMBE_Q_UV_MAX)
+			a = AMBE_Q_UV_MAX;
+
+		g = rms ? a * 65536 / rms : 0;
+
+		/* Set magnitude */
+		for (i=al; i<bl; i++) {
+			Uwi[i] = (Uwi[i] * g) >> 16;
+			Uwq[i] = (Uwq[i] * g) >> 16;
+		}
+	}
+
+	for (i=bl; i<=64; i++) {
+		Uwi[i] = 0;
+		Uwq[i] = 0;
+	}
+
+	/* Get time-domain samples via iDFT */
+	ambe_ifft_cf_q(uw, Uwi, Uwq, 121);
+
+	/* Weighted Overlap And Add, ws[i+60] = (60-i)/40, ws[i-20] = (i-20)/40 */
+	for (i=0; i<21; i++) {
+		suv[i] = synth->uw_prev[i + 60];
+	}
+
+	for (i=21; i<60; i++) {
+		int64_t v = (int64_t)(60 - i) * synth->uw_prev[i + 60]
+		          + (int64_t)(i - 20) * uw[i - 20];
+		suv[i] = (v * wola_q20[i - 21] + (1 << 19)) >> 20;
+	}
+
+	for (i=60; i<80; i++) {
+		suv[i] = uw[i - 20];
+	}
+
+	memcpy(synth->uw_prev, uw, sizeof(int32_t) * 121);
+}
+
+/*! \brief Bank of constant amplitude oscillators (fixed-point) */
+struct ambe_osc_q {
+	int n;			/*!< \brief Number of oscillators */
+	int32_t ampl[56];	/*!< \brief Amplitude (Q14) */
+	uint32_t phase[56];	/*!< \brief Phase of the first sample */
+	uint32_t w[56];		/*!< \brief Phase increment per sample */
+};
+
+/*! \brief Adds an oscillator to a bank
+ *  \param[inout] osc Oscillator bank
+ *  \param[in] Ml Magnitude (Q14)
+ *  \param[in] phase Phase of the first sample
+ *  \param[in] w Phase increment per sample
+ */
+static void
+ambe_osc_q_add(struct ambe_osc_q *osc, int32_t Ml, uint32_t phase, uint32_t w)
+{
+	int k = osc->n++;
+
+	osc->ampl[k]  = Ml;
+	osc->phase[k] = phase;
+	osc->w[k]     = w;
+}
+
+/*! \brief Runs a bank of oscillators and adds their windowed sum
+ *  \param[inout] osc Oscillator bank (state is advanced)
+ *  \param[inout] out Output buffer to add to (N samples, Q6)
+ *  \param[in] ws_ofs Index in the synthesis window of the first sample
+ *  \param[in] N Number of samples to generate
+ */
+static void
+ambe_osc_q_run(struct ambe_osc_q *osc, int32_t *out, int ws_ofs, int N)
+{
+	int i, k;
+
+	if (!osc->n)
+		return;
+
+	for (i=0; i<N; i++)
+	{
+		int64_t acc = 0;
+
+		for (k=0; k<osc->n; k++) {
+			acc += (int64_t)osc->ampl[k] * _cos_q14(osc->phase[k]);
+			osc->phase[k] += osc->w[k];
+		}
+
+		/* Q28 -> Q6, then window */
+		out[i] += ((acc + (1 << 21)) >> 22) * _ws_k(ws_ofs + i) / 40;
+	}
+}
+
+/*! \brief Perform voiced synthesis (fixed-point)
+ *  \param[in] synth Synthesizer state structure
+ *  \param[out] sv Result buffer (80 samples, Q6)
+ *  \param[in] sf Expanded subframe data for current subframe
+ *  \param[in] sf_prev Expanded subframe data for prevous subframe
+ */
+static void
+ambe_synth_voiced_q(struct ambe_synth *synth, int32_t *sv,
+                    struct ambe_subframe *sf, struct ambe_subframe *sf_prev)
+{
+	struct ambe_osc_q osc_cur, osc_prev;
+	uint32_t phi[56];
+	int i, l, L_max;
+
+	/* Pre-clear */
+	memset(sv, 0x00, sizeof(int32_t) * 80);
+
+	osc_cur.n  = 0;
+	osc_prev.n = 0;
+
+	/* How many subband to process */
+	L_max = sf_prev->L > sf->L ? sf_prev->L : sf->L;
+
+	/* Phases update */
+	ambe_synth_phase(synth, phi, sf, sf_prev);
+
+	/* Scan each band */
+	for (l=0; l<L_max; l++)
+	{
+		int      Vl_cur,  Vl_prev;
+		int32_t  Ml_cur,  Ml_prev;
+		uint32_t phi_cur, phi_prev;
+		int64_t  w_cur,   w_prev;
+		int fine;
+
+		/* Handle out-of-bound for Vl and Ml */
+		Vl_cur  = l >= sf->L      ? 0 : sf->Vl[l];
+		Vl_prev = l >= sf_prev->L ? 0 : sf_prev->Vl[l];
+
+		Ml_cur  = l >= sf->L      ? 0 : sf->Ml[l];
+		Ml_prev = l >= sf_prev->L ? 0 : sf_prev->Ml[l];
+
+		/* Phase and Angular speed (not wrapped, for the comparisons) */
+		w_cur   = (int64_t)(l+1) * sf->w0;
+		w_prev  = (int64_t)(l+1) * sf_prev->w0;
+
+		phi_prev = phi[l];
+		phi_cur  = synth->phi[l];
+
+		/* Actual synthesis */
+			/* Can we do a fine transistion ? */
+		fine = Vl_cur && Vl_prev && (l < 7) && ((w_cur - w_prev) * 10 < w_cur)
+		                                    && ((w_prev - w_cur) * 10 < w_cur);
+
+			/* Fine transition */
+		if (fine)
+		{
+			/* Phase error wrapped to [-pi, pi) by the int32_t cast */
+			int32_t Dpl = (int32_t)(phi_cur - phi_prev - (uint32_t)(w_cur + w_prev) * 40);
+			int32_t Dwl = Dpl / 80;
+
+			/* Phase is phi_prev + (THa + THb * i) * i, its increment
+			 * THa + THb * (2i + 1) grows by 2 * THb each sample, with
+			 * THa = w_prev + Dwl and THb = (w_cur - w_prev) / 160 */
+			uint32_t ph = phi_prev;
+			uint32_t d  = (uint32_t)(w_prev + Dwl + (w_cur - w_prev) / 160);
+			uint32_t dd = (uint32_t)((w_cur - w_prev) / 80);
+
+			int32_t a = Ml_prev;
+			int32_t a_step = (Ml_cur - a) / 80;
+
+			for (i=0; i<80; i++) {
+				sv[i] += ((int64_t)a * _cos_q14(ph) + (1 << 21)) >> 22;
+
+				a  += a_step;
+				ph += d;
+				d  += dd;
+			}
+		}
+
+			/* Coarse transition: Current frame (if voiced) */
+		if (!fine && Vl_cur) {
+			uint32_t w = (uint32_t)w_cur;
+			ambe_osc_q_add(&osc_cur, Ml_cur, phi_cur - 59 * w, w);
+		}
+
+			/* Coarse transition: Previous frame (if voiced) */
+		if (!fine && Vl_prev)
+			ambe_osc_q_add(&osc_prev, Ml_prev, phi_prev, (uint32_t)w_prev);
+	}
+
+	/* Coarse transitions of all bands */
+	ambe_osc_q_run(&osc_cur,  &sv[21], 1,  59);
+	ambe_osc_q_run(&osc_prev, &sv[0],  60, 60);
+}
+
+
+/*! \brief Apply the spectral magnitude enhancement on the subframe
+ *  \param[in] synth Synthesizer state structure
+ *  \param[in] sf Expanded subframe data for subframe to enhance
+ *
+ *  Same as the float version, with the weights written as
+ *  w^4 = Ml^2 / RM0 * 0.96.pi / w0 * (1 + r^2 - 2.r.cos(w0.l)) / (1 - r^2)
+ *  where r = RM1 / RM0. Energies are scaled so the largest one is 30 bits,
+ *  the rest is Q24.
+ */
+void
+ambe_synth_enhance(struct ambe_synth *synth, struct ambe_subframe *sf)
+{
+	uint32_t m_max, w[56];
+	uint64_t e[56], rm0, rm0_inv, g2;
+	int64_t rm1, r, den, kw, t_max;
+	int l, sh;
+
+	/* Scale of the energies */
+	m_max = 0;
+	for (l=0; l<sf->L; l++)
+		if (sf->Ml[l] > m_max)
+			m_max = sf->Ml[l];
+
+	for (sh=0; (m_max >> sh) >= (1 << 15); sh++);
+	for (; m_max && sh <= 0 && (m_max << -sh) < (1 << 14); sh--);
+
+	/* Compute RM0 and RM1 */
+	rm0 = 0;
+	rm1 = 0;
+
+	for (l=0; l<sf->L; l++)
+	{
+		e[l] = (uint64_t)sf->Ml[l] * sf->Ml[l];
+		e[l] = sh >= 0 ? e[l] >> (2 * sh) : e[l] << (-2 * sh);
+		rm0 += e[l];
+		rm1 += (int64_t)e[l] * _cos_q14(sf->w0 * (l+1));
+	}
+
+	rm1 >>= 14;
+
+	if (!rm0)
+		goto done;
+
+	/* Pre compute some constants: 1/RM0 (Q62), r and 1 - r^2 (Q24),
+	 * 0.96.pi / w0 (Q24, w0 being f0 * 2^32) and the largest
+	 * Ml^2 / RM0 * (1 + r^2 - 2.r.cos) not saturating w^4 */
+	rm0_inv = (1ULL << 62) / rm0;
+
+	r = (rm1 << 24) / (int64_t)rm0;
+	den = (1 << 24) - ((r * r) >> 24);
+	if (den < 1)
+		den = 1;
+
+	kw = (((int64_t)48 << 56) / 100) / sf->w0;
+
+	t_max = ((int64_t)AMBE_Q_W4_MAX * den / kw) << 24;
+
+	/* Weights */
+	g2 = 0;
+
+	for (l=0; l<sf->L; l++)
+	{
+		if ( (l+1)*8 <= sf->L ) {
+			w[l] = 1 << 24;
+		} else {
+			int64_t f, x, t, w4;
+
+			/* Ml^2 / RM0 and 1 + r^2 - 2.r.cos(w0.l), Q24 */
+			f = (e[l] * rm0_inv) >> 38;
+			x = (1 << 24) + ((r * r) >> 24)
+			  - ((2 * r * _cos_q14(sf->w0 * (l+1))) >> 14);
+			if (x < 0)
+				x = 0;
+
+			t = f * x;	/* Q48 */
+
+			if (t >= t_max) {
+				w4 = AMBE_Q_W4_MAX;
+			} else {
+				w4 = ((t >> 24) * kw) / den;
+				if (w4 < AMBE_Q_W4_MIN)
+					w4 = AMBE_Q_W4_MIN;
+			}
+
+			w[l] = _root4_q24(w4);
+		}
+
+		g2 += (e[l] * w[l] >> 24) * w[l];
+	}
+
+	/* Compute final gamma and apply it, sqrt(RM0 / sum((w.Ml)^2)) */
+	g2 >>= 24;
+
+	if (g2) {
+		uint64_t gamma = _isqrt64(((rm0 << 24) / g2) << 24);
+
+		for (l=0; l<sf->L; l++)
+		{
+			int64_t v = ((((int64_t)sf->Ml[l] * w[l]) >> 24) * gamma) >> 24;
+			sf->Ml[l] = v < AMBE_Q_ML_MAX ? v : AMBE_Q_ML_MAX;
+		}
+	}
+
+done:
+	/* Update SE, RM0 back to Q0 */
+	synth->SE = (19 * synth->SE + (rm0 >> (28 - 2 * sh))) / 20;
+	if (synth->SE < 10000)
+		synth->SE = 10000;
+}
+
+
+/*! \brief Generate audio for a given subframe
+ *  \param[in] synth Synthesizer state structure
+ *  \param[out] audio Result buffer (80 samples)
+ *  \param[in] sf Expanded subframe data for current subframe
+ *  \param[in] sf_prev Expanded subframe data for prevous subframe
+ */
+void
+ambe_synth_audio(struct ambe_synth *synth, int16_t *audio,
+                 struct ambe_subframe *sf,
+                 struct ambe_subframe *sf_prev)
+{
+	int32_t suv[80], sv[80];
+	int i;
+
+	ambe_synth_unvoiced_q(synth, suv, sf);
+	ambe_synth_voiced_q(synth, sv, sf, sf_prev);
+
+	for (i=0; i<80; i++)
+	{
+		/* (suv + 2 * sv) * 4 with suv in Q4 and sv in Q6, truncated
+		 * toward zero like the float version, and saturated */
+		int64_t v = (int64_t)suv[i] * 16 + (int64_t)sv[i] * 8;
+
+		v = v < 0 ? -(-v >> 6) : (v >> 6);
+
+		audio[i] = v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+	}
+}
+
+#endif /* AMBE_FIXED */
+
+/*! @} */
@@ -17,12 +17,24 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <osmocom/gmr1/codec/codec.h>
 
 
+#define BATCH_MAX_THREADS	64
+#define BATCH_CHUNK_FRAMES	4096	/* 1.3 MB of audio per write() */
+
+
 static const uint8_t wav_hdr[] = {
 	/* WAV header */
 	'R', 'I', 'F', 'F',		/* ChunkID   */
@@ -68,15 +80,367 @@ le16(uint16_t v)
 #endif
 }
 
+
+/* Batch mode ------------------------------------------------------------- */
+
+/*
+ * Many frame files decoded in parallel, one file per worker at a time.
+ * The input is mmap'd, the number of frames is known from its size so
+ * the WAV header is final from the start, and audio is written with
+ * large write() calls directly from the decode buffer.
+ */
+
+struct batch_job {
+	char *in;
+	char *out;
+	int n_frames;
+	int n_bad;
+	int rv;
+};
+
+struct batch_state {
+	struct batch_job *jobs;
+	int n_jobs;
+	int next;
+	pthread_mutex_t lock;
+};
+
+static int
+batch_add(struct batch_state *bs, const char *in, const char *out)
+{
+	struct batch_job *j;
+	const char *ext;
+	int l;
+
+	if (!(bs->n_jobs & 63)) {
+		j = realloc(bs->jobs, sizeof(struct batch_job) * (bs->n_jobs + 64));
+		if (!j)
+			return -ENOMEM;
+		bs->jobs = j;
+	}
+
+	j = &bs->jobs[bs->n_jobs];
+	memset(j, 0x00, sizeof(struct batch_job));
+
+	j->in = strdup(in);
+
+	if (out) {
+		j->out = strdup(out);
+	} else {
+		/* Replace the extension (if any) with .wav */
+		ext = strrchr(in, '.');
+		if (!ext || strchr(ext, '/'))
+			ext = in + strlen(in);
+		l = ext - in;
+
+		j->out = malloc(l + 5);
+		if (j->out)
+			sprintf(j->out, "%.*s.wav", l, in);
+	}
+
+	if (!j->in || !j->out) {
+		free(j->in);
+		free(j->out);
+		return -ENOMEM;
+	}
+
+	bs->n_jobs++;
+
+	return 0;
+}
+
+static int
+batch_load_manifest(struct batch_state *bs, const char *filename)
+{
+	char line[2048], in[1024], out[1024];
+	FILE *fh;
+	int n, rv = 0;
+
+	fh = fopen(filename, "r");
+	if (!fh)
+		return -errno;
+
+	while (fgets(line, sizeof(line), fh))
+	{
+		n = sscanf(line, "%1023s %1023s", in, out);
+		if (n < 1 || in[0] == '#')
+			continue;
+
+		rv = batch_add(bs, in, n > 1 ? out : NULL);
+		if (rv)
+			break;
+	}
+
+	fclose(fh);
+
+	return rv;
+}
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t rv;
+
+	while (len) {
+		rv = write(fd, p, len);
+		if (rv < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += rv;
+		len -= rv;
+	}
+
+	return 0;
+}
+
+static int
+batch_decode(struct gmr1_codec *codec, struct batch_job *j, int16_t *audio)
+{
+	uint8_t hdr[sizeof(wav_hdr)];
+	const uint8_t *in = MAP_FAILED;
+	struct stat st;
+	uint32_t v;
+	int fd_in = -1, fd_out = -1;
+	int f, c, i, rv;
+
+	/* Map the input */
+	fd_in = open(j->in, O_RDONLY);
+	if (fd_in < 0) {
+		rv = -errno;
+		goto err;
+	}
+
+	if (fstat(fd_in, &st)) {
+		rv = -errno;
+		goto err;
+	}
+
+	j->n_frames = st.st_size / 10;
+
+	if (j->n_frames) {
+		in = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd_in, 0);
+		if (in == MAP_FAILED) {
+			rv = -errno;
+			goto err;
+		}
+		madvise((void *)in, st.st_size, MADV_SEQUENTIAL);
+	}
+
+	/* Output with a final header */
+	fd_out = open(j->out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd_out < 0) {
+		rv = -errno;
+		goto err;
+	}
+
+	memcpy(hdr, wav_hdr, sizeof(wav_hdr));
+
+	v = le32(j->n_frames * 320);
+	memcpy(&hdr[40], &v, 4);
+
+	v = le32(j->n_frames * 320 + 36);
+	memcpy(&hdr[4], &v, 4);
+
+	rv = write_all(fd_out, hdr, sizeof(hdr));
+	if (rv)
+		goto err;
+
+	/* Decode by chunks */
+	for (f=0; f<j->n_frames; f+=c)
+	{
+		c = j->n_frames - f;
+		if (c > BATCH_CHUNK_FRAMES)
+			c = BATCH_CHUNK_FRAMES;
+
+		/* Undecodable frames are replaced by silence, the header
+		 * already announced all of them */
+		for (i=0; i<c; i++) {
+			rv = gmr1_codec_decode_frame(codec, &audio[160*i], 160,
+			                             &in[10*(f+i)], 0);
+			if (rv) {
+				memset(&audio[160*i], 0x00, 320);
+				j->n_bad++;
+			}
+		}
+
+		for (i=0; i<160*c; i++)
+			audio[i] = le16(audio[i]);
+
+		rv = write_all(fd_out, audio, 320 * c);
+		if (rv)
+			goto err;
+	}
+
+	rv = 0;
+
+err:
+	if (in != MAP_FAILED)
+		munmap((void *)in, st.st_size);
+
+	if (fd_out >= 0 && close(fd_out) && !rv)
+		rv = -errno;
+
+	if (fd_in >= 0)
+		close(fd_in);
+
+	return rv;
+}
+
+static void *
+batch_worker(void *arg)
+{
+	struct batch_state *bs = arg;
+	struct gmr1_codec *codec;
+	int16_t *audio;
+	int n;
+
+	audio = malloc(sizeof(int16_t) * 160 * BATCH_CHUNK_FRAMES);
+	if (!audio)
+		return NULL;
+
+	while (1)
+	{
+		pthread_mutex_lock(&bs->lock);
+		n = bs->next++;
+		pthread_mutex_unlock(&bs->lock);
+
+		if (n >= bs->n_jobs)
+			break;
+
+		/* Fresh decoder state for each stream */
+		codec = gmr1_codec_alloc();
+		if (!codec) {
+			bs->jobs[n].rv = -ENOMEM;
+			continue;
+		}
+
+		bs->jobs[n].rv = batch_decode(codec, &bs->jobs[n], audio);
+
+		gmr1_codec_release(codec);
+	}
+
+	free(audio);
+
+	return NULL;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+batch_main(int argc, char *argv[])
+{
+	struct batch_state _bs, *bs = &_bs;
+	pthread_t threads[BATCH_MAX_THREADS];
+	double t_start, t_audio;
+	int n_threads, n, i, n_err, n_bad;
+	int rv = 0;
+
+	memset(bs, 0x00, sizeof(struct batch_state));
+	pthread_mutex_init(&bs->lock, NULL);
+
+	n_threads = atoi(argv[2]);
+	if (n_threads < 1 || n_threads > BATCH_MAX_THREADS) {
+		fprintf(stderr, "[!] threads must be within [1,%d]\n", BATCH_MAX_THREADS);
+		return -EINVAL;
+	}
+
+	/* Job list */
+	for (i=3; i<argc; i++) {
+		if (argv[i][0] == '@')
+			rv = batch_load_manifest(bs, &argv[i][1]);
+		else
+			rv = batch_add(bs, argv[i], NULL);
+
+		if (rv) {
+			fprintf(stderr, "[!] Failed to add '%s' (%d)\n", argv[i], rv);
+			goto err;
+		}
+	}
+
+	if (n_threads > bs->n_jobs)
+		n_threads = bs->n_jobs;
+
+	fprintf(stderr, "[+] Decoding %d files, %d threads\n",
+		bs->n_jobs, n_threads);
+
+	/* Go */
+	t_start = now();
+
+	for (i=0, n=0; i<n_threads; i++)
+		if (!pthread_create(&threads[n], NULL, batch_worker, bs))
+			n++;
+
+	if (!n)
+		batch_worker(bs);
+
+	for (i=0; i<n; i++)
+		pthread_join(threads[i], NULL);
+
+	/* Report */
+	t_audio = 0.0;
+	n_err = 0;
+	n_bad = 0;
+
+	for (i=0; i<bs->n_jobs; i++) {
+		struct batch_job *j = &bs->jobs[i];
+
+		if (j->rv) {
+			fprintf(stderr, "[!] %s: failed (%s)\n", j->in, strerror(-j->rv));
+			n_err++;
+		} else {
+			t_audio += j->n_frames * 0.02;
+			n_bad += j->n_bad;
+		}
+	}
+
+	fprintf(stderr, "[+] %d files, %.1f s of audio, %d bad frames, %d errors (%.1fx real time)\n",
+		bs->n_jobs, t_audio, n_bad, n_err, t_audio / (now() - t_start));
+
+	rv = n_err ? -EIO : 0;
+
+err:
+	for (i=0; i<bs->n_jobs; i++) {
+		free(bs->jobs[i].in);
+		free(bs->jobs[i].out);
+	}
+	free(bs->jobs);
+
+	pthread_mutex_destroy(&bs->lock);
+
+	return rv;
+}
+
+
+/* Main ------------------------------------------------------------------- */
+
 int main(int argc, char *argv[])
 {
 	struct gmr1_codec *codec = NULL;
 	FILE *fin, *fout;
 	int is_wave = 0, l, rv;
 
+	/* Batch mode */
+	if ((argc > 1) && !strcmp(argv[1], "-b")) {
+		if (argc < 4) {
+			fprintf(stderr, "Usage: %s -b threads in_file|@manifest ...\n", argv[0]);
+			return -1;
+		}
+		return batch_main(argc, argv);
+	}
+
         /* Arguments */
 	if (argc > 3) {
 		fprintf(stderr, "Usage: %s [in_file [out_file]]\n", argv[0]);
+		fprintf(stderr, "       %s -b threads in_file|@manifest ...\n", argv[0]);
 		return -1;
 	}
 
@@ -0,0 +1,694 @@
+/* GMR-1 uplink RACH burst scanner */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <complex.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <fftw3.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/core/gsmtap_util.h>
+
+#include <osmocom/dsp/cxvec.h>
+#include <osmocom/dsp/cxvec_math.h>
+
+#include <osmocom/gmr1/gsmtap.h>
+#include <osmocom/gmr1/l1/rach.h>
+#include <osmocom/gmr1/sdr/defs.h>
+#include <osmocom/gmr1/sdr/nb.h>
+#include <osmocom/gmr1/sdr/pi4cxpsk.h>
+
+
+#define RSCAN_MAX_THREADS	64
+#define RSCAN_WIN_BLOCKS	16	/* Correlator blocks per window and thread */
+#define RSCAN_MAX_TPL		8
+#define RSCAN_MIN_TPL_SYMS	8	/* Shorter sync chunks are ignored */
+#define RSCAN_SLOT_SYMS		39
+#define RSCAN_FRAME_SLOTS	24
+#define GSMTAP_BATCH_SIZE	64	/* GSMTap messages per sendmmsg */
+#define GSMTAP_BATCH_DELAY_MS	100	/* Max GSMTap queuing delay */
+
+
+static struct gsmtap_inst *g_gti;
+static struct gmr1_gsmtap_batch *g_gtb;
+
+
+/* Sync correlator -------------------------------------------------------- */
+
+/*
+ * Overlap-save FFT correlator against the RACH sync sequences. Each
+ * block of N input samples is transformed once, then multiplied by the
+ * conjugate spectrum of every sync chunk and inverse transformed. The
+ * chunks are combined non coherently so that a residual frequency
+ * error doesn't cancel them, and the result is normalized by the
+ * signal power over the burst so the score is ~1 for a clean burst
+ * whatever the gain of the capture. Only the first V = N - L outputs of
+ * a block are valid, so blocks are independent and run in parallel.
+ *
+ * The input is streamed through a sliding window of S = M * V scored
+ * positions. The window buffer also keeps H samples of history (so a
+ * burst found at the end of the previous window can still be decoded)
+ * and T samples of look-ahead (the correlator overlap and a whole burst
+ * after the last position). Memory use doesn't depend on the capture
+ * length, and bursts are reported as each window completes.
+ */
+
+struct rscan_tpl {
+	int pos;		/* Chunk position (symbols) */
+	int len;		/* Chunk length (symbols) */
+	float complex *H;	/* conj(FFT(chunk)) / N */
+};
+
+struct rscan_cand {
+	long long ofs;		/* Burst start (samples) */
+	float score;
+
+	/* Results */
+	int rv;			/* Demod return */
+	int crc;
+	int conv;
+	uint8_t sb_mask;
+	uint8_t rach[18];
+	float toa;
+	float freq_err;
+};
+
+struct rscan_state {
+	FILE *src;
+	int sps;
+
+	/* Correlator */
+	int N, L, V;
+	int n_blocks;
+	struct rscan_tpl tpl[RSCAN_MAX_TPL];
+	int n_tpl;
+	float tpl_norm;
+	fftwf_plan fwd, inv;
+	float *score;
+
+	/* Sliding window */
+	int S, H, T;
+	float complex *buf;	/* Samples from base - H */
+	int buf_len;
+	long long base;		/* First scored position of the window */
+	long long n_out;	/* Scored positions (-1 until end of input) */
+	int n_score;		/* Scored positions in this window */
+
+	/* Peak picking, carried over windows */
+	long long pk_start;	/* Start of the current peak search, or -1 */
+	long long pk_best;
+	long long pk_skip;	/* No new peak before this position */
+	float pk_best_score;
+
+	/* Detected bursts (in the current window) */
+	struct rscan_cand *cands;
+	int n_cands;
+	int primed;
+
+	/* Work distribution */
+	pthread_mutex_t lock;
+	int next;
+};
+
+static int
+rscan_corr_init(struct rscan_state *ss)
+{
+	struct gmr1_pi4cxpsk_burst *bt = &gmr1_rach_burst;
+	struct gmr1_pi4cxpsk_sync *csync;
+	float complex *a, *b;
+	int i, j, rv = 0;
+
+	/* Template span */
+	ss->L = 0;
+
+	for (csync=bt->sync[0]; csync->pos>=0; csync++) {
+		if (csync->len < RSCAN_MIN_TPL_SYMS)
+			continue;
+		if (ss->n_tpl == RSCAN_MAX_TPL)
+			return -EINVAL;
+
+		ss->tpl[ss->n_tpl].pos = csync->pos;
+		ss->tpl[ss->n_tpl].len = csync->len;
+		ss->tpl_norm += (float)(csync->len * csync->len);
+		ss->n_tpl++;
+
+		if (((csync->pos + csync->len) * ss->sps) > ss->L)
+			ss->L = (csync->pos + csync->len) * ss->sps;
+	}
+
+	if (!ss->n_tpl)
+		return -EINVAL;
+
+	for (ss->N=4096; ss->N < (4 * ss->L); ss->N <<= 1);
+	ss->V = ss->N - ss->L;
+
+	/* Plans (created once, executed concurrently with new-array API) */
+	a = fftwf_malloc(sizeof(float complex) * ss->N);
+	b = fftwf_malloc(sizeof(float complex) * ss->N);
+
+	if (!a || !b) {
+		rv = -ENOMEM;
+		goto err;
+	}
+
+	ss->fwd = fftwf_plan_dft_1d(ss->N, a, b, FFTW_FORWARD, FFTW_MEASURE);
+	ss->inv = fftwf_plan_dft_1d(ss->N, b, b, FFTW_BACKWARD, FFTW_MEASURE);
+
+	/* Chunks spectrum, pi/4 rotation included */
+	for (i=0; i<ss->n_tpl; i++) {
+		struct rscan_tpl *tpl = &ss->tpl[i];
+
+		for (csync=bt->sync[0]; csync->pos != tpl->pos; csync++);
+
+		tpl->H = fftwf_malloc(sizeof(float complex) * ss->N);
+		if (!tpl->H) {
+			rv = -ENOMEM;
+			goto err;
+		}
+
+		memset(a, 0x00, sizeof(float complex) * ss->N);
+
+		for (j=0; j<tpl->len; j++) {
+			int p = tpl->pos + j;
+			a[p * ss->sps] =
+				bt->mod->syms[csync->syms[j]].mod_val *
+				cexpf(I * (M_PIf / 4.0f) * (float)(p & 7));
+		}
+
+		fftwf_execute_dft(ss->fwd, a, tpl->H);
+
+		for (j=0; j<ss->N; j++)
+			tpl->H[j] = conjf(tpl->H[j]) / (float)ss->N;
+	}
+
+err:
+	fftwf_free(b);
+	fftwf_free(a);
+
+	return rv;
+}
+
+static void
+rscan_corr_block(struct rscan_state *ss, int blk,
+                 float complex *x, float complex *X, float complex *y,
+                 float *acc)
+{
+	int N = ss->N, L = ss->L, V = ss->V;
+	int b = blk * V;
+	int n, i, k;
+	float e;
+
+	/* Input block, zero padded at the end of the capture */
+	n = ss->buf_len - (ss->H + b);
+	if (n > N)
+		n = N;
+
+	memcpy(x, &ss->buf[ss->H + b], sizeof(float complex) * n);
+	memset(&x[n], 0x00, sizeof(float complex) * (N - n));
+
+	fftwf_execute_dft(ss->fwd, x, X);
+
+	/* Correlate with each chunk and accumulate energies */
+	memset(acc, 0x00, sizeof(float) * V);
+
+	for (k=0; k<ss->n_tpl; k++) {
+		const float complex *H = ss->tpl[k].H;
+
+		for (i=0; i<N; i++)
+			y[i] = X[i] * H[i];
+
+		fftwf_execute_dft(ss->inv, y, y);
+
+		for (i=0; i<V; i++)
+			acc[i] += crealf(y[i]) * crealf(y[i]) + cimagf(y[i]) * cimagf(y[i]);
+	}
+
+	/* Normalize by sliding power over the template span */
+	for (i=0, e=0.0f; i<L; i++)
+		e += crealf(x[i]) * crealf(x[i]) + cimagf(x[i]) * cimagf(x[i]);
+
+	for (i=0; (i<V) && ((b+i) < ss->n_score); i++) {
+		ss->score[b+i] = (e > 0.0f) ?
+			(acc[i] * L) / (e * ss->tpl_norm) : 0.0f;
+
+		e += crealf(x[i+L]) * crealf(x[i+L]) + cimagf(x[i+L]) * cimagf(x[i+L]);
+		e -= crealf(x[i]) * crealf(x[i]) + cimagf(x[i]) * cimagf(x[i]);
+		if (e < 0.0f)
+			e = 0.0f;
+	}
+}
+
+static void
+rscan_peak_add(struct rscan_state *ss)
+{
+	ss->cands[ss->n_cands].ofs = ss->pk_best;
+	ss->cands[ss->n_cands].score = ss->pk_best_score;
+	ss->n_cands++;
+
+	/* Sidelobes after the peak are skipped with the burst */
+	ss->pk_skip = ss->pk_best + gmr1_rach_burst.len * ss->sps;
+	ss->pk_start = -1;
+}
+
+static void
+rscan_peaks(struct rscan_state *ss, float thresh, int last)
+{
+	long long p;
+	float v;
+	int i;
+
+	for (i=0; i<ss->n_score; i++)
+	{
+		p = ss->base + i;
+		v = ss->score[i];
+
+		/* Sidelobes are within one template span before the main peak */
+		if (ss->pk_start >= 0) {
+			if (p < ss->pk_start + ss->L) {
+				if (v > ss->pk_best_score) {
+					ss->pk_best = p;
+					ss->pk_best_score = v;
+				}
+				continue;
+			}
+
+			rscan_peak_add(ss);
+		}
+
+		if ((p < ss->pk_skip) || (v < thresh))
+			continue;
+
+		ss->pk_start = p;
+		ss->pk_best = p;
+		ss->pk_best_score = v;
+	}
+
+	/* End of input: the last search is complete */
+	if (last && (ss->pk_start >= 0))
+		rscan_peak_add(ss);
+}
+
+
+/* Sliding window --------------------------------------------------------- */
+
+static int
+rscan_win_init(struct rscan_state *ss, int n_threads)
+{
+	int bl = gmr1_rach_burst.len * ss->sps;
+
+	ss->S = RSCAN_WIN_BLOCKS * n_threads * ss->V;
+	ss->H = ss->L + 2 * ss->sps;
+	ss->T = bl + 2 * ss->sps;
+	if (ss->T < ss->L)
+		ss->T = ss->L;
+
+	ss->buf   = malloc(sizeof(float complex) * (ss->H + ss->S + ss->T));
+	ss->score = malloc(sizeof(float) * ss->S);
+	ss->cands = calloc(ss->S / bl + 2, sizeof(struct rscan_cand));
+	if (!ss->buf || !ss->score || !ss->cands)
+		return -ENOMEM;
+
+	/* Nothing before the capture */
+	memset(ss->buf, 0x00, sizeof(float complex) * ss->H);
+	ss->buf_len = ss->H;
+
+	ss->base = 0;
+	ss->n_out = -1;
+	ss->pk_start = -1;
+	ss->pk_skip = 0;
+
+	return 0;
+}
+
+static int
+rscan_win_fill(struct rscan_state *ss, long long *n_samples)
+{
+	int size = ss->H + ss->S + ss->T;
+	size_t n;
+
+	/* Read until the window is full or the input ends */
+	while ((ss->n_out < 0) && (ss->buf_len < size)) {
+		n = fread(&ss->buf[ss->buf_len], sizeof(float complex),
+		          size - ss->buf_len, ss->src);
+
+		ss->buf_len += n;
+		*n_samples += n;
+
+		if (n)
+			continue;
+
+		if (ferror(ss->src))
+			return -EIO;
+
+		ss->n_out = *n_samples - gmr1_rach_burst.len * ss->sps;
+		if (ss->n_out <= 0)
+			return -EINVAL;
+	}
+
+	/* Scored positions */
+	ss->n_score = ss->S;
+
+	if ((ss->n_out >= 0) && ((ss->n_out - ss->base) < ss->S))
+		ss->n_score = ss->n_out > ss->base ? ss->n_out - ss->base : 0;
+
+	ss->n_blocks = (ss->n_score + ss->V - 1) / ss->V;
+
+	return 0;
+}
+
+static void
+rscan_win_next(struct rscan_state *ss)
+{
+	/* Keep the history and the look-ahead */
+	ss->buf_len -= ss->S;
+	memmove(ss->buf, &ss->buf[ss->S], sizeof(float complex) * ss->buf_len);
+
+	ss->base += ss->S;
+	ss->n_cands = 0;
+}
+
+
+/* Burst demodulation / decoding ------------------------------------------ */
+
+static void
+rscan_decode(struct rscan_state *ss, struct rscan_cand *c)
+{
+	struct osmo_cxvec _win, *win = &_win;
+	sbit_t ebits[494];
+	long long b;
+	int l, sync_id;
+
+	/* Window with a +- 2 symbols search range */
+	b = c->ofs - 2 * ss->sps;
+	l = (gmr1_rach_burst.len + 4) * ss->sps;
+
+	if (b < 0) {
+		c->rv = -ERANGE;
+		return;
+	}
+
+	/* Relative to the window buffer */
+	b -= ss->base - ss->H;
+
+	if ((b < 0) || ((b + l) > ss->buf_len)) {
+		c->rv = -ERANGE;
+		return;
+	}
+
+	osmo_cxvec_init_from_data(win, &ss->buf[b], l);
+
+	c->rv = gmr1_pi4cxpsk_demod(
+		&gmr1_rach_burst,
+		win, ss->sps, 0.0f,
+		ebits, &sync_id, &c->toa, &c->freq_err
+	);
+	if (c->rv)
+		return;
+
+	c->crc = gmr1_rach_decode_sb(c->rach, ebits, &c->sb_mask, &c->conv);
+}
+
+
+/* Workers ---------------------------------------------------------------- */
+
+static int
+rscan_next(struct rscan_state *ss)
+{
+	int n;
+
+	pthread_mutex_lock(&ss->lock);
+	n = ss->next++;
+	pthread_mutex_unlock(&ss->lock);
+
+	return n;
+}
+
+static void *
+rscan_corr_worker(void *arg)
+{
+	struct rscan_state *ss = arg;
+	float complex *x, *X, *y;
+	float *acc;
+	int blk;
+
+	x   = fftwf_malloc(sizeof(float complex) * ss->N);
+	X   = fftwf_malloc(sizeof(float complex) * ss->N);
+	y   = fftwf_malloc(sizeof(float complex) * ss->N);
+	acc = malloc(sizeof(float) * ss->V);
+
+	if (x && X && y && acc)
+		while ((blk = rscan_next(ss)) < ss->n_blocks)
+			rscan_corr_block(ss, blk, x, X, y, acc);
+
+	free(acc);
+	fftwf_free(y);
+	fftwf_free(X);
+	fftwf_free(x);
+
+	return NULL;
+}
+
+static void *
+rscan_decode_worker(void *arg)
+{
+	struct rscan_state *ss = arg;
+	int c;
+
+	while ((c = rscan_next(ss)) < ss->n_cands)
+		rscan_decode(ss, &ss->cands[c]);
+
+	return NULL;
+}
+
+static int
+rscan_run(struct rscan_state *ss, void *(*fn)(void *), int first, int n_threads)
+{
+	pthread_t threads[RSCAN_MAX_THREADS];
+	int i, n = 0;
+
+	ss->next = first;
+
+	for (i=0; i<n_threads; i++)
+		if (!pthread_create(&threads[n], NULL, fn, ss))
+			n++;
+
+	if (!n) {
+		/* No threads at all, do it inline */
+		fn(ss);
+		return 0;
+	}
+
+	for (i=0; i<n; i++)
+		pthread_join(threads[i], NULL);
+
+	return 0;
+}
+
+
+/* Main ------------------------------------------------------------------- */
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+	struct rscan_state _ss, *ss = &_ss;
+	double t_start, t_cap;
+	long long n_samples = 0;
+	float thresh;
+	int n_threads, i, n_ok = 0, n_cands = 0, last;
+	int rv = 0;
+
+	memset(ss, 0x00, sizeof(struct rscan_state));
+	pthread_mutex_init(&ss->lock, NULL);
+
+	/* Arg check */
+	if (argc < 3 || argc > 5) {
+		fprintf(stderr, "Usage: %s sps uplink.cfile|- [threads [thresh]]\n", argv[0]);
+		return -EINVAL;
+	}
+
+	ss->sps    = atoi(argv[1]);
+	n_threads  = argc > 3 ? atoi(argv[3]) : 4;
+	thresh     = argc > 4 ? atof(argv[4]) : 0.30f;
+
+	if (ss->sps < 1 || ss->sps > 16) {
+		fprintf(stderr, "[!] sps must be within [1,16]\n");
+		return -EINVAL;
+	}
+
+	if (n_threads < 1 || n_threads > RSCAN_MAX_THREADS) {
+		fprintf(stderr, "[!] threads must be within [1,%d]\n", RSCAN_MAX_THREADS);
+		return -EINVAL;
+	}
+
+	/* Init GSMTap */
+	g_gti = gsmtap_source_init("127.0.0.1", GSMTAP_UDP_PORT, 0);
+	gsmtap_source_add_sink(g_gti);
+
+	g_gtb = gmr1_gsmtap_batch_alloc(g_gti, GSMTAP_BATCH_SIZE, GSMTAP_BATCH_DELAY_MS);
+	if (!g_gtb) {
+		fprintf(stderr, "[!] Failed to init GSMTap output\n");
+		rv = -ENOMEM;
+		goto err;
+	}
+
+	/* Correlator setup */
+	rv = rscan_corr_init(ss);
+	if (rv) {
+		fprintf(stderr, "[!] Failed to init the sync correlator\n");
+		goto err;
+	}
+
+	rv = rscan_win_init(ss, n_threads);
+	if (rv) {
+		fprintf(stderr, "[!] Failed to allocate the scan window\n");
+		goto err;
+	}
+
+	/* Open capture */
+	ss->src = strcmp(argv[2], "-") ? fopen(argv[2], "rb") : stdin;
+	if (!ss->src) {
+		fprintf(stderr, "[!] Failed to open input file\n");
+		rv = -EIO;
+		goto err;
+	}
+
+	fprintf(stderr, "[+] Scanning uplink, FFT %d, %.3f s windows, %d threads\n",
+		ss->N, (double)ss->S / (ss->sps * GMR1_SYM_RATE), n_threads);
+
+	t_start = now();
+
+	do {
+		rv = rscan_win_fill(ss, &n_samples);
+		if (rv) {
+			fprintf(stderr, "[!] %s\n", rv == -EIO ?
+				"Failed to read input file" : "Not enough samples");
+			goto err;
+		}
+
+		last = (ss->n_out >= 0) && (ss->base + ss->S >= ss->n_out);
+
+		/* Sync correlation over the window */
+		rscan_run(ss, rscan_corr_worker, 0, n_threads);
+
+		/* Peak picking */
+		rscan_peaks(ss, thresh, last);
+
+		/* Demod / decode. The sync references are built on first use,
+		 * which isn't thread safe: prime them serially */
+		if (ss->n_cands) {
+			if (!ss->primed)
+				rscan_decode(ss, &ss->cands[0]);
+			rscan_run(ss, rscan_decode_worker, !ss->primed, n_threads);
+			ss->primed = 1;
+		}
+
+		/* Report, in time order */
+		for (i=0; i<ss->n_cands; i++) {
+			struct rscan_cand *c = &ss->cands[i];
+			long long sym = c->ofs / ss->sps;
+			int fn = sym / (RSCAN_SLOT_SYMS * RSCAN_FRAME_SLOTS);
+			int tn = (sym / RSCAN_SLOT_SYMS) % RSCAN_FRAME_SLOTS;
+
+			if (c->rv) {
+				fprintf(stderr, "[!] RACH @%lld (%.3f ms) demod failed (%d)\n",
+					c->ofs, 1000.0 * sym / GMR1_SYM_RATE, c->rv);
+				continue;
+			}
+
+			fprintf(stderr, "[.] RACH @%lld (%.3f ms) fn=%d tn=%d score=%.2f toa=%.1f\n",
+				c->ofs, 1000.0 * sym / GMR1_SYM_RATE, fn, tn, c->score, c->toa);
+			fprintf(stderr, "crc=%d, conv=%d, sb_mask=%02x\n",
+				c->crc, c->conv, c->sb_mask);
+
+			if (c->crc)
+				continue;
+
+			fprintf(stderr, "rach=%s\n", osmo_hexdump_nospc(c->rach, 18));
+
+			gmr1_gsmtap_batch_send(g_gtb,
+				GSMTAP_GMR1_RACH, fn, tn, c->rach, 18);
+
+			n_ok++;
+		}
+
+		n_cands += ss->n_cands;
+
+		/* Don't hold GSMTap frames longer than asked */
+		gmr1_gsmtap_batch_poll(g_gtb);
+
+		rscan_win_next(ss);
+	} while (!last);
+
+	t_cap = (double)n_samples / (ss->sps * GMR1_SYM_RATE);
+
+	fprintf(stderr, "[+] %d RACH decoded, %d candidates in %.3f s (%.1fx real time)\n",
+		n_ok, n_cands, t_cap, t_cap / (now() - t_start));
+
+	/* Done ! */
+	rv = 0;
+
+	/* Clean up */
+err:
+	if (g_gtb) {
+		struct gmr1_gsmtap_stats st;
+
+		gmr1_gsmtap_batch_flush(g_gtb);
+		gmr1_gsmtap_batch_stats(g_gtb, &st);
+		fprintf(stderr, "[+] GSMTap: %lu sent in %lu batches, %lu dropped (pool %lu, socket %lu)\n",
+			st.sent, st.flushes, st.drop_pool + st.drop_send,
+			st.drop_pool, st.drop_send);
+
+		gmr1_gsmtap_batch_release(g_gtb);
+	}
+
+	if (ss->src && (ss->src != stdin))
+		fclose(ss->src);
+
+	free(ss->cands);
+	free(ss->score);
+	free(ss->buf);
+
+	for (i=0; i<ss->n_tpl; i++)
+		fftwf_free(ss->tpl[i].H);
+
+	if (ss->inv)
+		fftwf_destroy_plan(ss->inv);
+
+	if (ss->fwd)
+		fftwf_destroy_plan(ss->fwd);
+
+	pthread_mutex_destroy(&ss->lock);
+
+	return rv;
+}
@@ -20,6 +20,7 @@
 #include <complex.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -34,6 +35,7 @@
 #include <osmocom/dsp/cxvec_math.h>
 
 #include <osmocom/gmr1/gsmtap.h>
+#include <osmocom/gmr1/codec/codec.h>
 #include <osmocom/gmr1/l1/a5.h>
 #include <osmocom/gmr1/l1/bcch.h>
 #include <osmocom/gmr1/l1/ccch.h>
@@ -51,8 +53,18 @@
 
 #define START_DISCARD	8000
 
+#define TCH3_SPEECH_BAD_BITS	5	/* Max corrected bits (/72) of a good frame */
+#define WAV_QUEUE_MAX		1024	/* Pending 40 ms blocks, all calls */
+#define GSMTAP_BATCH_SIZE	64	/* GSMTap messages per sendmmsg */
+#define GSMTAP_BATCH_DELAY_MS	100	/* Max GSMTap queuing delay */
+
 
 static struct gsmtap_inst *g_gti;
+static struct gmr1_gsmtap_batch *g_gtb;
+static struct gmr1_gsmtap_pcap *g_pcap;
+static unsigned long g_pcap_drop;
+static const char *g_wav_prefix = "call_";
+static int g_call_cnt;
 
 
 struct tch3_state {
@@ -70,6 +82,11 @@ struct tch3_state {
 
 	int weak_cnt;
 
+	/* Speech */
+	struct gmr1_codec *codec;
+	struct wav_out *wav;
+	int audio_done;
+
 	/* FACCH state */
 	sbit_t ebits[104*4];
 	uint32_t bi_fn[4];
@@ -86,6 +103,9 @@ struct tch9_state {
 
 	/* Interleaver */
 	struct gmr1_interleaver il;
+
+	/* Rate selection (no signaling of it in the bursts) */
+	struct gmr1_tch9_rate rate;
 };
 
 struct chan_desc {
@@ -121,6 +141,12 @@ to_ms(struct chan_desc *cd, int s)
 	return (1000.0f * (float)s) / (cd->sps * GMR1_SYM_RATE);
 }
 
+static inline uint64_t
+to_ns(struct chan_desc *cd, int s)
+{
+	return ((uint64_t)s * 1000000000ULL) / (cd->sps * GMR1_SYM_RATE);
+}
+
 static inline float
 to_hz(float f_rps)
 {
@@ -133,6 +159,24 @@ to_db(float v)
 	return 10.0f * log10f(v);
 }
 
+/* GSMTap frames go to the pcap file if any (timestamped by their sample
+ * offset, so the file only depends on the input), to UDP otherwise. The
+ * FCCH channels are processed one after the other over the whole
+ * capture, the pcap writer puts their frames back in time order when
+ * closing the file. Over UDP they go out as they are decoded, channel
+ * after channel. */
+static void
+gsmtap_out(struct chan_desc *cd, uint8_t chan_type, uint32_t fn, uint8_t tn,
+           const uint8_t *l2, int len)
+{
+	if (g_pcap) {
+		if (gmr1_gsmtap_pcap_write(g_pcap, to_ns(cd, cd->align),
+		                           chan_type, fn, tn, l2, len))
+			g_pcap_drop++;
+	} else
+		gmr1_gsmtap_batch_send(g_gtb, chan_type, fn, tn, l2, len);
+}
+
 static int
 win_map(struct osmo_cxvec *win, struct cfile *cf, int begin, int len)
 {
@@ -180,6 +224,253 @@ burst_energy(struct osmo_cxvec *burst)
 }
 
 
+/* Asynchronous WAV writer ------------------------------------------------ */
+
+/*
+ * Decoding is done inline, but all the file I/O happens in a single
+ * writer thread fed through a bounded queue. A WAV is opened on its
+ * first block and its header is fixed up when the call is closed, so
+ * the audio of a call is available as the capture is processed.
+ */
+
+struct wav_out {
+	char *filename;
+	FILE *fh;
+	uint32_t n_samples;
+};
+
+struct wav_msg {
+	struct wav_msg *next;
+	struct wav_out *wo;
+	int close;
+	int n;
+	int16_t audio[320];
+};
+
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond_data;
+	pthread_cond_t cond_space;
+	struct wav_msg *head, *tail;
+	int len;
+	int stop;
+	int running;
+} g_wav = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond_data = PTHREAD_COND_INITIALIZER,
+	.cond_space = PTHREAD_COND_INITIALIZER,
+};
+
+static void
+_wav_put_le(uint8_t *p, uint32_t v, int n)
+{
+	int i;
+	for (i=0; i<n; i++)
+		p[i] = (v >> (8*i)) & 0xff;
+}
+
+static void
+_wav_header(uint8_t *hdr, uint32_t n_samples)
+{
+	memcpy(&hdr[0], "RIFF", 4);
+	_wav_put_le(&hdr[4], 36 + 2 * n_samples, 4);	/* ChunkSize */
+	memcpy(&hdr[8], "WAVEfmt ", 8);
+	_wav_put_le(&hdr[16], 16, 4);			/* Subchunk1Size */
+	_wav_put_le(&hdr[20], 1, 2);			/* AudioFormat: PCM */
+	_wav_put_le(&hdr[22], 1, 2);			/* NumChannels: Mono */
+	_wav_put_le(&hdr[24], 8000, 4);			/* SampleRate */
+	_wav_put_le(&hdr[28], 16000, 4);		/* ByteRate */
+	_wav_put_le(&hdr[32], 2, 2);			/* BlockAlign */
+	_wav_put_le(&hdr[34], 16, 2);			/* BitsPerSample */
+	memcpy(&hdr[36], "data", 4);
+	_wav_put_le(&hdr[40], 2 * n_samples, 4);	/* Subchunk2Size */
+}
+
+static void
+_wav_process(struct wav_msg *m)
+{
+	struct wav_out *wo = m->wo;
+	uint8_t buf[640];
+	int i;
+
+	/* Open on first use */
+	if (!wo->fh && !m->close) {
+		wo->fh = fopen(wo->filename, "wb");
+		if (!wo->fh)
+			fprintf(stderr, "[!] Unable to open '%s'\n", wo->filename);
+		else {
+			_wav_header(buf, 0);
+			fwrite(buf, 44, 1, wo->fh);
+		}
+	}
+
+	if (!m->close) {
+		if (!wo->fh)
+			return;
+
+		for (i=0; i<m->n; i++)
+			_wav_put_le(&buf[2*i], (uint16_t)m->audio[i], 2);
+
+		if (fwrite(buf, 2, m->n, wo->fh) == m->n)
+			wo->n_samples += m->n;
+
+		return;
+	}
+
+	/* Close: fix the header and release */
+	if (wo->fh) {
+		_wav_header(buf, wo->n_samples);
+		if (!fseek(wo->fh, 0, SEEK_SET))
+			fwrite(buf, 44, 1, wo->fh);
+		fclose(wo->fh);
+
+		fprintf(stderr, "[+] Wrote %s (%.2f s)\n",
+			wo->filename, wo->n_samples / 8000.0f);
+	}
+
+	free(wo->filename);
+	free(wo);
+}
+
+static void *
+wav_writer_thread(void *arg)
+{
+	struct wav_msg *m;
+
+	pthread_mutex_lock(&g_wav.lock);
+
+	while (1)
+	{
+		while (!g_wav.head && !g_wav.stop)
+			pthread_cond_wait(&g_wav.cond_data, &g_wav.lock);
+
+		m = g_wav.head;
+		if (!m)
+			break;	/* stop requested and queue drained */
+
+		g_wav.head = m->next;
+		if (!g_wav.head)
+			g_wav.tail = NULL;
+		g_wav.len--;
+
+		pthread_cond_signal(&g_wav.cond_space);
+		pthread_mutex_unlock(&g_wav.lock);
+
+		_wav_process(m);
+		free(m);
+
+		pthread_mutex_lock(&g_wav.lock);
+	}
+
+	pthread_mutex_unlock(&g_wav.lock);
+
+	return NULL;
+}
+
+static void
+wav_queue(struct wav_msg *m)
+{
+	/* No thread: write synchronously */
+	if (!g_wav.running) {
+		_wav_process(m);
+		free(m);
+		return;
+	}
+
+	pthread_mutex_lock(&g_wav.lock);
+
+	while (g_wav.len >= WAV_QUEUE_MAX)
+		pthread_cond_wait(&g_wav.cond_space, &g_wav.lock);
+
+	m->next = NULL;
+	if (g_wav.tail)
+		g_wav.tail->next = m;
+	else
+		g_wav.head = m;
+	g_wav.tail = m;
+	g_wav.len++;
+
+	pthread_cond_signal(&g_wav.cond_data);
+	pthread_mutex_unlock(&g_wav.lock);
+}
+
+static void
+wav_writer_start(void)
+{
+	g_wav.running = !pthread_create(&g_wav.thread, NULL, wav_writer_thread, NULL);
+	if (!g_wav.running)
+		fprintf(stderr, "[!] No WAV writer thread, writing inline\n");
+}
+
+static void
+wav_writer_stop(void)
+{
+	if (!g_wav.running)
+		return;
+
+	pthread_mutex_lock(&g_wav.lock);
+	g_wav.stop = 1;
+	pthread_cond_signal(&g_wav.cond_data);
+	pthread_mutex_unlock(&g_wav.lock);
+
+	pthread_join(g_wav.thread, NULL);
+	g_wav.running = 0;
+}
+
+static struct wav_out *
+wav_out_open(const char *filename)
+{
+	struct wav_out *wo;
+
+	wo = calloc(1, sizeof(struct wav_out));
+	if (!wo)
+		return NULL;
+
+	wo->filename = strdup(filename);
+	if (!wo->filename) {
+		free(wo);
+		return NULL;
+	}
+
+	return wo;
+}
+
+static void
+wav_out_write(struct wav_out *wo, const int16_t *audio, int n)
+{
+	struct wav_msg *m;
+
+	m = malloc(sizeof(struct wav_msg));
+	if (!m)
+		return;
+
+	m->wo = wo;
+	m->close = 0;
+	m->n = n > 320 ? 320 : n;
+	memcpy(m->audio, audio, sizeof(int16_t) * m->n);
+
+	wav_queue(m);
+}
+
+static void
+wav_out_close(struct wav_out *wo)
+{
+	struct wav_msg *m;
+
+	m = calloc(1, sizeof(struct wav_msg));
+	if (!m) {
+		/* Can't be queued, leak the stream rather than race */
+		return;
+	}
+
+	m->wo = wo;
+	m->close = 1;
+
+	wav_queue(m);
+}
+
+
 /* Message parsing -------------------------------------------------------- */
 
 static int
@@ -251,6 +542,18 @@ facch3_ass_cmd_1_parse(const uint8_t *l2, int *rx_tn)
 
 /* TCH9 Procesing --------------------------------------------------------- */
 
+static const int tch9_l2_len[GMR1_TCH9_MAX] = {
+	[GMR1_TCH9_2k4] = 18,
+	[GMR1_TCH9_4k8] = 30,
+	[GMR1_TCH9_9k6] = 60,
+};
+
+static const char *tch9_rate_name[GMR1_TCH9_MAX] = {
+	[GMR1_TCH9_2k4] = "2k4",
+	[GMR1_TCH9_4k8] = "4k8",
+	[GMR1_TCH9_9k6] = "9k6",
+};
+
 static void
 rx_tch9_init(struct chan_desc *cd, const uint8_t *ass_cmd)
 {
@@ -262,6 +565,9 @@ rx_tch9_init(struct chan_desc *cd, const uint8_t *ass_cmd)
 
 	/* Init interleaver */
 	gmr1_interleaver_init(&cd->tch9_state.il, 3, 648);
+
+	/* Init rate selection */
+	gmr1_tch9_rate_init(&cd->tch9_state.rate);
 }
 
 static int
@@ -306,11 +612,12 @@ rx_tch9(struct chan_desc *cd)
 
 		/* Send to GSMTap if correct */
 		if (!crc)
-			gsmtap_sendmsg(g_gti, gmr1_gsmtap_makemsg(
+			gsmtap_out(cd,
 				GSMTAP_GMR1_TCH9 | GSMTAP_GMR1_FACCH,
-				cd->fn, cd->tch9_state.tn, l2, 38));
+				cd->fn, cd->tch9_state.tn, l2, 38);
 	} else { /* TCH9 */
 		uint8_t l2[60];
+		enum gmr1_tch9_mode mode;
 		int i, s = 0;
 
 		/* Generate cipher stream */
@@ -320,21 +627,25 @@ rx_tch9(struct chan_desc *cd)
 			s += ebits[i] < 0 ? -ebits[i] : ebits[i];
 		s /= 662;
 
-		/* Decode */
-		gmr1_tch9_decode(l2, bits_sacch, bits_status, ebits, GMR1_TCH9_9k6, ciph, &cd->tch9_state.il, &conv);
-		fprintf(stderr, "fn=%d, conv9=%d, avg=%d\n", cd->fn, conv, s);
+		/* Decode (rate is auto-detected and locked) */
+		mode = gmr1_tch9_decode_auto(l2, bits_sacch, bits_status, ebits, ciph,
+		                             &cd->tch9_state.il, &cd->tch9_state.rate,
+		                             &conv);
+		fprintf(stderr, "fn=%d, rate=%s%s, conv=%d, avg=%d\n", cd->fn,
+			tch9_rate_name[mode],
+			cd->tch9_state.rate.locked ? " (locked)" : "", conv, s);
 
 		/* Forward to GSMTap (no CRC to validate :( ) */
-		gsmtap_sendmsg(g_gti, gmr1_gsmtap_makemsg(
+		gsmtap_out(cd,
 			GSMTAP_GMR1_TCH9,
-			cd->fn, cd->tch9_state.tn, l2, 60));
+			cd->fn, cd->tch9_state.tn, l2, tch9_l2_len[mode]);
 
 		/* Save to file */
 		{
 			static FILE *f = NULL;
 			if (!f)
 				f = fopen("/tmp/csd.data", "wb");
-			fwrite(l2, 60, 1, f);
+			fwrite(l2, tch9_l2_len[mode], 1, f);
 		}
 	}
 
@@ -346,9 +657,32 @@ rx_tch9(struct chan_desc *cd)
 
 /* TCH3 Procesing --------------------------------------------------------- */
 
+static void
+rx_tch3_fini(struct chan_desc *cd)
+{
+	struct tch3_state *st = &cd->tch3_state;
+
+	st->active = 0;
+
+	if (st->wav) {
+		wav_out_close(st->wav);
+		st->wav = NULL;
+	}
+
+	if (st->codec) {
+		gmr1_codec_release(st->codec);
+		st->codec = NULL;
+	}
+}
+
 static void
 rx_tch3_init(struct chan_desc *cd, const uint8_t *imm_ass, float ref_energy)
 {
+	char filename[256];
+
+	/* Previous call on this channel is over */
+	rx_tch3_fini(cd);
+
 	/* Activate */
 	cd->tch3_state.active = 1;
 
@@ -364,6 +698,53 @@ rx_tch3_init(struct chan_desc *cd, const uint8_t *imm_ass, float ref_energy)
 	/* Init FACCH state */
 	cd->tch3_state.sync_id = 0;
 	memset(&cd->tch3_state.ebits, 0x00, sizeof(sbit_t) * 104 * 4);
+
+	/* Speech decoder and audio output for this call */
+	if (!cd->tch)
+		return;
+
+	snprintf(filename, sizeof(filename), "%s%03d_fn%d_tn%d.wav",
+		g_wav_prefix, ++g_call_cnt, cd->fn, cd->tch3_state.tn);
+
+	cd->tch3_state.codec = gmr1_codec_alloc();
+	cd->tch3_state.wav = wav_out_open(filename);
+
+	if (!cd->tch3_state.codec || !cd->tch3_state.wav)
+		fprintf(stderr, "[!] No audio output for this call\n");
+	else
+		fprintf(stderr, "[+] Call audio to %s\n", filename);
+}
+
+static void
+_rx_tch3_audio(struct chan_desc *cd, const uint8_t *frame0, const uint8_t *frame1,
+               const int *bad)
+{
+	struct tch3_state *st = &cd->tch3_state;
+	int16_t audio[320];
+	int rv;
+
+	st->audio_done = 1;
+
+	if (!st->codec || !st->wav)
+		return;
+
+	/* Both speech frames of the burst, or DTX if there is none */
+	if (frame0) {
+		rv = gmr1_codec_decode_frame(st->codec, &audio[0], 160,
+		                             frame0, bad[0]);
+		if (rv)
+			gmr1_codec_decode_dtx(st->codec, &audio[0], 160);
+
+		rv = gmr1_codec_decode_frame(st->codec, &audio[160], 160,
+		                             frame1, bad[1]);
+		if (rv)
+			gmr1_codec_decode_dtx(st->codec, &audio[160], 160);
+	} else {
+		gmr1_codec_decode_dtx(st->codec, &audio[0],   160);
+		gmr1_codec_decode_dtx(st->codec, &audio[160], 160);
+	}
+
+	wav_out_write(st->wav, audio, 320);
 }
 
 static int
@@ -420,9 +801,9 @@ _rx_tch3_facch_flush(struct chan_desc *cd)
 
 	/* Send to GSMTap if correct */
 	if (!crc)
-		gsmtap_sendmsg(g_gti, gmr1_gsmtap_makemsg(
+		gsmtap_out(cd,
 			GSMTAP_GMR1_TCH3 | GSMTAP_GMR1_FACCH,
-			cd->fn-3, st->tn, l2, 10));
+			cd->fn-3, st->tn, l2, 10);
 
 	/* Parse for assignement */
 	if (!crc && facch3_is_ass_cmd_1(l2))
@@ -484,13 +865,42 @@ _rx_tch3_facch(struct chan_desc *cd, struct osmo_cxvec *burst)
 	return 0;
 }
 
+/* The Viterbi metric depends on the soft bits amplitude, so the frames
+ * are re-encoded and the bits the decoder corrected are counted instead.
+ * Only the 72 convolutional coded bits of a frame can differ. */
+static void
+_rx_tch3_bit_errors(int *err, const sbit_t *ebits, const ubit_t *ciph,
+                    const uint8_t *frame0, const uint8_t *frame1,
+                    const ubit_t *sbits)
+{
+	ubit_t bits[212];
+	int i, p;
+
+	gmr1_tch3_encode(bits, frame0, frame1, sbits, ciph, 0);
+
+	err[0] = err[1] = 0;
+
+	for (i=0; i<212; i++)
+	{
+		/* Status bits, and erased bits */
+		if ((i >= 52 && i < 56) || !ebits[i])
+			continue;
+
+		/* Both frames are interleaved bit by bit (m=0) */
+		p = i < 52 ? i : i - 4;
+
+		if ((ebits[i] < 0) != bits[i])
+			err[p & 1]++;
+	}
+}
+
 static int
 _rx_tch3_speech(struct chan_desc *cd, struct osmo_cxvec *burst)
 {
 	sbit_t ebits[212];
 	ubit_t sbits[4], ciph[208];
 	uint8_t frame0[10], frame1[10];
-	int rv, conv[2];
+	int rv, conv[2], err[2], bad[2];
 	float toa;
 
 	/* Debug */
@@ -510,17 +920,26 @@ _rx_tch3_speech(struct chan_desc *cd, struct osmo_cxvec *burst)
 
 	gmr1_tch3_decode(frame0, frame1, sbits, ebits, ciph, 0, &conv[0], &conv[1]);
 
+	_rx_tch3_bit_errors(err, ebits, ciph, frame0, frame1, sbits);
+
+	bad[0] = err[0] > TCH3_SPEECH_BAD_BITS;
+	bad[1] = err[1] > TCH3_SPEECH_BAD_BITS;
+
 	/* More debug */
 	fprintf(stderr, "toa=%.1f\n", toa);
-	fprintf(stderr, "conv=%3d,%3d\n", conv[0], conv[1]);
+	fprintf(stderr, "conv=%3d,%3d err=%2d,%2d%s\n", conv[0], conv[1],
+		err[0], err[1], (bad[0] || bad[1]) ? " bad" : "");
 	fprintf(stderr, "frame0=%s\n", osmo_hexdump_nospc(frame0, 10));
 	fprintf(stderr, "frame1=%s\n", osmo_hexdump_nospc(frame1, 10));
 
+	/* Speech */
+	_rx_tch3_audio(cd, frame0, frame1, bad);
+
 	return 0;
 }
 
 static int
-rx_tch3(struct chan_desc *cd)
+_rx_tch3(struct chan_desc *cd)
 {
 	static struct gmr1_pi4cxpsk_burst *burst_types[] = {
 		&gmr1_nt3_facch_burst,
@@ -532,10 +951,6 @@ rx_tch3(struct chan_desc *cd)
 	int e_toa, rv, btid, sid;
 	float be, det, toa;
 
-	/* Is TCH active at all ? */
-	if (!cd->tch3_state.active)
-		return 0;
-
 	/* Map potential burst (use FACCH3 as reference) */
 	e_toa = burst_map(burst, cd, &gmr1_nt3_facch_burst,
 	                  cd->tch3_state.tn, cd->sps + (cd->sps/2), 1);
@@ -590,6 +1005,31 @@ rx_tch3(struct chan_desc *cd)
 	return rv;
 }
 
+static int
+rx_tch3(struct chan_desc *cd)
+{
+	int rv;
+
+	/* Is TCH active at all ? */
+	if (!cd->tch3_state.active)
+		return 0;
+
+	/* Process the burst */
+	cd->tch3_state.audio_done = 0;
+
+	rv = _rx_tch3(cd);
+
+	/* DKAB, FACCH or lost burst: comfort audio to keep the call timing */
+	if (!cd->tch3_state.audio_done)
+		_rx_tch3_audio(cd, NULL, NULL, NULL);
+
+	/* End of call ? */
+	if (!cd->tch3_state.active)
+		rx_tch3_fini(cd);
+
+	return rv;
+}
+
 
 /* Procesing -------------------------------------------------------------- */
 
@@ -787,9 +1227,9 @@ rx_bcch(struct chan_desc *cd, float *energy)
 
 	/* Send to GSMTap if correct */
 	if (!crc)
-		gsmtap_sendmsg(g_gti, gmr1_gsmtap_makemsg(
+		gsmtap_out(cd,
 			GSMTAP_GMR1_BCCH,
-			cd->fn, cd->sa_bcch_stn, l2, 24));
+			cd->fn, cd->sa_bcch_stn, l2, 24);
 
 	return 0;
 }
@@ -839,9 +1279,9 @@ rx_ccch(struct chan_desc *cd, float min_energy)
 
 	/* Send to GSMTap if correct */
 	if (!crc)
-		gsmtap_sendmsg(g_gti, gmr1_gsmtap_makemsg(
+		gsmtap_out(cd,
 			GSMTAP_GMR1_CCCH,
-			cd->fn, cd->sa_bcch_stn, l2, 24));
+			cd->fn, cd->sa_bcch_stn, l2, 24);
 
 	return 0;
 }
@@ -878,6 +1318,10 @@ process_bcch(struct chan_desc *cd)
 		rx_tch3(cd);
 		rx_tch9(cd);
 
+		/* Don't hold GSMTap frames longer than asked */
+		if (g_gtb)
+			gmr1_gsmtap_batch_poll(g_gtb);
+
 		/* Next frame */
 		cd->fn++;
 		cd->align += frame_len;
@@ -888,6 +1332,9 @@ process_bcch(struct chan_desc *cd)
 			break;
 	}
 
+	/* Close any call still going on at the end of the capture */
+	rx_tch3_fini(cd);
+
 	return 0;
 }
 
@@ -897,6 +1344,7 @@ process_bcch(struct chan_desc *cd)
 int main(int argc, char *argv[])
 {
 	struct chan_desc _cd, *cd = &_cd;
+	const char *pcap_file = NULL;
 	int rv=0;
 
 	/* Init channel description */
@@ -906,8 +1354,15 @@ int main(int argc, char *argv[])
 	cd->freq_err = 0.0f;
 
 	/* Arg check */
-	if (argc < 3 || argc > 6) {
-		fprintf(stderr, "Usage: %s sps bcch.cfile [tch.cfile [key [tch_csd.cfile]]]\n", argv[0]);
+	if ((argc > 2) && !strcmp(argv[1], "-p")) {
+		pcap_file = argv[2];
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+
+	if (argc < 3 || argc > 7) {
+		fprintf(stderr, "Usage: %s [-p gsmtap.pcap] sps bcch.cfile [tch.cfile [key [tch_csd.cfile|- [wav_prefix]]]]\n", argv[0]);
 		return -EINVAL;
 	}
 
@@ -942,7 +1397,7 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (argc > 5) {
+	if (argc > 5 && strcmp(argv[5], "-")) {
 		cd->tch_csd = cfile_load(argv[5]);
 		if (!cd->tch_csd) {
 			fprintf(stderr, "[!] Failed to load tch CSD input file\n");
@@ -951,9 +1406,31 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	/* Init GSMTap */
-	g_gti = gsmtap_source_init("127.0.0.1", GSMTAP_UDP_PORT, 0);
-	gsmtap_source_add_sink(g_gti);
+	if (argc > 6)
+		g_wav_prefix = argv[6];
+
+	/* Call audio goes through the writer thread */
+	wav_writer_start();
+
+	/* Init GSMTap, to a file or over UDP */
+	if (pcap_file) {
+		g_pcap = gmr1_gsmtap_pcap_open(pcap_file);
+		if (!g_pcap) {
+			fprintf(stderr, "[!] Failed to create pcap file\n");
+			rv = -EIO;
+			goto err;
+		}
+	} else {
+		g_gti = gsmtap_source_init("127.0.0.1", GSMTAP_UDP_PORT, 0);
+		gsmtap_source_add_sink(g_gti);
+
+		g_gtb = gmr1_gsmtap_batch_alloc(g_gti, GSMTAP_BATCH_SIZE, GSMTAP_BATCH_DELAY_MS);
+		if (!g_gtb) {
+			fprintf(stderr, "[!] Failed to init GSMTap output\n");
+			rv = -ENOMEM;
+			goto err;
+		}
+	}
 
 	/* Use best FCCH for inital sync / freq error */
 	rv = fcch_single_init(cd);
@@ -975,6 +1452,35 @@ int main(int argc, char *argv[])
 
 	/* Clean up */
 err:
+	wav_writer_stop();
+
+	if (g_gtb) {
+		struct gmr1_gsmtap_stats st;
+
+		gmr1_gsmtap_batch_flush(g_gtb);
+		gmr1_gsmtap_batch_stats(g_gtb, &st);
+		fprintf(stderr, "[+] GSMTap: %lu sent in %lu batches, %lu dropped (pool %lu, socket %lu)\n",
+			st.sent, st.flushes, st.drop_pool + st.drop_send,
+			st.drop_pool, st.drop_send);
+
+		gmr1_gsmtap_batch_release(g_gtb);
+	}
+
+	if (g_pcap) {
+		int prv = gmr1_gsmtap_pcap_close(g_pcap);
+
+		if (g_pcap_drop)
+			fprintf(stderr, "[!] pcap: %lu frames could not be written\n",
+				g_pcap_drop);
+
+		if (prv == -ENOMEM) {
+			fprintf(stderr, "[!] pcap: out of memory, frames left in decode order\n");
+		} else if (prv) {
+			fprintf(stderr, "[!] Failed to write pcap file\n");
+			rv = rv ? rv : -EIO;
+		}
+	}
+
 	if (cd->tch_csd)
 		cfile_release(cd->tch_csd);
 
@@ -0,0 +1,501 @@
+/* GMR-1 wideband BCCH scanner */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <complex.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fftw3.h>
+
+#include <osmocom/dsp/cfile.h>
+#include <osmocom/dsp/cxvec.h>
+#include <osmocom/dsp/cxvec_math.h>
+
+#include <osmocom/gmr1/sdr/defs.h>
+#include <osmocom/gmr1/sdr/fcch.h>
+
+
+#define ARFCN_MIN		1
+#define ARFCN_MAX		1087
+#define ARFCN_DL_BASE		1525.0e6
+#define ARFCN_SPACING		31250.0
+
+#define SCAN_DURATION_MS	700	/* > 650 ms needed by rough_multi */
+#define SCAN_PASSBAND		16000.0f
+#define SCAN_STOPBAND		20000.0f
+#define SCAN_MAX_FFT		(1 << 22)
+#define SCAN_MAX_THREADS	64
+
+
+/* Channelizer ------------------------------------------------------------ */
+
+/*
+ * Overlap-save FFT filterbank. Each block of Nb input samples (50 %
+ * overlap) is transformed once, then for every channel the Ns bins around
+ * its center are windowed and inverse transformed, which filters, mixes
+ * and resamples to exactly sps * GMR1_SYM_RATE in a single step.
+ * Nb / Ns is the (reduced) input to output rate ratio so both are
+ * integers and blocks can be processed independently. The window is
+ * zero-phase so only the middle half of each output block is kept.
+ */
+
+struct scan_chan {
+	int arfcn;
+	double freq;		/* Absolute center frequency (Hz) */
+	int bin;		/* Center bin in the large FFT */
+	float freq_shift;	/* Residual shift to apply (rad/sym) */
+
+	struct osmo_cxvec *samples;
+
+	/* Results */
+	int n_fcch;
+	float snr;
+	float freq_err;
+	int toa;
+};
+
+struct scan_state {
+	struct cfile *src;
+	int sps;
+
+	/* Filterbank */
+	int Nb, Ns;		/* Large / small FFT sizes */
+	int n_blocks;
+	float *win;		/* Ns taps frequency domain window */
+	fftwf_plan fwd, inv;
+
+	/* Channels */
+	struct scan_chan *chans;
+	int n_chans;
+
+	/* Work distribution */
+	pthread_mutex_t lock;
+	int next;
+};
+
+static long
+gcd(long a, long b)
+{
+	while (b) {
+		long t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static int
+scan_fb_init(struct scan_state *ss, long fs)
+{
+	long out_rate, g, p, q;
+	float df;
+	int i, m;
+
+	out_rate = (long)ss->sps * GMR1_SYM_RATE;
+	if (out_rate >= fs)
+		return -EINVAL;
+
+	g = gcd(out_rate, fs);
+	p = out_rate / g;
+	q = fs / g;
+
+	/* Smallest multiple giving decent frequency resolution */
+	for (m=1; (4*q*m) < 4096; m++);
+
+	if ((4*q*m) > SCAN_MAX_FFT)
+		return -EINVAL;
+
+	ss->Nb = 4 * q * m;
+	ss->Ns = 4 * p * m;
+
+	/* Frequency domain window (flat + raised cosine taper) */
+	ss->win = malloc(sizeof(float) * ss->Ns);
+	if (!ss->win)
+		return -ENOMEM;
+
+	df = (float)fs / ss->Nb;
+
+	for (i=0; i<ss->Ns; i++) {
+		int k = (i < ss->Ns/2) ? i : i - ss->Ns;
+		float f = fabsf(k * df);
+
+		if (f <= SCAN_PASSBAND)
+			ss->win[i] = 1.0f;
+		else if (f >= SCAN_STOPBAND)
+			ss->win[i] = 0.0f;
+		else
+			ss->win[i] = 0.5f + 0.5f * cosf(M_PIf *
+				(f - SCAN_PASSBAND) / (SCAN_STOPBAND - SCAN_PASSBAND));
+
+		ss->win[i] /= ss->Nb;
+	}
+
+	/* Plans (created once, executed concurrently with new-array API) */
+	{
+		float complex *a = fftwf_malloc(sizeof(float complex) * ss->Nb);
+		float complex *b = fftwf_malloc(sizeof(float complex) * ss->Ns);
+
+		if (!a || !b) {
+			fftwf_free(a);
+			fftwf_free(b);
+			return -ENOMEM;
+		}
+
+		ss->fwd = fftwf_plan_dft_1d(ss->Nb, a, a, FFTW_FORWARD, FFTW_MEASURE);
+		ss->inv = fftwf_plan_dft_1d(ss->Ns, b, b, FFTW_BACKWARD, FFTW_MEASURE);
+
+		fftwf_free(b);
+		fftwf_free(a);
+	}
+
+	return 0;
+}
+
+static void
+scan_fb_block(struct scan_state *ss, int blk,
+              float complex *big, float complex *small)
+{
+	int Nb = ss->Nb, Ns = ss->Ns, V = Nb >> 1, Vs = Ns >> 1, Ss = Ns >> 2;
+	int c, i;
+
+	/* Forward transform of the input block */
+	memcpy(big, &ss->src->data[blk * V], sizeof(float complex) * Nb);
+	fftwf_execute_dft(ss->fwd, big, big);
+
+	/* Extract each channel */
+	for (c=0; c<ss->n_chans; c++) {
+		struct scan_chan *ch = &ss->chans[c];
+		float complex *out = &ch->samples->data[blk * Vs];
+		float sign;
+
+		for (i=0; i<Ns; i++) {
+			int k = (i < Ns/2) ? i : i - Ns;
+			int bi = ch->bin + k;
+
+			if (bi < 0)
+				bi += Nb;
+			else if (bi >= Nb)
+				bi -= Nb;
+
+			small[i] = big[bi] * ss->win[i];
+		}
+
+		fftwf_execute_dft(ss->inv, small, small);
+
+		/* Keep the valid half, fix the mixing phase between blocks */
+		sign = ((ch->bin & 1) && (blk & 1)) ? -1.0f : 1.0f;
+
+		for (i=0; i<Vs; i++)
+			out[i] = sign * small[Ss + i];
+	}
+}
+
+
+/* Workers ---------------------------------------------------------------- */
+
+static int
+scan_next(struct scan_state *ss)
+{
+	int n;
+
+	pthread_mutex_lock(&ss->lock);
+	n = ss->next++;
+	pthread_mutex_unlock(&ss->lock);
+
+	return n;
+}
+
+static void *
+scan_fb_worker(void *arg)
+{
+	struct scan_state *ss = arg;
+	float complex *big, *small;
+	int blk;
+
+	big   = fftwf_malloc(sizeof(float complex) * ss->Nb);
+	small = fftwf_malloc(sizeof(float complex) * ss->Ns);
+
+	if (big && small)
+		while ((blk = scan_next(ss)) < ss->n_blocks)
+			scan_fb_block(ss, blk, big, small);
+
+	fftwf_free(small);
+	fftwf_free(big);
+
+	return NULL;
+}
+
+static void *
+scan_fcch_worker(void *arg)
+{
+	struct scan_state *ss = arg;
+	int c, rv, toa[16];
+
+	while ((c = scan_next(ss)) < ss->n_chans) {
+		struct scan_chan *ch = &ss->chans[c];
+
+		rv = gmr1_fcch_rough_multi(ch->samples, ss->sps, ch->freq_shift, toa, 16);
+		if (rv <= 0) {
+			ch->n_fcch = 0;
+			continue;
+		}
+
+		ch->n_fcch = rv;
+		ch->toa = toa[0];	/* Strongest */
+	}
+
+	return NULL;
+}
+
+static int
+scan_run(struct scan_state *ss, void *(*fn)(void *), int n_threads)
+{
+	pthread_t threads[SCAN_MAX_THREADS];
+	int i, n = 0;
+
+	ss->next = 0;
+
+	for (i=0; i<n_threads; i++)
+		if (!pthread_create(&threads[n], NULL, fn, ss))
+			n++;
+
+	if (!n) {
+		/* No threads at all, do it inline */
+		fn(ss);
+		return 0;
+	}
+
+	for (i=0; i<n; i++)
+		pthread_join(threads[i], NULL);
+
+	return 0;
+}
+
+
+/* Per channel refinement ------------------------------------------------- */
+
+static void
+scan_refine(struct scan_state *ss, struct scan_chan *ch)
+{
+	struct osmo_cxvec _win, *win = &_win;
+	int l = GMR1_FCCH_SYMS * ss->sps;
+	int toa;
+	float freq_err;
+
+	/* FFTW planning isn't thread safe, this part runs serially */
+	if ((ch->toa + l) > ch->samples->len)
+		goto bad;
+
+	osmo_cxvec_init_from_data(win, &ch->samples->data[ch->toa], l);
+
+	if (gmr1_fcch_fine(win, ss->sps, ch->freq_shift, &toa, &freq_err))
+		goto bad;
+
+	ch->toa += toa;
+	ch->freq_err = freq_err;
+
+	if ((ch->toa < 0) || ((ch->toa + l) > ch->samples->len))
+		goto bad;
+
+	osmo_cxvec_init_from_data(win, &ch->samples->data[ch->toa], l);
+
+	if (gmr1_fcch_snr(win, ss->sps, ch->freq_shift - freq_err, &ch->snr))
+		goto bad;
+
+	return;
+
+bad:
+	ch->n_fcch = 0;
+}
+
+
+/* Main ------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+	struct scan_state _ss, *ss = &_ss;
+	double fs, fc, df;
+	float snr_th;
+	int n_threads, n_out, i, n_found;
+	int rv = 0;
+
+	memset(ss, 0x00, sizeof(struct scan_state));
+	pthread_mutex_init(&ss->lock, NULL);
+
+	/* Arg check */
+	if (argc < 4 || argc > 7) {
+		fprintf(stderr, "Usage: %s sample_rate center_freq capture.cfile [sps [threads [snr_db]]]\n", argv[0]);
+		return -EINVAL;
+	}
+
+	fs = atof(argv[1]);
+	fc = atof(argv[2]);
+	ss->sps    = argc > 4 ? atoi(argv[4]) : 2;
+	n_threads  = argc > 5 ? atoi(argv[5]) : 4;
+	snr_th     = argc > 6 ? atof(argv[6]) : 10.0f;
+
+	if (ss->sps < 1 || ss->sps > 16) {
+		fprintf(stderr, "[!] sps must be within [1,16]\n");
+		return -EINVAL;
+	}
+
+	if (n_threads < 1 || n_threads > SCAN_MAX_THREADS) {
+		fprintf(stderr, "[!] threads must be within [1,%d]\n", SCAN_MAX_THREADS);
+		return -EINVAL;
+	}
+
+	if (fs != floor(fs) || fs <= 0) {
+		fprintf(stderr, "[!] sample_rate must be an integer number of Hz\n");
+		return -EINVAL;
+	}
+
+	/* Filterbank setup */
+	rv = scan_fb_init(ss, (long)fs);
+	if (rv) {
+		fprintf(stderr, "[!] Unsupported sample rate / sps combination\n");
+		goto err;
+	}
+
+	df = fs / ss->Nb;
+
+	/* Load capture */
+	ss->src = cfile_load(argv[3]);
+	if (!ss->src) {
+		fprintf(stderr, "[!] Failed to load input file\n");
+		rv = -EIO;
+		goto err;
+	}
+
+	n_out = (SCAN_DURATION_MS * GMR1_SYM_RATE * ss->sps) / 1000;
+	ss->n_blocks = (n_out + (ss->Ns >> 1) - 1) / (ss->Ns >> 1);
+
+	if (((ss->n_blocks + 1) * (ss->Nb >> 1)) > ss->src->len) {
+		fprintf(stderr, "[!] Not enough samples (need %d ms)\n", SCAN_DURATION_MS);
+		rv = -EINVAL;
+		goto err;
+	}
+
+	/* Select all ARFCNs fully inside the captured band */
+	ss->chans = calloc(ARFCN_MAX - ARFCN_MIN + 1, sizeof(struct scan_chan));
+	if (!ss->chans) {
+		rv = -ENOMEM;
+		goto err;
+	}
+
+	for (i=ARFCN_MIN; i<=ARFCN_MAX; i++) {
+		struct scan_chan *ch = &ss->chans[ss->n_chans];
+		double f = ARFCN_DL_BASE + ARFCN_SPACING * i;
+		double fo = f - fc;
+
+		if ((fabs(fo) + SCAN_STOPBAND) > (fs / 2.0))
+			continue;
+
+		ch->arfcn = i;
+		ch->freq = f;
+		ch->bin = (int)lround(fo / df);
+		ch->freq_shift = - 2.0f * M_PIf * (fo - ch->bin * df) / GMR1_SYM_RATE;
+
+		if (ch->bin < 0)
+			ch->bin += ss->Nb;
+
+		ch->samples = osmo_cxvec_alloc(ss->n_blocks * (ss->Ns >> 1));
+		if (!ch->samples) {
+			rv = -ENOMEM;
+			goto err;
+		}
+		ch->samples->len = ss->n_blocks * (ss->Ns >> 1);
+
+		ss->n_chans++;
+	}
+
+	if (!ss->n_chans) {
+		fprintf(stderr, "[!] No ARFCN within the captured band\n");
+		rv = -EINVAL;
+		goto err;
+	}
+
+	fprintf(stderr, "[+] Scanning %d ARFCNs (%d-%d), FFT %d/%d, %d threads\n",
+		ss->n_chans, ss->chans[0].arfcn, ss->chans[ss->n_chans-1].arfcn,
+		ss->Nb, ss->Ns, n_threads);
+
+	/* Channelize */
+	scan_run(ss, scan_fb_worker, n_threads);
+
+	/* Rough FCCH detection on every channel */
+	scan_run(ss, scan_fcch_worker, n_threads);
+
+	/* Fine acquisition & SNR estimate */
+	for (i=0; i<ss->n_chans; i++)
+		if (ss->chans[i].n_fcch)
+			scan_refine(ss, &ss->chans[i]);
+
+	/* Report */
+	printf("# ARFCN  Freq (MHz)  SNR (dB)  Freq err (Hz)  FCCH\n");
+
+	for (i=0, n_found=0; i<ss->n_chans; i++) {
+		struct scan_chan *ch = &ss->chans[i];
+		float snr_db;
+
+		if (!ch->n_fcch)
+			continue;
+
+		snr_db = 10.0f * log10f(ch->snr);
+		if (snr_db < snr_th)
+			continue;
+
+		printf("%7d  %10.5f  %8.1f  %13.1f  %4d\n",
+			ch->arfcn, ch->freq / 1e6, snr_db,
+			(GMR1_SYM_RATE * ch->freq_err) / (2.0f * M_PIf),
+			ch->n_fcch);
+
+		n_found++;
+	}
+
+	fprintf(stderr, "[+] %d ARFCNs with BCCH found\n", n_found);
+
+	/* Done ! */
+	rv = 0;
+
+	/* Clean up */
+err:
+	if (ss->chans) {
+		for (i=0; i<ss->n_chans; i++)
+			osmo_cxvec_free(ss->chans[i].samples);
+		free(ss->chans);
+	}
+
+	if (ss->src)
+		cfile_release(ss->src);
+
+	if (ss->inv)
+		fftwf_destroy_plan(ss->inv);
+
+	if (ss->fwd)
+		fftwf_destroy_plan(ss->fwd);
+
+	free(ss->win);
+
+	pthread_mutex_destroy(&ss->lock);
+
+	return rv;
+}
@@ -25,16 +25,63 @@
  *  \brief Osmocom GMR-1 GSMtap helpers header
  */
 
+#define _GNU_SOURCE	/* sendmmsg */
+
+#include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/types.h>
 
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/gsmtap.h>
+#include <osmocom/core/gsmtap_util.h>
 #include <osmocom/gmr1/gsmtap.h>
 
 
+/*! \brief Fills a GSM tap header for a GMR-1 payload
+ *  \param[out] gh Header to fill
+ *  \param[in] chan_type Type of channel (one of GSMTAP_GMR1_xxx)
+ */
+static void
+_gsmtap_hdr(struct gsmtap_hdr *gh, uint8_t chan_type, uint32_t fn, uint8_t tn)
+{
+	memset(gh, 0x00, sizeof(*gh));
+
+	gh->version = GSMTAP_VERSION;
+	gh->hdr_len = sizeof(*gh)/4;
+	gh->type = GSMTAP_TYPE_GMR1_UM;
+	gh->timeslot = tn;
+	gh->frame_number = htonl(fn);
+	gh->sub_type = chan_type;
+}
+
+/*! \brief Fills a GSM tap message with GMR-1 payload
+ *  \param[in] msg Empty message buffer, large enough
+ *  \param[in] chan_type Type of channel (one of GSMTAP_GMR1_xxx)
+ *  \param[in] l2 Packet of L2 data to encapsulate
+ *  \param[in] len Length of the l2 data in bytes
+ */
+static void
+_gsmtap_fill(struct msgb *msg, uint8_t chan_type, uint32_t fn, uint8_t tn,
+             const uint8_t *l2, int len)
+{
+	struct gsmtap_hdr *gh;
+	uint8_t *dst;
+
+	gh = (struct gsmtap_hdr *) msgb_put(msg, sizeof(*gh));
+	_gsmtap_hdr(gh, chan_type, fn, tn);
+
+	dst = msgb_put(msg, len);
+	memcpy(dst, l2, len);
+}
+
 /*! \brief Helper to build GSM tap message with GMR-1 payload
  *  \param[in] chan_type Type of channel (one of GSMTAP_GMR1_xxx)
  *  \param[in] l2 Packet of L2 data to encapsulate
@@ -45,29 +92,683 @@ gmr1_gsmtap_makemsg(uint8_t chan_type, uint32_t fn, uint8_t tn,
                     const uint8_t *l2, int len)
 {
 	struct msgb *msg;
-	struct gsmtap_hdr *gh;
-	uint8_t *dst;
 
-	msg = msgb_alloc(sizeof(*gh) + len, "gmr1_gsmtap_tx");
+	msg = msgb_alloc(sizeof(struct gsmtap_hdr) + len, "gmr1_gsmtap_tx");
 	if (!msg)
 		return NULL;
 
-	gh = (struct gsmtap_hdr *) msgb_put(msg, sizeof(*gh));
-	gh->version = GSMTAP_VERSION;
-	gh->hdr_len = sizeof(*gh)/4;
-	gh->type = GSMTAP_TYPE_GMR1_UM;
-	gh->timeslot = tn;
-	gh->sub_slot = 0;
-	gh->snr_db = 0;
-	gh->signal_dbm = 0;
-	gh->frame_number = htonl(fn);
-	gh->sub_type = chan_type;
-	gh->antenna_nr = 0;
-
-	dst = msgb_put(msg, len);
-	memcpy(dst, l2, len);
+	_gsmtap_fill(msg, chan_type, fn, tn, l2, len);
 
 	return msg;
 }
 
+
+/* Batched sender --------------------------------------------------------- */
+
+/*! \brief Batched GSMtap sender state */
+struct gmr1_gsmtap_batch
+{
+	struct gsmtap_inst *gti;	/*!< \brief GSMtap instance (socket) */
+	int fd;				/*!< \brief Its socket */
+
+	int size;			/*!< \brief Pool size / flush threshold */
+	double max_delay;		/*!< \brief Flush delay threshold (s) */
+
+	pthread_mutex_t lock;		/*!< \brief Protects everything below */
+
+	struct msgb **pool;		/*!< \brief Free messages (stack) */
+	int n_free;			/*!< \brief Number of free messages */
+
+	struct msgb **queue;		/*!< \brief Messages waiting to be sent */
+	struct mmsghdr *hdr;		/*!< \brief sendmmsg headers (size) */
+	struct iovec *iov;		/*!< \brief sendmmsg buffers (size) */
+	int n_queued;			/*!< \brief Number of queued messages */
+	double t_first;			/*!< \brief Queuing time of the oldest one */
+
+	struct gmr1_gsmtap_stats stats;	/*!< \brief Counters */
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*! \brief Sends the queued messages, lock held
+ *  \returns Number of messages still queued (socket busy)
+ *
+ *  Messages refused by the socket with a hard error are dropped, the
+ *  ones refused because it is full stay queued for the next flush.
+ *  The socket is connected, so a port unreachable (nobody listening)
+ *  shows up on the next send, the rest of the batch is dropped then
+ *  rather than sent one by one into the void.
+ */
+static int
+_batch_flush(struct gmr1_gsmtap_batch *b)
+{
+	int i, j, rv;
+
+	for (j=0; j<b->n_queued; j++) {
+		b->iov[j].iov_base = b->queue[j]->data;
+		b->iov[j].iov_len  = msgb_length(b->queue[j]);
+		memset(&b->hdr[j], 0x00, sizeof(struct mmsghdr));
+		b->hdr[j].msg_hdr.msg_iov = &b->iov[j];
+		b->hdr[j].msg_hdr.msg_iovlen = 1;
+	}
+
+	i = 0;
+
+	while (i < b->n_queued)
+	{
+		rv = sendmmsg(b->fd, &b->hdr[i], b->n_queued - i, 0);
+		b->stats.flushes++;
+
+		if (rv > 0) {
+			b->stats.sent += rv;
+		} else if (!rv) {
+			break;
+		} else if (errno == EINTR) {
+			continue;
+		} else if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS)) {
+			break;
+		} else if (errno == ECONNREFUSED) {
+			b->stats.drop_send += b->n_queued - i;
+			rv = b->n_queued - i;
+		} else {
+			b->stats.drop_send++;
+			rv = 1;
+		}
+
+		/* Give back to the pool */
+		for (j=0; j<rv; j++) {
+			msgb_reset(b->queue[i+j]);
+			b->pool[b->n_free++] = b->queue[i+j];
+		}
+
+		i += rv;
+	}
+
+	/* Keep what's left in order */
+	if (i) {
+		b->n_queued -= i;
+		memmove(b->queue, b->queue + i, b->n_queued * sizeof(struct msgb *));
+		b->t_first = now();
+	}
+
+	return b->n_queued;
+}
+
+/*! \brief Creates a batched GSMtap sender
+ *  \param[in] gti GSMtap instance to send through (sink already added)
+ *  \param[in] size Number of preallocated messages, flushed when all used
+ *  \param[in] max_delay_ms Flush when the oldest message is that old (ms)
+ *  \returns New sender, NULL on error
+ *
+ *  Messages are built in a pool of preallocated buffers (no allocation
+ *  per message) and sent by groups with one sendmmsg call. The delay
+ *  is checked when sending and by \ref gmr1_gsmtap_batch_poll, which
+ *  the processing loop should call regularly so messages don't wait
+ *  for the next one when the traffic is low.
+ */
+struct gmr1_gsmtap_batch *
+gmr1_gsmtap_batch_alloc(struct gsmtap_inst *gti, int size, int max_delay_ms)
+{
+	struct gmr1_gsmtap_batch *b;
+	int i;
+
+	if (!gti || size < 1)
+		return NULL;
+
+	b = calloc(1, sizeof(struct gmr1_gsmtap_batch));
+	if (!b)
+		return NULL;
+
+	b->gti = gti;
+	b->fd = gsmtap_inst_fd(gti);
+	b->size = size;
+	b->max_delay = max_delay_ms * 1e-3;
+
+	pthread_mutex_init(&b->lock, NULL);
+
+	b->pool  = calloc(size, sizeof(struct msgb *));
+	b->queue = calloc(size, sizeof(struct msgb *));
+	b->hdr   = calloc(size, sizeof(struct mmsghdr));
+	b->iov   = calloc(size, sizeof(struct iovec));
+
+	if (!b->pool || !b->queue || !b->hdr || !b->iov)
+		goto err;
+
+	for (i=0; i<size; i++) {
+		b->pool[i] = msgb_alloc(sizeof(struct gsmtap_hdr) + GMR1_GSMTAP_MAX_L2,
+		                        "gmr1_gsmtap_pool");
+		if (!b->pool[i])
+			goto err;
+		b->n_free++;
+	}
+
+	return b;
+
+err:
+	gmr1_gsmtap_batch_release(b);
+	return NULL;
+}
+
+/*! \brief Flushes and releases a batched GSMtap sender
+ *  \param[in] b Sender to release
+ *
+ *  Messages the socket still refuses at that point are counted as
+ *  dropped. The GSMtap instance itself is left alone.
+ */
+void
+gmr1_gsmtap_batch_release(struct gmr1_gsmtap_batch *b)
+{
+	int i;
+
+	if (!b)
+		return;
+
+	if (b->queue) {
+		pthread_mutex_lock(&b->lock);
+		b->stats.drop_send += _batch_flush(b);
+		pthread_mutex_unlock(&b->lock);
+
+		for (i=0; i<b->n_queued; i++)
+			msgb_free(b->queue[i]);
+	}
+
+	if (b->pool) {
+		for (i=0; i<b->n_free; i++)
+			msgb_free(b->pool[i]);
+	}
+
+	pthread_mutex_destroy(&b->lock);
+
+	free(b->iov);
+	free(b->hdr);
+	free(b->queue);
+	free(b->pool);
+	free(b);
+}
+
+/*! \brief Queues a GMR-1 payload for sending as GSMtap
+ *  \param[in] b Sender
+ *  \param[in] chan_type Type of channel (one of GSMTAP_GMR1_xxx)
+ *  \param[in] fn Frame number
+ *  \param[in] tn Timeslot number
+ *  \param[in] l2 Packet of L2 data to encapsulate
+ *  \param[in] len Length of the l2 data in bytes
+ *  \returns 0 if queued or sent, -ENOBUFS if dropped (pool exhausted)
+ *
+ *  Same message as \ref gmr1_gsmtap_makemsg. Payloads larger than
+ *  GMR1_GSMTAP_MAX_L2 go out alone, after the queued ones.
+ */
+int
+gmr1_gsmtap_batch_send(struct gmr1_gsmtap_batch *b,
+                       uint8_t chan_type, uint32_t fn, uint8_t tn,
+                       const uint8_t *l2, int len)
+{
+	struct msgb *msg;
+	int rv = 0;
+
+	pthread_mutex_lock(&b->lock);
+
+	/* Oversized, keep order */
+	if (len > GMR1_GSMTAP_MAX_L2) {
+		_batch_flush(b);
+		msg = gmr1_gsmtap_makemsg(chan_type, fn, tn, l2, len);
+		if (!msg || gsmtap_sendmsg(b->gti, msg) < 0) {
+			b->stats.drop_send++;
+			rv = -EIO;
+		} else {
+			b->stats.sent++;
+		}
+		goto out;
+	}
+
+	/* Need a buffer, none left means the socket was busy last time */
+	if (!b->n_free)
+		_batch_flush(b);
+
+	if (!b->n_free) {
+		b->stats.drop_pool++;
+		rv = -ENOBUFS;
+		goto out;
+	}
+
+	/* Queue */
+	msg = b->pool[--b->n_free];
+	_gsmtap_fill(msg, chan_type, fn, tn, l2, len);
+
+	if (!b->n_queued)
+		b->t_first = now();
+
+	b->queue[b->n_queued++] = msg;
+
+	/* Flush on size / age */
+	if ((b->n_queued >= b->size) || ((now() - b->t_first) >= b->max_delay))
+		_batch_flush(b);
+
+out:
+	pthread_mutex_unlock(&b->lock);
+
+	return rv;
+}
+
+/*! \brief Sends all the queued messages now
+ *  \param[in] b Sender
+ *  \returns Number of messages still queued (socket busy)
+ */
+int
+gmr1_gsmtap_batch_flush(struct gmr1_gsmtap_batch *b)
+{
+	int rv;
+
+	pthread_mutex_lock(&b->lock);
+	rv = _batch_flush(b);
+	pthread_mutex_unlock(&b->lock);
+
+	return rv;
+}
+
+/*! \brief Sends the queued messages if the oldest one is too old
+ *  \param[in] b Sender
+ *  \returns Number of messages still queued
+ */
+int
+gmr1_gsmtap_batch_poll(struct gmr1_gsmtap_batch *b)
+{
+	int rv;
+
+	pthread_mutex_lock(&b->lock);
+
+	if (b->n_queued && ((now() - b->t_first) >= b->max_delay))
+		_batch_flush(b);
+
+	rv = b->n_queued;
+
+	pthread_mutex_unlock(&b->lock);
+
+	return rv;
+}
+
+/*! \brief Reads the counters of a batched GSMtap sender
+ *  \param[in] b Sender
+ *  \param[out] stats Counters copy
+ */
+void
+gmr1_gsmtap_batch_stats(struct gmr1_gsmtap_batch *b,
+                        struct gmr1_gsmtap_stats *stats)
+{
+	pthread_mutex_lock(&b->lock);
+	*stats = b->stats;
+	pthread_mutex_unlock(&b->lock);
+}
+
+
+/* pcap file output ------------------------------------------------------- */
+
+#define PCAP_MAGIC_NS	0xa1b23c4d	/*!< \brief pcap, nanosecond timestamps */
+#define PCAP_LINKTYPE_IPV4	228	/*!< \brief Raw IPv4 packets */
+#define PCAP_BUF_SIZE	(4 << 20)	/*!< \brief Write buffer size */
+
+/*! \brief Index entry of a frame written to the pcap file */
+struct pcap_frame
+{
+	uint64_t ts_ns;		/*!< \brief Timestamp (ns) */
+	unsigned long seq;	/*!< \brief Write order, for equal timestamps */
+	off_t ofs;		/*!< \brief Record offset in the file */
+	uint32_t len;		/*!< \brief Record length */
+};
+
+/*! \brief GSMtap pcap file writer state */
+struct gmr1_gsmtap_pcap
+{
+	char *filename;		/*!< \brief Output file name */
+	FILE *fh;		/*!< \brief Output file */
+	char *buf;		/*!< \brief Its write buffer */
+	unsigned long n;	/*!< \brief Number of frames written */
+	off_t ofs;		/*!< \brief Current file length */
+	int err;		/*!< \brief A write failed */
+
+	struct pcap_frame *frames;	/*!< \brief Index of the frames */
+	unsigned long n_frames_max;	/*!< \brief Allocated index entries */
+	uint64_t last_ts;		/*!< \brief Timestamp of the last frame */
+	int unsorted;			/*!< \brief Frames are out of order */
+	int no_index;			/*!< \brief Index alloc failed */
+};
+
+/*! \brief pcap file header */
+struct pcap_file_hdr {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t  thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+} __attribute__((packed));
+
+/*! \brief pcap record: record header, IPv4, UDP and GSMtap headers */
+struct pcap_gsmtap_rec {
+	/* Record */
+	uint32_t ts_sec;
+	uint32_t ts_nsec;
+	uint32_t incl_len;
+	uint32_t orig_len;
+
+	/* IPv4 */
+	uint8_t  ip_vhl;
+	uint8_t  ip_tos;
+	uint16_t ip_len;
+	uint16_t ip_id;
+	uint16_t ip_off;
+	uint8_t  ip_ttl;
+	uint8_t  ip_p;
+	uint16_t ip_sum;
+	uint32_t ip_src;
+	uint32_t ip_dst;
+
+	/* UDP */
+	uint16_t uh_sport;
+	uint16_t uh_dport;
+	uint16_t uh_ulen;
+	uint16_t uh_sum;
+
+	/* GSMtap */
+	struct gsmtap_hdr gh;
+} __attribute__((packed));
+
+/*! \brief Orders frames by timestamp, then by write order */
+static int
+_pcap_frame_cmp(const void *a, const void *b)
+{
+	const struct pcap_frame *fa = a, *fb = b;
+
+	if (fa->ts_ns != fb->ts_ns)
+		return fa->ts_ns < fb->ts_ns ? -1 : 1;
+
+	return fa->seq < fb->seq ? -1 : (fa->seq > fb->seq);
+}
+
+/*! \brief Sets the IPv4 id of a record (its index in the file) */
+static void
+_pcap_ip_id(struct pcap_gsmtap_rec *r, unsigned long n)
+{
+	const uint8_t *b;
+	uint32_t sum;
+	int i;
+
+	r->ip_id  = htons(n & 0xffff);
+	r->ip_sum = 0;
+
+	b = &r->ip_vhl;
+	for (i=0, sum=0; i<20; i+=2)
+		sum += (b[i] << 8) | b[i+1];
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	r->ip_sum = htons(~sum & 0xffff);
+}
+
+/*! \brief Sorts the records of the pcap file by timestamp
+ *  \param[in] p Writer, with its index complete
+ *  \returns 0 for success, -errno otherwise (the file is left as is)
+ *
+ *  The records are copied in order to a new file, renumbered, which
+ *  then replaces the original one.
+ */
+static int
+_pcap_sort(struct gmr1_gsmtap_pcap *p)
+{
+	struct pcap_file_hdr fh;
+	FILE *fo = NULL;
+	char *tmp = NULL, *buf = NULL;
+	uint8_t *rec = NULL;
+	unsigned long i;
+	int rv = -EIO;
+
+	qsort(p->frames, p->n, sizeof(struct pcap_frame), _pcap_frame_cmp);
+
+	tmp = malloc(strlen(p->filename) + 5);
+	rec = malloc(sizeof(struct pcap_gsmtap_rec) + 0xffff);
+	buf = malloc(PCAP_BUF_SIZE);
+	if (!tmp || !rec) {
+		rv = -ENOMEM;
+		goto err;
+	}
+
+	sprintf(tmp, "%s.tmp", p->filename);
+
+	fo = fopen(tmp, "wb");
+	if (!fo)
+		goto err;
+
+	if (buf)
+		setvbuf(fo, buf, _IOFBF, PCAP_BUF_SIZE);
+
+	/* Header then all the records in time order */
+	if (fseeko(p->fh, 0, SEEK_SET) ||
+	    (fread(&fh, sizeof(fh), 1, p->fh) != 1) ||
+	    (fwrite(&fh, sizeof(fh), 1, fo) != 1))
+		goto err;
+
+	for (i=0; i<p->n; i++) {
+		const struct pcap_frame *f = &p->frames[i];
+
+		if (fseeko(p->fh, f->ofs, SEEK_SET) ||
+		    (fread(rec, f->len, 1, p->fh) != 1))
+			goto err;
+
+		_pcap_ip_id((struct pcap_gsmtap_rec *)rec, i);
+
+		if (fwrite(rec, f->len, 1, fo) != 1)
+			goto err;
+	}
+
+	rv = fclose(fo);
+	fo = NULL;
+
+	if (rv || rename(tmp, p->filename)) {
+		rv = -EIO;
+		goto err;
+	}
+
+	rv = 0;
+
+err:
+	if (fo)
+		fclose(fo);
+	if (rv && tmp)
+		remove(tmp);
+
+	free(buf);
+	free(rec);
+	free(tmp);
+
+	return rv;
+}
+
+/*! \brief Opens a pcap file for GSMtap frames
+ *  \param[in] filename File to create
+ *  \returns New writer, NULL on error
+ *
+ *  Frames are stored as IPv4 / UDP to the GSMtap port, loopback to
+ *  loopback, so wireshark dissects them just like a live capture.
+ *  Each frame goes to the file (through a large stdio buffer) as soon
+ *  as it's given, so the capture survives a crash. They can be given in
+ *  any time order: if they were not, the file is rewritten sorted by
+ *  timestamp (then by write order) on close.
+ */
+struct gmr1_gsmtap_pcap *
+gmr1_gsmtap_pcap_open(const char *filename)
+{
+	struct gmr1_gsmtap_pcap *p;
+	struct pcap_file_hdr fh;
+
+	p = calloc(1, sizeof(struct gmr1_gsmtap_pcap));
+	if (!p)
+		return NULL;
+
+	p->filename = strdup(filename);
+	if (!p->filename)
+		goto err;
+
+	/* Read back when sorting */
+	p->fh = fopen(filename, "w+b");
+	if (!p->fh)
+		goto err;
+
+	p->buf = malloc(PCAP_BUF_SIZE);
+	if (p->buf)
+		setvbuf(p->fh, p->buf, _IOFBF, PCAP_BUF_SIZE);
+
+	memset(&fh, 0x00, sizeof(fh));
+	fh.magic = PCAP_MAGIC_NS;
+	fh.version_major = 2;
+	fh.version_minor = 4;
+	fh.snaplen = 65535;
+	fh.linktype = PCAP_LINKTYPE_IPV4;
+
+	if (fwrite(&fh, sizeof(fh), 1, p->fh) != 1)
+		goto err;
+
+	p->ofs = sizeof(fh);
+
+	return p;
+
+err:
+	gmr1_gsmtap_pcap_close(p);
+	return NULL;
+}
+
+/*! \brief Flushes, sorts if needed, and closes a GSMtap pcap file
+ *  \param[in] p Writer to close
+ *  \returns 0 if everything got written in time order, -EIO if a write
+ *           failed, -ENOMEM if all frames are in the file but it could
+ *           not be sorted
+ */
+int
+gmr1_gsmtap_pcap_close(struct gmr1_gsmtap_pcap *p)
+{
+	int rv;
+
+	if (!p)
+		return 0;
+
+	rv = p->err ? -EIO : 0;
+
+	if (p->fh) {
+		if (fflush(p->fh))
+			rv = -EIO;
+
+		if (!rv && p->unsorted)
+			rv = p->no_index ? -ENOMEM : _pcap_sort(p);
+
+		if (ferror(p->fh) || fclose(p->fh))
+			rv = rv ? rv : -EIO;
+	}
+
+	free(p->frames);
+	free(p->buf);
+	free(p->filename);
+	free(p);
+
+	return rv;
+}
+
+/*! \brief Adds one GMR-1 payload as a GSMtap frame to a pcap file
+ *  \param[in] p Writer
+ *  \param[in] ts_ns Timestamp (ns)
+ *  \param[in] chan_type Type of channel (one of GSMTAP_GMR1_xxx)
+ *  \param[in] fn Frame number
+ *  \param[in] tn Timeslot number
+ *  \param[in] l2 Packet of L2 data to encapsulate
+ *  \param[in] len Length of the l2 data in bytes
+ *  \returns 0 for success, -EINVAL if len is too large, -EIO if the
+ *           write failed
+ *
+ *  The GSMtap part is the same as \ref gmr1_gsmtap_makemsg. The frame
+ *  is written right away. Only its timestamp and position are kept, to
+ *  sort the file on \ref gmr1_gsmtap_pcap_close.
+ */
+int
+gmr1_gsmtap_pcap_write(struct gmr1_gsmtap_pcap *p, uint64_t ts_ns,
+                       uint8_t chan_type, uint32_t fn, uint8_t tn,
+                       const uint8_t *l2, int len)
+{
+	struct pcap_gsmtap_rec r;
+	int ip_len;
+
+	if (len < 0 || len > 0xffff - 20 - 8 - (int)sizeof(struct gsmtap_hdr))
+		return -EINVAL;
+
+	if (p->err)
+		return -EIO;
+
+	ip_len = 20 + 8 + sizeof(struct gsmtap_hdr) + len;
+
+	/* Record */
+	r.ts_sec   = ts_ns / 1000000000ULL;
+	r.ts_nsec  = ts_ns % 1000000000ULL;
+	r.incl_len = ip_len;
+	r.orig_len = ip_len;
+
+	/* IPv4 */
+	r.ip_vhl = 0x45;
+	r.ip_tos = 0;
+	r.ip_len = htons(ip_len);
+	r.ip_off = htons(0x4000);	/* DF */
+	r.ip_ttl = 64;
+	r.ip_p   = 17;			/* UDP */
+	r.ip_src = htonl(0x7f000001);
+	r.ip_dst = htonl(0x7f000001);
+
+	_pcap_ip_id(&r, p->n);
+
+	/* UDP (no checksum) */
+	r.uh_sport = htons(GSMTAP_UDP_PORT);
+	r.uh_dport = htons(GSMTAP_UDP_PORT);
+	r.uh_ulen  = htons(ip_len - 20);
+	r.uh_sum   = 0;
+
+	/* GSMtap */
+	_gsmtap_hdr(&r.gh, chan_type, fn, tn);
+
+	if ((fwrite(&r, sizeof(r), 1, p->fh) != 1) ||
+	    (len && (fwrite(l2, len, 1, p->fh) != 1))) {
+		p->err = 1;
+		return -EIO;
+	}
+
+	/* Index it. Without memory, the file just won't be sorted */
+	if (!p->no_index && (p->n == p->n_frames_max)) {
+		unsigned long n = p->n_frames_max ? 2 * p->n_frames_max : 1024;
+		struct pcap_frame *f = realloc(p->frames, n * sizeof(struct pcap_frame));
+		if (f) {
+			p->frames = f;
+			p->n_frames_max = n;
+		} else {
+			p->no_index = 1;
+		}
+	}
+
+	if (!p->no_index) {
+		struct pcap_frame *f = &p->frames[p->n];
+		f->ts_ns = ts_ns;
+		f->seq   = p->n;
+		f->ofs   = p->ofs;
+		f->len   = sizeof(r) + len;
+	}
+
+	if (p->n && (ts_ns < p->last_ts))
+		p->unsorted = 1;
+
+	p->last_ts = ts_ns;
+	p->ofs += sizeof(r) + len;
+	p->n++;
+
+	return 0;
+}
+
 /*! @} */
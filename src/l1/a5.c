@@ -41,6 +41,11 @@
 
 #include <osmocom/gmr1/l1/a5.h>
 
+#ifdef GMR1_L1_TABLES_GEN
+#include <inttypes.h>
+#include "gen_tables.h"
+#endif
+
 
 /*! \brief Main method to generate a A5/x cipher stream
  *  \param[in] n Which A5/x method to use
@@ -213,20 +218,16 @@ _a5_1_output(uint32_t *r)
 	return m[0] ^ m[1] ^ m[2];
 }
 
-/*! \brief Generate a GMR-1 A5/1 cipher stream
+#ifdef GMR1_L1_TABLES_GEN
+
+/*! \brief GMR1-A5/1: Reorganize the key and mix-in the frame number
+ *  \param[out] lkey 8 byte array for the key to load in the registers
  *  \param[in] key 8 byte array for the key (as received from the SIM)
  *  \param[in] fn Frame number
- *  \param[in] nbits How many bits to generate
- *  \param[out] dl Pointer to array of ubits to return Downlink cipher stream
- *  \param[out] ul Pointer to array of ubits to return Uplink cipher stream
- *
- * Either (or both) of dl/ul can be NULL if not needed.
  */
-void
-gmr1_a5_1(uint8_t *key, uint32_t fn, int nbits, ubit_t *dl, ubit_t *ul)
+static void
+_a5_1_key_prepare(uint8_t *lkey, const uint8_t *key, uint32_t fn)
 {
-	uint32_t r[4];
-	uint8_t lkey[8];
 	int i;
 
 	/* Reorganize the key */
@@ -239,6 +240,16 @@ gmr1_a5_1(uint8_t *key, uint32_t fn, int nbits, ubit_t *dl, ubit_t *ul)
 	lkey[1] ^= (fn & 0x007c0) >>  3; /* SuperFrame Number */
 	lkey[0] ^= (fn & 0x0f800) >> 11; /* ... */
 	lkey[0] ^= (fn & 0x70000) >> 11; /* ... */
+}
+
+/*! \brief GMR1-A5/1: Key mixing (bit by bit)
+ *  \param[out] r Register states
+ *  \param[in] lkey 8 byte array of the prepared key
+ */
+static void
+_a5_1_key_mix(uint32_t *r, const uint8_t *lkey)
+{
+	int i;
 
 	/* Init Rx */
 	r[0] = r[1] = r[2] = r[3] = 0;
@@ -256,6 +267,131 @@ gmr1_a5_1(uint8_t *key, uint32_t fn, int nbits, ubit_t *dl, ubit_t *ul)
 		r[2] ^= b;
 		r[3] ^= b;
 	}
+}
+
+/*
+ * Starting from all zero registers, the key mixing is linear over GF(2):
+ * the register states after it are the XOR of the states obtained for
+ * each key bit and each frame number bit taken alone. Those are computed
+ * at build time.
+ */
+
+/*! \brief Register states contribution of each key bit (msb first) */
+static uint32_t a51_key_basis[64][4];
+
+/*! \brief Register states contribution of each frame number bit */
+static uint32_t a51_fn_basis[19][4];
+
+static void
+_a5_1_basis_gen(FILE *fh, const char *name, uint32_t (*basis)[4], int n)
+{
+	int i;
+
+	fprintf(fh, "static const uint32_t %s[%d][4] = {\n", name, n);
+	for (i=0; i<n; i++) {
+		fprintf(fh, "\t{ 0x%08" PRIx32 ", 0x%08" PRIx32 ", 0x%08" PRIx32
+			", 0x%08" PRIx32 " },\n",
+			basis[i][0], basis[i][1], basis[i][2], basis[i][3]);
+	}
+	fprintf(fh, "};\n");
+}
+
+/*! \brief Generates the A5/1 key mixing basis (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_a5_gen_tables(FILE *fh)
+{
+	uint8_t key[8], lkey[8];
+	int i;
+
+	memset(key, 0x00, sizeof(key));
+
+	for (i=0; i<64; i++) {
+		key[i >> 3] = 0x80 >> (i & 7);
+		_a5_1_key_prepare(lkey, key, 0);
+		_a5_1_key_mix(a51_key_basis[i], lkey);
+		key[i >> 3] = 0x00;
+	}
+
+	for (i=0; i<19; i++) {
+		_a5_1_key_prepare(lkey, key, 1 << i);
+		_a5_1_key_mix(a51_fn_basis[i], lkey);
+	}
+
+	_a5_1_basis_gen(fh, "a51_key_basis", a51_key_basis, 64);
+	_a5_1_basis_gen(fh, "a51_fn_basis",  a51_fn_basis,  19);
+	fprintf(fh, "\n");
+
+	return 0;
+}
+
+#else
+
+#define GMR1_L1_TABLES_A5
+#include "l1_tables.h"
+
+#endif
+
+/*! \brief GMR1-A5/1: Init registers and mix key and frame number
+ *  \param[out] r Register states
+ *  \param[in] key 8 byte array for the key (as received from the SIM)
+ *  \param[in] fn Frame number
+ *
+ * Same result as \ref _a5_1_key_mix on the prepared key, using the
+ * precomputed linear contributions.
+ */
+static void
+_a5_1_setup(uint32_t *r, const uint8_t *key, uint32_t fn)
+{
+	const uint32_t *v;
+	int i, j;
+
+	r[0] = r[1] = r[2] = r[3] = 0;
+
+	for (i=0; i<8; i++) {
+		uint8_t k = key[i];
+
+		for (j=0, v=a51_key_basis[i<<3]; k; j++, k<<=1, v+=4) {
+			if (!(k & 0x80))
+				continue;
+			r[0] ^= v[0];
+			r[1] ^= v[1];
+			r[2] ^= v[2];
+			r[3] ^= v[3];
+		}
+	}
+
+	fn &= (1 << 19) - 1;
+
+	for (v=a51_fn_basis[0]; fn; fn>>=1, v+=4) {
+		if (!(fn & 1))
+			continue;
+		r[0] ^= v[0];
+		r[1] ^= v[1];
+		r[2] ^= v[2];
+		r[3] ^= v[3];
+	}
+}
+
+/*! \brief Generate a GMR-1 A5/1 cipher stream
+ *  \param[in] key 8 byte array for the key (as received from the SIM)
+ *  \param[in] fn Frame number
+ *  \param[in] nbits How many bits to generate
+ *  \param[out] dl Pointer to array of ubits to return Downlink cipher stream
+ *  \param[out] ul Pointer to array of ubits to return Uplink cipher stream
+ *
+ * Either (or both) of dl/ul can be NULL if not needed.
+ */
+void
+gmr1_a5_1(uint8_t *key, uint32_t fn, int nbits, ubit_t *dl, ubit_t *ul)
+{
+	uint32_t r[4];
+	int i;
+
+	/* Init Rx & Key mixing */
+	_a5_1_setup(r, key, fn);
 
 	/* Set high bits */
 	_a5_1_set_bits(r);
@@ -281,4 +417,230 @@ gmr1_a5_1(uint8_t *key, uint32_t fn, int nbits, ubit_t *dl, ubit_t *ul)
 	}
 }
 
+
+/* ------------------------------------------------------------------------ */
+/* Bitsliced A5/1                                                           */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * The batched generator runs A5_LANES independent (key, fn) pairs at once.
+ * Each register bit is stored as a word holding that bit for all the
+ * lanes, so that clocking, feedback and majority become plain bitwise
+ * logic and irregular clocking is a per-lane select between the current
+ * and the shifted bit.
+ */
+
+#define A5_LANES	256
+
+typedef uint64_t a5_vec_t __attribute__((vector_size(A5_LANES / 8)));
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__ELF__) && (__GNUC__ >= 6) && !defined(__clang__)
+#define A5_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define A5_CLONES
+#endif
+
+#define A5_OUT_CHUNK	64	/* Output bits buffered before transposition */
+#define A5_MIN_BATCH	16	/* Below this, the scalar version is faster */
+
+/*! \brief Bitsliced GMR1-A5/1 state */
+struct a5_1_bs {
+	a5_vec_t r1[A51_R1_LEN];
+	a5_vec_t r2[A51_R2_LEN];
+	a5_vec_t r3[A51_R3_LEN];
+	a5_vec_t r4[A51_R4_LEN];
+};
+
+/*! \brief Bitsliced majority of 3 words */
+#define A5_BS_MAJ(a, b, c)	(((a) & (b)) | ((a) & (c)) | ((b) & (c)))
+
+/*! \brief Bitsliced LFSR clocking of lanes selected by a mask
+ *  \param[in,out] r Register bit words (bit 0 first)
+ *  \param[in] len Length of the register
+ *  \param[in] fb Feedback bit word
+ *  \param[in] c Mask of lanes to clock
+ */
+static inline void
+_a5_bs_clock(a5_vec_t *r, int len, const a5_vec_t *fb, const a5_vec_t *c)
+{
+	int k;
+
+	for (k=len-1; k>0; k--)
+		r[k] ^= (r[k] ^ r[k-1]) & *c;
+
+	r[0] ^= (r[0] ^ *fb) & *c;
+}
+
+/*! \brief Bitsliced GMR1-A5/1: Clock registers (forced or clocking rule)
+ *  \param[in,out] s Bitsliced state
+ *  \param[in] force Clock all registers regardless of the clocking rule
+ */
+static inline void
+_a5_1_bs_clock(struct a5_1_bs *s, int force)
+{
+	a5_vec_t c[4], fb;
+
+	c[3] = ~(a5_vec_t){ 0 };
+
+	if (force) {
+		c[0] = c[1] = c[2] = c[3];
+	} else {
+		a5_vec_t m = A5_BS_MAJ(s->r4[15], s->r4[6], s->r4[1]);
+		c[0] = ~(s->r4[15] ^ m);
+		c[1] = ~(s->r4[ 6] ^ m);
+		c[2] = ~(s->r4[ 1] ^ m);
+	}
+
+	fb = s->r1[13] ^ s->r1[16] ^ s->r1[17] ^ s->r1[18];
+	_a5_bs_clock(s->r1, A51_R1_LEN, &fb, &c[0]);
+
+	fb = s->r2[12] ^ s->r2[16] ^ s->r2[20] ^ s->r2[21];
+	_a5_bs_clock(s->r2, A51_R2_LEN, &fb, &c[1]);
+
+	fb = s->r3[17] ^ s->r3[18] ^ s->r3[21] ^ s->r3[22];
+	_a5_bs_clock(s->r3, A51_R3_LEN, &fb, &c[2]);
+
+	fb = s->r4[ 8] ^ s->r4[12] ^ s->r4[13] ^ s->r4[16];
+	_a5_bs_clock(s->r4, A51_R4_LEN, &fb, &c[3]);
+}
+
+/*! \brief Bitsliced GMR1-A5/1: Generate the output bit word
+ *  \param[in] s Bitsliced state
+ *  \param[out] o Output bit word
+ */
+static inline void
+_a5_1_bs_output(const struct a5_1_bs *s, a5_vec_t *o)
+{
+	*o =	A5_BS_MAJ(s->r1[1], s->r1[ 6], s->r1[15]) ^ s->r1[11] ^
+		A5_BS_MAJ(s->r2[3], s->r2[ 8], s->r2[14]) ^ s->r2[ 1] ^
+		A5_BS_MAJ(s->r3[4], s->r3[15], s->r3[19]) ^ s->r3[ 0];
+}
+
+/*! \brief Bitsliced GMR1-A5/1: Generate and scatter output bits
+ *  \param[in,out] s Bitsliced state
+ *  \param[in] nbits How many bits to generate
+ *  \param[out] out Array of n output pointers (array or items can be NULL)
+ *  \param[in] n Number of used lanes
+ */
+static inline void
+_a5_1_bs_generate(struct a5_1_bs *s, int nbits, ubit_t * const *out, int n)
+{
+	a5_vec_t o[A5_OUT_CHUNK];
+	int i, j, l, m;
+
+	for (i=0; i<nbits; i+=m)
+	{
+		m = nbits - i;
+		if (m > A5_OUT_CHUNK)
+			m = A5_OUT_CHUNK;
+
+		for (j=0; j<m; j++) {
+			_a5_1_bs_clock(s, 0);
+			_a5_1_bs_output(s, &o[j]);
+		}
+
+		if (!out)
+			continue;
+
+		for (l=0; l<n; l++) {
+			ubit_t *ob = out[l];
+			int w = l >> 6;
+			int b = l & 63;
+
+			if (!ob)
+				continue;
+
+			for (j=0; j<m; j++)
+				ob[i+j] = (o[j][w] >> b) & 1;
+		}
+	}
+}
+
+/*! \brief Bitsliced GMR1-A5/1 for one group of up to A5_LANES streams */
+A5_CLONES
+static void
+_a5_1_bs_group(const uint8_t * const *key, const uint32_t *fn, int nbits,
+               ubit_t * const *dl, ubit_t * const *ul, int n)
+{
+	struct a5_1_bs s;
+	int i, l;
+
+	/* Init Rx & Key mixing (scalar) then transpose into bit words */
+	memset(&s, 0x00, sizeof(s));
+
+	for (l=0; l<n; l++) {
+		uint32_t r[4];
+		int w = l >> 6;
+		int b = l & 63;
+
+		_a5_1_setup(r, key[l], fn[l]);
+
+		#define XPOSE(rv, rb, len)					\
+			for (i=0; i<len; i++)					\
+				rb[i][w] |= (uint64_t)((rv >> i) & 1) << b;
+
+		XPOSE(r[0], s.r1, A51_R1_LEN);
+		XPOSE(r[1], s.r2, A51_R2_LEN);
+		XPOSE(r[2], s.r3, A51_R3_LEN);
+		XPOSE(r[3], s.r4, A51_R4_LEN);
+
+		#undef XPOSE
+	}
+
+	/* Set high bits */
+	s.r1[0] = s.r2[0] = s.r3[0] = s.r4[0] = ~(a5_vec_t){ 0 };
+
+	/* Mixing */
+	for (i=0; i<250; i++)
+		_a5_1_bs_clock(&s, 0);
+
+	/* DL Output */
+	_a5_1_bs_generate(&s, nbits, dl, n);
+
+	/* UL Output */
+	if (ul)
+		_a5_1_bs_generate(&s, nbits, ul, n);
+}
+
+/*! \brief Generate several GMR-1 A5/1 cipher streams at once
+ *  \param[in] key Array of n pointers to 8 byte keys
+ *  \param[in] fn Array of n frame numbers
+ *  \param[in] nbits How many bits to generate for each stream
+ *  \param[out] dl Array of n pointers to ubits for Downlink cipher streams
+ *  \param[out] ul Array of n pointers to ubits for Uplink cipher streams
+ *  \param[in] n Number of streams
+ *
+ * Output is identical to n calls to \ref gmr1_a5_1 but streams are
+ * generated in parallel by a bitsliced implementation. This is most
+ * efficient for large n (up to 256 streams are processed for the cost
+ * of one). Small batches are handed to the scalar version.
+ *
+ * Either (or both) of dl/ul can be NULL if not needed, as can any of
+ * their individual pointers.
+ */
+void
+gmr1_a5_1_batch(const uint8_t * const *key, const uint32_t *fn, int nbits,
+                ubit_t * const *dl, ubit_t * const *ul, int n)
+{
+	int i, g;
+
+	for (i=0; i<n; i+=g)
+	{
+		g = n - i;
+		if (g > A5_LANES)
+			g = A5_LANES;
+
+		if (g < A5_MIN_BATCH) {
+			for (; i<n; i++)
+				gmr1_a5_1((uint8_t *)key[i], fn[i], nbits,
+				          dl ? dl[i] : NULL, ul ? ul[i] : NULL);
+			break;
+		}
+
+		_a5_1_bs_group(&key[i], &fn[i], nbits,
+		               dl ? &dl[i] : NULL, ul ? &ul[i] : NULL, g);
+	}
+}
+
 /*! @} */
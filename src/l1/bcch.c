@@ -33,22 +33,69 @@
 #include <osmocom/core/conv.h>
 #include <osmocom/core/crc16gen.h>
 
+#include <osmocom/gmr1/l1/codemat.h>
 #include <osmocom/gmr1/l1/conv.h>
 #include <osmocom/gmr1/l1/crc.h>
+#include <osmocom/gmr1/l1/encmap.h>
+#include <osmocom/gmr1/l1/gather.h>
 #include <osmocom/gmr1/l1/interleave.h>
 #include <osmocom/gmr1/l1/scramb.h>
 
+#ifdef GMR1_L1_TABLES_GEN
+#include "gen_tables.h"
+#endif
+
+
+#define GMR1_BCCH_BATCH	16	/*!< \brief Bursts per batched conv. decode */
+
+static struct gmr1_codemat gmr1_bcch_codemat;
+
+#ifdef GMR1_L1_TABLES_GEN
 
 static struct osmo_conv_code gmr1_conv_bcch;
 
-static void __attribute__ ((constructor))
-gmr1_bcch_init(void)
+static struct gmr1_gather gmr1_bcch_gather;
+static struct gmr1_gather_ent gmr1_bcch_gather_ent[424];
+
+/*! \brief Reference burst bits to conv. input path (see \ref gather) */
+static void
+_bcch_unmap(sbit_t *bits_c, const sbit_t *bits_e, const ubit_t *ciph)
+{
+	sbit_t bits_ep[424];
+
+	gmr1_scramble_sbit(bits_ep, bits_e, 424);
+	gmr1_deinterleave_intra(bits_c, bits_ep, 53);
+}
+
+/*! \brief Generates the BCCH tables (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_bcch_gen_tables(FILE *fh)
 {
 	/* Init convolutional coder */
 	memcpy(&gmr1_conv_bcch, &gmr1_conv_12, sizeof(struct osmo_conv_code));
 	gmr1_conv_bcch.len = 208;
+
+	/* Init gather table */
+	gmr1_gather_build(&gmr1_bcch_gather, gmr1_bcch_gather_ent,
+	                  424, 424, 0, _bcch_unmap, NULL);
+
+	/* Print them as const data */
+	gen_tables_conv(fh, "gmr1_conv_bcch", &gmr1_conv_bcch);
+	gen_tables_gather(fh, "gmr1_bcch_gather", &gmr1_bcch_gather);
+
+	return 0;
 }
 
+#else
+
+#define GMR1_L1_TABLES_BCCH
+#include "l1_tables.h"
+
+#endif
+
 
 /*! \brief Stateless GMR-1 BCCH channel coder
  *  \param[out] bits_e Data bits of a burst
@@ -64,13 +111,36 @@ gmr1_bcch_encode(ubit_t *bits_e, const uint8_t *l2)
 	ubit_t bits_c[424];
 	ubit_t bits_ep[424];
 
-	osmo_pbit2ubit_ext(bits_u, 0, l2, 0, 192, 1);
-	osmo_crc16gen_set_bits(&gmr1_crc16, bits_u, 192, bits_u+192);
+	gmr1_crc_unpack_set_ubit(&gmr1_crc16_tab, bits_u, l2, 192);
 	osmo_conv_encode(&gmr1_conv_bcch, bits_u, bits_c);
 	gmr1_interleave_intra(bits_ep, bits_c, 53);
 	gmr1_scramble_ubit(bits_e, bits_ep, 424);
 }
 
+static struct gmr1_encmap gmr1_bcch_encmap;
+
+/*! \brief Packed GMR-1 BCCH channel coder
+ *  \param[out] bits_e 424 encoded bits, packed (see \ref encmap)
+ *  \param[in] l2 L2 packet data
+ *  \return 0 for success, -errno for failure
+ *
+ * Same output as \ref gmr1_bcch_encode. The encoder map is built on the
+ * first call.
+ */
+int
+gmr1_bcch_encode_p64(uint64_t *bits_e, const uint8_t *l2)
+{
+	int rv;
+
+	rv = gmr1_encmap_build(&gmr1_bcch_encmap, 24, 424, gmr1_bcch_encode);
+	if (rv)
+		return rv;
+
+	gmr1_encmap_run(&gmr1_bcch_encmap, bits_e, l2);
+
+	return 0;
+}
+
 /*! \brief Stateless GMR-1 BCCH channel decoder
  *  \param[out] l2 L2 packet data
  *  \param[in] bits_e Data bits of a burst
@@ -83,23 +153,93 @@ gmr1_bcch_encode(ubit_t *bits_e, const uint8_t *l2)
 int
 gmr1_bcch_decode(uint8_t *l2, const sbit_t *bits_e, int *conv_rv)
 {
-	sbit_t bits_ep[424];
 	sbit_t bits_c[424];
 	ubit_t bits_u[208];
 	int rv;
 
-	gmr1_scramble_sbit(bits_ep, bits_e, 424);
-	gmr1_deinterleave_intra(bits_c, bits_ep, 53);
+	gmr1_gather_sbit(&gmr1_bcch_gather, bits_c, bits_e, NULL);
+
+	/* Strong burst fast path */
+	rv = gmr1_codemat_try_decode(&gmr1_bcch_codemat, &gmr1_conv_bcch,
+	                             bits_u, bits_c);
+	if (rv >= 0 && !gmr1_crc_check_pack_ubit(&gmr1_crc16_tab, l2, bits_u, 192)) {
+		if (conv_rv)
+			*conv_rv = rv;
+		return 0;
+	}
 
-	rv = osmo_conv_decode(&gmr1_conv_bcch, bits_c, bits_u);
+	rv = gmr1_conv_decode(&gmr1_conv_bcch, bits_c, bits_u);
 	if (conv_rv)
 		*conv_rv = rv;
 
-	rv = osmo_crc16gen_check_bits(&gmr1_crc16, bits_u, 192, bits_u+192);
-
-	osmo_ubit2pbit_ext(l2, 0, bits_u, 0, 192, 1);
+	rv = gmr1_crc_check_pack_ubit(&gmr1_crc16_tab, l2, bits_u, 192);
 
 	return rv;
 }
 
+/*! \brief Batched GMR-1 BCCH channel decoder
+ *  \param[out] l2 Array of n L2 packet data pointers
+ *  \param[in] bits_e Array of n burst data bits pointers
+ *  \param[out] crc_rv Array of n CRC check results (0 if pass)
+ *  \param[out] conv_rv Array of n conv. decode results (can be NULL)
+ *  \param[in] n Number of bursts to decode
+ *  \return 0 for success, -errno for failure
+ *
+ * Same as \ref gmr1_bcch_decode but runs the convolutional decoding
+ * of several bursts in parallel (see \ref gmr1_conv_decode_batch).
+ */
+int
+gmr1_bcch_decode_batch(uint8_t * const *l2, const sbit_t * const *bits_e,
+                       int *crc_rv, int *conv_rv, int n)
+{
+	sbit_t bits_c[GMR1_BCCH_BATCH][424];
+	ubit_t bits_u[GMR1_BCCH_BATCH][208];
+	const sbit_t *in[GMR1_BCCH_BATCH];
+	ubit_t *out[GMR1_BCCH_BATCH];
+	int idx[GMR1_BCCH_BATCH], vrv[GMR1_BCCH_BATCH];
+	int i, j, g, m, rv;
+
+	for (i=0; i<n; i+=g)
+	{
+		g = n - i;
+		if (g > GMR1_BCCH_BATCH)
+			g = GMR1_BCCH_BATCH;
+
+		for (j=0, m=0; j<g; j++) {
+			gmr1_gather_sbit(&gmr1_bcch_gather, bits_c[j],
+			                 bits_e[i+j], NULL);
+
+			/* Strong bursts skip the Viterbi decoder */
+			rv = gmr1_codemat_try_decode(&gmr1_bcch_codemat,
+			                             &gmr1_conv_bcch,
+			                             bits_u[j], bits_c[j]);
+			if (rv >= 0 &&
+			    !gmr1_crc_check_pack_ubit(&gmr1_crc16_tab,
+			                              l2[i+j], bits_u[j], 192)) {
+				crc_rv[i+j] = 0;
+				if (conv_rv)
+					conv_rv[i+j] = rv;
+				continue;
+			}
+
+			idx[m]   = j;
+			in[m]    = bits_c[j];
+			out[m++] = bits_u[j];
+		}
+
+		rv = gmr1_conv_decode_batch(&gmr1_conv_bcch, in, out, vrv, m);
+		if (rv)
+			return rv;
+
+		for (j=0; j<m; j++) {
+			crc_rv[i+idx[j]] = gmr1_crc_check_pack_ubit(&gmr1_crc16_tab,
+				l2[i+idx[j]], bits_u[idx[j]], 192);
+			if (conv_rv)
+				conv_rv[i+idx[j]] = vrv[j];
+		}
+	}
+
+	return 0;
+}
+
 /*! @} */
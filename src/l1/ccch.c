@@ -33,22 +33,69 @@
 #include <osmocom/core/conv.h>
 #include <osmocom/core/crc16gen.h>
 
+#include <osmocom/gmr1/l1/codemat.h>
 #include <osmocom/gmr1/l1/conv.h>
 #include <osmocom/gmr1/l1/crc.h>
+#include <osmocom/gmr1/l1/encmap.h>
+#include <osmocom/gmr1/l1/gather.h>
 #include <osmocom/gmr1/l1/interleave.h>
 #include <osmocom/gmr1/l1/scramb.h>
 
+#ifdef GMR1_L1_TABLES_GEN
+#include "gen_tables.h"
+#endif
+
+
+#define GMR1_CCCH_BATCH	16	/*!< \brief Bursts per batched conv. decode */
+
+static struct gmr1_codemat gmr1_ccch_codemat;
+
+#ifdef GMR1_L1_TABLES_GEN
 
 static struct osmo_conv_code gmr1_conv_ccch;
 
-static void __attribute__ ((constructor))
-gmr1_ccch_init(void)
+static struct gmr1_gather gmr1_ccch_gather;
+static struct gmr1_gather_ent gmr1_ccch_gather_ent[428];
+
+/*! \brief Reference burst bits to conv. input path (see \ref gather) */
+static void
+_ccch_unmap(sbit_t *bits_c, const sbit_t *bits_e, const ubit_t *ciph)
+{
+	sbit_t bits_ep[432];
+
+	gmr1_scramble_sbit(bits_ep, bits_e, 432);
+	gmr1_deinterleave_intra(bits_c, &bits_ep[4], 53);
+}
+
+/*! \brief Generates the CCCH tables (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_ccch_gen_tables(FILE *fh)
 {
 	/* Init convolutional coder */
 	memcpy(&gmr1_conv_ccch, &gmr1_conv_12, sizeof(struct osmo_conv_code));
 	gmr1_conv_ccch.len = 208;
+
+	/* Init gather table */
+	gmr1_gather_build(&gmr1_ccch_gather, gmr1_ccch_gather_ent,
+	                  428, 432, 0, _ccch_unmap, NULL);
+
+	/* Print them as const data */
+	gen_tables_conv(fh, "gmr1_conv_ccch", &gmr1_conv_ccch);
+	gen_tables_gather(fh, "gmr1_ccch_gather", &gmr1_ccch_gather);
+
+	return 0;
 }
 
+#else
+
+#define GMR1_L1_TABLES_CCCH
+#include "l1_tables.h"
+
+#endif
+
 
 /*! \brief Stateless GMR-1 CCCH channel coder
  *  \param[out] bits_e Data bits of a burst
@@ -68,13 +115,36 @@ gmr1_ccch_encode(ubit_t *bits_e, const uint8_t *l2)
 	for (i=0; i<4; i++)
 		bits_ep[i] = bits_ep[431-i] = 0;
 
-	osmo_pbit2ubit_ext(bits_u, 0, l2, 0, 192, 1);
-	osmo_crc16gen_set_bits(&gmr1_crc16, bits_u, 192, bits_u+192);
+	gmr1_crc_unpack_set_ubit(&gmr1_crc16_tab, bits_u, l2, 192);
 	osmo_conv_encode(&gmr1_conv_ccch, bits_u, bits_c);
 	gmr1_interleave_intra(&bits_ep[4], bits_c, 53);
 	gmr1_scramble_ubit(bits_e, bits_ep, 432);
 }
 
+static struct gmr1_encmap gmr1_ccch_encmap;
+
+/*! \brief Packed GMR-1 CCCH channel coder
+ *  \param[out] bits_e 432 encoded bits, packed (see \ref encmap)
+ *  \param[in] l2 L2 packet data
+ *  \return 0 for success, -errno for failure
+ *
+ * Same output as \ref gmr1_ccch_encode. The encoder map is built on the
+ * first call.
+ */
+int
+gmr1_ccch_encode_p64(uint64_t *bits_e, const uint8_t *l2)
+{
+	int rv;
+
+	rv = gmr1_encmap_build(&gmr1_ccch_encmap, 24, 432, gmr1_ccch_encode);
+	if (rv)
+		return rv;
+
+	gmr1_encmap_run(&gmr1_ccch_encmap, bits_e, l2);
+
+	return 0;
+}
+
 /*! \brief Stateless GMR-1 CCCH channel decoder
  *  \param[out] l2 L2 packet data
  *  \param[in] bits_e Data bits of a burst
@@ -87,23 +157,93 @@ gmr1_ccch_encode(ubit_t *bits_e, const uint8_t *l2)
 int
 gmr1_ccch_decode(uint8_t *l2, const sbit_t *bits_e, int *conv_rv)
 {
-	sbit_t bits_ep[432];
 	sbit_t bits_c[428];
 	ubit_t bits_u[208];
 	int rv;
 
-	gmr1_scramble_sbit(bits_ep, bits_e, 432);
-	gmr1_deinterleave_intra(bits_c, &bits_ep[4], 53);
+	gmr1_gather_sbit(&gmr1_ccch_gather, bits_c, bits_e, NULL);
+
+	/* Strong burst fast path */
+	rv = gmr1_codemat_try_decode(&gmr1_ccch_codemat, &gmr1_conv_ccch,
+	                             bits_u, bits_c);
+	if (rv >= 0 && !gmr1_crc_check_pack_ubit(&gmr1_crc16_tab, l2, bits_u, 192)) {
+		if (conv_rv)
+			*conv_rv = rv;
+		return 0;
+	}
 
-	rv = osmo_conv_decode(&gmr1_conv_ccch, bits_c, bits_u);
+	rv = gmr1_conv_decode(&gmr1_conv_ccch, bits_c, bits_u);
 	if (conv_rv)
 		*conv_rv = rv;
 
-	rv = osmo_crc16gen_check_bits(&gmr1_crc16, bits_u, 192, bits_u+192);
-
-	osmo_ubit2pbit_ext(l2, 0, bits_u, 0, 192, 1);
+	rv = gmr1_crc_check_pack_ubit(&gmr1_crc16_tab, l2, bits_u, 192);
 
 	return rv;
 }
 
+/*! \brief Batched GMR-1 CCCH channel decoder
+ *  \param[out] l2 Array of n L2 packet data pointers
+ *  \param[in] bits_e Array of n burst data bits pointers
+ *  \param[out] crc_rv Array of n CRC check results (0 if pass)
+ *  \param[out] conv_rv Array of n conv. decode results (can be NULL)
+ *  \param[in] n Number of bursts to decode
+ *  \return 0 for success, -errno for failure
+ *
+ * Same as \ref gmr1_ccch_decode but runs the convolutional decoding
+ * of several bursts in parallel (see \ref gmr1_conv_decode_batch).
+ */
+int
+gmr1_ccch_decode_batch(uint8_t * const *l2, const sbit_t * const *bits_e,
+                       int *crc_rv, int *conv_rv, int n)
+{
+	sbit_t bits_c[GMR1_CCCH_BATCH][428];
+	ubit_t bits_u[GMR1_CCCH_BATCH][208];
+	const sbit_t *in[GMR1_CCCH_BATCH];
+	ubit_t *out[GMR1_CCCH_BATCH];
+	int idx[GMR1_CCCH_BATCH], vrv[GMR1_CCCH_BATCH];
+	int i, j, g, m, rv;
+
+	for (i=0; i<n; i+=g)
+	{
+		g = n - i;
+		if (g > GMR1_CCCH_BATCH)
+			g = GMR1_CCCH_BATCH;
+
+		for (j=0, m=0; j<g; j++) {
+			gmr1_gather_sbit(&gmr1_ccch_gather, bits_c[j],
+			                 bits_e[i+j], NULL);
+
+			/* Strong bursts skip the Viterbi decoder */
+			rv = gmr1_codemat_try_decode(&gmr1_ccch_codemat,
+			                             &gmr1_conv_ccch,
+			                             bits_u[j], bits_c[j]);
+			if (rv >= 0 &&
+			    !gmr1_crc_check_pack_ubit(&gmr1_crc16_tab,
+			                              l2[i+j], bits_u[j], 192)) {
+				crc_rv[i+j] = 0;
+				if (conv_rv)
+					conv_rv[i+j] = rv;
+				continue;
+			}
+
+			idx[m]   = j;
+			in[m]    = bits_c[j];
+			out[m++] = bits_u[j];
+		}
+
+		rv = gmr1_conv_decode_batch(&gmr1_conv_ccch, in, out, vrv, m);
+		if (rv)
+			return rv;
+
+		for (j=0; j<m; j++) {
+			crc_rv[i+idx[j]] = gmr1_crc_check_pack_ubit(&gmr1_crc16_tab,
+				l2[i+idx[j]], bits_u[idx[j]], 192);
+			if (conv_rv)
+				conv_rv[i+idx[j]] = vrv[j];
+		}
+	}
+
+	return 0;
+}
+
 /*! @} */
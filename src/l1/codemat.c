@@ -0,0 +1,361 @@
+/* GMR-1 convolutional code matrices */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup codemat
+ *  @{
+ */
+
+/*! \file l1/codemat.c
+ *  \brief Osmocom GMR-1 convolutional code matrices implementation
+ */
+
+/*
+ * A (punctured) convolutional code with zero initial state is a linear
+ * block code c = G.u . G is obtained by encoding unit vectors (like
+ * gmr1_gen_mat does for FACCH3). Gauss-Jordan elimination of G^T gives
+ * an information set (the pivot columns), from which we derive :
+ *  - H : one parity check per non-pivot coded bit
+ *  - R : how to get u back from the information set of a codeword
+ *
+ * If the hard decisions of a burst form a codeword (H.y = 0) and none
+ * of them is an erasure, that codeword minimizes every branch metric
+ * term at once, so it is the maximum likelihood one : the Viterbi
+ * decoder would return exactly u = R.y, and its path metric is known
+ * directly from the soft bits. This is used as a fast path ahead of the
+ * Viterbi decoder for strong bursts. To make it cheap, R and H are
+ * merged in nibble tables indexed by 4 hard decisions at a time, giving
+ * [u | H.y] with a single XOR pass over the burst.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+
+#include <osmocom/gmr1/l1/codemat.h>
+
+
+#define W64(n)		(((n) + 63) >> 6)
+#define BIT_GET(r,i)	(((r)[(i) >> 6] >> ((i) & 63)) & 1)
+#define BIT_SET(r,i)	((r)[(i) >> 6] |= 1ULL << ((i) & 63))
+
+/*! \brief Serializes the lazy builds of \ref gmr1_codemat_try_decode */
+static pthread_mutex_t gmr1_codemat_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*! \brief Builds the matrices of a convolutional code
+ *  \param[out] cm Code matrices to build
+ *  \param[in] code Convolutional code (with its final length/puncturing)
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_codemat_build(struct gmr1_codemat *cm, const struct osmo_conv_code *code)
+{
+	int k = code->len;
+	int n = osmo_conv_get_output_length(code, 0);
+	int kw = W64(k), nw = W64(n);
+	int sw = W64(n - k), dw = kw + sw;
+	uint64_t *A = NULL, *T = NULL, *G = NULL, *H = NULL, *R = NULL, *D = NULL;
+	ubit_t *u = NULL, *c = NULL;
+	int *piv = NULL;
+	int i, j, r, col, w, rv;
+
+	memset(cm, 0x00, sizeof(struct gmr1_codemat));
+
+	A   = calloc(k * nw, sizeof(uint64_t));
+	T   = calloc(k * kw, sizeof(uint64_t));
+	G   = calloc(n * kw, sizeof(uint64_t));
+	H   = calloc((n - k) * nw, sizeof(uint64_t));
+	R   = calloc(k * nw, sizeof(uint64_t));
+	D   = calloc(((n + 3) >> 2) * 16 * dw, sizeof(uint64_t));
+	u   = calloc(k, sizeof(ubit_t));
+	c   = calloc(n, sizeof(ubit_t));
+	piv = calloc(k, sizeof(int));
+	if (!A || !T || !G || !H || !R || !D || !u || !c || !piv) {
+		rv = -ENOMEM;
+		goto err;
+	}
+
+	/* A = G^T (row i is the codeword of the i-th unit vector), T = I */
+	for (i=0; i<k; i++) {
+		u[i] = 1;
+		osmo_conv_encode(code, u, c);
+		u[i] = 0;
+
+		for (j=0; j<n; j++) {
+			if (c[j]) {
+				BIT_SET(&A[i*nw], j);
+				BIT_SET(&G[j*kw], i);
+			}
+		}
+
+		BIT_SET(&T[i*kw], i);
+	}
+
+	/* Gauss-Jordan on [A | T] */
+	for (col=0, r=0; col<n && r<k; col++) {
+		for (i=r; i<k; i++)
+			if (BIT_GET(&A[i*nw], col))
+				break;
+
+		if (i == k)
+			continue;
+
+		if (i != r) {
+			for (w=0; w<nw; w++) {
+				uint64_t t = A[i*nw+w]; A[i*nw+w] = A[r*nw+w]; A[r*nw+w] = t;
+			}
+			for (w=0; w<kw; w++) {
+				uint64_t t = T[i*kw+w]; T[i*kw+w] = T[r*kw+w]; T[r*kw+w] = t;
+			}
+		}
+
+		for (i=0; i<k; i++) {
+			if (i == r || !BIT_GET(&A[i*nw], col))
+				continue;
+			for (w=0; w<nw; w++)
+				A[i*nw+w] ^= A[r*nw+w];
+			for (w=0; w<kw; w++)
+				T[i*kw+w] ^= T[r*kw+w];
+		}
+
+		piv[r++] = col;
+	}
+
+	if (r != k) {
+		rv = -EINVAL;
+		goto err;
+	}
+
+	/* H : c[q] + sum_j A[j][q].c[piv[j]] = 0 for each non pivot q */
+	for (col=0, r=0, i=0; col<n; col++) {
+		uint64_t *h;
+
+		if (r < k && piv[r] == col) {
+			r++;
+			continue;
+		}
+
+		h = &H[(i++)*nw];
+		BIT_SET(h, col);
+		for (j=0; j<k; j++)
+			if (BIT_GET(&A[j*nw], col))
+				BIT_SET(h, piv[j]);
+	}
+
+	/* R : u[i] = sum_j T[j][i].c[piv[j]] */
+	for (j=0; j<k; j++)
+		for (i=0; i<k; i++)
+			if (BIT_GET(&T[j*kw], i))
+				BIT_SET(&R[i*nw], piv[j]);
+
+	/* D : column j of R and H for each single bit, then all nibbles */
+	for (j=0; j<n; j++) {
+		uint64_t *d = &D[((j >> 2) * 16 + (1 << (j & 3))) * dw];
+
+		for (i=0; i<k; i++)
+			if (BIT_GET(&R[i*nw], j))
+				BIT_SET(d, i);
+
+		for (i=0; i<n-k; i++)
+			if (BIT_GET(&H[i*nw], j))
+				BIT_SET(&d[kw], i);
+	}
+
+	for (j=0; j<((n + 3) >> 2); j++) {
+		uint64_t *d = &D[j * 16 * dw];
+		int v;
+
+		for (v=3; v<16; v++) {
+			if (!(v & (v-1)))
+				continue;
+			for (w=0; w<dw; w++)
+				d[v*dw+w] = d[(v & (v-1))*dw+w] ^ d[(v & -v)*dw+w];
+		}
+	}
+
+	free(piv);
+	free(c);
+	free(u);
+	free(T);
+	free(A);
+
+	cm->k  = k;
+	cm->n  = n;
+	cm->kw = kw;
+	cm->nw = nw;
+	cm->sw = sw;
+	cm->G  = G;
+	cm->H  = H;
+	cm->R  = R;
+	cm->D  = D;
+
+	return 0;
+
+err:
+	free(piv);
+	free(c);
+	free(u);
+	free(D);
+	free(R);
+	free(H);
+	free(G);
+	free(T);
+	free(A);
+
+	return rv;
+}
+
+/*! \brief Releases the matrices of a convolutional code
+ *  \param[in] cm Code matrices to release
+ */
+void
+gmr1_codemat_free(struct gmr1_codemat *cm)
+{
+	free(cm->D);
+	free(cm->R);
+	free(cm->H);
+	free(cm->G);
+
+	memset(cm, 0x00, sizeof(struct gmr1_codemat));
+}
+
+/*! \brief Hard decision decoding of a codeword
+ *  \param[in] cm Code matrices
+ *  \param[out] output k decoded bits
+ *  \param[in] input n soft bits
+ *  \param[in] thr Minimum soft bit magnitude (>= 1)
+ *  \return Path metric (as \ref gmr1_conv_decode) if the hard decisions
+ *          are a codeword, -1 otherwise.
+ *
+ * output is only valid when a metric is returned.
+ */
+int
+gmr1_codemat_hard_decode(const struct gmr1_codemat *cm,
+                         ubit_t *output, const sbit_t *input, int thr)
+{
+	const int dw = cm->kw + cm->sw;
+	uint64_t acc[dw];
+	int i, w, weak, metric;
+
+	/* Strength check & path metric */
+	weak = 0;
+	metric = 0;
+
+	for (i=0; i<cm->n; i++) {
+		int v = input[i];
+		int d = 127 - (v < 0 ? -v : v);
+		weak |= (v < thr) & (v > -thr);
+		metric += (d * d) >> 9;
+	}
+
+	if (weak)
+		return -1;
+
+	/* [u | H.y] by nibbles of hard decisions */
+	memset(acc, 0x00, sizeof(acc));
+
+	for (i=0; i<cm->n; i+=4) {
+		const uint64_t *d;
+		int v;
+
+		v = (input[i] < 0);
+		if (i + 1 < cm->n) v |= (input[i+1] < 0) << 1;
+		if (i + 2 < cm->n) v |= (input[i+2] < 0) << 2;
+		if (i + 3 < cm->n) v |= (input[i+3] < 0) << 3;
+
+		d = &cm->D[((i >> 2) * 16 + v) * dw];
+
+		for (w=0; w<dw; w++)
+			acc[w] ^= d[w];
+	}
+
+	/* Syndrome */
+	for (w=cm->kw; w<dw; w++)
+		if (acc[w])
+			return -1;
+
+	for (i=0; i<cm->k; i++)
+		output[i] = (acc[i >> 6] >> (i & 63)) & 1;
+
+	return metric;
+}
+
+/*! \brief Decoders hard decision fast path
+ *  \param[inout] cm Code matrices (built on first use, zero initialized)
+ *  \param[in] code Convolutional code
+ *  \param[out] output Decoded bits
+ *  \param[in] input Soft bits, as for \ref gmr1_conv_decode
+ *  \return Path metric if the fast path was taken, -1 if the Viterbi
+ *          decoder is needed.
+ *
+ * When a metric is returned, output and metric are what
+ * \ref gmr1_conv_decode would return. Tail biting codes are excluded
+ * since their decoder is not exactly maximum likelihood. Only bursts
+ * where every soft bit is at least \ref GMR1_CODEMAT_THR strong try the
+ * fast path.
+ *
+ * Can be called from any thread: the build is serialized and the
+ * matrices are only published once complete.
+ */
+int
+gmr1_codemat_try_decode(struct gmr1_codemat *cm,
+                        const struct osmo_conv_code *code,
+                        ubit_t *output, const sbit_t *input)
+{
+	struct gmr1_codemat tmp;
+
+	if (code->term == CONV_TERM_TAIL_BITING)
+		return -1;
+
+	/* Fast path, pairs with the release store below */
+	if (__atomic_load_n(&cm->D, __ATOMIC_ACQUIRE))
+		goto decode;
+
+	pthread_mutex_lock(&gmr1_codemat_lock);
+
+	if (!cm->D) {
+		if (gmr1_codemat_build(&tmp, code)) {
+			pthread_mutex_unlock(&gmr1_codemat_lock);
+			return -1;
+		}
+
+		/* Everything but D, then D to publish */
+		cm->k  = tmp.k;
+		cm->n  = tmp.n;
+		cm->kw = tmp.kw;
+		cm->nw = tmp.nw;
+		cm->sw = tmp.sw;
+		cm->G  = tmp.G;
+		cm->H  = tmp.H;
+		cm->R  = tmp.R;
+		__atomic_store_n(&cm->D, tmp.D, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&gmr1_codemat_lock);
+
+decode:
+	return gmr1_codemat_hard_decode(cm, output, input, GMR1_CODEMAT_THR);
+}
+
+/*! @} */
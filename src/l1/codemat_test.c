@@ -0,0 +1,187 @@
+/* GMR-1 hard decision decoder test */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file l1/codemat_test.c
+ *  \brief Osmocom GMR-1 hard decision decoder test
+ *
+ * Checks that whenever \ref gmr1_codemat_try_decode takes the fast path,
+ * its output and metric are the ones of \ref gmr1_conv_decode, for every
+ * code with a fast path. Strong bursts (every soft bit at least
+ * GMR1_CODEMAT_THR, right sign) must all take it. Bursts with a few
+ * wrong signs may or may not, and bursts with a weak bit must not. The
+ * tail biting TCH3 speech code must never take it.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+
+#include <osmocom/gmr1/l1/codemat.h>
+#include <osmocom/gmr1/l1/conv.h>
+#include <osmocom/gmr1/l1/punct.h>
+
+
+#define TEST_RUNS	256	/* Bursts per code and kind */
+#define TEST_MAX_IN	1024
+#define TEST_MAX_OUT	2048
+
+
+struct test_code {
+	const char *name;
+	const struct osmo_conv_code *base;
+	int len;
+	const struct gmr1_puncturer *punct[3];
+	int repeat;
+};
+
+static const struct test_code test_codes[] = {
+	{ "BCCH/CCCH",   &gmr1_conv_12,   208, { NULL, NULL, NULL }, 0 },
+	{ "FACCH3",      &gmr1_conv_14,    92, { NULL, NULL, NULL }, 0 },
+	{ "FACCH9",      &gmr1_conv_12,   316, { NULL, NULL, NULL }, 0 },
+	{ "RACH",        &gmr1_conv_14,   159, { NULL, NULL, NULL }, 0 },
+	{ "TCH3 speech", &gmr1_conv_tch3,  48,
+		{ NULL, &gmr1_punct12_P12, NULL }, 0 },
+	{ "TCH9 2.4k",   &gmr1_conv_15,   144,
+		{ &gmr1_punct15_P53, &gmr1_punct15_P23, &gmr1_punct15_Ps53 }, 41 },
+	{ "TCH9 4.8k",   &gmr1_conv_13,   240,
+		{ &gmr1_punct13_P15, &gmr1_punct13_P25, &gmr1_punct13_Ps15 }, 41 },
+	{ "TCH9 9.6k",   &gmr1_conv_12,   480,
+		{ &gmr1_punct12_P25, &gmr1_punct12_P23, &gmr1_punct12_Ps25 }, 158 },
+};
+
+/* RACH puncturing: b[4i+2] and b[4i+3] for i < 135 (see rach.c) */
+static int test_rach_punct[135*2 + 1];
+
+
+/*! \brief One burst of a given kind, returns 1 on mismatch */
+static int
+test_burst(struct gmr1_codemat *cm, const struct osmo_conv_code *code,
+           int kind, int *fast)
+{
+	ubit_t u[TEST_MAX_IN], e[TEST_MAX_OUT];
+	ubit_t o_ref[TEST_MAX_IN], o_tst[TEST_MAX_IN];
+	sbit_t s[TEST_MAX_OUT];
+	int i, ol, m_ref, m_tst;
+
+	ol = osmo_conv_get_output_length(code, 0);
+
+	for (i=0; i<code->len; i++)
+		u[i] = rand() & 1;
+
+	osmo_conv_encode(code, u, e);
+
+	/* Strong bits, right sign */
+	for (i=0; i<ol; i++) {
+		int v = GMR1_CODEMAT_THR + rand() % (128 - GMR1_CODEMAT_THR);
+		s[i] = e[i] ? -v : v;
+	}
+
+	/* 1: a few wrong signs, 2: one weak bit */
+	if (kind == 1) {
+		for (i=0; i<3; i++)
+			s[rand() % ol] *= -1;
+	} else if (kind == 2) {
+		s[rand() % ol] = (GMR1_CODEMAT_THR - 1) * ((rand() & 1) ? 1 : -1);
+	}
+
+	m_tst = gmr1_codemat_try_decode(cm, code, o_tst, s);
+
+	*fast = m_tst >= 0;
+
+	if (m_tst < 0)
+		return (kind == 0) && (code->term != CONV_TERM_TAIL_BITING);
+
+	if ((kind == 2) || (code->term == CONV_TERM_TAIL_BITING))
+		return 1;
+
+	m_ref = gmr1_conv_decode(code, s, o_ref);
+
+	return (m_ref != m_tst) || memcmp(o_ref, o_tst, code->len);
+}
+
+int main(int argc, char *argv[])
+{
+	struct osmo_conv_code code;
+	struct gmr1_codemat cm;
+	const struct test_code *tc;
+	int i, k, r, rv, bad = 0;
+
+	srand(1);
+
+	for (i=0; i<135; i++) {
+		test_rach_punct[(i<<1)  ] = (i << 2) + 2;
+		test_rach_punct[(i<<1)+1] = (i << 2) + 3;
+	}
+	test_rach_punct[270] = -1;
+
+	printf("%-12s %8s %8s %8s\n", "code", "strong", "errors", "weak");
+
+	for (i=0; i<sizeof(test_codes)/sizeof(test_codes[0]); i++)
+	{
+		int fast[3] = { 0, 0, 0 }, n = 0;
+
+		tc = &test_codes[i];
+
+		memcpy(&code, tc->base, sizeof(code));
+		code.len = tc->len;
+
+		if (!strcmp(tc->name, "RACH"))
+			code.puncture = test_rach_punct;
+
+		if (tc->punct[1]) {
+			rv = gmr1_puncturer_generate(&code,
+				tc->punct[0], tc->punct[1], tc->punct[2],
+				tc->repeat);
+			if (rv) {
+				fprintf(stderr, "[!] %s: puncturer failed\n", tc->name);
+				return 1;
+			}
+		}
+
+		memset(&cm, 0x00, sizeof(cm));
+
+		for (k=0; k<3; k++) {
+			for (r=0; r<TEST_RUNS; r++) {
+				int f;
+				n += test_burst(&cm, &code, k, &f);
+				fast[k] += f;
+			}
+		}
+
+		/* Fast path taken, out of TEST_RUNS, for each kind */
+		printf("%-12s %8d %8d %8d%s\n", tc->name,
+			fast[0], fast[1], fast[2], n ? " FAIL" : "");
+
+		if (n) {
+			fprintf(stderr, "[!] %s: %d mismatches\n", tc->name, n);
+			bad += n;
+		}
+
+		gmr1_codemat_free(&cm);
+
+		if (tc->punct[1])
+			free((void *)code.puncture);
+	}
+
+	return bad ? 1 : 0;
+}
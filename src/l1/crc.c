@@ -31,6 +31,13 @@
 #include <osmocom/core/bits.h>
 #include <osmocom/core/crcgen.h>
 
+#include <osmocom/gmr1/l1/crc.h>
+
+#ifdef GMR1_L1_TABLES_GEN
+#include <string.h>
+#include "gen_tables.h"
+#endif
+
 
 /*! \brief GMR-1 CRC8
  *  g8(D) = D8 + D7 + D4 + D3 + D + 1
@@ -62,4 +69,254 @@ const struct osmo_crc16gen_code gmr1_crc16 = {
 	.remainder = 0x0000,
 };
 
+
+/* ------------------------------------------------------------------------ */
+/* Table driven implementation                                              */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * All the GMR-1 data blocks are packed LSB first (i.e. the first bit of
+ * the block is bit 0 of the first byte). So the CRC engine works on the
+ * bit-reversed shift register : reflected polynom, register shifted right
+ * and packed data is processed 4 bytes at a time using 4 tables (the
+ * classic 'slice-by-4'). Remaining bits are processed one by one.
+ * The register only needs to be reversed when a CRC value is returned.
+ * The tables are generated at build time.
+ */
+
+static uint16_t
+_crc_reverse(uint16_t v, int n)
+{
+	uint16_t r = 0;
+	int i;
+
+	for (i=0; i<n; i++)
+		r |= ((v >> i) & 1) << (n - i - 1);
+
+	return r;
+}
+
+#ifdef GMR1_L1_TABLES_GEN
+
+/*
+ * The generator only prints the tables, it never computes a CRC, so
+ * these only carry the parameters.
+ */
+
+/*! \brief GMR-1 CRC8 table driven context */
+const struct gmr1_crc_tab gmr1_crc8_tab  = { .bits =  8, .poly = 0x9b   };
+
+/*! \brief GMR-1 CRC12 table driven context */
+const struct gmr1_crc_tab gmr1_crc12_tab = { .bits = 12, .poly = 0x80f  };
+
+/*! \brief GMR-1 CRC16 table driven context */
+const struct gmr1_crc_tab gmr1_crc16_tab = { .bits = 16, .poly = 0x1021 };
+
+
+static void
+_crc_tab_gen(FILE *fh, const char *name, const struct gmr1_crc_tab *params)
+{
+	struct gmr1_crc_tab ct;
+	uint16_t r;
+	int i, j;
+
+	memset(&ct, 0x00, sizeof(ct));
+
+	ct.bits  = params->bits;
+	ct.poly  = params->poly;
+	ct.rpoly = _crc_reverse(ct.poly, ct.bits);
+
+	for (i=0; i<256; i++) {
+		r = i;
+		for (j=0; j<8; j++)
+			r = (r & 1) ? ((r >> 1) ^ ct.rpoly) : (r >> 1);
+		ct.t[0][i] = r;
+	}
+
+	for (j=1; j<4; j++)
+		for (i=0; i<256; i++) {
+			r = ct.t[j-1][i];
+			ct.t[j][i] = (r >> 8) ^ ct.t[0][r & 0xff];
+		}
+
+	gen_tables_crc(fh, name, &ct);
+}
+
+/*! \brief Generates the CRC tables (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_crc_gen_tables(FILE *fh)
+{
+	_crc_tab_gen(fh, "gmr1_crc8_tab",  &gmr1_crc8_tab);
+	_crc_tab_gen(fh, "gmr1_crc12_tab", &gmr1_crc12_tab);
+	_crc_tab_gen(fh, "gmr1_crc16_tab", &gmr1_crc16_tab);
+
+	return 0;
+}
+
+#else
+
+#define GMR1_L1_TABLES_CRC
+#include "l1_tables.h"
+
+#endif
+
+
+static inline uint16_t
+_crc_bytes(const struct gmr1_crc_tab *ct, uint16_t r, const uint8_t *in, int n)
+{
+	while (n >= 4) {
+		r = ct->t[3][(r ^ in[0]) & 0xff] ^
+		    ct->t[2][((r >> 8) ^ in[1]) & 0xff] ^
+		    ct->t[1][in[2]] ^
+		    ct->t[0][in[3]];
+		in += 4;
+		n  -= 4;
+	}
+
+	while (n--)
+		r = (r >> 8) ^ ct->t[0][(r ^ *in++) & 0xff];
+
+	return r;
+}
+
+static inline uint16_t
+_crc_bits(const struct gmr1_crc_tab *ct, uint16_t r, uint8_t v, int n)
+{
+	/* n LSBs of v */
+	r ^= v;
+	while (n--)
+		r = (r & 1) ? ((r >> 1) ^ ct->rpoly) : (r >> 1);
+
+	return r;
+}
+
+static inline uint8_t
+_ubit_pack8(const ubit_t *in)
+{
+	return   (in[0] & 1)       | ((in[1] & 1) << 1) |
+		((in[2] & 1) << 2) | ((in[3] & 1) << 3) |
+		((in[4] & 1) << 4) | ((in[5] & 1) << 5) |
+		((in[6] & 1) << 6) | ((in[7] & 1) << 7);
+}
+
+static inline uint16_t
+_ubit_packn(const ubit_t *in, int n)
+{
+	uint16_t v = 0;
+	int i;
+
+	for (i=0; i<n; i++)
+		v |= (in[i] & 1) << i;
+
+	return v;
+}
+
+static uint16_t
+_pack_ubit(const struct gmr1_crc_tab *ct,
+           uint8_t *out, const ubit_t *in, int len)
+{
+	uint16_t r;
+	int n = len >> 3;
+	int i;
+
+	for (i=0; i<n; i++)
+		out[i] = _ubit_pack8(&in[i<<3]);
+
+	r = _crc_bytes(ct, 0, out, n);
+
+	if (len & 7) {
+		uint8_t m = (1 << (len & 7)) - 1;
+		uint8_t v = _ubit_packn(&in[n<<3], len & 7);
+		out[n] = (out[n] & ~m) | v;
+		r = _crc_bits(ct, r, v, len & 7);
+	}
+
+	return r;
+}
+
+
+/*! \brief Computes the CRC of packed data
+ *  \param[in] ct CRC table context
+ *  \param[in] in Packed input bits (LSB first)
+ *  \param[in] len Number of data bits
+ *  \return CRC value
+ */
+uint16_t
+gmr1_crc_compute_pbit(const struct gmr1_crc_tab *ct, const uint8_t *in, int len)
+{
+	uint16_t r;
+
+	r = _crc_bytes(ct, 0, in, len >> 3);
+
+	if (len & 7)
+		r = _crc_bits(ct, r, in[len >> 3] & ((1 << (len & 7)) - 1), len & 7);
+
+	return _crc_reverse(r, ct->bits);
+}
+
+/*! \brief Packs unpacked bits and computes their CRC in a single pass
+ *  \param[in] ct CRC table context
+ *  \param[out] out Packed output bits (LSB first)
+ *  \param[in] in Unpacked input bits
+ *  \param[in] len Number of data bits
+ *  \return CRC value
+ *
+ * The packing is done like osmo_ubit2pbit_ext(out, 0, in, 0, len, 1),
+ * i.e. the unused MSBs of the last byte are left untouched.
+ */
+uint16_t
+gmr1_crc_pack_ubit(const struct gmr1_crc_tab *ct,
+                   uint8_t *out, const ubit_t *in, int len)
+{
+	return _crc_reverse(_pack_ubit(ct, out, in, len), ct->bits);
+}
+
+/*! \brief Packs unpacked bits and checks their CRC in a single pass
+ *  \param[in] ct CRC table context
+ *  \param[out] out Packed output bits (LSB first)
+ *  \param[in] in Unpacked input bits, followed by the CRC bits
+ *  \param[in] len Number of data bits
+ *  \return 0 if CRC matches. 1 in the other case.
+ *
+ * Equivalent of osmo_crc*gen_check_bits() followed by
+ * osmo_ubit2pbit_ext(out, 0, in, 0, len, 1).
+ */
+int
+gmr1_crc_check_pack_ubit(const struct gmr1_crc_tab *ct,
+                         uint8_t *out, const ubit_t *in, int len)
+{
+	uint16_t r = _pack_ubit(ct, out, in, len);
+	return r != _ubit_packn(&in[len], ct->bits);
+}
+
+/*! \brief Unpacks packed bits and appends their CRC
+ *  \param[in] ct CRC table context
+ *  \param[out] out Unpacked output bits, len data bits + CRC bits
+ *  \param[in] in Packed input bits (LSB first)
+ *  \param[in] len Number of data bits
+ *
+ * Equivalent of osmo_pbit2ubit_ext(out, 0, in, 0, len, 1) followed by
+ * osmo_crc*gen_set_bits(), with the CRC computed on the packed data.
+ */
+void
+gmr1_crc_unpack_set_ubit(const struct gmr1_crc_tab *ct,
+                         ubit_t *out, const uint8_t *in, int len)
+{
+	uint16_t r;
+	int i;
+
+	r = _crc_bytes(ct, 0, in, len >> 3);
+
+	if (len & 7)
+		r = _crc_bits(ct, r, in[len >> 3] & ((1 << (len & 7)) - 1), len & 7);
+
+	osmo_pbit2ubit_ext(out, 0, in, 0, len, 1);
+
+	for (i=0; i<ct->bits; i++)
+		out[len+i] = (r >> i) & 1;
+}
+
 /*! @} */
@@ -0,0 +1,167 @@
+/* GMR-1 table driven CRC test */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file l1/crc_test.c
+ *  \brief Osmocom GMR-1 table driven CRC test
+ *
+ * Checks the table driven CRC functions against the bit by bit
+ * osmo_crc*gen ones and osmo_ubit2pbit_ext / osmo_pbit2ubit_ext, for
+ * the three GMR-1 CRCs over random data of every length up to
+ * TEST_MAX_LEN bits, with and without corrupted bits.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/crcgen.h>
+
+#include <osmocom/gmr1/l1/crc.h>
+
+
+#define TEST_MAX_LEN	512	/* Data bits */
+#define TEST_RUNS	8	/* Random blocks per length */
+
+
+struct test_crc {
+	const char *name;
+	const struct gmr1_crc_tab *tab;
+	const struct osmo_crc8gen_code *c8;
+	const struct osmo_crc16gen_code *c16;
+};
+
+static const struct test_crc test_crcs[] = {
+	{ "CRC8",  &gmr1_crc8_tab,  &gmr1_crc8, NULL },
+	{ "CRC12", &gmr1_crc12_tab, NULL, &gmr1_crc12 },
+	{ "CRC16", &gmr1_crc16_tab, NULL, &gmr1_crc16 },
+};
+
+
+/*! \brief Reference CRC bits of unpacked data */
+static void
+ref_set_bits(const struct test_crc *tc, const ubit_t *in, int len, ubit_t *crc)
+{
+	if (tc->c8)
+		osmo_crc8gen_set_bits(tc->c8, in, len, crc);
+	else
+		osmo_crc16gen_set_bits(tc->c16, in, len, crc);
+}
+
+/*! \brief Reference CRC check of unpacked data */
+static int
+ref_check_bits(const struct test_crc *tc, const ubit_t *in, int len,
+               const ubit_t *crc)
+{
+	if (tc->c8)
+		return osmo_crc8gen_check_bits(tc->c8, in, len, crc);
+	else
+		return osmo_crc16gen_check_bits(tc->c16, in, len, crc);
+}
+
+/*! \brief Checks one random block, returns the number of mismatches */
+static int
+test_block(const struct test_crc *tc, int len)
+{
+	const int bits = tc->tab->bits;
+	ubit_t u[TEST_MAX_LEN + 16], u_tst[TEST_MAX_LEN + 16];
+	uint8_t p[TEST_MAX_LEN / 8 + 1];
+	uint8_t p_ref[TEST_MAX_LEN / 8 + 1], p_tst[TEST_MAX_LEN / 8 + 1];
+	uint16_t crc;
+	int i, e, bad = 0;
+
+	for (i=0; i<len; i++)
+		u[i] = rand() & 1;
+
+	ref_set_bits(tc, u, len, &u[len]);
+
+	for (i=0, crc=0; i<bits; i++)
+		crc = (crc << 1) | u[len+i];
+
+	/* Packing and CRC value */
+	memset(p_ref, 0x5a, sizeof(p_ref));
+	memset(p_tst, 0x5a, sizeof(p_tst));
+
+	osmo_ubit2pbit_ext(p_ref, 0, u, 0, len, 1);
+
+	if ((gmr1_crc_pack_ubit(tc->tab, p_tst, u, len) != crc) ||
+	    memcmp(p_ref, p_tst, sizeof(p_ref)))
+		bad++;
+
+	if (gmr1_crc_compute_pbit(tc->tab, p_ref, len) != crc)
+		bad++;
+
+	/* Unpacking with CRC, from packed data with junk in the last byte */
+	memcpy(p, p_ref, sizeof(p));
+
+	gmr1_crc_unpack_set_ubit(tc->tab, u_tst, p, len);
+
+	if (memcmp(u, u_tst, len + bits))
+		bad++;
+
+	/* Check, intact then with one flipped data bit and one flipped CRC bit */
+	for (e=0; e<3; e++)
+	{
+		memcpy(u_tst, u, len + bits);
+
+		if (e == 1 && len)
+			u_tst[rand() % len] ^= 1;
+		else if (e == 2)
+			u_tst[len + (rand() % bits)] ^= 1;
+
+		memset(p_ref, 0x5a, sizeof(p_ref));
+		memset(p_tst, 0x5a, sizeof(p_tst));
+
+		osmo_ubit2pbit_ext(p_ref, 0, u_tst, 0, len, 1);
+
+		if ((!gmr1_crc_check_pack_ubit(tc->tab, p_tst, u_tst, len) !=
+		     !ref_check_bits(tc, u_tst, len, &u_tst[len])) ||
+		    memcmp(p_ref, p_tst, sizeof(p_ref)))
+			bad++;
+	}
+
+	return bad;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, len, r, bad = 0;
+
+	srand(1);
+
+	for (i=0; i<sizeof(test_crcs)/sizeof(test_crcs[0]); i++)
+	{
+		const struct test_crc *tc = &test_crcs[i];
+		int n = 0;
+
+		for (len=0; len<=TEST_MAX_LEN; len++)
+			for (r=0; r<TEST_RUNS; r++)
+				n += test_block(tc, len);
+
+		printf("%-6s %s\n", tc->name, n ? "FAIL" : "ok");
+
+		if (n)
+			fprintf(stderr, "[!] %s: %d mismatches\n", tc->name, n);
+
+		bad += n;
+	}
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+/* GMR-1 packed encoder maps */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup encmap
+ *  @{
+ */
+
+/*! \file l1/encmap.c
+ *  \brief Osmocom GMR-1 packed encoder maps implementation
+ */
+
+/*
+ * All the steps of the channel encoders (CRC, convolutional coding,
+ * puncturing, interleaving, scrambling) are affine over GF(2), so a
+ * whole encoder is out = base ^ M.in . The map is recovered by probing
+ * the reference encoder once per input bit and stored as one table per
+ * input nibble, holding the XOR of the columns for each of the 16
+ * possible nibble values. Encoding is then 2 lookups per input byte and
+ * a XOR of the output words.
+ *
+ * Packed output ('p64') uses 64 bits words, bit k of the burst being
+ * bit (k & 63) of word (k >> 6).
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+
+#include <osmocom/gmr1/l1/encmap.h>
+
+
+static inline uint64_t
+_p64_get(const uint64_t *in, int pos, int n)
+{
+	int w = pos >> 6, s = pos & 63;
+	uint64_t v = in[w] >> s;
+
+	if (s && (s + n > 64))
+		v |= in[w+1] << (64 - s);
+
+	if (n < 64)
+		v &= (1ULL << n) - 1;
+
+	return v;
+}
+
+static inline void
+_p64_xor(uint64_t *out, int pos, uint64_t v, int n)
+{
+	int w = pos >> 6, s = pos & 63;
+
+	out[w] ^= v << s;
+
+	if (s && (s + n > 64))
+		out[w+1] ^= v >> (64 - s);
+}
+
+/*! \brief XORs a range of packed bits into another packed bit array
+ *  \param[inout] out Packed bits to XOR into
+ *  \param[in] out_ofs Bit offset in out
+ *  \param[in] in Packed bits to read
+ *  \param[in] in_ofs Bit offset in in
+ *  \param[in] len Number of bits
+ */
+void
+gmr1_p64_xor_bits(uint64_t *out, int out_ofs,
+                  const uint64_t *in, int in_ofs, int len)
+{
+	int n;
+
+	while (len > 0) {
+		n = len > 64 ? 64 : len;
+		_p64_xor(out, out_ofs, _p64_get(in, in_ofs, n), n);
+		out_ofs += n;
+		in_ofs  += n;
+		len     -= n;
+	}
+}
+
+/*! \brief XORs unpacked bits into a packed bit array
+ *  \param[inout] out Packed bits to XOR into
+ *  \param[in] out_ofs Bit offset in out
+ *  \param[in] in Unpacked bits to read
+ *  \param[in] len Number of bits
+ */
+void
+gmr1_p64_xor_ubit(uint64_t *out, int out_ofs, const ubit_t *in, int len)
+{
+	uint64_t v;
+	int i, n;
+
+	while (len > 0) {
+		n = len > 64 ? 64 : len;
+
+		v = 0;
+		for (i=0; i<n; i++)
+			v |= (uint64_t)(in[i] & 1) << i;
+
+		_p64_xor(out, out_ofs, v, n);
+
+		out_ofs += n;
+		in      += n;
+		len     -= n;
+	}
+}
+
+/*! \brief Unpacks a packed bit array
+ *  \param[out] out Unpacked bits
+ *  \param[in] in Packed bits
+ *  \param[in] len Number of bits
+ */
+void
+gmr1_p64_to_ubit(ubit_t *out, const uint64_t *in, int len)
+{
+	int i;
+
+	for (i=0; i<len; i++)
+		out[i] = (in[i >> 6] >> (i & 63)) & 1;
+}
+
+
+/*! \brief Serializes the map builds */
+static pthread_mutex_t gmr1_encmap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*! \brief Builds a packed encoder map by probing a reference encoder
+ *  \param[out] em Encoder map to build
+ *  \param[in] in_len Input length of the encoder (bytes)
+ *  \param[in] out_len Output length of the encoder (bits)
+ *  \param[in] ref Reference encoder
+ *  \return 0 for success, -errno for failure
+ *
+ * Does nothing if the map was already built, so this can be called
+ * before each use, from any thread: builds are serialized and a map is
+ * only published once complete. ref must be an affine function of its
+ * input bits and can use any bit ordering for the input bytes.
+ */
+int
+gmr1_encmap_build(struct gmr1_encmap *em, int in_len, int out_len,
+                  gmr1_encmap_ref_t ref)
+{
+	int W = GMR1_P64_WORDS(out_len);
+	uint8_t *in = NULL;
+	ubit_t *out = NULL;
+	uint64_t *base = NULL, *tab = NULL;
+	int i, b, r, v, w;
+
+	/* Fast path, pairs with the release store below */
+	if (__atomic_load_n(&em->tab, __ATOMIC_ACQUIRE))
+		return 0;
+
+	pthread_mutex_lock(&gmr1_encmap_lock);
+
+	if (em->tab) {
+		pthread_mutex_unlock(&gmr1_encmap_lock);
+		return 0;
+	}
+
+	in   = calloc(in_len, sizeof(uint8_t));
+	out  = calloc(out_len, sizeof(ubit_t));
+	base = calloc(W, sizeof(uint64_t));
+	tab  = calloc(2 * in_len * 16 * W, sizeof(uint64_t));
+	if (!in || !out || !base || !tab)
+		goto err;
+
+	/* Constant part */
+	ref(out, in);
+	gmr1_p64_xor_ubit(base, 0, out, out_len);
+
+	/* One column per input bit */
+	for (i=0; i<in_len; i++) {
+		for (b=0; b<8; b++) {
+			uint64_t *col = &tab[((2*i + (b >> 2)) * 16 + (1 << (b & 3))) * W];
+
+			in[i] = 1 << b;
+			ref(out, in);
+			in[i] = 0;
+
+			gmr1_p64_xor_ubit(col, 0, out, out_len);
+			for (w=0; w<W; w++)
+				col[w] ^= base[w];
+		}
+	}
+
+	/* Other nibble values by linearity */
+	for (r=0; r<2*in_len; r++) {
+		uint64_t *t = &tab[r * 16 * W];
+
+		for (v=3; v<16; v++) {
+			if (!(v & (v-1)))
+				continue;
+			for (w=0; w<W; w++)
+				t[v*W+w] = t[(v & (v-1))*W+w] ^ t[(v & -v)*W+w];
+		}
+	}
+
+	free(out);
+	free(in);
+
+	em->in_len  = in_len;
+	em->out_len = out_len;
+	em->words   = W;
+	em->base    = base;
+	__atomic_store_n(&em->tab, tab, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&gmr1_encmap_lock);
+
+	return 0;
+
+err:
+	pthread_mutex_unlock(&gmr1_encmap_lock);
+
+	free(tab);
+	free(base);
+	free(out);
+	free(in);
+
+	return -ENOMEM;
+}
+
+/*! \brief Runs a packed encoder map
+ *  \param[in] em Encoder map
+ *  \param[out] out Packed output bits (em->words words)
+ *  \param[in] in Input bytes (em->in_len bytes)
+ */
+void
+gmr1_encmap_run(const struct gmr1_encmap *em, uint64_t *out, const uint8_t *in)
+{
+	const int W = em->words;
+	const uint64_t *t = em->tab;
+	int i, w;
+
+	memcpy(out, em->base, W * sizeof(uint64_t));
+
+	for (i=0; i<em->in_len; i++) {
+		const uint64_t *lo = &t[((2*i  ) * 16 + (in[i] & 0xf)) * W];
+		const uint64_t *hi = &t[((2*i+1) * 16 + (in[i] >>  4)) * W];
+
+		for (w=0; w<W; w++)
+			out[w] ^= lo[w] ^ hi[w];
+	}
+}
+
+/*! @} */
@@ -33,22 +33,82 @@
 #include <osmocom/core/conv.h>
 #include <osmocom/core/crc16gen.h>
 
+#include <osmocom/gmr1/l1/codemat.h>
 #include <osmocom/gmr1/l1/conv.h>
 #include <osmocom/gmr1/l1/crc.h>
+#include <osmocom/gmr1/l1/encmap.h>
+#include <osmocom/gmr1/l1/gather.h>
 #include <osmocom/gmr1/l1/interleave.h>
 #include <osmocom/gmr1/l1/scramb.h>
 
+#ifdef GMR1_L1_TABLES_GEN
+#include "gen_tables.h"
+#endif
+
+
+static struct gmr1_codemat gmr1_facch3_codemat;
+
+#ifdef GMR1_L1_TABLES_GEN
 
 static struct osmo_conv_code gmr1_conv_facch3;
 
-static void __attribute__ ((constructor))
-gmr1_facch3_init(void)
+static struct gmr1_gather gmr1_facch3_gather;
+static struct gmr1_gather_ent gmr1_facch3_gather_ent[384];
+
+/*! \brief Reference burst bits to conv. input path (see \ref gather) */
+static void
+_facch3_unmap(sbit_t *bits_c, const sbit_t *bits_e, const ubit_t *ciph)
+{
+	sbit_t bits_ep[96*4];
+	sbit_t bits_cp[96*4];
+	int i;
+
+	for (i=0; i<4; i++)
+	{
+		const sbit_t *b_bits_e = bits_e + 104*i;
+		sbit_t *b_bits_ep  = bits_ep  +  96*i;
+		sbit_t *b_bits_cp  = bits_cp  +  96*i;
+		const ubit_t *b_ciph = ciph ? ciph + 96*i : NULL;
+
+		gmr1_scramble_sbit_ciph(b_bits_ep, b_bits_e, b_ciph, 0, 22);
+		gmr1_scramble_sbit_ciph(b_bits_ep+22, b_bits_e+30,
+		                        b_ciph ? b_ciph+22 : NULL, 22, 74);
+		gmr1_deinterleave_intra(b_bits_cp, b_bits_ep, 12);
+	};
+
+	for (i=0; i<384; i++)
+		bits_c[i] = bits_cp[(i&3)*96 + (i>>2)];
+}
+
+/*! \brief Generates the FACCH3 tables (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_facch3_gen_tables(FILE *fh)
 {
 	/* Init convolutional coder */
 	memcpy(&gmr1_conv_facch3, &gmr1_conv_14, sizeof(struct osmo_conv_code));
 	gmr1_conv_facch3.len = 92;
+
+	/* Init gather table */
+	gmr1_gather_build(&gmr1_facch3_gather, gmr1_facch3_gather_ent,
+	                  384, 416, 384, _facch3_unmap, NULL);
+
+	/* Print them as const data */
+	gen_tables_conv(fh, "gmr1_conv_facch3", &gmr1_conv_facch3);
+	gen_tables_gather(fh, "gmr1_facch3_gather", &gmr1_facch3_gather);
+
+	return 0;
 }
 
+#else
+
+#define GMR1_L1_TABLES_FACCH3
+#include "l1_tables.h"
+
+#endif
+
 
 /*! \brief Stateless GMR-1 FACCH3 channel coder
  *  \param[out] bits_e 4*104 encoded bits of 4 bursts
@@ -70,11 +130,9 @@ gmr1_facch3_encode(ubit_t *bits_e, const uint8_t *l2,
 	ubit_t bits_c[384];
 	ubit_t bits_cp[96*4];
 	ubit_t bits_ep[96*4];
-	ubit_t bits_xmy[96*4];
-	int i, j;
+	int i;
 
-	osmo_pbit2ubit_ext(bits_u, 0, l2, 0, 76, 1);
-	osmo_crc16gen_set_bits(&gmr1_crc16, bits_u, 76, bits_u+76);
+	gmr1_crc_unpack_set_ubit(&gmr1_crc16_tab, bits_u, l2, 76);
 
 	osmo_conv_encode(&gmr1_conv_facch3, bits_u, bits_c);
 
@@ -85,23 +143,64 @@ gmr1_facch3_encode(ubit_t *bits_e, const uint8_t *l2,
 	{
 		ubit_t *b_bits_cp  = bits_cp  +  96*i;
 		ubit_t *b_bits_ep  = bits_ep  +  96*i;
-		ubit_t *b_bits_xmy = bits_xmy +  96*i;
 		ubit_t *b_bits_e   = bits_e   + 104*i;
 		const ubit_t *b_bits_s = bits_s + 8*i;
-		const ubit_t *b_ciph = ciph + 96*i;
+		const ubit_t *b_ciph = ciph ? ciph + 96*i : NULL;
 
 		gmr1_interleave_intra(b_bits_ep, b_bits_cp, 12);
-		gmr1_scramble_ubit(b_bits_xmy, b_bits_ep, 96);
+
+		gmr1_scramble_ubit_ciph(b_bits_e, b_bits_ep, b_ciph, 0, 22);
+		memcpy(b_bits_e+22, b_bits_s, 8);
+		gmr1_scramble_ubit_ciph(b_bits_e+30, b_bits_ep+22,
+		                        b_ciph ? b_ciph+22 : NULL, 22, 74);
+	}
+}
+
+static struct gmr1_encmap gmr1_facch3_encmap;
+
+/*! \brief Reference for the packed encoder: no status, no ciphering */
+static void
+_facch3_encode_ref(ubit_t *bits_e, const uint8_t *l2)
+{
+	ubit_t bits_s[32];
+
+	memset(bits_s, 0x00, sizeof(bits_s));
+	gmr1_facch3_encode(bits_e, l2, bits_s, NULL);
+}
+
+/*! \brief Packed GMR-1 FACCH3 channel coder
+ *  \param[out] bits_e 4*104 encoded bits, packed (see \ref encmap)
+ *  \param[in] l2 L2 packet data
+ *  \param[in] bits_s 4*8 status bits to be multiplexed
+ *  \param[in] ciph 4*96 bits of cipher stream (can be NULL)
+ *  \return 0 for success, -errno for failure
+ *
+ * Same output as \ref gmr1_facch3_encode. The encoder map is built on
+ * the first call.
+ */
+int
+gmr1_facch3_encode_p64(uint64_t *bits_e, const uint8_t *l2,
+                       const ubit_t *bits_s, const ubit_t *ciph)
+{
+	int i, rv;
+
+	rv = gmr1_encmap_build(&gmr1_facch3_encmap, 10, 416, _facch3_encode_ref);
+	if (rv)
+		return rv;
+
+	gmr1_encmap_run(&gmr1_facch3_encmap, bits_e, l2);
+
+	for (i=0; i<4; i++)
+	{
+		gmr1_p64_xor_ubit(bits_e, 104*i+22, bits_s + 8*i, 8);
 
 		if (ciph) {
-			for (j=0; j<96; j++)
-				b_bits_xmy[j] ^= b_ciph[j];
+			gmr1_p64_xor_ubit(bits_e, 104*i,    ciph + 96*i,    22);
+			gmr1_p64_xor_ubit(bits_e, 104*i+30, ciph + 96*i+22, 74);
 		}
-
-		memcpy(b_bits_e   , b_bits_xmy,    22);
-		memcpy(b_bits_e+22, b_bits_s,       8);
-		memcpy(b_bits_e+30, b_bits_xmy+22, 74);
 	}
+
+	return 0;
 }
 
 /*! \brief Stateless GMR-1 FACCH3 channel decoder
@@ -122,49 +221,32 @@ int
 gmr1_facch3_decode(uint8_t *l2, ubit_t *bits_s,
                    const sbit_t *bits_e, const ubit_t *ciph, int *conv_rv)
 {
-	sbit_t bits_xmy[96*4];
-	sbit_t bits_ep[96*4];
-	sbit_t bits_cp[96*4];
 	sbit_t bits_c[384];
 	ubit_t bits_u[92];
 	int rv, i, j;
 
 	for (i=0; i<4; i++)
-	{
-		const sbit_t *b_bits_e = bits_e + 104*i;
-		ubit_t *b_bits_s   = bits_s   +   8*i;
-		sbit_t *b_bits_xmy = bits_xmy +  96*i;
-		sbit_t *b_bits_ep  = bits_ep  +  96*i;
-		sbit_t *b_bits_cp  = bits_cp  +  96*i;
-		const ubit_t *b_ciph = ciph + 96*i;
-
 		for (j=0; j<8; j++)
-			b_bits_s[j] = b_bits_e[22+j] < 0;
-
-		memcpy(b_bits_xmy,    b_bits_e,    22);
-		memcpy(b_bits_xmy+22, b_bits_e+30, 74);
+			bits_s[8*i+j] = bits_e[104*i+22+j] < 0;
 
-		if (ciph) {
-			for (j=0; j<96; j++)
-				if (b_ciph[j])
-					b_bits_xmy[j] *= -1;
-		}
+	gmr1_gather_sbit(&gmr1_facch3_gather, bits_c, bits_e, ciph);
 
-		gmr1_scramble_sbit(b_bits_ep, b_bits_xmy, 96);
-		gmr1_deinterleave_intra(b_bits_cp, b_bits_ep, 12);
-	};
+	l2[9] = 0; /* upper nibble won't be written */
 
-	for (i=0; i<384; i++)
-		bits_c[i] = bits_cp[(i&3)*96 + (i>>2)];
+	/* Strong burst fast path */
+	rv = gmr1_codemat_try_decode(&gmr1_facch3_codemat, &gmr1_conv_facch3,
+	                             bits_u, bits_c);
+	if (rv >= 0 && !gmr1_crc_check_pack_ubit(&gmr1_crc16_tab, l2, bits_u, 76)) {
+		if (conv_rv)
+			*conv_rv = rv;
+		return 0;
+	}
 
-	rv = osmo_conv_decode(&gmr1_conv_facch3, bits_c, bits_u);
+	rv = gmr1_conv_decode(&gmr1_conv_facch3, bits_c, bits_u);
 	if (conv_rv)
 		*conv_rv = rv;
 
-	rv = osmo_crc16gen_check_bits(&gmr1_crc16, bits_u, 76, bits_u+76);
-
-	l2[9] = 0; /* upper nibble won't be written */
-	osmo_ubit2pbit_ext(l2, 0, bits_u, 0, 76, 1);
+	rv = gmr1_crc_check_pack_ubit(&gmr1_crc16_tab, l2, bits_u, 76);
 
 	return rv;
 }
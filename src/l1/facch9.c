@@ -33,22 +33,70 @@
 #include <osmocom/core/conv.h>
 #include <osmocom/core/crc16gen.h>
 
+#include <osmocom/gmr1/l1/codemat.h>
 #include <osmocom/gmr1/l1/conv.h>
 #include <osmocom/gmr1/l1/crc.h>
+#include <osmocom/gmr1/l1/encmap.h>
+#include <osmocom/gmr1/l1/gather.h>
 #include <osmocom/gmr1/l1/interleave.h>
 #include <osmocom/gmr1/l1/scramb.h>
 
+#ifdef GMR1_L1_TABLES_GEN
+#include "gen_tables.h"
+#endif
+
+
+static struct gmr1_codemat gmr1_facch9_codemat;
+
+#ifdef GMR1_L1_TABLES_GEN
 
 static struct osmo_conv_code gmr1_conv_facch9;
 
-static void __attribute__ ((constructor))
-gmr1_facch9_init(void)
+static struct gmr1_gather gmr1_facch9_gather;
+static struct gmr1_gather_ent gmr1_facch9_gather_ent[640];
+
+/*! \brief Reference burst bits to conv. input path (see \ref gather) */
+static void
+_facch9_unmap(sbit_t *bits_c, const sbit_t *bits_e, const ubit_t *ciph)
+{
+	sbit_t bits_epp_x[648];
+
+	gmr1_scramble_sbit_ciph(bits_epp_x, bits_e, ciph, 0, 52);
+	gmr1_scramble_sbit_ciph(bits_epp_x+52, bits_e+66,
+	                        ciph ? ciph+62 : NULL, 52, 596);
+
+	gmr1_deinterleave_intra(bits_c, bits_epp_x+4, 80);
+}
+
+/*! \brief Generates the FACCH9 tables (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_facch9_gen_tables(FILE *fh)
 {
 	/* Init convolutional coder */
 	memcpy(&gmr1_conv_facch9, &gmr1_conv_12, sizeof(struct osmo_conv_code));
 	gmr1_conv_facch9.len = 316;
+
+	/* Init gather table */
+	gmr1_gather_build(&gmr1_facch9_gather, gmr1_facch9_gather_ent,
+	                  640, 662, 658, _facch9_unmap, NULL);
+
+	/* Print them as const data */
+	gen_tables_conv(fh, "gmr1_conv_facch9", &gmr1_conv_facch9);
+	gen_tables_gather(fh, "gmr1_facch9_gather", &gmr1_facch9_gather);
+
+	return 0;
 }
 
+#else
+
+#define GMR1_L1_TABLES_FACCH9
+#include "l1_tables.h"
+
+#endif
+
 
 /*! \brief Stateless GMR-1 FACCH9 channel coder
  *  \param[out] bits_e 662 encoded bits of one NT9 burst
@@ -65,11 +113,9 @@ gmr1_facch9_encode(ubit_t *bits_e, const uint8_t *l2,
 	ubit_t bits_u[316];
 	ubit_t bits_c[640];
 	ubit_t bits_epp_x[648];
-	ubit_t bits_my[658];
 	int i;
 
-	osmo_pbit2ubit_ext(bits_u, 0, l2, 0, 300, 1);
-	osmo_crc16gen_set_bits(&gmr1_crc16, bits_u, 300, bits_u+300);
+	gmr1_crc_unpack_set_ubit(&gmr1_crc16_tab, bits_u, l2, 300);
 
 	osmo_conv_encode(&gmr1_conv_facch9, bits_u, bits_c);
 
@@ -77,20 +123,60 @@ gmr1_facch9_encode(ubit_t *bits_e, const uint8_t *l2,
 	memset(bits_epp_x+644, 0, 4);
 	gmr1_interleave_intra(bits_epp_x+4, bits_c, 80);
 
-	gmr1_scramble_ubit(bits_epp_x, bits_epp_x, 648);
+	gmr1_scramble_ubit_ciph(bits_e, bits_epp_x, ciph, 0, 52);
+	memcpy(bits_e+52, bits_status, 4);
+	for (i=0; i<10; i++)
+		bits_e[56+i] = bits_sacch[i] ^ (ciph ? ciph[52+i] : 0);
+	gmr1_scramble_ubit_ciph(bits_e+66, bits_epp_x+52,
+	                        ciph ? ciph+62 : NULL, 52, 596);
+}
+
+static struct gmr1_encmap gmr1_facch9_encmap;
+
+/*! \brief Reference for the packed encoder: no SACCH/status, no ciphering */
+static void
+_facch9_encode_ref(ubit_t *bits_e, const uint8_t *l2)
+{
+	ubit_t bits_sacch[10], bits_status[4];
+
+	memset(bits_sacch, 0x00, sizeof(bits_sacch));
+	memset(bits_status, 0x00, sizeof(bits_status));
+	gmr1_facch9_encode(bits_e, l2, bits_sacch, bits_status, NULL);
+}
+
+/*! \brief Packed GMR-1 FACCH9 channel coder
+ *  \param[out] bits_e 662 encoded bits, packed (see \ref encmap)
+ *  \param[in] l2 L2 packet data
+ *  \param[in] bits_sacch 10 saach bits to be multiplexed
+ *  \param[in] bits_status 4 status bits to be multiplexed
+ *  \param[in] ciph 658 bits of cipher stream (can be NULL)
+ *  \return 0 for success, -errno for failure
+ *
+ * Same output as \ref gmr1_facch9_encode. The encoder map is built on
+ * the first call.
+ */
+int
+gmr1_facch9_encode_p64(uint64_t *bits_e, const uint8_t *l2,
+                       const ubit_t *bits_sacch, const ubit_t *bits_status,
+                       const ubit_t *ciph)
+{
+	int rv;
 
-	memcpy(bits_my,    bits_epp_x,     52);
-	memcpy(bits_my+52, bits_sacch,     10);
-	memcpy(bits_my+62, bits_epp_x+52, 596);
+	rv = gmr1_encmap_build(&gmr1_facch9_encmap, 38, 662, _facch9_encode_ref);
+	if (rv)
+		return rv;
+
+	gmr1_encmap_run(&gmr1_facch9_encmap, bits_e, l2);
+
+	gmr1_p64_xor_ubit(bits_e, 52, bits_status, 4);
+	gmr1_p64_xor_ubit(bits_e, 56, bits_sacch, 10);
 
 	if (ciph) {
-		for (i=0; i<658; i++)
-			bits_my[i] ^= ciph[i];
+		gmr1_p64_xor_ubit(bits_e,  0, ciph,     52);
+		gmr1_p64_xor_ubit(bits_e, 56, ciph+52, 606);
 	}
 
-	memcpy(bits_e,    bits_my,      52);
-	memcpy(bits_e+52, bits_status,   4);
-	memcpy(bits_e+56, bits_my+52,  606);
+	return 0;
 }
 
 /*! \brief Stateless GMR-1 FACCH9 channel decoder
@@ -107,38 +193,32 @@ int
 gmr1_facch9_decode(uint8_t *l2, sbit_t *bits_sacch, sbit_t *bits_status,
                    const sbit_t *bits_e, const ubit_t *ciph, int *conv_rv)
 {
-	sbit_t bits_my[658];
-	sbit_t bits_epp_x[648];
 	sbit_t bits_c[640];
 	ubit_t bits_u[316];
 	int i, rv;
 
-	memcpy(bits_my,     bits_e,     52);
-	memcpy(bits_status, bits_e+52,   4);
-	memcpy(bits_my+52,  bits_e+56, 606);
-
-	if (ciph) {
-		for (i=0; i<658; i++)
-			if (ciph[i])
-				bits_my[i] *= -1;
-	}
+	memcpy(bits_status, bits_e+52, 4);
+	for (i=0; i<10; i++)
+		bits_sacch[i] = (ciph && ciph[52+i]) ? -bits_e[56+i] : bits_e[56+i];
 
-	memcpy(bits_epp_x,    bits_my,     52);
-	memcpy(bits_sacch,    bits_my+52,  10);
-	memcpy(bits_epp_x+52, bits_my+62, 596);
+	gmr1_gather_sbit(&gmr1_facch9_gather, bits_c, bits_e, ciph);
 
-	gmr1_scramble_sbit(bits_epp_x, bits_epp_x, 648);
+	l2[37] = 0; /* upper nibble won't be written */
 
-	gmr1_deinterleave_intra(bits_c, bits_epp_x+4, 80);
+	/* Strong burst fast path */
+	rv = gmr1_codemat_try_decode(&gmr1_facch9_codemat, &gmr1_conv_facch9,
+	                             bits_u, bits_c);
+	if (rv >= 0 && !gmr1_crc_check_pack_ubit(&gmr1_crc16_tab, l2, bits_u, 300)) {
+		if (conv_rv)
+			*conv_rv = rv;
+		return 0;
+	}
 
-	rv = osmo_conv_decode(&gmr1_conv_facch9, bits_c, bits_u);
+	rv = gmr1_conv_decode(&gmr1_conv_facch9, bits_c, bits_u);
 	if (conv_rv)
 		*conv_rv = rv;
 
-	rv = osmo_crc16gen_check_bits(&gmr1_crc16, bits_u, 300, bits_u+300);
-
-	l2[37] = 0; /* upper nibble won't be written */
-	osmo_ubit2pbit_ext(l2, 0, bits_u, 0, 300, 1);
+	rv = gmr1_crc_check_pack_ubit(&gmr1_crc16_tab, l2, bits_u, 300);
 
 	return rv;
 }
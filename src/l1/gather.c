@@ -0,0 +1,202 @@
+/* GMR-1 soft bits gather tables */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup gather
+ *  @{
+ */
+
+/*! \file l1/gather.c
+ *  \brief Osmocom GMR-1 soft bits gather tables implementation
+ */
+
+/*
+ * Before the convolutional decoder, every channel demultiplexes the burst
+ * bits, deciphers them, descrambles them and deinterleaves them. All of
+ * this is a fixed permutation with sign flips, so it can be done in a
+ * single gather pass from the burst soft bits.
+ *
+ * The gather tables are not written by hand: they're built at init by
+ * probing the channel's reference (bit by bit) implementation :
+ *  - an all +1 input gives the scrambling sign of each output bit
+ *  - the input index, split in two byte planes, gives the source of
+ *    each output bit (sign flips are undone using the previous step)
+ *  - one run per bit of the cipher stream index, with the cipher
+ *    stream set to that bit of its own index, gives which cipher bit
+ *    (if any) applies to each output bit
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+
+#include <osmocom/gmr1/l1/gather.h>
+
+
+/*! \brief Finds the source index of each output bit using byte planes
+ *  \param[out] src Source index of each output bit
+ *  \param[out] mask Sign mask of each output bit
+ *  \param[in] out_len Number of output bits
+ *  \param[in] in_len Number of input bits
+ *  \param[in] ref Reference implementation
+ */
+static void
+_gather_probe_src(uint16_t *src, sbit_t *mask, int out_len, int in_len,
+                  gmr1_gather_ref_t ref)
+{
+	sbit_t in[in_len], out[out_len];
+	int i, p;
+
+	/* Signs */
+	memset(in, 1, in_len);
+	ref(out, in, NULL);
+
+	for (i=0; i<out_len; i++)
+		mask[i] = out[i] < 0 ? -1 : 0;
+
+	/* Sources */
+	memset(src, 0x00, out_len * sizeof(uint16_t));
+
+	for (p=0; p<2; p++) {
+		for (i=0; i<in_len; i++)
+			in[i] = (sbit_t)((i >> (8*p)) & 0xff);
+
+		ref(out, in, NULL);
+
+		for (i=0; i<out_len; i++) {
+			uint8_t v = (uint8_t)((out[i] ^ mask[i]) - mask[i]);
+			src[i] |= v << (8*p);
+		}
+	}
+}
+
+/*! \brief Builds a gather table from a reference implementation
+ *  \param[out] g Gather table to build
+ *  \param[in] ent Storage for out_len entries
+ *  \param[in] out_len Number of output bits
+ *  \param[in] in_len Number of input bits
+ *  \param[in] ciph_len Length of the cipher stream (0 if not ciphered)
+ *  \param[in] ref Reference implementation
+ *  \param[in] ref2 Reference implementation for a second copy of some
+ *                  bits, whose soft values are averaged (can be NULL)
+ *
+ * ref2 must be identical to ref, except that for the output bits
+ * transmitted twice it uses the second copy. Those output bits are then
+ * averaged. Only the first copy can be ciphered.
+ */
+void
+gmr1_gather_build(struct gmr1_gather *g, struct gmr1_gather_ent *ent,
+                  int out_len, int in_len, int ciph_len,
+                  gmr1_gather_ref_t ref, gmr1_gather_ref_t ref2)
+{
+	uint16_t src[out_len], src2[out_len];
+	sbit_t mask[out_len], mask2[out_len];
+	int i, k;
+
+	/* Sources & signs */
+	_gather_probe_src(src, mask, out_len, in_len, ref);
+
+	if (ref2)
+		_gather_probe_src(src2, mask2, out_len, in_len, ref2);
+
+	for (i=0; i<out_len; i++) {
+		ent[i].src   = src[i];
+		ent[i].mask  = mask[i];
+		ent[i].ciph  = GMR1_GATHER_NONE;
+
+		if (ref2 && (src2[i] != src[i])) {
+			ent[i].src2  = src2[i];
+			ent[i].mask2 = mask2[i];
+		} else {
+			ent[i].src2  = GMR1_GATHER_NONE;
+			ent[i].mask2 = 0;
+		}
+	}
+
+	/* Cipher stream indexes */
+	if (ciph_len) {
+		sbit_t in[in_len], out[out_len];
+		ubit_t ciph[ciph_len];
+		int ciphered[out_len];
+
+		memset(in, 1, in_len);
+
+		memset(ciph, 1, ciph_len);
+		ref(out, in, ciph);
+
+		for (i=0; i<out_len; i++) {
+			ciphered[i] = (out[i] < 0) != (mask[i] < 0);
+			if (ciphered[i])
+				ent[i].ciph = 0;
+		}
+
+		for (k=0; (1 << k) < ciph_len; k++) {
+			for (i=0; i<ciph_len; i++)
+				ciph[i] = (i >> k) & 1;
+
+			ref(out, in, ciph);
+
+			for (i=0; i<out_len; i++) {
+				if (!ciphered[i])
+					continue;
+				if ((out[i] < 0) != (mask[i] < 0))
+					ent[i].ciph |= 1 << k;
+			}
+		}
+	}
+
+	g->len = out_len;
+	g->ent = ent;
+}
+
+/*! \brief Gathers, deciphers and descrambles soft bits
+ *  \param[in] g Gather table
+ *  \param[out] out Output soft bits (g->len)
+ *  \param[in] in Input soft bits
+ *  \param[in] ciph Cipher stream (can be NULL)
+ *
+ * Same result as the reference implementation the table was built from.
+ */
+void
+gmr1_gather_sbit(const struct gmr1_gather *g,
+                 sbit_t *out, const sbit_t *in, const ubit_t *ciph)
+{
+	const struct gmr1_gather_ent *e = g->ent;
+	int i;
+
+	for (i=0; i<g->len; i++, e++)
+	{
+		sbit_t m = e->mask;
+		sbit_t v;
+
+		if (ciph && (e->ciph != GMR1_GATHER_NONE))
+			m ^= -(sbit_t)ciph[e->ciph];
+
+		v = (in[e->src] ^ m) - m;
+
+		if (e->src2 != GMR1_GATHER_NONE) {
+			sbit_t v2 = (in[e->src2] ^ e->mask2) - e->mask2;
+			v = (sbit_t)(((int)v + (int)v2) >> 1);
+		}
+
+		out[i] = v;
+	}
+}
+
+/*! @} */
@@ -0,0 +1,229 @@
+/* GMR-1 L1 build time tables generator */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup l1_prim
+ *  @{
+ */
+
+/*! \file l1/gen_tables.c
+ *  \brief Osmocom GMR-1 L1 build time tables generator
+ *
+ * The L1 sources are built a second time with GMR1_L1_TABLES_GEN defined
+ * and linked with this file. Each module then exposes a function that
+ * computes its tables (conv. codes with their puncturing, gather tables,
+ * scrambling sequence, ...) the same way they used to be computed at
+ * load time, and prints them as const C data. The result is written
+ * to stdout and becomes l1_tables.h, one section per module, which the
+ * library includes instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <osmocom/core/conv.h>
+
+#include <osmocom/gmr1/l1/crc.h>
+#include <osmocom/gmr1/l1/gather.h>
+
+#include "gen_tables.h"
+
+
+static const char *
+_conv_term_name(enum osmo_conv_term term)
+{
+	switch (term) {
+	case CONV_TERM_FLUSH:
+		return "CONV_TERM_FLUSH";
+	case CONV_TERM_TRUNCATION:
+		return "CONV_TERM_TRUNCATION";
+	case CONV_TERM_TAIL_BITING:
+		return "CONV_TERM_TAIL_BITING";
+	}
+
+	abort();
+}
+
+static void
+_gen_u8_pairs(FILE *fh, const char *name, const char *field,
+              const uint8_t (*v)[2], int n)
+{
+	int i;
+
+	fprintf(fh, "static const uint8_t %s_%s[%d][2] = {", name, field, n);
+	for (i=0; i<n; i++)
+		fprintf(fh, "%s{ %d, %d },", (i & 3) ? " " : "\n\t", v[i][0], v[i][1]);
+	fprintf(fh, "\n};\n");
+}
+
+/*! \brief Prints a convolutional code and all the arrays it points to
+ *  \param[in] fh Output file
+ *  \param[in] name Name of the generated struct osmo_conv_code
+ *  \param[in] code Code to print
+ */
+void
+gen_tables_conv(FILE *fh, const char *name, const struct osmo_conv_code *code)
+{
+	int S = 1 << (code->K - 1);
+	int n;
+
+	_gen_u8_pairs(fh, name, "next_output", code->next_output, S);
+	_gen_u8_pairs(fh, name, "next_state",  code->next_state,  S);
+
+	if (code->next_term_output) {
+		fprintf(fh, "static const uint8_t %s_next_term_output[%d] = ", name, S);
+		gen_tables_list(fh, "%d", code->next_term_output, S, 16);
+		fprintf(fh, ";\n");
+	}
+
+	if (code->next_term_state) {
+		fprintf(fh, "static const uint8_t %s_next_term_state[%d] = ", name, S);
+		gen_tables_list(fh, "%d", code->next_term_state, S, 16);
+		fprintf(fh, ";\n");
+	}
+
+	if (code->puncture) {
+		for (n=0; code->puncture[n] >= 0; n++);
+		fprintf(fh, "static const int %s_puncture[%d] = ", name, n+1);
+		gen_tables_list(fh, "%d", code->puncture, n+1, 12);
+		fprintf(fh, ";\n");
+	}
+
+	fprintf(fh, "static const struct osmo_conv_code %s = {\n", name);
+	fprintf(fh, "\t.N = %d,\n", code->N);
+	fprintf(fh, "\t.K = %d,\n", code->K);
+	fprintf(fh, "\t.len = %d,\n", code->len);
+	fprintf(fh, "\t.term = %s,\n", _conv_term_name(code->term));
+	fprintf(fh, "\t.next_output = %s_next_output,\n", name);
+	fprintf(fh, "\t.next_state = %s_next_state,\n", name);
+	if (code->next_term_output)
+		fprintf(fh, "\t.next_term_output = %s_next_term_output,\n", name);
+	if (code->next_term_state)
+		fprintf(fh, "\t.next_term_state = %s_next_term_state,\n", name);
+	if (code->puncture)
+		fprintf(fh, "\t.puncture = %s_puncture,\n", name);
+	fprintf(fh, "};\n\n");
+}
+
+/*! \brief Prints the entries of a gather table
+ *  \param[in] fh Output file
+ *  \param[in] name Name of the generated struct gmr1_gather_ent array
+ *  \param[in] g Gather table to print
+ */
+void
+gen_tables_gather_ent(FILE *fh, const char *name, const struct gmr1_gather *g)
+{
+	const struct gmr1_gather_ent *e;
+	int i;
+
+	fprintf(fh, "static const struct gmr1_gather_ent %s[%d] = {", name, g->len);
+	for (i=0; i<g->len; i++) {
+		e = &g->ent[i];
+		fprintf(fh, "%s{ %5d, %5d, %5d, %2d, %2d },",
+			(i & 1) ? " " : "\n\t",
+			e->src, e->src2, e->ciph, e->mask, e->mask2);
+	}
+	fprintf(fh, "\n};\n");
+}
+
+/*! \brief Prints a gather table and its entries
+ *  \param[in] fh Output file
+ *  \param[in] name Name of the generated struct gmr1_gather
+ *  \param[in] g Gather table to print
+ */
+void
+gen_tables_gather(FILE *fh, const char *name, const struct gmr1_gather *g)
+{
+	char ent_name[64];
+
+	snprintf(ent_name, sizeof(ent_name), "%s_ent", name);
+	gen_tables_gather_ent(fh, ent_name, g);
+
+	fprintf(fh, "static const struct gmr1_gather %s = {\n", name);
+	fprintf(fh, "\t.len = %d,\n", g->len);
+	fprintf(fh, "\t.ent = %s,\n", ent_name);
+	fprintf(fh, "};\n\n");
+}
+
+/*! \brief Prints a table driven CRC context
+ *  \param[in] fh Output file
+ *  \param[in] name Name of the generated struct gmr1_crc_tab
+ *  \param[in] ct CRC context to print
+ */
+void
+gen_tables_crc(FILE *fh, const char *name, const struct gmr1_crc_tab *ct)
+{
+	int i;
+
+	fprintf(fh, "const struct gmr1_crc_tab %s = {\n", name);
+	fprintf(fh, "\t.bits = %d,\n", ct->bits);
+	fprintf(fh, "\t.poly = 0x%04x,\n", ct->poly);
+	fprintf(fh, "\t.rpoly = 0x%04x,\n", ct->rpoly);
+	fprintf(fh, "\t.t = {\n");
+	for (i=0; i<4; i++) {
+		fprintf(fh, "\t\t");
+		gen_tables_list(fh, "0x%04x", ct->t[i], 256, 8);
+		fprintf(fh, ",\n");
+	}
+	fprintf(fh, "\t},\n");
+	fprintf(fh, "};\n\n");
+}
+
+
+static const struct {
+	const char *section;
+	int (*gen)(FILE *fh);
+} gen_modules[] = {
+	/* Scrambling first, the channels gather tables are built with it */
+	{ "SCRAMB", gmr1_scramble_gen_tables },
+	{ "CRC",    gmr1_crc_gen_tables },
+	{ "A5",     gmr1_a5_gen_tables },
+	{ "BCCH",   gmr1_bcch_gen_tables },
+	{ "CCCH",   gmr1_ccch_gen_tables },
+	{ "RACH",   gmr1_rach_gen_tables },
+	{ "FACCH3", gmr1_facch3_gen_tables },
+	{ "FACCH9", gmr1_facch9_gen_tables },
+	{ "TCH3",   gmr1_tch3_gen_tables },
+	{ "TCH9",   gmr1_tch9_gen_tables },
+};
+
+int main(int argc, char *argv[])
+{
+	FILE *fh = stdout;
+	int i;
+
+	fprintf(fh, "/* Generated by gen_tables, do not edit */\n");
+	fprintf(fh, "/* Each module defines its GMR1_L1_TABLES_xxx before inclusion */\n\n");
+
+	for (i=0; i<sizeof(gen_modules)/sizeof(gen_modules[0]); i++) {
+		fprintf(fh, "#ifdef GMR1_L1_TABLES_%s\n\n", gen_modules[i].section);
+		if (gen_modules[i].gen(fh)) {
+			fprintf(stderr, "Failed to generate %s tables\n",
+				gen_modules[i].section);
+			return 1;
+		}
+		fprintf(fh, "#endif /* GMR1_L1_TABLES_%s */\n\n", gen_modules[i].section);
+	}
+
+	if (fflush(fh) || ferror(fh))
+		return 1;
+
+	return 0;
+}
+
+/*! @} */
@@ -0,0 +1,76 @@
+/* GMR-1 L1 build time tables generator */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OSMO_GMR1_L1_GEN_TABLES_H__
+#define __OSMO_GMR1_L1_GEN_TABLES_H__
+
+/*! \file l1/gen_tables.h
+ *  \brief Osmocom GMR-1 L1 build time tables generator header
+ *
+ * Only used when building the generator (GMR1_L1_TABLES_GEN defined).
+ * The library itself includes the generated l1_tables.h instead.
+ */
+
+#include <stdio.h>
+
+#include <osmocom/core/conv.h>
+
+#include <osmocom/gmr1/l1/crc.h>
+#include <osmocom/gmr1/l1/gather.h>
+
+
+/*! \brief Prints the n elements of array v as a C initializer list
+ *  \param[in] fh Output file
+ *  \param[in] fmt printf format of one element
+ *  \param[in] v Array to print
+ *  \param[in] n Number of elements
+ *  \param[in] pl Number of elements per line
+ */
+#define gen_tables_list(fh, fmt, v, n, pl)				\
+	do {								\
+		int _i;							\
+		fprintf(fh, "{");					\
+		for (_i=0; _i<(n); _i++)				\
+			fprintf(fh, "%s" fmt ",",			\
+			        (_i % (pl)) ? " " : "\n\t", (v)[_i]);	\
+		fprintf(fh, "\n}");					\
+	} while (0)
+
+void gen_tables_conv(FILE *fh, const char *name,
+                     const struct osmo_conv_code *code);
+void gen_tables_gather_ent(FILE *fh, const char *name,
+                           const struct gmr1_gather *g);
+void gen_tables_gather(FILE *fh, const char *name,
+                       const struct gmr1_gather *g);
+void gen_tables_crc(FILE *fh, const char *name,
+                    const struct gmr1_crc_tab *ct);
+
+int gmr1_scramble_gen_tables(FILE *fh);
+int gmr1_crc_gen_tables(FILE *fh);
+int gmr1_a5_gen_tables(FILE *fh);
+int gmr1_bcch_gen_tables(FILE *fh);
+int gmr1_ccch_gen_tables(FILE *fh);
+int gmr1_rach_gen_tables(FILE *fh);
+int gmr1_facch3_gen_tables(FILE *fh);
+int gmr1_facch9_gen_tables(FILE *fh);
+int gmr1_tch3_gen_tables(FILE *fh);
+int gmr1_tch9_gen_tables(FILE *fh);
+
+
+#endif /* __OSMO_GMR1_L1_GEN_TABLES_H__ */
@@ -125,6 +125,36 @@ gmr1_interleaver_fini(struct gmr1_interleaver *il)
 	memset(il, 0x00, sizeof(struct gmr1_interleaver));
 }
 
+/*
+ * Column jk of the burst n is stored in row (n - jk) mod N of c''. That
+ * only depends on jk mod N, so the N rows used by a burst are resolved
+ * once and the per bit loop just cycles through them. Each column is
+ * only touched by its own bit, so reading the input, updating c'' and
+ * writing the output can be done in a single pass, in place if needed.
+ */
+
+/*! \brief Resolve the c'' row of each column phase for the current burst
+ *  \param[in] il The interleaver object
+ *  \param[out] rows N row pointers, rows[t] for columns jk = t (mod N)
+ */
+static inline void
+_gmr1_inter_rows(struct gmr1_interleaver *il, uint8_t **rows)
+{
+	int t, r = il->n;
+
+	for (t=0; t<il->N; t++) {
+		rows[t] = &il->bits_cpp[r * il->K];
+		r = r ? (r - 1) : (il->N - 1);
+	}
+}
+
+/*! \brief Advance to the next burst */
+static inline void
+_gmr1_inter_next(struct gmr1_interleaver *il)
+{
+	il->n = (il->n == (il->N - 1)) ? 0 : (il->n + 1);
+}
+
 /*! \brief GMR-1 inter burst interleaver
  *  \param[in] il The interleaver object
  *  \param[out] bits_epp N bits output of interleaver
@@ -136,25 +166,27 @@ void
 gmr1_interleave_inter(struct gmr1_interleaver *il,
                       void *bits_epp, void *bits_ep)
 {
-	int i, jk;
-	uint8_t *d, *s;
+	uint8_t *rows[il->N], *cur;
+	const uint8_t *s = bits_ep;
+	uint8_t *d = bits_epp;
+	int jk, t;
+
+	_gmr1_inter_rows(il, rows);
+	cur = rows[0];
 
-	/* Copy ep to cpp */
-	i = il->n % il->N;
-	d = &il->bits_cpp[i * il->K];
-	memcpy(d, bits_ep, il->K * sizeof(uint8_t));
+	for (jk=0, t=0; jk<il->K; jk++) {
+		/* Copy ep to cpp */
+		cur[jk] = s[jk];
 
-	/* Copy cpp to epp */
-	d = bits_epp;
-	s = il->bits_cpp;
+		/* Copy cpp to epp */
+		d[jk] = rows[t][jk];
 
-	for (jk=0; jk<il->K; jk++) {
-		i = ((il->n % il->N) - (jk % il->N) + il->N) % il->N;
-		d[jk] = s[(i * il->K) + jk];
+		if (++t == il->N)
+			t = 0;
 	}
 
 	/* Next burst */
-	il->n++;
+	_gmr1_inter_next(il);
 }
 
 /*! \brief GMR-1 inter burst de-interleaver
@@ -168,25 +200,76 @@ void
 gmr1_deinterleave_inter(struct gmr1_interleaver *il,
                         void *bits_ep, void *bits_epp)
 {
-	int i, jk;
-	uint8_t *d, *s;
+	uint8_t *rows[il->N], *out;
+	const uint8_t *s = bits_epp;
+	uint8_t *d = bits_ep;
+	int jk, t;
 
-	/* Copy epp to cpp */
-	s = bits_epp;
-	d = il->bits_cpp;
+	_gmr1_inter_rows(il, rows);
+	out = rows[il->N > 1 ? il->N - 1 : 0];
 
-	for (jk=0; jk<il->K; jk++) {
-		i = ((il->n % il->N) - (jk % il->N) + il->N) % il->N;
-		d[(i * il->K) + jk] = s[jk];
-	}
+	for (jk=0, t=0; jk<il->K; jk++) {
+		uint8_t v = s[jk];
+
+		/* Copy epp to cpp */
+		rows[t][jk] = v;
 
-	/* Copy cpp to ep */
-	i = (il->n + 1) % il->N;
-	s = &il->bits_cpp[i * il->K];
-	memcpy(bits_ep, s, il->K * sizeof(uint8_t));
+		/* Copy cpp to ep */
+		d[jk] = out[jk];
+
+		if (++t == il->N)
+			t = 0;
+	}
 
 	/* Next burst */
-	il->n++;
+	_gmr1_inter_next(il);
+}
+
+/*! \brief GMR-1 inter burst interleaver for packed hard bits
+ *  \param[in] il The interleaver object
+ *  \param[out] bits_epp K packed bits output of interleaver
+ *  \param[in] bits_ep K packed bits input to interleaver
+ *
+ * Packed bits are in 64 bits words, LSB first (see \ref encmap). The c''
+ * rows are then stored packed, so a given interleaver object must only
+ * be used with this function. bits_ep and bits_epp can be equal.
+ */
+void
+gmr1_interleave_inter_p64(struct gmr1_interleaver *il,
+                          uint64_t *bits_epp, const uint64_t *bits_ep)
+{
+	const int W = (il->K + 63) >> 6;
+	uint64_t *rows[il->N], pat[il->N];
+	int t, w, b, r, ph;
+
+	/* Same row resolution as the byte version, with packed rows */
+	for (t=0, r=il->n; t<il->N; t++) {
+		rows[t] = &((uint64_t *)il->bits_cpp)[r * W];
+		r = r ? (r - 1) : (il->N - 1);
+	}
+
+	/* pat[s] selects the bits b with b = s (mod N) */
+	memset(pat, 0x00, sizeof(pat));
+	for (b=0; b<64; b++)
+		pat[b % il->N] |= 1ULL << b;
+
+	memcpy(rows[0], bits_ep, W * sizeof(uint64_t));
+
+	for (w=0, ph=0; w<W; w++) {
+		uint64_t v = 0;
+
+		/* Column jk = 64*w + b comes from rows[jk mod N] */
+		for (t=0; t<il->N; t++)
+			v |= rows[t][w] & pat[(t - ph + il->N) % il->N];
+
+		bits_epp[w] = v;
+		ph = (ph + 64) % il->N;
+	}
+
+	if (il->K & 63)
+		bits_epp[W-1] &= (1ULL << (il->K & 63)) - 1;
+
+	_gmr1_inter_next(il);
 }
 
 /*! @} */
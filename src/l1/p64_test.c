@@ -0,0 +1,237 @@
+/* GMR-1 packed encoders test */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file l1/p64_test.c
+ *  \brief Osmocom GMR-1 packed encoders test
+ *
+ * Checks that every *_encode_p64 channel coder gives the same bits as
+ * its ubit_t counterpart, over random inputs (unused bits of the last
+ * input byte included), with and without cipher stream. The TCH9 coders
+ * run over a sequence of bursts so the inter-burst interleaver state is
+ * checked as well.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+
+#include <osmocom/gmr1/l1/bcch.h>
+#include <osmocom/gmr1/l1/ccch.h>
+#include <osmocom/gmr1/l1/encmap.h>
+#include <osmocom/gmr1/l1/facch3.h>
+#include <osmocom/gmr1/l1/facch9.h>
+#include <osmocom/gmr1/l1/interleave.h>
+#include <osmocom/gmr1/l1/rach.h>
+#include <osmocom/gmr1/l1/tch3.h>
+#include <osmocom/gmr1/l1/tch9.h>
+
+
+#define TEST_RUNS	64	/* Random inputs per coder and variant */
+#define TEST_MAX_BITS	1024
+
+
+static uint8_t  t_in[2][64];
+static ubit_t   t_s[32], t_sacch[10], t_ciph[TEST_MAX_BITS];
+static ubit_t   t_ref[TEST_MAX_BITS], t_tst[TEST_MAX_BITS];
+static uint64_t t_p64[GMR1_P64_WORDS(TEST_MAX_BITS)];
+
+
+/*! \brief Fresh random inputs for one run */
+static void
+test_rand(void)
+{
+	int i;
+
+	for (i=0; i<sizeof(t_in); i++)
+		((uint8_t *)t_in)[i] = rand();
+
+	for (i=0; i<32; i++)
+		t_s[i] = rand() & 1;
+
+	for (i=0; i<10; i++)
+		t_sacch[i] = rand() & 1;
+
+	for (i=0; i<TEST_MAX_BITS; i++)
+		t_ciph[i] = rand() & 1;
+}
+
+/*! \brief Compares the packed output with the reference one */
+static int
+test_cmp(int rv, int len)
+{
+	if (rv)
+		return 1;
+
+	memset(t_tst, 0xff, sizeof(t_tst));
+	gmr1_p64_to_ubit(t_tst, t_p64, len);
+
+	return memcmp(t_ref, t_tst, len) ? 1 : 0;
+}
+
+/*! \brief Result line of one coder */
+static int
+test_report(const char *name, int bad)
+{
+	printf("%-12s %s\n", name, bad ? "FAIL" : "ok");
+
+	if (bad)
+		fprintf(stderr, "[!] %s: %d mismatches\n", name, bad);
+
+	return bad;
+}
+
+static int
+test_bcch_ccch(void)
+{
+	int i, rv, b_bcch = 0, b_ccch = 0;
+
+	for (i=0; i<TEST_RUNS; i++) {
+		test_rand();
+
+		gmr1_bcch_encode(t_ref, t_in[0]);
+		rv = gmr1_bcch_encode_p64(t_p64, t_in[0]);
+		b_bcch += test_cmp(rv, 424);
+
+		gmr1_ccch_encode(t_ref, t_in[0]);
+		rv = gmr1_ccch_encode_p64(t_p64, t_in[0]);
+		b_ccch += test_cmp(rv, 432);
+	}
+
+	return test_report("BCCH", b_bcch) + test_report("CCCH", b_ccch);
+}
+
+static int
+test_rach(void)
+{
+	int i, rv, bad = 0;
+
+	for (i=0; i<TEST_RUNS; i++) {
+		uint8_t sb_mask = rand();
+
+		test_rand();
+
+		gmr1_rach_encode(t_ref, t_in[0], sb_mask);
+		rv = gmr1_rach_encode_p64(t_p64, t_in[0], sb_mask);
+		bad += test_cmp(rv, 494);
+	}
+
+	return test_report("RACH", bad);
+}
+
+static int
+test_facch(void)
+{
+	int i, c, rv, b3 = 0, b9 = 0;
+
+	for (i=0; i<TEST_RUNS; i++) {
+		for (c=0; c<2; c++) {
+			const ubit_t *ciph = c ? t_ciph : NULL;
+
+			test_rand();
+
+			gmr1_facch3_encode(t_ref, t_in[0], t_s, ciph);
+			rv = gmr1_facch3_encode_p64(t_p64, t_in[0], t_s, ciph);
+			b3 += test_cmp(rv, 4*104);
+
+			gmr1_facch9_encode(t_ref, t_in[0], t_sacch, t_s, ciph);
+			rv = gmr1_facch9_encode_p64(t_p64, t_in[0], t_sacch, t_s, ciph);
+			b9 += test_cmp(rv, 662);
+		}
+	}
+
+	return test_report("FACCH3", b3) + test_report("FACCH9", b9);
+}
+
+static int
+test_tch3(void)
+{
+	int i, c, m, rv, bad = 0;
+
+	for (i=0; i<TEST_RUNS; i++) {
+		for (c=0; c<2; c++) {
+			for (m=0; m<2; m++) {
+				const ubit_t *ciph = c ? t_ciph : NULL;
+
+				test_rand();
+
+				gmr1_tch3_encode(t_ref, t_in[0], t_in[1], t_s, ciph, m);
+				rv = gmr1_tch3_encode_p64(t_p64, t_in[0], t_in[1],
+				                          t_s, ciph, m);
+				bad += test_cmp(rv, 212);
+			}
+		}
+	}
+
+	return test_report("TCH3", bad);
+}
+
+static int
+test_tch9(void)
+{
+	static const char *names[GMR1_TCH9_MAX] = {
+		[GMR1_TCH9_2k4] = "TCH9 2.4k",
+		[GMR1_TCH9_4k8] = "TCH9 4.8k",
+		[GMR1_TCH9_9k6] = "TCH9 9.6k",
+	};
+	struct gmr1_interleaver il_ref, il_tst;
+	int mode, i, rv, bad, tot = 0;
+
+	for (mode=0; mode<GMR1_TCH9_MAX; mode++)
+	{
+		gmr1_interleaver_init(&il_ref, 3, 648);
+		gmr1_interleaver_init(&il_tst, 3, 648);
+
+		for (i=0, bad=0; i<TEST_RUNS; i++) {
+			const ubit_t *ciph = (i & 1) ? t_ciph : NULL;
+
+			test_rand();
+
+			gmr1_tch9_encode(t_ref, t_in[0], mode, t_sacch, t_s,
+			                 ciph, &il_ref);
+			rv = gmr1_tch9_encode_p64(t_p64, t_in[0], mode, t_sacch, t_s,
+			                          ciph, &il_tst);
+			bad += test_cmp(rv, 662);
+		}
+
+		gmr1_interleaver_fini(&il_tst);
+		gmr1_interleaver_fini(&il_ref);
+
+		tot += test_report(names[mode], bad);
+	}
+
+	return tot;
+}
+
+int main(int argc, char *argv[])
+{
+	int bad = 0;
+
+	srand(1);
+
+	bad += test_bcch_ccch();
+	bad += test_rach();
+	bad += test_facch();
+	bad += test_tch3();
+	bad += test_tch9();
+
+	return bad ? 1 : 0;
+}
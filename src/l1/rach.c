@@ -27,34 +27,97 @@
  */
 
 #include <stdint.h>
-#include <stdlib.h>
 #include <string.h>
 
 #include <osmocom/core/bits.h>
 #include <osmocom/core/conv.h>
 #include <osmocom/core/crcgen.h>
 
+#include <osmocom/gmr1/l1/codemat.h>
 #include <osmocom/gmr1/l1/conv.h>
 #include <osmocom/gmr1/l1/crc.h>
+#include <osmocom/gmr1/l1/encmap.h>
+#include <osmocom/gmr1/l1/gather.h>
 #include <osmocom/gmr1/l1/interleave.h>
 #include <osmocom/gmr1/l1/scramb.h>
 
+#ifdef GMR1_L1_TABLES_GEN
+#include "gen_tables.h"
+#endif
+
+static struct gmr1_codemat gmr1_rach_codemat;
+
+#ifdef GMR1_L1_TABLES_GEN
+
 static struct osmo_conv_code gmr1_conv_rach;
+static int gmr1_conv_rach_puncture[135*2 + 1];
+
+static struct gmr1_gather gmr1_rach_gather;
+static struct gmr1_gather_ent gmr1_rach_gather_ent[382];
+
+/*! \brief Reference burst bits to conv. input path (see \ref gather)
+ *  \param[out] bits_c 382 conv. input soft bits
+ *  \param[in] bits_e 494 soft bits unmapped from a RACH burst
+ *  \param[in] copy Which copy of e1' to use (0/1), or -1 to average them
+ */
+static void
+_rach_unmap(sbit_t *bits_c, const sbit_t *bits_e, int copy)
+{
+	sbit_t bits_x[494];
+	sbit_t bits_ep[494];
+	sbit_t bits_e1p[112], bits_e2p[270];
+	int i;
+
+	/* e=m -> x : de-multiplex */
+	memcpy(bits_x,     bits_e+136, 112);
+	memcpy(bits_x+112, bits_e,     136);
+	memcpy(bits_x+248, bits_e+360, 134);
+	memcpy(bits_x+382, bits_e+248, 112);
+
+	/* x -> e' : de-scrambling */
+	gmr1_scramble_sbit(bits_ep, bits_x, 494);
+
+	/* e' -> c : de-interleaving */
+	memcpy(bits_e2p, bits_ep+112, 270);
+
+	if (copy < 0) {
+		for (i=0; i<112; i++)
+			bits_e1p[i] = (sbit_t)(((int)bits_ep[i] + (int)bits_ep[i+382]) >> 1);
+	} else {
+		memcpy(bits_e1p, bits_ep + (copy ? 382 : 0), 112);
+	}
+
+	gmr1_deinterleave_intra(bits_c+270, bits_e1p, 14);
+	gmr1_deinterleave_intra(bits_c,     bits_e2p, 33);
+	memcpy(bits_c+264, bits_e2p+264, 6);
+}
+
+static void
+_rach_unmap_c0(sbit_t *bits_c, const sbit_t *bits_e, const ubit_t *ciph)
+{
+	_rach_unmap(bits_c, bits_e, 0);
+}
+
+static void
+_rach_unmap_c1(sbit_t *bits_c, const sbit_t *bits_e, const ubit_t *ciph)
+{
+	_rach_unmap(bits_c, bits_e, 1);
+}
 
-static void __attribute__ ((constructor))
-gmr1_rach_init(void)
+/*! \brief Generates the RACH tables (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_rach_gen_tables(FILE *fh)
 {
-	int i, *p;
+	int i, *p = gmr1_conv_rach_puncture;
 
 	/* Init convolutional coder */
 	memcpy(&gmr1_conv_rach, &gmr1_conv_14, sizeof(struct osmo_conv_code));
 	gmr1_conv_rach.len = 159;
 
 	/* Generate puncturer (only b[0] .. b[539] punctured) */
-	p = malloc((135*2 + 1) * sizeof(int));
-	if (!p)
-		abort();
-
 	for (i=0; i<135; i++) {
 		p[(i<<1)  ] = (i << 2) + 2;
 		p[(i<<1)+1] = (i << 2) + 3;
@@ -63,8 +126,25 @@ gmr1_rach_init(void)
 	p[270] = -1;
 
 	gmr1_conv_rach.puncture = p;
+
+	/* Init gather table (e1' is sent twice and averaged) */
+	gmr1_gather_build(&gmr1_rach_gather, gmr1_rach_gather_ent,
+	                  382, 494, 0, _rach_unmap_c0, _rach_unmap_c1);
+
+	/* Print them as const data */
+	gen_tables_conv(fh, "gmr1_conv_rach", &gmr1_conv_rach);
+	gen_tables_gather(fh, "gmr1_rach_gather", &gmr1_rach_gather);
+
+	return 0;
 }
 
+#else
+
+#define GMR1_L1_TABLES_RACH
+#include "l1_tables.h"
+
+#endif
+
 
 /*! \brief Stateless GMR-1 RACH channel coder
  *  \param[out] bits_e Data bits of a burst
@@ -84,16 +164,12 @@ gmr1_rach_encode(ubit_t *bits_e, const uint8_t *rach, uint8_t sb_mask)
 	ubit_t bits_x[494];
 	int i;
 
-	/* rach -> d : unpacking */
+	/* rach -> u : unpacking & CRC addition */
 	bits_u1 = bits_u + 135;
 	bits_u2 = bits_u;
 
-	osmo_pbit2ubit_ext(bits_u1, 0, rach,  0,  16, 1);
-	osmo_pbit2ubit_ext(bits_u2, 0, rach, 16, 123, 1);
-
-	/* d -> u : CRC addition */
-	osmo_crc8gen_set_bits (&gmr1_crc8,  bits_u1,  16, bits_u1+16);
-	osmo_crc16gen_set_bits(&gmr1_crc16, bits_u2, 123, bits_u2+123);
+	gmr1_crc_unpack_set_ubit(&gmr1_crc8_tab,  bits_u1, rach,    16);
+	gmr1_crc_unpack_set_ubit(&gmr1_crc12_tab, bits_u2, rach+2, 123);
 
 	/* u -> u' : masking */
 	for (i=0; i<8; i++)
@@ -103,8 +179,8 @@ gmr1_rach_encode(ubit_t *bits_e, const uint8_t *rach, uint8_t sb_mask)
 	osmo_conv_encode(&gmr1_conv_rach, bits_u, bits_c);
 
 	/* c -> e' : interleaving */
-	gmr1_deinterleave_intra(bits_e1p, bits_c+270, 14);
-	gmr1_deinterleave_intra(bits_e2p, bits_c,     33);
+	gmr1_interleave_intra(bits_e1p, bits_c+270, 14);
+	gmr1_interleave_intra(bits_e2p, bits_c,     33);
 
 	memcpy(bits_e2p+264, bits_c+264, 6);
 
@@ -122,6 +198,68 @@ gmr1_rach_encode(ubit_t *bits_e, const uint8_t *rach, uint8_t sb_mask)
 	memcpy(bits_e+360, bits_x+248, 134);
 }
 
+static struct gmr1_encmap gmr1_rach_encmap;
+
+/*! \brief Reference for the packed encoder: 18 bytes of RACH + sb_mask */
+static void
+_rach_encode_ref(ubit_t *bits_e, const uint8_t *in)
+{
+	gmr1_rach_encode(bits_e, in, in[18]);
+}
+
+/*! \brief Packed GMR-1 RACH channel coder
+ *  \param[out] bits_e 494 encoded bits, packed (see \ref encmap)
+ *  \param[in] rach RACH packet data (2 class-1 bytes, 16 class-2 bytes)
+ *  \param[in] sb_mask RACH SB Mask value (see GMR-1 04.008)
+ *  \return 0 for success, -errno for failure
+ *
+ * Same output as \ref gmr1_rach_encode. The encoder map is built on the
+ * first call.
+ */
+int
+gmr1_rach_encode_p64(uint64_t *bits_e, const uint8_t *rach, uint8_t sb_mask)
+{
+	uint8_t in[19];
+	int rv;
+
+	rv = gmr1_encmap_build(&gmr1_rach_encmap, 19, 494, _rach_encode_ref);
+	if (rv)
+		return rv;
+
+	memcpy(in, rach, 18);
+	in[18] = sb_mask;
+
+	gmr1_encmap_run(&gmr1_rach_encmap, bits_e, in);
+
+	return 0;
+}
+
+/*! \brief CRC checks, removal & packing of decoded RACH bits
+ *  \param[out] rach RACH packet data
+ *  \param[inout] bits_u 159 decoded bits (SB mask is removed in place)
+ *  \param[in] sb_mask RACH SB Mask value
+ *  \param[out] crc The 2 CRC check results
+ *  \return 0 if both CRC check pass, any other value for fail.
+ */
+static int
+_rach_crc(uint8_t *rach, ubit_t *bits_u, uint8_t sb_mask, int *crc)
+{
+	ubit_t *bits_u1 = bits_u + 135;
+	ubit_t *bits_u2 = bits_u;
+	int i;
+
+	crc[0] = gmr1_crc_check_pack_ubit(&gmr1_crc8_tab,  rach,   bits_u1,  16);
+	crc[1] = gmr1_crc_check_pack_ubit(&gmr1_crc12_tab, rach+2, bits_u2, 123);
+
+	if (crc[0]) {
+		for (i=0; i<8; i++)
+			bits_u1[16+i] ^= (sb_mask >> (7-i)) & 1;
+		crc[0] = gmr1_crc_check_pack_ubit(&gmr1_crc8_tab, rach, bits_u1, 16);
+	}
+
+	return crc[0] || crc[1];
+}
+
 /*! \brief Stateless GMR-1 RACH channel decoder
  *  \param[out] rach RACH packet data (2 class-1 bytes, 16 class-2 bytes)
  *  \param[in] bits_e Data bits of a burst
@@ -137,60 +275,78 @@ int
 gmr1_rach_decode(uint8_t *rach, const sbit_t *bits_e, uint8_t sb_mask,
                  int *conv_rv, int *crc_rv)
 {
-	sbit_t bits_x[494];
-	sbit_t bits_ep[494];
-	sbit_t bits_e1p[112], bits_e2p[270];
 	sbit_t bits_c[382];
-	ubit_t bits_u[159], *bits_u1, *bits_u2;
-	int i, rv, crc[2];
-
-	/* e=m -> x : de-multiplex */
-	memcpy(bits_x,     bits_e+136, 112);
-	memcpy(bits_x+112, bits_e,     136);
-	memcpy(bits_x+248, bits_e+360, 134);
-	memcpy(bits_x+382, bits_e+248, 112);
-
-	/* x -> e' : de-scrambling */
-	gmr1_scramble_sbit(bits_ep, bits_x, 494);
-
-	/* e' -> c : de-interleaving */
-	memcpy(bits_e2p, bits_ep+112, 270);
-
-	for (i=0; i<112; i++)
-		bits_e1p[i] = (sbit_t)(((int)bits_ep[i] + (int)bits_ep[i+382]) >> 1);
-
-	gmr1_deinterleave_intra(bits_c+270, bits_e1p, 14);
-	gmr1_deinterleave_intra(bits_c,     bits_e2p, 33);
-	memcpy(bits_c+264, bits_e2p+264, 6);
+	ubit_t bits_u[159];
+	int rv, crc[2];
+
+	/* e=m -> c : de-multiplex, de-scrambling & de-interleaving */
+	gmr1_gather_sbit(&gmr1_rach_gather, bits_c, bits_e, NULL);
+
+	/* c -> u' / u : strong burst fast path or convolutional decoding */
+	rv = gmr1_codemat_try_decode(&gmr1_rach_codemat, &gmr1_conv_rach,
+	                             bits_u, bits_c);
+	if (rv < 0 || _rach_crc(rach, bits_u, sb_mask, crc)) {
+		rv = gmr1_conv_decode(&gmr1_conv_rach, bits_c, bits_u);
+		_rach_crc(rach, bits_u, sb_mask, crc);
+	}
 
-	/* c -> u' / u : convolutional decoding */
-	rv = osmo_conv_decode(&gmr1_conv_rach, bits_c, bits_u);
 	if (conv_rv)
 		*conv_rv = rv;
 
-	bits_u1 = bits_u + 135;
-	bits_u2 = bits_u;
-
-	/* CRC checks */
-	crc[0] = osmo_crc8gen_check_bits (&gmr1_crc8,  bits_u1,  16, bits_u1+16);
-	crc[1] = osmo_crc16gen_check_bits(&gmr1_crc12, bits_u2, 123, bits_u2+123);
-
-	if (crc[0]) {
-		for (i=0; i<8; i++)
-			bits_u1[16+i] ^= (sb_mask >> (7-i)) & 1;
-		crc[0] = osmo_crc8gen_check_bits (&gmr1_crc8,  bits_u1,  16, bits_u1+16);
-	}
-
 	if (crc_rv) {
 		crc_rv[0] = crc[0];
 		crc_rv[1] = crc[1];
 	}
 
-	/* CRC removal & packing */
-	osmo_ubit2pbit_ext(rach,  0, bits_u1, 0,  16, 1);
-	osmo_ubit2pbit_ext(rach, 16, bits_u2, 0, 123, 1);
-
 	return crc[0] || crc[1];
 }
 
+/*! \brief Stateless GMR-1 RACH channel decoder for an unknown SB mask
+ *  \param[out] rach RACH packet data (2 class-1 bytes, 16 class-2 bytes)
+ *  \param[in] bits_e Data bits of a burst
+ *  \param[out] sb_mask RACH SB Mask value the burst was sent with
+ *  \param[out] conv_rv Return of the convolutional decode (can be NULL)
+ *  \return 0 if the class-2 CRC check passes, any other value for fail.
+ *
+ * Same as \ref gmr1_rach_decode, for receivers that don't know the SB
+ * mask of the spotbeam (e.g. uplink only captures). The mask is XORed
+ * onto the class-1 CRC, so that CRC is used to recover it and only the
+ * class-2 CRC validates the decoding.
+ */
+int
+gmr1_rach_decode_sb(uint8_t *rach, const sbit_t *bits_e, uint8_t *sb_mask,
+                    int *conv_rv)
+{
+	sbit_t bits_c[382];
+	ubit_t bits_u[159];
+	ubit_t *bits_u1 = bits_u + 135;
+	uint8_t rcv;
+	int rv, crc, i;
+
+	/* e=m -> c : de-multiplex, de-scrambling & de-interleaving */
+	gmr1_gather_sbit(&gmr1_rach_gather, bits_c, bits_e, NULL);
+
+	/* c -> u' / u : strong burst fast path or convolutional decoding */
+	rv = gmr1_codemat_try_decode(&gmr1_rach_codemat, &gmr1_conv_rach,
+	                             bits_u, bits_c);
+	crc = (rv < 0) ? 1 :
+		gmr1_crc_check_pack_ubit(&gmr1_crc12_tab, rach+2, bits_u, 123);
+
+	if (crc) {
+		rv = gmr1_conv_decode(&gmr1_conv_rach, bits_c, bits_u);
+		crc = gmr1_crc_check_pack_ubit(&gmr1_crc12_tab, rach+2, bits_u, 123);
+	}
+
+	/* SB mask is the difference between received and computed CRC8 */
+	for (i=0, rcv=0; i<8; i++)
+		rcv |= bits_u1[16+i] << (7-i);
+
+	*sb_mask = rcv ^ gmr1_crc_pack_ubit(&gmr1_crc8_tab, rach, bits_u1, 16);
+
+	if (conv_rv)
+		*conv_rv = rv;
+
+	return crc;
+}
+
 /*! @} */
@@ -27,9 +27,18 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <osmocom/core/bits.h>
 
+#include <osmocom/gmr1/l1/scramb.h>
+
+#ifdef GMR1_L1_TABLES_GEN
+#include <inttypes.h>
+#include "gen_tables.h"
+#endif
+
 
 /*
  * h(D) = 1 + D + D^15
@@ -52,6 +61,71 @@ gmr1_scramble_reg_next(uint16_t *reg)
 }
 
 
+/*
+ * The sequence always starts from the same register state, so it's
+ * precomputed at build time for the longest burst (NT9: 662 bits) both
+ * as a sign mask (0 / -1) usable directly on softbits and hard bits, and
+ * as packed bits (MSB first). Longer requests fall back to the LFSR.
+ */
+
+#define GMR1_SCRAMBLE_MAX_LEN	662
+
+#define SCR_VEC_LEN	16
+
+typedef int8_t scr_vec_t __attribute__((vector_size(SCR_VEC_LEN)));
+
+#ifdef GMR1_L1_TABLES_GEN
+
+static sbit_t  gmr1_scramble_mask[GMR1_SCRAMBLE_MAX_LEN];
+static uint8_t gmr1_scramble_packed[(GMR1_SCRAMBLE_MAX_LEN + 7) >> 3];
+static uint64_t gmr1_scramble_p64_mask[(GMR1_SCRAMBLE_MAX_LEN + 63) >> 6];
+
+/*! \brief Generates the scrambling tables (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_scramble_gen_tables(FILE *fh)
+{
+	uint16_t r = GMR1_SCRAMBLE_REG_INIT;
+	int i, b;
+
+	for (i=0; i<GMR1_SCRAMBLE_MAX_LEN; i++) {
+		b = gmr1_scramble_reg_next(&r);
+		gmr1_scramble_mask[i] = -b;
+		gmr1_scramble_packed[i >> 3] |= b << (7 - (i & 7));
+		gmr1_scramble_p64_mask[i >> 6] |= (uint64_t)b << (i & 63);
+	}
+
+	fprintf(fh, "static const sbit_t gmr1_scramble_mask[%d] = ",
+		GMR1_SCRAMBLE_MAX_LEN);
+	gen_tables_list(fh, "%2d", gmr1_scramble_mask,
+		GMR1_SCRAMBLE_MAX_LEN, 16);
+	fprintf(fh, ";\n");
+
+	fprintf(fh, "static const uint8_t gmr1_scramble_packed[%d] = ",
+		(GMR1_SCRAMBLE_MAX_LEN + 7) >> 3);
+	gen_tables_list(fh, "0x%02x", gmr1_scramble_packed,
+		(GMR1_SCRAMBLE_MAX_LEN + 7) >> 3, 8);
+	fprintf(fh, ";\n");
+
+	fprintf(fh, "static const uint64_t gmr1_scramble_p64_mask[%d] = ",
+		(GMR1_SCRAMBLE_MAX_LEN + 63) >> 6);
+	gen_tables_list(fh, "0x%016" PRIx64 "ULL", gmr1_scramble_p64_mask,
+		(GMR1_SCRAMBLE_MAX_LEN + 63) >> 6, 2);
+	fprintf(fh, ";\n\n");
+
+	return 0;
+}
+
+#else
+
+#define GMR1_L1_TABLES_SCRAMB
+#include "l1_tables.h"
+
+#endif
+
+
 /*! \brief Scrambles/Unscrambles a softbit vector
  *  \param[out] out output sbit_t array
  *  \param[in] in input sbit_t array
@@ -63,13 +137,7 @@ gmr1_scramble_reg_next(uint16_t *reg)
 void
 gmr1_scramble_sbit(sbit_t *out, const sbit_t *in, int len)
 {
-	uint16_t r = GMR1_SCRAMBLE_REG_INIT;
-	int i;
-
-	for (i=0; i<len; i++) {
-		sbit_t v = in[i];
-		out[i] = gmr1_scramble_reg_next(&r) ? -v : v;
-	}
+	gmr1_scramble_sbit_ciph(out, in, NULL, 0, len);
 }
 
 /*! \brief Scrambles/Unscrambles an unpacked hard bit vector
@@ -83,13 +151,183 @@ gmr1_scramble_sbit(sbit_t *out, const sbit_t *in, int len)
 void
 gmr1_scramble_ubit(ubit_t *out, const ubit_t *in, int len)
 {
-	uint16_t r = GMR1_SCRAMBLE_REG_INIT;
+	gmr1_scramble_ubit_ciph(out, in, NULL, 0, len);
+}
+
+/*! \brief Scrambles/Unscrambles and (de)ciphers a softbit vector
+ *  \param[out] out output sbit_t array
+ *  \param[in] in input sbit_t array
+ *  \param[in] ciph cipher stream aligned with in/out (can be NULL)
+ *  \param[in] ofs offset of in[0] in the scrambling sequence
+ *  \param[in] len length of the array to convert
+ *
+ * Both are sign flips so a single pass does both. Same result as
+ * flipping according to ciph and then calling \ref gmr1_scramble_sbit.
+ * The output array can be equal to the input array.
+ */
+void
+gmr1_scramble_sbit_ciph(sbit_t *out, const sbit_t *in, const ubit_t *ciph,
+                        int ofs, int len)
+{
+	const sbit_t *m;
+	int i;
+
+	if (ofs + len > GMR1_SCRAMBLE_MAX_LEN) {
+		uint16_t r = GMR1_SCRAMBLE_REG_INIT;
+
+		for (i=0; i<ofs; i++)
+			gmr1_scramble_reg_next(&r);
+
+		for (i=0; i<len; i++) {
+			sbit_t v = in[i];
+			if (ciph && ciph[i])
+				v = -v;
+			out[i] = gmr1_scramble_reg_next(&r) ? -v : v;
+		}
+
+		return;
+	}
+
+	m = &gmr1_scramble_mask[ofs];
+
+	for (i=0; i+SCR_VEC_LEN<=len; i+=SCR_VEC_LEN) {
+		scr_vec_t v, s, c;
+
+		memcpy(&v, &in[i], SCR_VEC_LEN);
+		memcpy(&s, &m[i],  SCR_VEC_LEN);
+
+		if (ciph) {
+			memcpy(&c, &ciph[i], SCR_VEC_LEN);
+			s ^= -c;
+		}
+
+		v = (v ^ s) - s;
+		memcpy(&out[i], &v, SCR_VEC_LEN);
+	}
+
+	for (; i<len; i++) {
+		sbit_t s = m[i];
+		if (ciph)
+			s ^= -(sbit_t)ciph[i];
+		out[i] = (in[i] ^ s) - s;
+	}
+}
+
+/*! \brief Scrambles/Unscrambles and (de)ciphers an unpacked hard bit vector
+ *  \param[out] out output ubit_t array
+ *  \param[in] in input ubit_t array
+ *  \param[in] ciph cipher stream aligned with in/out (can be NULL)
+ *  \param[in] ofs offset of in[0] in the scrambling sequence
+ *  \param[in] len length of the array to convert
+ *
+ * The output array can be equal to the input array.
+ */
+void
+gmr1_scramble_ubit_ciph(ubit_t *out, const ubit_t *in, const ubit_t *ciph,
+                        int ofs, int len)
+{
+	const sbit_t *m;
 	int i;
 
-	for (i=0; i<len; i++) {
-		ubit_t v = in[i];
-		out[i] = v ^ gmr1_scramble_reg_next(&r);
+	if (ofs + len > GMR1_SCRAMBLE_MAX_LEN) {
+		uint16_t r = GMR1_SCRAMBLE_REG_INIT;
+
+		for (i=0; i<ofs; i++)
+			gmr1_scramble_reg_next(&r);
+
+		for (i=0; i<len; i++)
+			out[i] = in[i] ^ gmr1_scramble_reg_next(&r) ^
+			         (ciph ? ciph[i] : 0);
+
+		return;
+	}
+
+	m = &gmr1_scramble_mask[ofs];
+
+	for (i=0; i+SCR_VEC_LEN<=len; i+=SCR_VEC_LEN) {
+		scr_vec_t v, s, c;
+
+		memcpy(&v, &in[i], SCR_VEC_LEN);
+		memcpy(&s, &m[i],  SCR_VEC_LEN);
+
+		v ^= s & 1;
+
+		if (ciph) {
+			memcpy(&c, &ciph[i], SCR_VEC_LEN);
+			v ^= c;
+		}
+
+		memcpy(&out[i], &v, SCR_VEC_LEN);
 	}
+
+	for (; i<len; i++)
+		out[i] = in[i] ^ (m[i] & 1) ^ (ciph ? ciph[i] : 0);
+}
+
+/*! \brief Scrambles/Unscrambles a packed hard bit vector
+ *  \param[out] out output packed bits (MSB first)
+ *  \param[in] in input packed bits (MSB first)
+ *  \param[in] len length of the vector in bits
+ *
+ * The output array can be equal to the input array. Bits beyond len
+ * in the last byte are copied unchanged.
+ */
+void
+gmr1_scramble_pbit(uint8_t *out, const uint8_t *in, int len)
+{
+	uint16_t r = GMR1_SCRAMBLE_REG_INIT;
+	int i, n;
+
+	n = len > GMR1_SCRAMBLE_MAX_LEN ? GMR1_SCRAMBLE_MAX_LEN : len;
+
+	for (i=0; i<(n >> 3); i++)
+		out[i] = in[i] ^ gmr1_scramble_packed[i];
+
+	if (n & 7)
+		out[i] = in[i] ^ (gmr1_scramble_packed[i] & (0xff00 >> (n & 7)));
+
+	if (n == len)
+		return;
+
+	for (i=0; i<n; i++)
+		gmr1_scramble_reg_next(&r);
+
+	for (; i<len; i++)
+		out[i >> 3] ^= gmr1_scramble_reg_next(&r) << (7 - (i & 7));
+}
+
+/*! \brief Scrambles/Unscrambles a packed bit vector (64 bits words)
+ *  \param[out] out output packed bits (LSB first, see \ref encmap)
+ *  \param[in] in input packed bits
+ *  \param[in] len length in bits
+ *
+ * Same conventions as \ref gmr1_scramble_pbit for the unused bits.
+ */
+void
+gmr1_scramble_p64(uint64_t *out, const uint64_t *in, int len)
+{
+	uint16_t r = GMR1_SCRAMBLE_REG_INIT;
+	int i, n;
+
+	n = len > GMR1_SCRAMBLE_MAX_LEN ? GMR1_SCRAMBLE_MAX_LEN : len;
+
+	for (i=0; i<(n >> 6); i++)
+		out[i] = in[i] ^ gmr1_scramble_p64_mask[i];
+
+	if (n & 63)
+		out[i] = in[i] ^ (gmr1_scramble_p64_mask[i] & ((1ULL << (n & 63)) - 1));
+
+	if (n == len)
+		return;
+
+	for (i=(n + 63) >> 6; i<((len + 63) >> 6); i++)
+		out[i] = in[i];
+
+	for (i=0; i<n; i++)
+		gmr1_scramble_reg_next(&r);
+
+	for (; i<len; i++)
+		out[i >> 6] ^= (uint64_t)gmr1_scramble_reg_next(&r) << (i & 63);
 }
 
 /*! @} */
@@ -33,21 +33,115 @@
 #include <osmocom/core/conv.h>
 
 #include <osmocom/gmr1/l1/conv.h>
+#include <osmocom/gmr1/l1/encmap.h>
+#include <osmocom/gmr1/l1/gather.h>
 #include <osmocom/gmr1/l1/punct.h>
 #include <osmocom/gmr1/l1/scramb.h>
 
+#ifdef GMR1_L1_TABLES_GEN
+#include "gen_tables.h"
+#endif
+
+
+#ifdef GMR1_L1_TABLES_GEN
 
 static struct osmo_conv_code gmr1_conv_tch3_speech;
 
-static void __attribute__ ((constructor))
-gmr1_tch3_init(void)
+static struct gmr1_gather gmr1_tch3_gather[2];
+static struct gmr1_gather_ent gmr1_tch3_gather_ent[2][208];
+
+/*! \brief Reference burst bits to conv. inputs path (see \ref gather)
+ *  \param[out] bits_c 2*104 conv. input soft bits of both speech frames
+ *  \param[in] bits_e 212 softbits demodulated from a burst
+ *  \param[in] ciph 208 bits of cipher stream (can be NULL)
+ *  \param[in] m Multiplexing mode (0 or 1)
+ */
+static void
+_tch3_unmap(sbit_t *bits_c, const sbit_t *bits_e, const ubit_t *ciph, int m)
 {
+	sbit_t bits_epp[208];
+	int i, j;
+
+	gmr1_scramble_sbit_ciph(bits_epp, bits_e, ciph, 0, 52);
+	gmr1_scramble_sbit_ciph(bits_epp+52, bits_e+56,
+	                        ciph ? ciph+52 : NULL, 52, 156);
+
+	for (i=0; i<2; i++)
+	{
+		sbit_t bits_ep[104];
+		int kc;
+
+		if (m) {
+			for (j=0; j<104; j++)
+				bits_ep[j] = bits_epp[(104*i)+j];
+		} else {
+			for (j=0; j<104; j++)
+				bits_ep[j] = bits_epp[(j<<1)+i];
+		}
+
+		for (kc=0; kc<104; kc++) {
+			int ii, ij, kep;
+			ii = kc % 24;
+			ij = kc / 24;
+			kep = (ii < 8) ? (ij + 5*ii) : (ij + 4*ii + 8);
+			bits_c[(104*i)+kc] = bits_ep[kep];
+		}
+	}
+}
+
+static void
+_tch3_unmap_m0(sbit_t *bits_c, const sbit_t *bits_e, const ubit_t *ciph)
+{
+	_tch3_unmap(bits_c, bits_e, ciph, 0);
+}
+
+static void
+_tch3_unmap_m1(sbit_t *bits_c, const sbit_t *bits_e, const ubit_t *ciph)
+{
+	_tch3_unmap(bits_c, bits_e, ciph, 1);
+}
+
+/*! \brief Generates the TCH3 tables (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_tch3_gen_tables(FILE *fh)
+{
+	int rv;
+
 	/* Init convolutional coder */
 	memcpy(&gmr1_conv_tch3_speech, &gmr1_conv_tch3, sizeof(struct osmo_conv_code));
 	gmr1_conv_tch3_speech.len = 48;
-	gmr1_puncturer_generate(&gmr1_conv_tch3_speech, NULL, &gmr1_punct12_P12, NULL, 0);
+	rv = gmr1_puncturer_generate(&gmr1_conv_tch3_speech, NULL, &gmr1_punct12_P12, NULL, 0);
+	if (rv)
+		return rv;
+
+	/* Init gather tables (one per multiplexing mode) */
+	gmr1_gather_build(&gmr1_tch3_gather[0], gmr1_tch3_gather_ent[0],
+	                  208, 212, 208, _tch3_unmap_m0, NULL);
+	gmr1_gather_build(&gmr1_tch3_gather[1], gmr1_tch3_gather_ent[1],
+	                  208, 212, 208, _tch3_unmap_m1, NULL);
+
+	/* Print them as const data */
+	gen_tables_conv(fh, "gmr1_conv_tch3_speech", &gmr1_conv_tch3_speech);
+	gen_tables_gather_ent(fh, "gmr1_tch3_gather_ent_m0", &gmr1_tch3_gather[0]);
+	gen_tables_gather_ent(fh, "gmr1_tch3_gather_ent_m1", &gmr1_tch3_gather[1]);
+	fprintf(fh, "static const struct gmr1_gather gmr1_tch3_gather[2] = {\n"
+	            "\t{ .len = 208, .ent = gmr1_tch3_gather_ent_m0 },\n"
+	            "\t{ .len = 208, .ent = gmr1_tch3_gather_ent_m1 },\n"
+	            "};\n\n");
+
+	return 0;
 }
 
+#else
+
+#define GMR1_L1_TABLES_TCH3
+#include "l1_tables.h"
+
+#endif
+
 
 /*! \brief Stateless GMR-1 TCH3 channel coder
  *  \param[out] bits_e 212 encoded bits to be mapped on a burst
@@ -63,7 +157,6 @@ gmr1_tch3_encode(ubit_t *bits_e,
                  const ubit_t *bits_s, const ubit_t *ciph, int m)
 {
 	ubit_t bits_epp[208];
-	ubit_t bits_xmy[208];
 	int i, j;
 
 	for (i=0; i<2; i++)
@@ -78,7 +171,7 @@ gmr1_tch3_encode(ubit_t *bits_e,
 
 		osmo_pbit2ubit(bits_d, frame, 80);
 
-		osmo_conv_encode(&gmr1_conv_tch3_speech, bits_c, bits_d);
+		osmo_conv_encode(&gmr1_conv_tch3_speech, bits_d, bits_c);
 		memcpy(bits_c+72, bits_d+48, 32);
 
 		for (kc=0; kc<104; kc++) {
@@ -98,16 +191,69 @@ gmr1_tch3_encode(ubit_t *bits_e,
 		}
 	}
 
-	gmr1_scramble_ubit(bits_xmy, bits_epp, 208);
+	gmr1_scramble_ubit_ciph(bits_e, bits_epp, ciph, 0, 52);
+	memcpy(bits_e+52, bits_s, 4);
+	gmr1_scramble_ubit_ciph(bits_e+56, bits_epp+52,
+	                        ciph ? ciph+52 : NULL, 52, 156);
+}
+
+static struct gmr1_encmap gmr1_tch3_encmap[2];
+
+/*! \brief References for the packed encoder: both frames, no status and
+ *         no ciphering */
+static void
+_tch3_encode_ref_m0(ubit_t *bits_e, const uint8_t *frames)
+{
+	ubit_t bits_s[4] = { 0, 0, 0, 0 };
+	gmr1_tch3_encode(bits_e, frames, frames+10, bits_s, NULL, 0);
+}
+
+static void
+_tch3_encode_ref_m1(ubit_t *bits_e, const uint8_t *frames)
+{
+	ubit_t bits_s[4] = { 0, 0, 0, 0 };
+	gmr1_tch3_encode(bits_e, frames, frames+10, bits_s, NULL, 1);
+}
+
+/*! \brief Packed GMR-1 TCH3 channel coder
+ *  \param[out] bits_e 212 encoded bits, packed (see \ref encmap)
+ *  \param[in] frame0 1st speech frame (10 byte / 80 bits, msb first)
+ *  \param[in] frame1 2nd speech frame (10 byte / 80 bits, msb first)
+ *  \param[in] bits_s 4 status bits to be multiplexed
+ *  \param[in] ciph 208 bits of cipher stream (can be NULL)
+ *  \param[in] m Multiplexing mode (0 or 1)
+ *  \return 0 for success, -errno for failure
+ *
+ * Same output as \ref gmr1_tch3_encode. The encoder maps are built on
+ * the first call.
+ */
+int
+gmr1_tch3_encode_p64(uint64_t *bits_e,
+                     const uint8_t *frame0, const uint8_t *frame1,
+                     const ubit_t *bits_s, const ubit_t *ciph, int m)
+{
+	struct gmr1_encmap *em = &gmr1_tch3_encmap[m ? 1 : 0];
+	uint8_t frames[20];
+	int rv;
+
+	rv = gmr1_encmap_build(em, 20, 212,
+	                       m ? _tch3_encode_ref_m1 : _tch3_encode_ref_m0);
+	if (rv)
+		return rv;
+
+	memcpy(frames,    frame0, 10);
+	memcpy(frames+10, frame1, 10);
+
+	gmr1_encmap_run(em, bits_e, frames);
+
+	gmr1_p64_xor_ubit(bits_e, 52, bits_s, 4);
 
 	if (ciph) {
-		for (i=0; i<208; i++)
-			bits_xmy[i] ^= ciph[i];
+		gmr1_p64_xor_ubit(bits_e,  0, ciph,     52);
+		gmr1_p64_xor_ubit(bits_e, 56, ciph+52, 156);
 	}
 
-	memcpy(bits_e,    bits_xmy,     52);
-	memcpy(bits_e+52, bits_s,        4);
-	memcpy(bits_e+56, bits_xmy+52, 156);
+	return 0;
 }
 
 /*! \brief Stateless GMR-1 TCH3 channel decoder
@@ -126,57 +272,26 @@ gmr1_tch3_decode(uint8_t *frame0, uint8_t *frame1, ubit_t *bits_s,
                  const sbit_t *bits_e, const ubit_t *ciph, int m,
                  int *conv0_rv, int *conv1_rv)
 {
-	sbit_t bits_xmy[208];
-	sbit_t bits_epp[208];
+	sbit_t bits_c[2][104];
 	int rv, i, j;
 
 	for (i=0; i<4; i++)
 		bits_s[i] = bits_e[52+i] < 0;
 
-	memcpy(bits_xmy,    bits_e,     52);
-	memcpy(bits_xmy+52, bits_e+56, 156);
-
-	if (ciph) {
-		for (i=0; i<208; i++)
-			if (ciph[i])
-				bits_xmy[i] *= -1;
-	}
-
-	gmr1_scramble_sbit(bits_epp, bits_xmy, 208);
+	gmr1_gather_sbit(&gmr1_tch3_gather[m ? 1 : 0], bits_c[0], bits_e, ciph);
 
 	for (i=0; i<2; i++)
 	{
 		int *conv_rv = i ? conv1_rv : conv0_rv;
 		uint8_t *frame = i ? frame1 : frame0;
-
-		sbit_t bits_ep[104];
-		sbit_t bits_c[104];
 		ubit_t bits_d[80];
 
-		int kc;
-
-		if (m) {
-			for (j=0; j<104; j++)
-				bits_ep[j] = bits_epp[(104*i)+j];
-		} else {
-			for (j=0; j<104; j++)
-				bits_ep[j] = bits_epp[(j<<1)+i];
-		}
-
-		for (kc=0; kc<104; kc++) {
-			int ii, ij, kep;
-			ii = kc % 24;
-			ij = kc / 24;
-			kep = (ii < 8) ? (ij + 5*ii) : (ij + 4*ii + 8);
-			bits_c[kc] = bits_ep[kep];
-		}
-
-		rv = osmo_conv_decode(&gmr1_conv_tch3_speech, bits_c, bits_d);
+		rv = gmr1_conv_decode(&gmr1_conv_tch3_speech, bits_c[i], bits_d);
 		if (conv_rv)
 			*conv_rv = rv;
 
 		for (j=48; j<80; j++)
-			bits_d[j] = bits_c[j+24] < 0;
+			bits_d[j] = bits_c[i][j+24] < 0;
 
 		osmo_ubit2pbit(frame, bits_d, 80);
 	}
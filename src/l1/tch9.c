@@ -26,6 +26,7 @@
  *  \brief Osmocom GMR-1 TCH9 channel coding implementation
  */
 
+#include <math.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -33,51 +34,108 @@
 #include <osmocom/core/conv.h>
 #include <osmocom/core/crc16gen.h>
 
+#include <osmocom/gmr1/l1/codemat.h>
 #include <osmocom/gmr1/l1/conv.h>
 #include <osmocom/gmr1/l1/crc.h>
+#include <osmocom/gmr1/l1/encmap.h>
+#include <osmocom/gmr1/l1/gather.h>
 #include <osmocom/gmr1/l1/interleave.h>
 #include <osmocom/gmr1/l1/punct.h>
 #include <osmocom/gmr1/l1/scramb.h>
 
 #include <osmocom/gmr1/l1/tch9.h>
 
+#ifdef GMR1_L1_TABLES_GEN
+#include "gen_tables.h"
+#endif
+
+
+#define GMR1_TCH9_BATCH	16	/*!< \brief Bursts per batched conv. decode */
+
+static struct gmr1_codemat gmr1_tch9_codemat[GMR1_TCH9_MAX];
+
+#ifdef GMR1_L1_TABLES_GEN
 
 static struct osmo_conv_code gmr1_conv_tch9_24;
 static struct osmo_conv_code gmr1_conv_tch9_48;
 static struct osmo_conv_code gmr1_conv_tch9_96;
 
-static const struct osmo_conv_code *gmr1_conv_tch9[GMR1_TCH9_MAX] = {
-	[GMR1_TCH9_2k4] = &gmr1_conv_tch9_24,
-	[GMR1_TCH9_4k8] = &gmr1_conv_tch9_48,
-	[GMR1_TCH9_9k6] = &gmr1_conv_tch9_96,
-};
+static struct gmr1_gather gmr1_tch9_gather;
+static struct gmr1_gather_ent gmr1_tch9_gather_ent[648];
+
+/*! \brief Reference burst bits to inter-burst deinterleaver input path
+ *         (see \ref gather) */
+static void
+_tch9_unmap(sbit_t *bits_ep_epp_x, const sbit_t *bits_e, const ubit_t *ciph)
+{
+	gmr1_scramble_sbit_ciph(bits_ep_epp_x, bits_e, ciph, 0, 52);
+	gmr1_scramble_sbit_ciph(bits_ep_epp_x+52, bits_e+66,
+	                        ciph ? ciph+62 : NULL, 52, 596);
+}
 
-static void __attribute__ ((constructor))
-gmr1_tch9_init(void)
+/*! \brief Generates the TCH9 tables (see \ref gen_tables.c)
+ *  \param[in] fh Output file
+ *  \return 0 for success, -errno for failure
+ */
+int
+gmr1_tch9_gen_tables(FILE *fh)
 {
+	int rv;
+
 	/* Init convolutional coders */
 	memcpy(&gmr1_conv_tch9_24, &gmr1_conv_15, sizeof(struct osmo_conv_code));
 	gmr1_conv_tch9_24.len = 144;
-	gmr1_puncturer_generate(
+	rv = gmr1_puncturer_generate(
 		&gmr1_conv_tch9_24,
 		&gmr1_punct15_P53, &gmr1_punct15_P23, &gmr1_punct15_Ps53, 41
 	);
+	if (rv)
+		return rv;
 
 	memcpy(&gmr1_conv_tch9_48, &gmr1_conv_13, sizeof(struct osmo_conv_code));
 	gmr1_conv_tch9_48.len = 240;
-	gmr1_puncturer_generate(
+	rv = gmr1_puncturer_generate(
 		&gmr1_conv_tch9_48,
 		&gmr1_punct13_P15, &gmr1_punct13_P25, &gmr1_punct13_Ps15, 41
 	);
+	if (rv)
+		return rv;
 
 	memcpy(&gmr1_conv_tch9_96, &gmr1_conv_12, sizeof(struct osmo_conv_code));
 	gmr1_conv_tch9_96.len = 480;
-	gmr1_puncturer_generate(
+	rv = gmr1_puncturer_generate(
 		&gmr1_conv_tch9_96,
 		&gmr1_punct12_P25, &gmr1_punct12_P23, &gmr1_punct12_Ps25, 158
 	);
+	if (rv)
+		return rv;
+
+	/* Init gather table */
+	gmr1_gather_build(&gmr1_tch9_gather, gmr1_tch9_gather_ent,
+	                  648, 662, 658, _tch9_unmap, NULL);
+
+	/* Print them as const data */
+	gen_tables_conv(fh, "gmr1_conv_tch9_24", &gmr1_conv_tch9_24);
+	gen_tables_conv(fh, "gmr1_conv_tch9_48", &gmr1_conv_tch9_48);
+	gen_tables_conv(fh, "gmr1_conv_tch9_96", &gmr1_conv_tch9_96);
+	gen_tables_gather(fh, "gmr1_tch9_gather", &gmr1_tch9_gather);
+
+	return 0;
 }
 
+#else
+
+#define GMR1_L1_TABLES_TCH9
+#include "l1_tables.h"
+
+#endif
+
+static const struct osmo_conv_code *gmr1_conv_tch9[GMR1_TCH9_MAX] = {
+	[GMR1_TCH9_2k4] = &gmr1_conv_tch9_24,
+	[GMR1_TCH9_4k8] = &gmr1_conv_tch9_48,
+	[GMR1_TCH9_9k6] = &gmr1_conv_tch9_96,
+};
+
 
 /*! \brief GMR-1 TCH9 channel coder
  *  \param[out] bits_e 662 encoded bits of one NT9 burst
@@ -100,27 +158,162 @@ gmr1_tch9_encode(ubit_t *bits_e, const uint8_t *l2, enum gmr1_tch9_mode mode,
 	ubit_t bits_u[480];
 	ubit_t bits_c[648];
 	ubit_t bits_ep_epp_x[648];
-	ubit_t bits_my[658];
 	int i;
 
 	osmo_pbit2ubit_ext(bits_u, 0, l2, 0, cc->len, 1);
 	osmo_conv_encode(cc, bits_u, bits_c);
 	gmr1_interleave_intra(bits_ep_epp_x, bits_c, 81);
 	gmr1_interleave_inter(il, bits_ep_epp_x, bits_ep_epp_x);
-	gmr1_scramble_ubit(bits_ep_epp_x, bits_ep_epp_x, 648);
+	gmr1_scramble_ubit_ciph(bits_e, bits_ep_epp_x, ciph, 0, 52);
+	memcpy(bits_e+52, bits_status, 4);
+	for (i=0; i<10; i++)
+		bits_e[56+i] = bits_sacch[i] ^ (ciph ? ciph[52+i] : 0);
+	gmr1_scramble_ubit_ciph(bits_e+66, bits_ep_epp_x+52,
+	                        ciph ? ciph+62 : NULL, 52, 596);
+}
+
+static struct gmr1_encmap gmr1_tch9_encmap[GMR1_TCH9_MAX];
+
+/*
+ * The inter burst interleaver keeps state, so the TCH9 maps only cover
+ * l2 -> e' (before the inter burst interleaver), the rest is done on
+ * the packed bits.
+ */
+
+static void
+_tch9_encode_ref(ubit_t *bits_ep, const uint8_t *l2, enum gmr1_tch9_mode mode)
+{
+	const struct osmo_conv_code *cc = gmr1_conv_tch9[mode];
+	ubit_t bits_u[480];
+	ubit_t bits_c[648];
+
+	osmo_pbit2ubit_ext(bits_u, 0, l2, 0, cc->len, 1);
+	osmo_conv_encode(cc, bits_u, bits_c);
+	gmr1_interleave_intra(bits_ep, bits_c, 81);
+}
 
-	memcpy(bits_my,    bits_ep_epp_x,     52);
-	memcpy(bits_my+52, bits_sacch,        10);
-	memcpy(bits_my+62, bits_ep_epp_x+52, 596);
+static void
+_tch9_encode_ref_24(ubit_t *bits_ep, const uint8_t *l2)
+{
+	_tch9_encode_ref(bits_ep, l2, GMR1_TCH9_2k4);
+}
+
+static void
+_tch9_encode_ref_48(ubit_t *bits_ep, const uint8_t *l2)
+{
+	_tch9_encode_ref(bits_ep, l2, GMR1_TCH9_4k8);
+}
+
+static void
+_tch9_encode_ref_96(ubit_t *bits_ep, const uint8_t *l2)
+{
+	_tch9_encode_ref(bits_ep, l2, GMR1_TCH9_9k6);
+}
+
+static const gmr1_encmap_ref_t gmr1_tch9_encode_ref[GMR1_TCH9_MAX] = {
+	[GMR1_TCH9_2k4] = _tch9_encode_ref_24,
+	[GMR1_TCH9_4k8] = _tch9_encode_ref_48,
+	[GMR1_TCH9_9k6] = _tch9_encode_ref_96,
+};
+
+/*! \brief Packed GMR-1 TCH9 channel coder
+ *  \param[out] bits_e 662 encoded bits, packed (see \ref encmap)
+ *  \param[in] l2 L2 packet data
+ *  \param[in] mode Channel encoding mode
+ *  \param[in] bits_sacch 10 saach bits to be multiplexed
+ *  \param[in] bits_status 4 status bits to be multiplexed
+ *  \param[in] ciph 658 bits of cipher stream (can be NULL)
+ *  \param[inout] il Inter-burst interleaver state
+ *  \return 0 for success, -errno for failure
+ *
+ * Same output as \ref gmr1_tch9_encode. il must only be used with this
+ * function (see \ref gmr1_interleave_inter_p64). The encoder maps are
+ * built on the first call.
+ */
+int
+gmr1_tch9_encode_p64(uint64_t *bits_e, const uint8_t *l2,
+                     enum gmr1_tch9_mode mode,
+                     const ubit_t *bits_sacch, const ubit_t *bits_status,
+                     const ubit_t *ciph, struct gmr1_interleaver *il)
+{
+	struct gmr1_encmap *em = &gmr1_tch9_encmap[mode];
+	uint64_t bits_ep[GMR1_P64_WORDS(648)];
+	int rv;
+
+	rv = gmr1_encmap_build(em, (gmr1_conv_tch9[mode]->len + 7) >> 3, 648,
+	                       gmr1_tch9_encode_ref[mode]);
+	if (rv)
+		return rv;
+
+	gmr1_encmap_run(em, bits_ep, l2);
+	gmr1_interleave_inter_p64(il, bits_ep, bits_ep);
+	gmr1_scramble_p64(bits_ep, bits_ep, 648);
+
+	memset(bits_e, 0x00, GMR1_P64_WORDS(662) * sizeof(uint64_t));
+
+	gmr1_p64_xor_bits(bits_e,  0, bits_ep,  0,  52);
+	gmr1_p64_xor_bits(bits_e, 66, bits_ep, 52, 596);
+
+	gmr1_p64_xor_ubit(bits_e, 52, bits_status, 4);
+	gmr1_p64_xor_ubit(bits_e, 56, bits_sacch, 10);
 
 	if (ciph) {
-		for (i=0; i<658; i++)
-			bits_my[i] ^= ciph[i];
+		gmr1_p64_xor_ubit(bits_e,  0, ciph,     52);
+		gmr1_p64_xor_ubit(bits_e, 56, ciph+52, 606);
 	}
 
-	memcpy(bits_e,    bits_my,      52);
-	memcpy(bits_e+52, bits_status,   4);
-	memcpy(bits_e+56, bits_my+52,  606);
+	return 0;
+}
+
+/*! \brief GMR-1 TCH9 burst bits to conv. input soft bits
+ *  \param[out] bits_c 648 soft bits for the convolutional decoder
+ *  \param[out] bits_sacch 10 saach bits demultiplexed
+ *  \param[out] bits_status 4 status bits demultiplexed
+ *  \param[in] bits_e 662 encoded bits of one NT9 burst
+ *  \param[in] ciph 658 bits of cipher stream (can be NULL)
+ *  \param[inout] il Inter-burst interleaver state
+ */
+static void
+_tch9_demux(sbit_t *bits_c, sbit_t *bits_sacch, sbit_t *bits_status,
+            const sbit_t *bits_e, const ubit_t *ciph,
+            struct gmr1_interleaver *il)
+{
+	sbit_t bits_ep_epp_x[648];
+	int i;
+
+	memcpy(bits_status, bits_e+52, 4);
+	for (i=0; i<10; i++)
+		bits_sacch[i] = (ciph && ciph[52+i]) ? -bits_e[56+i] : bits_e[56+i];
+
+	gmr1_gather_sbit(&gmr1_tch9_gather, bits_ep_epp_x, bits_e, ciph);
+
+	gmr1_deinterleave_inter(il, bits_ep_epp_x, bits_ep_epp_x);
+	gmr1_deinterleave_intra(bits_c, bits_ep_epp_x, 81);
+}
+
+/*! \brief Decodes the conv. input soft bits with one rate hypothesis
+ *  \param[out] bits_u Decoded bits (up to 480)
+ *  \param[in] bits_c 648 conv. input soft bits
+ *  \param[in] mode Rate hypothesis
+ *  \param[out] fast Set if the hard decision fast path was used
+ *  \return Path metric of the decoded bits (lower is better)
+ */
+static int
+_tch9_decode_mode(ubit_t *bits_u, const sbit_t *bits_c,
+                  enum gmr1_tch9_mode mode, int *fast)
+{
+	const struct osmo_conv_code *cc = gmr1_conv_tch9[mode];
+	int rv;
+
+	/* Strong burst fast path (no CRC, the parity checks are enough) */
+	rv = gmr1_codemat_try_decode(&gmr1_tch9_codemat[mode], cc, bits_u, bits_c);
+
+	*fast = rv >= 0;
+
+	if (rv < 0)
+		rv = gmr1_conv_decode(cc, bits_c, bits_u);
+
+	return rv;
 }
 
 /*! \brief GMR-1 TCH9 channel decoder
@@ -142,36 +335,234 @@ gmr1_tch9_decode(uint8_t *l2, sbit_t *bits_sacch, sbit_t *bits_status,
 		 const ubit_t *ciph, struct gmr1_interleaver *il,
                  int *conv_rv)
 {
-	const struct osmo_conv_code *cc = gmr1_conv_tch9[mode];
-	sbit_t bits_my[658];
-	sbit_t bits_ep_epp_x[648];
 	sbit_t bits_c[648];
 	ubit_t bits_u[480];
-	int i, rv;
+	int rv, fast;
 
-	memcpy(bits_my,     bits_e,     52);
-	memcpy(bits_status, bits_e+52,   4);
-	memcpy(bits_my+52,  bits_e+56, 606);
+	_tch9_demux(bits_c, bits_sacch, bits_status, bits_e, ciph, il);
 
-	if (ciph) {
-		for (i=0; i<658; i++)
-			if (ciph[i])
-				bits_my[i] *= -1;
+	rv = _tch9_decode_mode(bits_u, bits_c, mode, &fast);
+
+	if (conv_rv)
+		*conv_rv = rv;
+
+	osmo_ubit2pbit_ext(l2, 0, bits_u, 0, gmr1_conv_tch9[mode]->len, 1);
+}
+
+
+/*
+ * TCH9 has no CRC, and the rate isn't signaled in the bursts themselves.
+ * But all rates fill the same 648 coded bits after the same interleaving,
+ * so the path metrics of the different hypotheses on the same soft bits
+ * can be compared. The raw metrics favor the higher rates though (more
+ * codewords to fit the noise), so each hypothesis is scored with its
+ * approximate log likelihood : the path metric scaled by the estimated
+ * A / sigma^2 of the soft bits, plus ln(2) per information bit (uniform
+ * prior on the codewords).
+ *
+ * Until a rate is locked, every frame is decoded with all of them (the
+ * current one first, and one passing the hard decision parity checks wins
+ * outright). A frame only counts as a win if its margin over the second
+ * best is large enough. Once a rate won GMR1_TCH9_RATE_LOCK frames in a
+ * row, only that one is decoded, with a full check every
+ * GMR1_TCH9_RATE_RECHECK frames that unlocks if another rate clearly wins.
+ */
+
+#define GMR1_TCH9_RATE_LOCK	 3	/*!< \brief Wins in a row to lock */
+#define GMR1_TCH9_RATE_RECHECK	32	/*!< \brief Frames between rechecks */
+#define GMR1_TCH9_RATE_MARGIN	20.0f	/*!< \brief Win margin (nats) */
+
+/*! \brief Initializes a TCH9 rate selection state
+ *  \param[out] rs Rate selection state (one per call)
+ */
+void
+gmr1_tch9_rate_init(struct gmr1_tch9_rate *rs)
+{
+	memset(rs, 0x00, sizeof(struct gmr1_tch9_rate));
+	rs->mode = GMR1_TCH9_9k6;
+}
+
+/*! \brief Scale from path metric to log likelihood (see above)
+ *  \param[in] bits_c 648 conv. input soft bits
+ *  \return Negative log likelihood (nats) of one path metric unit
+ *
+ * Each metric unit is 1/512 of a squared distance to +-127, i.e.
+ * 512/254 of correlation, and the log likelihood of a correlation
+ * is A / sigma^2 times it (A and sigma estimated from the moments).
+ */
+static float
+_tch9_metric_scale(const sbit_t *bits_c)
+{
+	int i, m1 = 0, m2 = 0;
+	float a, v;
+
+	for (i=0; i<648; i++) {
+		m1 += bits_c[i] < 0 ? -bits_c[i] : bits_c[i];
+		m2 += bits_c[i] * bits_c[i];
 	}
 
-	memcpy(bits_ep_epp_x,    bits_my,     52);
-	memcpy(bits_sacch,       bits_my+52,  10);
-	memcpy(bits_ep_epp_x+52, bits_my+62, 596);
+	a = (float)m1 / 648.0f;
+	v = (float)m2 / 648.0f - a * a;
 
-	gmr1_scramble_sbit(bits_ep_epp_x, bits_ep_epp_x, 648);
-	gmr1_deinterleave_inter(il, bits_ep_epp_x, bits_ep_epp_x);
-	gmr1_deinterleave_intra(bits_c, bits_ep_epp_x, 81);
+	if (v < 1.0f)
+		v = 1.0f;
+
+	return (512.0f / 254.0f) * a / v;
+}
 
-	rv = osmo_conv_decode(cc, bits_c, bits_u);
+/*! \brief GMR-1 TCH9 channel decoder with automatic rate selection
+ *  \param[out] l2 L2 packet data (up to 60 bytes, see \ref gmr1_tch9_decode)
+ *  \param[out] bits_sacch 10 saach bits demultiplexed
+ *  \param[out] bits_status 4 status bits demultiplexed
+ *  \param[in] bits_e 662 encoded bits of one NT9 burst
+ *  \param[in] ciph 658 bits of cipher stream (can be NULL)
+ *  \param[inout] il Inter-burst interleaver state
+ *  \param[inout] rs Rate selection state
+ *  \param[out] conv_rv Return of the convolutional decode (can be NULL)
+ *  \return The rate l2 was decoded with
+ */
+enum gmr1_tch9_mode
+gmr1_tch9_decode_auto(uint8_t *l2, sbit_t *bits_sacch, sbit_t *bits_status,
+                      const sbit_t *bits_e, const ubit_t *ciph,
+                      struct gmr1_interleaver *il, struct gmr1_tch9_rate *rs,
+                      int *conv_rv)
+{
+	sbit_t bits_c[648];
+	ubit_t bits_u[GMR1_TCH9_MAX][480];
+	int rv[GMR1_TCH9_MAX];
+	float scale, score[GMR1_TCH9_MAX], margin;
+	int i, m, best, fast;
+
+	_tch9_demux(bits_c, bits_sacch, bits_status, bits_e, ciph, il);
+
+	if (rs->locked && (++rs->frames < GMR1_TCH9_RATE_RECHECK)) {
+		/* Steady state : locked rate only */
+		best = rs->mode;
+		rv[best] = _tch9_decode_mode(bits_u[best], bits_c, best, &fast);
+		goto out;
+	}
+
+	/* Try all the rates */
+	rs->frames = 0;
+	scale = _tch9_metric_scale(bits_c);
+	margin = 0.0f;
+	best = -1;
+
+	for (i=0; i<GMR1_TCH9_MAX; i++) {
+		m = (rs->mode + i) % GMR1_TCH9_MAX;
+		rv[m] = _tch9_decode_mode(bits_u[m], bits_c, m, &fast);
+
+		if (fast) {
+			best = m;
+			margin = GMR1_TCH9_RATE_MARGIN;
+			break;
+		}
+
+		score[m] = scale * rv[m] + (float)M_LN2 * gmr1_conv_tch9[m]->len;
+
+		if (best < 0) {
+			best = m;
+			margin = INFINITY;
+		} else if (score[m] < score[best]) {
+			margin = score[best] - score[m];
+			best = m;
+		} else if (score[m] - score[best] < margin) {
+			margin = score[m] - score[best];
+		}
+	}
+
+	/* Lock / Unlock, only on clear wins */
+	if (margin < GMR1_TCH9_RATE_MARGIN)
+		goto out;
+
+	if (best == rs->mode) {
+		if (++rs->wins >= GMR1_TCH9_RATE_LOCK)
+			rs->locked = 1;
+	} else {
+		rs->mode = best;
+		rs->wins = 1;
+		rs->locked = 0;
+	}
+
+out:
 	if (conv_rv)
-		*conv_rv = rv;
+		*conv_rv = rv[best];
+
+	osmo_ubit2pbit_ext(l2, 0, bits_u[best], 0, gmr1_conv_tch9[best]->len, 1);
+
+	return best;
+}
+
+/*! \brief GMR-1 TCH9 channel decoder for several channels at once
+ *  \param[out] l2 Array of n L2 packet data pointers
+ *  \param[out] bits_sacch Array of n pointers to 10 saach bits
+ *  \param[out] bits_status Array of n pointers to 4 status bits
+ *  \param[in] bits_e Array of n pointers to 662 encoded bits
+ *  \param[in] mode Channel encoding mode (same for all channels)
+ *  \param[in] ciph Array of n cipher streams pointers (array or items
+ *                  can be NULL)
+ *  \param[inout] il Array of n inter-burst interleaver states
+ *  \param[out] conv_rv Array of n conv. decode results (can be NULL)
+ *  \param[in] n Number of channels
+ *  \return 0 for success, -errno for failure
+ *
+ * Same as \ref gmr1_tch9_decode for one burst of each of n channels,
+ * with the convolutional decoding of all of them run in parallel (see
+ * \ref gmr1_conv_decode_batch).
+ */
+int
+gmr1_tch9_decode_batch(uint8_t * const *l2, sbit_t * const *bits_sacch,
+                       sbit_t * const *bits_status,
+                       const sbit_t * const *bits_e, enum gmr1_tch9_mode mode,
+                       const ubit_t * const *ciph,
+                       struct gmr1_interleaver * const *il,
+                       int *conv_rv, int n)
+{
+	const struct osmo_conv_code *cc = gmr1_conv_tch9[mode];
+	sbit_t bits_c[GMR1_TCH9_BATCH][648];
+	ubit_t bits_u[GMR1_TCH9_BATCH][480];
+	const sbit_t *in[GMR1_TCH9_BATCH];
+	ubit_t *out[GMR1_TCH9_BATCH];
+	int idx[GMR1_TCH9_BATCH], vrv[GMR1_TCH9_BATCH];
+	int i, j, g, m, rv;
+
+	for (i=0; i<n; i+=g)
+	{
+		g = n - i;
+		if (g > GMR1_TCH9_BATCH)
+			g = GMR1_TCH9_BATCH;
+
+		for (j=0, m=0; j<g; j++) {
+			_tch9_demux(bits_c[j], bits_sacch[i+j], bits_status[i+j],
+			            bits_e[i+j], ciph ? ciph[i+j] : NULL, il[i+j]);
+
+			/* Strong bursts skip the Viterbi decoder */
+			rv = gmr1_codemat_try_decode(&gmr1_tch9_codemat[mode], cc,
+			                             bits_u[j], bits_c[j]);
+			if (rv >= 0) {
+				if (conv_rv)
+					conv_rv[i+j] = rv;
+				continue;
+			}
+
+			idx[m]   = j;
+			in[m]    = bits_c[j];
+			out[m++] = bits_u[j];
+		}
+
+		rv = gmr1_conv_decode_batch(cc, in, out, vrv, m);
+		if (rv)
+			return rv;
+
+		if (conv_rv)
+			for (j=0; j<m; j++)
+				conv_rv[i+idx[j]] = vrv[j];
+
+		for (j=0; j<g; j++)
+			osmo_ubit2pbit_ext(l2[i+j], 0, bits_u[j], 0, cc->len, 1);
+	}
 
-	osmo_ubit2pbit_ext(l2, 0, bits_u, 0, cc->len, 1);
+	return 0;
 }
 
 /*! @} */
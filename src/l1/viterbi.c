@@ -0,0 +1,806 @@
+/* GMR-1 Viterbi decoder */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \addtogroup conv
+ *  @{
+ */
+
+/*! \file l1/viterbi.c
+ *  \brief Osmocom GMR-1 specialized Viterbi decoder implementation
+ *
+ * All GMR-1 codes are feedforward codes built on a simple shift register
+ * (K=5 for the 16 states codes, K=7 for the TCH3 speech code). This allows
+ * a much faster decoder than the generic one from libosmocore :
+ *  - Branch metrics are computed once per trellis step, directly handling
+ *    the punctured positions. For tail biting codes they're reused for the
+ *    second pass.
+ *  - The add-compare-select uses the butterfly structure of the trellis
+ *    and is vectorized using SSE2 / AVX2 when the CPU supports it.
+ *  - Survivors are stored as one decision bit per state.
+ *
+ * Path metrics, tie breaking and state selection rules are the ones of
+ * the generic Viterbi of libosmocore up to 0.9 (squared error metric,
+ * lowest predecessor wins ties). Later libosmocore versions decode these
+ * codes with their conv_acc decoder which uses another metric and other
+ * tie breaking rules, so the output of osmo_conv_decode() can differ on
+ * ties and its return value isn't comparable. The returned metric (the
+ * conv_rv of all the channel decoders) is this decoder's own.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+
+#include <osmocom/gmr1/l1/conv.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_VIT_X86
+#endif
+
+
+#define MAX_AE		0x00ffffff	/* Same as libosmocore */
+#define VIT_MAX_N	5
+#define VIT_MAX_S	64
+#define VIT_MAX_STEPS	1024
+
+
+/*! \brief Branch metrics for one trellis step
+ *
+ * The metric of an output symbol 'o' is base + sum of diff[j] for all bits
+ * j set in 'o' (MSB first like libosmocore).
+ */
+struct vit_bm {
+	int32_t base;			/*!< \brief Metric if all bits are 0 */
+	int32_t diff[VIT_MAX_N];	/*!< \brief Extra metric if bit is 1 */
+};
+
+/*! \brief Per code constants used by the ACS kernels */
+struct vit_code {
+	int N;				/*!< \brief Bits per trellis step */
+	int S;				/*!< \brief Number of states */
+
+	/*! \brief Output bit masks (0 / -1) for each destination state,
+	 *  [j][0] for the low predecessor, [j][1] for the high one */
+	int32_t mask[VIT_MAX_N][2][VIT_MAX_S] __attribute__((aligned(32)));
+
+	/*! \brief Output symbols for each destination state / predecessor */
+	uint8_t out[2][VIT_MAX_S];
+};
+
+typedef void (*vit_kernel_t)(const struct vit_code *vc, int32_t *ae,
+                             uint64_t *dec, const struct vit_bm *bm, int n);
+
+
+/* ------------------------------------------------------------------------ */
+/* Setup                                                                    */
+/* ------------------------------------------------------------------------ */
+
+/*! \brief Check if a code can be handled by the specialized decoder */
+static int
+_vit_supported(const struct osmo_conv_code *code)
+{
+	int S, s;
+
+	if ((code->K != 5) && (code->K != 7))
+		return 0;
+
+	if ((code->N < 1) || (code->N > VIT_MAX_N))
+		return 0;
+
+	if (code->next_term_output || code->next_term_state)
+		return 0;
+
+	if ((code->len <= 0) || ((code->len + code->K - 1) > VIT_MAX_STEPS))
+		return 0;
+
+	/* Must be a plain shift register */
+	S = 1 << (code->K - 1);
+
+	for (s=0; s<S; s++)
+		if ((code->next_state[s][0] != ((s << 1)     & (S-1))) ||
+		    (code->next_state[s][1] != (((s << 1) | 1) & (S-1))))
+			return 0;
+
+	return 1;
+}
+
+/*! \brief Prepare the output bit masks for a given code */
+static void
+_vit_code_init(struct vit_code *vc, const struct osmo_conv_code *code)
+{
+	int ns, j, p;
+
+	vc->N = code->N;
+	vc->S = 1 << (code->K - 1);
+
+	for (ns=0; ns<vc->S; ns++) {
+		for (p=0; p<2; p++) {
+			int ps = (ns >> 1) + (p ? (vc->S >> 1) : 0);
+			uint8_t o = code->next_output[ps][ns & 1];
+
+			vc->out[p][ns] = o;
+
+			for (j=0; j<vc->N; j++)
+				vc->mask[j][p][ns] = -((o >> (vc->N - 1 - j)) & 1);
+		}
+	}
+}
+
+/*! \brief Compute all branch metrics, handling punctured positions
+ *  \param[in] code Convolutional code
+ *  \param[in] input Soft input bits (punctured)
+ *  \param[out] bm Branch metrics array (n entries)
+ *  \param[in] n Number of trellis steps
+ *
+ * A punctured (or zero) input contributes nothing, exactly like in
+ * libosmocore. The puncture array is walked once, in step with the input.
+ */
+static void
+_vit_branch_metrics(const struct osmo_conv_code *code, const sbit_t *input,
+                    struct vit_bm *bm, int n)
+{
+	const int *punct = code->puncture;
+	int i, j, idx = 0;
+
+	for (i=0; i<n; i++) {
+		bm[i].base = 0;
+
+		for (j=0; j<code->N; j++, idx++) {
+			int is, ep, en;
+
+			if (punct && (*punct == idx)) {
+				punct++;
+				bm[i].diff[j] = 0;
+				continue;
+			}
+
+			is = *input++;
+
+			if (!is) {
+				bm[i].diff[j] = 0;
+				continue;
+			}
+
+			ep = is - 127;
+			en = is + 127;
+
+			ep = (ep * ep) >> 9;
+			en = (en * en) >> 9;
+
+			bm[i].base += ep;
+			bm[i].diff[j] = en - ep;
+		}
+	}
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Add-Compare-Select kernels                                               */
+/* ------------------------------------------------------------------------ */
+
+/*! \brief Generic C ACS kernel
+ *
+ * For destination state ns, predecessors are ns>>1 and (ns>>1) + S/2, both
+ * with input bit ns&1. The high predecessor only wins if strictly better,
+ * matching the scan order of the generic libosmocore decoder.
+ */
+static void
+_vit_acs_c(const struct vit_code *vc, int32_t *ae, uint64_t *dec,
+           const struct vit_bm *bm, int n)
+{
+	const int S = vc->S, H = S >> 1, N = vc->N;
+	int32_t ae_next[VIT_MAX_S];
+	int32_t sym[1 << VIT_MAX_N];
+	int i, j, o, l, ns;
+
+	for (i=0; i<n; i++) {
+		uint64_t d = 0;
+
+		/* Metric for each possible output symbol (LSB first) */
+		sym[0] = bm[i].base;
+		for (j=N-1, l=1; j>=0; j--, l<<=1)
+			for (o=0; o<l; o++)
+				sym[o+l] = sym[o] + bm[i].diff[j];
+
+		/* ACS */
+		for (ns=0; ns<S; ns++) {
+			int32_t m0 = ae[ns >> 1]     + sym[vc->out[0][ns]];
+			int32_t m1 = ae[(ns >> 1)+H] + sym[vc->out[1][ns]];
+
+			if (m1 < m0) {
+				ae_next[ns] = m1;
+				d |= 1ULL << ns;
+			} else {
+				ae_next[ns] = m0;
+			}
+		}
+
+		memcpy(ae, ae_next, sizeof(int32_t) * S);
+		dec[i] = d;
+	}
+}
+
+#ifdef HAVE_VIT_X86
+
+/*! \brief SSE2 ACS kernel (4 states per vector) */
+__attribute__((target("sse2")))
+static void
+_vit_acs_sse2(const struct vit_code *vc, int32_t *ae, uint64_t *dec,
+              const struct vit_bm *bm, int n)
+{
+	const int S = vc->S, V = S >> 2, N = vc->N;
+	__m128i a[VIT_MAX_S/4], an[VIT_MAX_S/4];
+	int i, j, c;
+
+	for (c=0; c<V; c++)
+		a[c] = _mm_loadu_si128((const __m128i *)&ae[c << 2]);
+
+	for (i=0; i<n; i++) {
+		__m128i base = _mm_set1_epi32(bm[i].base);
+		__m128i diff[VIT_MAX_N];
+		uint64_t d = 0;
+
+		for (j=0; j<N; j++)
+			diff[j] = _mm_set1_epi32(bm[i].diff[j]);
+
+		for (c=0; c<V; c++) {
+			__m128i p0, p1, m0, m1, sel;
+
+			/* Duplicated predecessors metrics */
+			if (c & 1) {
+				p0 = _mm_unpackhi_epi32(a[c>>1], a[c>>1]);
+				p1 = _mm_unpackhi_epi32(a[(c>>1)+(V>>1)], a[(c>>1)+(V>>1)]);
+			} else {
+				p0 = _mm_unpacklo_epi32(a[c>>1], a[c>>1]);
+				p1 = _mm_unpacklo_epi32(a[(c>>1)+(V>>1)], a[(c>>1)+(V>>1)]);
+			}
+
+			/* Add branch metrics */
+			m0 = _mm_add_epi32(p0, base);
+			m1 = _mm_add_epi32(p1, base);
+
+			for (j=0; j<N; j++) {
+				m0 = _mm_add_epi32(m0, _mm_and_si128(diff[j],
+					_mm_load_si128((const __m128i *)&vc->mask[j][0][c<<2])));
+				m1 = _mm_add_epi32(m1, _mm_and_si128(diff[j],
+					_mm_load_si128((const __m128i *)&vc->mask[j][1][c<<2])));
+			}
+
+			/* Compare / Select */
+			sel = _mm_cmplt_epi32(m1, m0);
+			an[c] = _mm_or_si128(_mm_and_si128(sel, m1), _mm_andnot_si128(sel, m0));
+
+			d |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(sel)) << (c << 2);
+		}
+
+		for (c=0; c<V; c++)
+			a[c] = an[c];
+
+		dec[i] = d;
+	}
+
+	for (c=0; c<V; c++)
+		_mm_storeu_si128((__m128i *)&ae[c << 2], a[c]);
+}
+
+/*! \brief AVX2 ACS kernel (8 states per vector) */
+__attribute__((target("avx2")))
+static void
+_vit_acs_avx2(const struct vit_code *vc, int32_t *ae, uint64_t *dec,
+              const struct vit_bm *bm, int n)
+{
+	const int S = vc->S, V = S >> 3, N = vc->N;
+	const __m256i dup_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i dup_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+	__m256i a[VIT_MAX_S/8], an[VIT_MAX_S/8];
+	int i, j, c;
+
+	for (c=0; c<V; c++)
+		a[c] = _mm256_loadu_si256((const __m256i *)&ae[c << 3]);
+
+	for (i=0; i<n; i++) {
+		__m256i base = _mm256_set1_epi32(bm[i].base);
+		__m256i diff[VIT_MAX_N];
+		uint64_t d = 0;
+
+		for (j=0; j<N; j++)
+			diff[j] = _mm256_set1_epi32(bm[i].diff[j]);
+
+		for (c=0; c<V; c++) {
+			__m256i idx = (c & 1) ? dup_hi : dup_lo;
+			__m256i p0, p1, m0, m1, sel;
+
+			/* Duplicated predecessors metrics */
+			p0 = _mm256_permutevar8x32_epi32(a[c>>1], idx);
+			p1 = _mm256_permutevar8x32_epi32(a[(c>>1)+(V>>1)], idx);
+
+			/* Add branch metrics */
+			m0 = _mm256_add_epi32(p0, base);
+			m1 = _mm256_add_epi32(p1, base);
+
+			for (j=0; j<N; j++) {
+				m0 = _mm256_add_epi32(m0, _mm256_and_si256(diff[j],
+					_mm256_load_si256((const __m256i *)&vc->mask[j][0][c<<3])));
+				m1 = _mm256_add_epi32(m1, _mm256_and_si256(diff[j],
+					_mm256_load_si256((const __m256i *)&vc->mask[j][1][c<<3])));
+			}
+
+			/* Compare / Select */
+			sel = _mm256_cmpgt_epi32(m0, m1);
+			an[c] = _mm256_blendv_epi8(m0, m1, sel);
+
+			d |= (uint64_t)(uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(sel)) << (c << 3);
+		}
+
+		for (c=0; c<V; c++)
+			a[c] = an[c];
+
+		dec[i] = d;
+	}
+
+	for (c=0; c<V; c++)
+		_mm256_storeu_si256((__m256i *)&ae[c << 3], a[c]);
+}
+
+#endif /* HAVE_VIT_X86 */
+
+/*! \brief Select the best ACS kernel for this CPU and number of states */
+static vit_kernel_t
+_vit_kernel(int S)
+{
+#ifdef HAVE_VIT_X86
+	if ((S >= 16) && __builtin_cpu_supports("avx2"))
+		return _vit_acs_avx2;
+	if ((S >= 8) && __builtin_cpu_supports("sse2"))
+		return _vit_acs_sse2;
+#endif
+	return _vit_acs_c;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Decoder                                                                  */
+/* ------------------------------------------------------------------------ */
+
+/*! \brief Termination (flush) steps, only input bit 0 is allowed
+ *
+ * Only even states can be reached, odd ones are reset to MAX_AE.
+ */
+static void
+_vit_flush(const struct vit_code *vc, int32_t *ae, uint64_t *dec,
+           const struct vit_bm *bm, int n)
+{
+	const int S = vc->S, H = S >> 1;
+	int32_t ae_next[VIT_MAX_S];
+	int i, j, ns;
+
+	for (i=0; i<n; i++) {
+		uint64_t d = 0;
+
+		for (ns=0; ns<S; ns++) {
+			int32_t m0, m1;
+
+			if (ns & 1) {
+				ae_next[ns] = MAX_AE;
+				continue;
+			}
+
+			m0 = ae[ns >> 1]     + bm[i].base;
+			m1 = ae[(ns >> 1)+H] + bm[i].base;
+
+			for (j=0; j<vc->N; j++) {
+				m0 += bm[i].diff[j] & vc->mask[j][0][ns];
+				m1 += bm[i].diff[j] & vc->mask[j][1][ns];
+			}
+
+			if (m1 < m0) {
+				ae_next[ns] = m1;
+				d |= 1ULL << ns;
+			} else {
+				ae_next[ns] = m0;
+			}
+		}
+
+		memcpy(ae, ae_next, sizeof(int32_t) * S);
+		dec[i] = d;
+	}
+}
+
+/*! \brief Find best end state and trace back the decisions
+ *  \returns Path metric of the best state
+ */
+static int
+_vit_traceback(const struct vit_code *vc, const int32_t *ae,
+               const uint64_t *dec, int n_steps, int len, ubit_t *output)
+{
+	const int H = vc->S >> 1;
+	int32_t min_ae = MAX_AE;
+	int min_state = -1;
+	int i, s;
+
+	/* Lowest metric, first one wins in case of tie */
+	for (s=0; s<vc->S; s++) {
+		if (ae[s] < min_ae) {
+			min_ae = ae[s];
+			min_state = s;
+		}
+	}
+
+	if (min_state < 0)
+		return -1;
+
+	/* Walk back */
+	s = min_state;
+
+	for (i=n_steps-1; i>=0; i--) {
+		if (i < len)
+			output[i] = s & 1;
+		s = (s >> 1) + (((dec[i] >> s) & 1) ? H : 0);
+	}
+
+	return min_ae;
+}
+
+/*! \brief Viterbi decoding of a GMR-1 convolutional code
+ *  \param[in] code Convolutional code (possibly specialized/punctured)
+ *  \param[in] input Soft input bits
+ *  \param[out] output Decoded bits (code->len)
+ *  \returns Path metric of the decoded sequence (lower is better),
+ *           negative if nothing could be decoded
+ *
+ * Replacement for osmo_conv_decode() for GMR-1 codes. The metric is the
+ * sum over all coded bits of (soft bit - expected)^2 >> 9, expected being
+ * +-127 and punctured / zero soft bits counting for nothing, so it only
+ * depends on this decoder and not on the libosmocore version. Codes that
+ * are not shift register based (or too large) are passed on to
+ * osmo_conv_decode() and return its metric.
+ */
+int
+gmr1_conv_decode(const struct osmo_conv_code *code,
+                 const sbit_t *input, ubit_t *output)
+{
+	struct vit_code vc;
+	struct vit_bm bm[VIT_MAX_STEPS];
+	uint64_t dec[VIT_MAX_STEPS];
+	int32_t ae[VIT_MAX_S];
+	vit_kernel_t kernel;
+	int n_flush, s;
+
+	if (!_vit_supported(code))
+		return osmo_conv_decode(code, input, output);
+
+	_vit_code_init(&vc, code);
+
+	n_flush = (code->term == CONV_TERM_FLUSH) ? code->K - 1 : 0;
+
+	/* Branch metrics for all steps (including termination) */
+	_vit_branch_metrics(code, input, bm, code->len + n_flush);
+
+	/* Initial state */
+	for (s=0; s<vc.S; s++)
+		ae[s] = MAX_AE;
+	ae[0] = 0;
+
+	kernel = _vit_kernel(vc.S);
+
+	/* Tail biting: one pass to get starting metrics, then normalize */
+	if (code->term == CONV_TERM_TAIL_BITING) {
+		int32_t min_ae = MAX_AE;
+
+		kernel(&vc, ae, dec, bm, code->len);
+
+		for (s=0; s<vc.S; s++)
+			if (ae[s] < min_ae)
+				min_ae = ae[s];
+
+		for (s=0; s<vc.S; s++)
+			ae[s] -= min_ae;
+	}
+
+	/* Main pass */
+	kernel(&vc, ae, dec, bm, code->len);
+
+	if (n_flush)
+		_vit_flush(&vc, ae, &dec[code->len], &bm[code->len], n_flush);
+
+	/* Output */
+	return _vit_traceback(&vc, ae, dec, code->len + n_flush, code->len, output);
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Batched (inter-frame) decoder                                            */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * With at most 64 states, a single trellis doesn't fill wide vector units
+ * (a 16 states trellis is a single AVX-512 register). The batched decoder
+ * instead runs VIT_LANES independent codewords of the same code side by
+ * side, one per vector lane. Every operation of the scalar algorithm then
+ * maps one-to-one to a vector operation, without any shuffle.
+ *
+ * The kernel uses GCC vector extensions and, when available, is compiled
+ * for several ISAs with the best one picked at load time.
+ */
+
+#define VIT_LANES	16
+
+typedef int32_t vit_vec_t __attribute__((vector_size(VIT_LANES * 4)));
+
+#if defined(HAVE_VIT_X86) && defined(__ELF__) && (__GNUC__ >= 6) && !defined(__clang__)
+#define VIT_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define VIT_CLONES
+#endif
+
+/*! \brief Branch metrics for one trellis step of all lanes */
+struct vit_bm_vec {
+	vit_vec_t base;
+	vit_vec_t diff[VIT_MAX_N];
+};
+
+/*! \brief Lane-parallel ACS kernel
+ *  \param[in] vc Code constants
+ *  \param[in,out] ae Path metrics (one vector per state)
+ *  \param[out] dec Decisions, (S+31)/32 vectors per step, bit ns%32 of lane
+ *  \param[in] bm Branch metrics
+ *  \param[in] n Number of steps
+ *  \param[in] flush Termination steps (only input bit 0 allowed)
+ */
+VIT_CLONES
+static void
+_vit_batch_acs(const struct vit_code *vc, vit_vec_t *ae, vit_vec_t *dec,
+               const struct vit_bm_vec *bm, int n, int flush)
+{
+	const int S = vc->S, H = S >> 1, N = vc->N, W = (S + 31) >> 5;
+	vit_vec_t ae_next[VIT_MAX_S];
+	vit_vec_t sym[1 << VIT_MAX_N];
+	const vit_vec_t max_ae = (vit_vec_t){ 0 } + MAX_AE;
+	int i, j, o, l, ns;
+
+	for (i=0; i<n; i++, dec+=W) {
+		/* Metric for each possible output symbol (LSB first) */
+		sym[0] = bm[i].base;
+		for (j=N-1, l=1; j>=0; j--, l<<=1)
+			for (o=0; o<l; o++)
+				sym[o+l] = sym[o] + bm[i].diff[j];
+
+		for (j=0; j<W; j++)
+			dec[j] = (vit_vec_t){ 0 };
+
+		/* ACS */
+		for (ns=0; ns<S; ns++) {
+			vit_vec_t m0, m1, sel;
+
+			if (flush && (ns & 1)) {
+				ae_next[ns] = max_ae;
+				continue;
+			}
+
+			m0 = ae[ns >> 1]     + sym[vc->out[0][ns]];
+			m1 = ae[(ns >> 1)+H] + sym[vc->out[1][ns]];
+
+			sel = m1 < m0;
+
+			ae_next[ns] = (m1 & sel) | (m0 & ~sel);
+			dec[ns >> 5] |= sel & (int32_t)(1U << (ns & 31));
+		}
+
+		memcpy(ae, ae_next, sizeof(vit_vec_t) * S);
+	}
+}
+
+/*! \brief Lane-parallel branch metrics computation
+ *  \param[in] pos Input offset of each coded bit (-1 if punctured)
+ *  \param[in] input Array of n soft input bits pointers
+ *  \param[in] n Number of used lanes (others get a zero input)
+ *  \param[out] bmv Branch metrics
+ *  \param[in] n_steps Number of trellis steps
+ *  \param[in] N Bits per trellis step
+ */
+VIT_CLONES
+static void
+_vit_batch_bm(const int16_t *pos, const sbit_t * const *input, int n,
+              struct vit_bm_vec *bmv, int n_steps, int N)
+{
+	int i, j, l;
+
+	for (i=0; i<n_steps; i++) {
+		bmv[i].base = (vit_vec_t){ 0 };
+
+		for (j=0; j<N; j++, pos++) {
+			vit_vec_t is = { 0 }, ep, en, nz;
+
+			if (*pos < 0) {
+				bmv[i].diff[j] = (vit_vec_t){ 0 };
+				continue;
+			}
+
+			for (l=0; l<n; l++)
+				is[l] = input[l][*pos];
+
+			nz = is != 0;
+			ep = is - 127;
+			en = is + 127;
+			ep = ((ep * ep) >> 9) & nz;
+			en = ((en * en) >> 9) & nz;
+
+			bmv[i].base += ep;
+			bmv[i].diff[j] = en - ep;
+		}
+	}
+}
+
+/*! \brief Decode one group of up to VIT_LANES codewords */
+static void
+_vit_batch_group(const struct osmo_conv_code *code, const struct vit_code *vc,
+                 const int16_t *pos, const sbit_t * const *input,
+                 ubit_t * const *output, int *rv, int n,
+                 struct vit_bm_vec *bmv, vit_vec_t *dec)
+{
+	const int W = (vc->S + 31) >> 5;
+	vit_vec_t ae[VIT_MAX_S];
+	int n_flush, n_steps, i, s, l;
+
+	n_flush = (code->term == CONV_TERM_FLUSH) ? code->K - 1 : 0;
+	n_steps = code->len + n_flush;
+
+	/* Branch metrics */
+	_vit_batch_bm(pos, input, n, bmv, n_steps, vc->N);
+
+	/* Initial state */
+	for (s=0; s<vc->S; s++)
+		ae[s] = (vit_vec_t){ 0 } + (s ? MAX_AE : 0);
+
+	/* Tail biting: one pass to get starting metrics, then normalize */
+	if (code->term == CONV_TERM_TAIL_BITING) {
+		vit_vec_t min_ae;
+
+		_vit_batch_acs(vc, ae, dec, bmv, code->len, 0);
+
+		min_ae = ae[0];
+
+		for (s=1; s<vc->S; s++) {
+			vit_vec_t m = ae[s] < min_ae;
+			min_ae = (ae[s] & m) | (min_ae & ~m);
+		}
+
+		for (s=0; s<vc->S; s++)
+			ae[s] -= min_ae;
+	}
+
+	/* Main pass + termination */
+	_vit_batch_acs(vc, ae, dec, bmv, code->len, 0);
+
+	if (n_flush)
+		_vit_batch_acs(vc, ae, &dec[code->len * W], &bmv[code->len], n_flush, 1);
+
+	/* Per lane traceback */
+	for (l=0; l<n; l++) {
+		int32_t min_ae = MAX_AE;
+		int min_state = -1;
+
+		for (s=0; s<vc->S; s++) {
+			if (ae[s][l] < min_ae) {
+				min_ae = ae[s][l];
+				min_state = s;
+			}
+		}
+
+		if (min_state < 0) {
+			if (rv)
+				rv[l] = -1;
+			continue;
+		}
+
+		s = min_state;
+
+		for (i=n_steps-1; i>=0; i--) {
+			int d = (dec[(i * W) + (s >> 5)][l] >> (s & 31)) & 1;
+			if (i < code->len)
+				output[l][i] = s & 1;
+			s = (s >> 1) + (d ? (vc->S >> 1) : 0);
+		}
+
+		if (rv)
+			rv[l] = min_ae;
+	}
+}
+
+/*! \brief Batched Viterbi decoding of many codewords of the same code
+ *  \param[in] code Convolutional code (possibly specialized/punctured)
+ *  \param[in] input Array of n soft input bits pointers
+ *  \param[out] output Array of n decoded bits pointers (code->len each)
+ *  \param[out] rv Array of n path metrics, same as \ref gmr1_conv_decode
+ *                 would return (can be NULL)
+ *  \param[in] n Number of codewords
+ *  \returns 0 for success, -errno for errors
+ *
+ * Results are identical to n calls to \ref gmr1_conv_decode but codewords
+ * are decoded in parallel, one per vector lane, which gives a much better
+ * throughput when there is a backlog to process (e.g. CCCH blocks from
+ * many carriers).
+ */
+int
+gmr1_conv_decode_batch(const struct osmo_conv_code *code,
+                       const sbit_t * const *input, ubit_t * const *output,
+                       int *rv, int n)
+{
+	struct vit_code vc;
+	struct vit_bm_vec *bmv = NULL;
+	vit_vec_t *dec = NULL;
+	int16_t pos[VIT_MAX_STEPS * VIT_MAX_N];
+	const int *punct;
+	int n_steps, i, k, g;
+
+	if (n <= 0)
+		return n ? -EINVAL : 0;
+
+	/* Fallback for unsupported codes */
+	if (!_vit_supported(code)) {
+		for (i=0; i<n; i++) {
+			int r = osmo_conv_decode(code, input[i], output[i]);
+			if (rv)
+				rv[i] = r;
+		}
+		return 0;
+	}
+
+	_vit_code_init(&vc, code);
+
+	n_steps = code->len + code->K - 1;
+
+	/* Depuncturing map, shared by all codewords */
+	punct = code->puncture;
+
+	for (i=0, k=0; i<(n_steps * code->N); i++) {
+		if (punct && (*punct == i)) {
+			punct++;
+			pos[i] = -1;
+		} else {
+			pos[i] = k++;
+		}
+	}
+
+	if (posix_memalign((void **)&bmv, sizeof(vit_vec_t),
+	                   sizeof(struct vit_bm_vec) * n_steps) ||
+	    posix_memalign((void **)&dec, sizeof(vit_vec_t),
+	                   sizeof(vit_vec_t) * n_steps * ((vc.S + 31) >> 5))) {
+		free(bmv);
+		return -ENOMEM;
+	}
+
+	for (i=0; i<n; i+=VIT_LANES) {
+		g = (n - i) < VIT_LANES ? (n - i) : VIT_LANES;
+		_vit_batch_group(code, &vc, pos, &input[i], &output[i],
+		                 rv ? &rv[i] : NULL, g, bmv, dec);
+	}
+
+	free(dec);
+	free(bmv);
+
+	return 0;
+}
+
+/*! @} */
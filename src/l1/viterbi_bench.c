@@ -0,0 +1,357 @@
+/* GMR-1 Viterbi decoder benchmark */
+
+/* (C) 2011 by Sylvain Munaut <tnt@246tNt.com>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! \file l1/viterbi_bench.c
+ *  \brief Osmocom GMR-1 Viterbi decoder benchmark
+ *
+ * Decodes noisy codewords of every GMR-1 channel code, single threaded,
+ * with the generic libosmocore decoder and with \ref gmr1_conv_decode,
+ * and prints the frames per second (per core) of each. The batch API,
+ * \ref gmr1_conv_decode_batch, is measured too, decoding all the frames
+ * in one call, and the speedup printed is the one of the batch decoder
+ * over libosmocore.
+ *
+ * The outputs and path metrics of both GMR-1 decoders are checked against
+ * \ref ref_conv_decode, a plain scalar copy of the generic libosmocore
+ * Viterbi they reproduce, and any mismatch makes the program fail. They
+ * are not checked against osmo_conv_decode itself: since libosmocore 0.10
+ * it uses another decoder for these codes, with another metric.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/conv.h>
+
+#include <osmocom/gmr1/l1/conv.h>
+#include <osmocom/gmr1/l1/punct.h>
+
+
+#define BENCH_FRAMES	64	/* Distinct codewords per code */
+#define BENCH_TIME	0.5	/* Seconds per measurement */
+#define BENCH_MAX_IN	1024
+#define BENCH_MAX_OUT	2048
+
+#define REF_MAX_AE	0x00ffffff
+#define REF_MAX_S	64
+
+
+struct bench_code {
+	const char *name;
+	const struct osmo_conv_code *base;
+	int len;
+	const struct gmr1_puncturer *punct[3];
+	int repeat;
+};
+
+static const struct bench_code bench_codes[] = {
+	{ "BCCH/CCCH",   &gmr1_conv_12,   208, { NULL, NULL, NULL }, 0 },
+	{ "FACCH3",      &gmr1_conv_14,    92, { NULL, NULL, NULL }, 0 },
+	{ "FACCH9",      &gmr1_conv_12,   316, { NULL, NULL, NULL }, 0 },
+	{ "TCH3 speech", &gmr1_conv_tch3,  48,
+		{ NULL, &gmr1_punct12_P12, NULL }, 0 },
+	{ "TCH9 2.4k",   &gmr1_conv_15,   144,
+		{ &gmr1_punct15_P53, &gmr1_punct15_P23, &gmr1_punct15_Ps53 }, 41 },
+	{ "TCH9 4.8k",   &gmr1_conv_13,   240,
+		{ &gmr1_punct13_P15, &gmr1_punct13_P25, &gmr1_punct13_Ps15 }, 41 },
+	{ "TCH9 9.6k",   &gmr1_conv_12,   480,
+		{ &gmr1_punct12_P25, &gmr1_punct12_P23, &gmr1_punct12_Ps25 }, 158 },
+};
+
+static sbit_t bench_in[BENCH_FRAMES][BENCH_MAX_OUT];
+static ubit_t bench_out[BENCH_FRAMES][BENCH_MAX_IN];
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*! \brief Reference Viterbi decoder
+ *  \param[in] code Convolutional code (possibly specialized/punctured)
+ *  \param[in] input Soft input bits
+ *  \param[out] output Decoded bits (code->len)
+ *  \returns Path metric of the best path, -1 if none
+ *
+ * Scalar copy of the generic osmo_conv_decode of libosmocore up to 0.9,
+ * which \ref gmr1_conv_decode must match bit for bit: for every state and
+ * input bit, squared error metric, a survivor only replaced by a strictly
+ * better path, the lowest end state wins ties. Only handles what the GMR-1
+ * codes use (no termination tables).
+ */
+static int
+ref_conv_decode(const struct osmo_conv_code *code,
+                const sbit_t *input, ubit_t *output)
+{
+	static uint8_t hist[BENCH_MAX_IN][REF_MAX_S];
+	int ae[REF_MAX_S], ae_next[REF_MAX_S];
+	const sbit_t *in;
+	sbit_t sym[8];
+	int S, n_steps, n_main, pass, i, j, s, b, idx, p_idx;
+	int min_ae, min_state;
+
+	S = 1 << (code->K - 1);
+	n_main = code->len;
+	n_steps = n_main + ((code->term == CONV_TERM_FLUSH) ? code->K - 1 : 0);
+
+	for (s=0; s<S; s++)
+		ae[s] = REF_MAX_AE;
+	ae[0] = 0;
+
+	/* Tail biting does a first pass to get the start metrics */
+	for (pass=(code->term == CONV_TERM_TAIL_BITING) ? 0 : 1; pass<2; pass++)
+	{
+		in = input;
+		p_idx = 0;
+
+		for (i=0; i<(pass ? n_steps : n_main); i++)
+		{
+			/* Input symbols, 0 when punctured */
+			for (j=0; j<code->N; j++) {
+				idx = (i * code->N) + j;
+				if (code->puncture && (code->puncture[p_idx] == idx)) {
+					sym[j] = 0;
+					p_idx++;
+				} else {
+					sym[j] = *in++;
+				}
+			}
+
+			/* Every state and input bit (only 0 when flushing) */
+			for (s=0; s<S; s++)
+				ae_next[s] = REF_MAX_AE;
+
+			for (s=0; s<S; s++) {
+				for (b=0; b<((i < n_main) ? 2 : 1); b++) {
+					uint8_t out = code->next_output[s][b];
+					uint8_t ns  = code->next_state[s][b];
+					int nae = ae[s];
+
+					for (j=0; j<code->N; j++) {
+						int e;
+						if (!sym[j])
+							continue;
+						e = sym[j] - (((out >> (code->N-1-j)) & 1) ? -127 : 127);
+						nae += (e * e) >> 9;
+					}
+
+					if (ae_next[ns] > nae) {
+						ae_next[ns] = nae;
+						hist[i][ns] = s;
+					}
+				}
+			}
+
+			memcpy(ae, ae_next, sizeof(int) * S);
+		}
+
+		/* Normalize after the first tail biting pass */
+		if (!pass) {
+			min_ae = REF_MAX_AE;
+			for (s=0; s<S; s++)
+				if (ae[s] < min_ae)
+					min_ae = ae[s];
+			for (s=0; s<S; s++)
+				ae[s] -= min_ae;
+		}
+	}
+
+	/* Best end state */
+	min_ae = REF_MAX_AE;
+	min_state = -1;
+
+	for (s=0; s<S; s++) {
+		if (ae[s] < min_ae) {
+			min_ae = ae[s];
+			min_state = s;
+		}
+	}
+
+	if (min_state < 0)
+		return -1;
+
+	/* Trace back */
+	s = min_state;
+
+	for (i=n_steps-1; i>=0; i--) {
+		int ps = hist[i][s];
+		if (i < n_main)
+			output[i] = (code->next_state[ps][0] == s) ? 0 : 1;
+		s = ps;
+	}
+
+	return min_ae;
+}
+
+/*! \brief Encodes random data and adds noise, a few bits being erased */
+static void
+bench_gen(const struct osmo_conv_code *code)
+{
+	ubit_t u[BENCH_MAX_IN], e[BENCH_MAX_OUT];
+	int i, j, ol, v;
+
+	ol = osmo_conv_get_output_length(code, 0);
+
+	for (i=0; i<BENCH_FRAMES; i++) {
+		for (j=0; j<code->len; j++)
+			u[j] = rand() & 1;
+
+		osmo_conv_encode(code, u, e);
+
+		for (j=0; j<ol; j++) {
+			v = (e[j] ? -64 : 64) + (rand() % 161) - 80;
+			if (!(rand() % 50))
+				v = 0;
+			bench_in[i][j] = v > 127 ? 127 : (v < -127 ? -127 : v);
+		}
+	}
+}
+
+/*! \brief Frames per second of one decoder over the generated codewords */
+static double
+bench_run(const struct osmo_conv_code *code,
+          int (*decode)(const struct osmo_conv_code *,
+                        const sbit_t *, ubit_t *))
+{
+	double t0, t;
+	long n = 0;
+	int i;
+
+	t0 = now();
+	do {
+		for (i=0; i<BENCH_FRAMES; i++)
+			decode(code, bench_in[i], bench_out[i]);
+		n += BENCH_FRAMES;
+		t = now() - t0;
+	} while (t < BENCH_TIME);
+
+	return n / t;
+}
+
+/*! \brief Frames per second of the batch decoder, BENCH_FRAMES per call */
+static double
+bench_run_batch(const struct osmo_conv_code *code)
+{
+	const sbit_t *in[BENCH_FRAMES];
+	ubit_t *out[BENCH_FRAMES];
+	double t0, t;
+	long n = 0;
+	int i;
+
+	for (i=0; i<BENCH_FRAMES; i++) {
+		in[i]  = bench_in[i];
+		out[i] = bench_out[i];
+	}
+
+	t0 = now();
+	do {
+		gmr1_conv_decode_batch(code, in, out, NULL, BENCH_FRAMES);
+		n += BENCH_FRAMES;
+		t = now() - t0;
+	} while (t < BENCH_TIME);
+
+	return n / t;
+}
+
+/*! \brief Checks gmr1_conv_decode & _batch against ref_conv_decode */
+static int
+bench_check(const struct osmo_conv_code *code)
+{
+	ubit_t ref[BENCH_MAX_IN];
+	const sbit_t *in[BENCH_FRAMES];
+	ubit_t *out[BENCH_FRAMES];
+	int rv[BENCH_FRAMES];
+	int i, r, bad = 0;
+
+	for (i=0; i<BENCH_FRAMES; i++) {
+		in[i]  = bench_in[i];
+		out[i] = bench_out[i];
+	}
+
+	if (gmr1_conv_decode_batch(code, in, out, rv, BENCH_FRAMES))
+		return BENCH_FRAMES;
+
+	for (i=0; i<BENCH_FRAMES; i++) {
+		r = ref_conv_decode(code, bench_in[i], ref);
+		if ((r != rv[i]) || memcmp(ref, bench_out[i], code->len))
+			bad++;
+
+		if ((r != gmr1_conv_decode(code, bench_in[i], bench_out[i])) ||
+		    memcmp(ref, bench_out[i], code->len))
+			bad++;
+	}
+
+	return bad;
+}
+
+int main(int argc, char *argv[])
+{
+	struct osmo_conv_code code;
+	const struct bench_code *bc;
+	double f_ref, f_gmr1, f_batch;
+	int i, rv, bad = 0;
+
+	srand(1);
+
+	printf("%-12s %12s %12s %12s %8s\n",
+		"code", "osmo fr/s", "gmr1 fr/s", "batch fr/s", "speedup");
+
+	for (i=0; i<sizeof(bench_codes)/sizeof(bench_codes[0]); i++) {
+		bc = &bench_codes[i];
+
+		memcpy(&code, bc->base, sizeof(code));
+		code.len = bc->len;
+
+		if (bc->punct[1]) {
+			rv = gmr1_puncturer_generate(&code,
+				bc->punct[0], bc->punct[1], bc->punct[2],
+				bc->repeat);
+			if (rv) {
+				fprintf(stderr, "[!] %s: puncturer failed\n", bc->name);
+				return 1;
+			}
+		}
+
+		bench_gen(&code);
+
+		rv = bench_check(&code);
+		if (rv) {
+			fprintf(stderr, "[!] %s: %d mismatches\n", bc->name, rv);
+			bad += rv;
+		}
+
+		f_ref  = bench_run(&code, osmo_conv_decode);
+		f_gmr1 = bench_run(&code, gmr1_conv_decode);
+		f_batch = bench_run_batch(&code);
+
+		printf("%-12s %12.0f %12.0f %12.0f %7.1fx\n",
+			bc->name, f_ref, f_gmr1, f_batch, f_batch / f_ref);
+
+		if (bc->punct[1])
+			free((void *)code.puncture);
+	}
+
+	return bad ? 1 : 0;
+}
@@ -31,8 +31,8 @@
 #include <math.h>
 #include <errno.h>
 #include <stdint.h>
-#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <osmocom/core/bits.h>
 
@@ -47,72 +47,140 @@
 #define DKAB_PWR_RATIO_THRESHOLD	10.0f
 
 
+/*! \brief Prefix sums used for all DKAB energy measurements
+ *
+ * Both the power and the raw signal are accumulated so that the energy of
+ * any DC-removed span can be computed in O(1), whatever the span and DC
+ * estimate used. The power is computed once per sample.
+ *
+ * The sums are accumulated in double precision: a span energy is the
+ * difference of two large sums minus the DC terms, which cancels out most
+ * of the bits of a float over a whole frame.
+ */
+struct dkab_pfx {
+	const float complex *x;	/*!< \brief Input signal */
+	double *pe;		/*!< \brief Prefix sum of |x|^2 (len+1) */
+	double complex *px;	/*!< \brief Prefix sum of x (len+1) */
+};
+
+/*! \brief Compute the prefix sums of a signal
+ *  \param[out] pfx Prefix sums to fill (pe & px must hold len+1 elements)
+ *  \param[in] x Input signal
+ *  \param[in] len Length of the input signal
+ */
+static void
+_dkab_pfx_compute(struct dkab_pfx *pfx, const float complex *x, int len)
+{
+	int i;
+
+	pfx->x = x;
+
+	/* Power first (vectorizable), then the running sums */
+	pfx->pe[0] = 0.0;
+	for (i=0; i<len; i++)
+		pfx->pe[i+1] = osmo_normsqf(x[i]);
+
+	pfx->px[0] = 0.0;
+	for (i=0; i<len; i++) {
+		pfx->pe[i+1] += pfx->pe[i];
+		pfx->px[i+1]  = pfx->px[i] + (double complex)x[i];
+	}
+}
+
+/*! \brief Mean of a span of the signal
+ *  \param[in] pfx Prefix sums
+ *  \param[in] b Beginning of the span
+ *  \param[in] l Length of the span
+ */
+static inline float complex
+_dkab_pfx_mean(const struct dkab_pfx *pfx, int b, int l)
+{
+	return (float complex)((pfx->px[b+l] - pfx->px[b]) / (double)l);
+}
+
+/*! \brief Energy of a span of the signal with a given DC offset removed
+ *  \param[in] pfx Prefix sums
+ *  \param[in] b Beginning of the span
+ *  \param[in] l Length of the span
+ *  \param[in] dc DC offset to remove
+ */
+static inline float
+_dkab_pfx_egy(const struct dkab_pfx *pfx, int b, int l, float complex dc)
+{
+	double complex s = pfx->px[b+l] - pfx->px[b];
+	double complex dcd = dc;
+	return (float)((pfx->pe[b+l] - pfx->pe[b])
+		- 2.0 * creal(s * conj(dcd))
+		+ (double)l * (creal(dcd) * creal(dcd) + cimag(dcd) * cimag(dcd)));
+}
+
+/*! \brief Energy of both KABs for a candidate position
+ *  \param[in] pfx Prefix sums
+ *  \param[in] ofs Positions of the two KABs
+ *  \param[in] d Length of a KAB
+ *  \param[in] dc DC offset to remove
+ *  \param[in] i Candidate position (relative to ofs)
+ */
+static inline float
+_dkab_pwr(const struct dkab_pfx *pfx, const int *ofs, int d,
+          float complex dc, int i)
+{
+	return _dkab_pfx_egy(pfx, ofs[0]+i, d, dc) +
+	       _dkab_pfx_egy(pfx, ofs[1]+i, d, dc);
+}
+
 /*! \brief Finds the precise TOA of a DKAB burts by looking for power spikes
- *  \param[in] burst Complex signal of the burst
+ *  \param[in] pfx Prefix sums of the signal
+ *  \param[in] base Offset of the burst in the signal
+ *  \param[in] len Length of the burst
+ *  \param[in] dc DC offset of the burst
  *  \param[in] sps Oversampling used in the input complex signal
  *  \param[in] p DKAB position
  *  \param[out] toa_p Pointer to TOA return variable
  *  \returns 0 for success, 1 if DKAB not found, -errno for fatal errors
+ *
+ * Scaling of the signal is irrelevant here, so the burst doesn't need to be
+ * normalized first.
  */
 static int
-_gmr1_dkab_find_toa(struct osmo_cxvec *burst, int sps, int p, float *toa_p)
+_gmr1_dkab_find_toa(const struct dkab_pfx *pfx, int base, int len,
+                    float complex dc, int sps, int p, float *toa_p)
 {
-	struct osmo_cxvec *pwr = NULL;
-	int rv, w, i, ofs[2], d, mi;
-	float mp, toa;
+	int w, i, ofs[2], d, mi;
+	float mp, np, toa;
+	float pwr_l, pwr_r;
 	float egy_peak, egy_valley;
-	int l_peak, l_valley, toa_i;
+	int l_valley, toa_i;
 
 	/* Window size */
-	w = burst->len - (GMR1_DKAB_SYMS * sps) + 1;
+	w = len - (GMR1_DKAB_SYMS * sps) + 1;
 	if (w <= 0)
 		return -EINVAL;
 
-	/* Energy vector */
-	pwr = osmo_cxvec_alloc(w);
-	if (!pwr)
-		return -ENOMEM;
-
-	ofs[0] = sps * (2 + p);		/* First  KAB position */
-	ofs[1] = sps * (2 + p + 59);	/* Second KAB position */
-	d = sps * 5;			/* Length of KAB */
-
-	pwr->data[0] = 0.0f;
-
-	for (i=0; i<d; i++) {
-		pwr->data[0] +=
-			osmo_normsqf(burst->data[ofs[0]+i]) +
-			osmo_normsqf(burst->data[ofs[1]+i]);
-	}
+	ofs[0] = base + sps * (2 + p);		/* First  KAB position */
+	ofs[1] = base + sps * (2 + p + 59);	/* Second KAB position */
+	d = sps * 5;				/* Length of KAB */
 
+	/* Energy for each candidate position, keep the max */
 	mi = 0;				/* Max index */
-	mp = pwr->data[0];		/* Max pwr */
-
-	for (i=0; i<w-1; i++)
-	{
-		float np;
-
-		np = pwr->data[i]
-			- osmo_normsqf(burst->data[ofs[0]+i])
-			- osmo_normsqf(burst->data[ofs[1]+i])
-			+ osmo_normsqf(burst->data[ofs[0]+d+i])
-			+ osmo_normsqf(burst->data[ofs[1]+d+i]);
-
-		pwr->data[i+1] = np;
+	mp = _dkab_pwr(pfx, ofs, d, dc, 0);	/* Max pwr */
 
+	for (i=1; i<w; i++) {
+		np = _dkab_pwr(pfx, ofs, d, dc, i);
 		if (np > mp) {
-			mi = i+1;
+			mi = i;
 			mp = np;
 		}
 	}
 
-	pwr->len = w;
-
-	/* Weigh & center peak */
+	/* Weigh & center peak (neighbours are O(1) to recompute) */
 	toa = (float)mi;
-	if ((mi > 0) && (mi < (w-1)))
-		toa += 0.5f * (-pwr->data[mi-1] + pwr->data[mi+1]) /
-		       (-pwr->data[mi-1] + 2.0f * pwr->data[mi] - pwr->data[mi+1]);
+	if ((mi > 0) && (mi < (w-1))) {
+		pwr_l = _dkab_pwr(pfx, ofs, d, dc, mi-1);
+		pwr_r = _dkab_pwr(pfx, ofs, d, dc, mi+1);
+		toa += 0.5f * (-pwr_l + pwr_r) /
+		       (-pwr_l + 2.0f * mp - pwr_r);
+	}
 	toa += ((float)(sps-1)) / 2.0f;
 
 	*toa_p = toa;
@@ -120,51 +188,47 @@ _gmr1_dkab_find_toa(struct osmo_cxvec *burst, int sps, int p, float *toa_p)
 	toa_i = (int)roundf(toa);
 
 	/* Check the ratio between the peaks and valley to validate */
-	egy_peak = 0.0f;
-	l_peak = d * 2;
-	for (i=0; i<d; i++) {
-		egy_peak +=
-			osmo_normsqf(burst->data[toa_i+ofs[0]+i]) +
-			osmo_normsqf(burst->data[toa_i+ofs[1]+i]);
-	}
-	egy_peak /= l_peak;
+	egy_peak = _dkab_pfx_egy(pfx, toa_i+ofs[0], d, dc) +
+	           _dkab_pfx_egy(pfx, toa_i+ofs[1], d, dc);
+	egy_peak /= d * 2;
 
-	egy_valley = 0.0f;
 	l_valley = ofs[1] - ofs[0] - d;
-	for (i=0; i<l_valley; i++)
-		egy_valley += osmo_normsqf(burst->data[toa_i+ofs[0]+d+i]);
+	egy_valley = _dkab_pfx_egy(pfx, toa_i+ofs[0]+d, l_valley, dc);
 	egy_valley /= l_valley;
 
-	rv = ((egy_peak /egy_valley) > DKAB_PWR_RATIO_THRESHOLD) ? 0 : 1;
-
-	/* Done */
-	osmo_cxvec_free(pwr);
-
-	return rv;
+	return ((egy_peak /egy_valley) > DKAB_PWR_RATIO_THRESHOLD) ? 0 : 1;
 }
 
 /*! \brief Converts a burst into softbits given proper TOA
- *  \param[in] burst Complex signal of the burst
+ *  \param[in] x Complex signal of the burst
+ *  \param[in] dc DC offset of the burst
  *  \param[in] sps Oversampling used in the input complex signal
+ *  \param[in] freq_shift Frequency shift to pre-apply (rad/sym)
  *  \param[in] p DKAB position
  *  \param[in] toa The TOA to use to extract symbols
  *  \param[out] ebits Encoded soft bits return array
  *  \returns 0 for success. -errno for errors
+ *
+ * Only phase differences over one symbol are used, so the frequency shift
+ * (and pi/4 counter rotation) reduces to a constant phase rotation.
  */
 static int
-_gmr1_dkab_soft_bits(struct osmo_cxvec *burst, int sps, int p, float toa,
-                     sbit_t *ebits)
+_gmr1_dkab_soft_bits(const float complex *x, float complex dc, int sps,
+                     float freq_shift, int p, float toa, sbit_t *ebits)
 {
 	int i, toa_i, ofs[2], o;
+	float complex rot;
 	float pd;
 
+	rot = cexpf(- I * (freq_shift - (M_PIf/4)));
+
 	toa_i = (int)roundf(toa);
 	ofs[0] = toa_i + sps * (2 + p);		/* First DKAB */
-	ofs[1] = toa_i + sps * (2 + p + 159);	/* Second DKAB */
+	ofs[1] = toa_i + sps * (2 + p + 59);	/* Second DKAB */
 
 	for (i=0; i<8; i++) {
 		o = ofs[i>>2] + (i&3);
-		pd = cargf(burst->data[o] * conjf(burst->data[o+sps]));
+		pd = cargf((x[o] - dc) * conjf(x[o+sps] - dc) * rot);
 		ebits[i] = (sbit_t)roundf((0.5f - (fabsf(pd) / M_PIf)) * 254.0f);
 	}
 
@@ -188,29 +252,99 @@ int
 gmr1_dkab_demod(struct osmo_cxvec *burst_in, int sps, float freq_shift, int p,
                 sbit_t *ebits, float *toa_p)
 {
-	struct osmo_cxvec *burst = NULL;
+	struct dkab_pfx pfx;
+	float complex dc;
 	int rv;
 
-	/* Normalize the burst and counter rotate by pi/4 */
-	burst = osmo_cxvec_sig_normalize(burst_in, 1, (freq_shift - (M_PIf/4)) / sps, NULL);
-	if (!burst) {
+	/* Energy / DC prefix sums */
+	pfx.pe = malloc(sizeof(double) * (burst_in->len + 1));
+	pfx.px = malloc(sizeof(double complex) * (burst_in->len + 1));
+
+	if (!pfx.pe || !pfx.px) {
 		rv = -ENOMEM;
 		goto err;
 	}
 
+	_dkab_pfx_compute(&pfx, burst_in->data, burst_in->len);
+
+	dc = _dkab_pfx_mean(&pfx, 0, burst_in->len);
+
 	/* Find TOA */
-	rv = _gmr1_dkab_find_toa(burst, sps, p, toa_p);
+	rv = _gmr1_dkab_find_toa(&pfx, 0, burst_in->len, dc, sps, p, toa_p);
 	if (rv)
 		goto err;
 
 	/* Demodulate into soft bits */
-	rv = _gmr1_dkab_soft_bits(burst, sps, p, *toa_p, ebits);
+	rv = _gmr1_dkab_soft_bits(burst_in->data, dc, sps, freq_shift, p,
+	                          *toa_p, ebits);
 
-	/* Done */
 err:
-	osmo_cxvec_free(burst);
+	free(pfx.px);
+	free(pfx.pe);
 
 	return rv;
 }
 
+/*! \brief Finding and demodulation of many DKAB bursts in a single signal
+ *  \param[in] sig Complex signal containing all the bursts (e.g. a frame)
+ *  \param[in] sps Oversampling used in the input complex signal
+ *  \param[in] freq_shift Frequency shift to pre-apply to sig (rad/sym)
+ *  \param[in,out] req Array of DKAB search requests
+ *  \param[in] n Number of requests
+ *  \returns Number of DKAB found. -errno for fatal errors
+ *
+ * Each request describes a search window inside sig (same rules as the
+ * burst_in of \ref gmr1_dkab_demod) and a DKAB position. The energy of the
+ * signal is computed only once and shared by all requests, which makes
+ * monitoring several idle TCH3 (different timeslots and/or positions)
+ * cheap. Results are the same as separate \ref gmr1_dkab_demod calls up
+ * to the rounding of the span sums, which are taken from prefix sums
+ * over the whole signal instead of over each window.
+ */
+int
+gmr1_dkab_demod_multi(struct osmo_cxvec *sig, int sps, float freq_shift,
+                      struct gmr1_dkab_req *req, int n)
+{
+	struct dkab_pfx pfx;
+	int i, found = 0;
+
+	pfx.pe = malloc(sizeof(double) * (sig->len + 1));
+	pfx.px = malloc(sizeof(double complex) * (sig->len + 1));
+
+	if (!pfx.pe || !pfx.px) {
+		found = -ENOMEM;
+		goto err;
+	}
+
+	_dkab_pfx_compute(&pfx, sig->data, sig->len);
+
+	for (i=0; i<n; i++) {
+		struct gmr1_dkab_req *r = &req[i];
+		float complex dc;
+
+		if ((r->ofs < 0) || (r->len <= 0) || ((r->ofs + r->len) > sig->len)) {
+			r->rv = -EINVAL;
+			continue;
+		}
+
+		dc = _dkab_pfx_mean(&pfx, r->ofs, r->len);
+
+		r->rv = _gmr1_dkab_find_toa(&pfx, r->ofs, r->len, dc,
+		                            sps, r->p, &r->toa);
+		if (r->rv)
+			continue;
+
+		_gmr1_dkab_soft_bits(&sig->data[r->ofs], dc, sps, freq_shift,
+		                     r->p, r->toa, r->ebits);
+
+		found++;
+	}
+
+err:
+	free(pfx.px);
+	free(pfx.pe);
+
+	return found;
+}
+
 /*! @} */